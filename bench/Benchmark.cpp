@@ -0,0 +1,101 @@
+#include <iostream>
+
+#include "Benchmark.h"
+
+BenchmarkState::BenchmarkState(uint64_t iterations)
+    : m_iterations(iterations)
+{
+}
+
+BenchmarkState::Iterator BenchmarkState::begin() {
+    start_timer();
+    return Iterator(*this, m_iterations);
+}
+
+BenchmarkState::Iterator BenchmarkState::end() {
+    return Iterator(*this, 0);
+}
+
+void BenchmarkState::start_timer() {
+    m_running = true;
+    m_start = std::chrono::steady_clock::now();
+}
+
+void BenchmarkState::stop_timer() {
+    if (m_running) {
+        m_elapsed += std::chrono::steady_clock::now() - m_start;
+        m_running = false;
+    }
+}
+
+void BenchmarkState::pause_timing() { stop_timer(); }
+void BenchmarkState::resume_timing() { start_timer(); }
+
+uint64_t BenchmarkState::iterations() const { return m_iterations; }
+void BenchmarkState::set_items_processed(uint64_t items) { m_items = items; }
+void BenchmarkState::set_bytes_processed(uint64_t bytes) { m_bytes = bytes; }
+void BenchmarkState::set_counter(const std::string &name, double value) { m_counters[name] = value; }
+
+std::chrono::nanoseconds BenchmarkState::elapsed() const { return m_elapsed; }
+uint64_t BenchmarkState::get_items_processed() const { return m_items; }
+uint64_t BenchmarkState::get_bytes_processed() const { return m_bytes; }
+const nlohmann::json &BenchmarkState::get_counters() const { return m_counters; }
+
+BenchmarkRegistry &BenchmarkRegistry::instance() {
+    static BenchmarkRegistry registry;
+    return registry;
+}
+
+int BenchmarkRegistry::add(const std::string &name, Function function) {
+    m_benchmarks.emplace_back(name, std::move(function));
+    return static_cast<int>(m_benchmarks.size());
+}
+
+nlohmann::json BenchmarkRegistry::run(const std::string &filter, std::chrono::milliseconds min_time) const {
+    nlohmann::json results = nlohmann::json::array();
+
+    for (const auto &[name, function]: m_benchmarks) {
+        if (name.find(filter) == std::string::npos) {
+            continue;
+        }
+
+        /* like Google Benchmark: grow the iterations until a run takes the minimum time */
+        uint64_t iterations = 1;
+        while (true) {
+            BenchmarkState state(iterations);
+            function(state);
+
+            auto elapsed = state.elapsed();
+            bool done = elapsed >= min_time || iterations >= 1000000000;
+            if (!done) {
+                double factor = elapsed.count() > 0 ? 1.4 * min_time.count() * 1e6 / elapsed.count() : 10;
+                iterations = std::max<uint64_t>(iterations + 1, iterations * std::min(factor, 10.0));
+                continue;
+            }
+
+            double seconds = elapsed.count() / 1e9;
+            nlohmann::json result = {
+                {"name", name},
+                {"run_type", "iteration"},
+                {"iterations", iterations},
+                {"real_time", static_cast<double>(elapsed.count()) / iterations},
+                {"cpu_time", static_cast<double>(elapsed.count()) / iterations},
+                {"time_unit", "ns"}
+            };
+            if (state.get_items_processed() > 0) {
+                result["items_per_second"] = state.get_items_processed() / seconds;
+            }
+            if (state.get_bytes_processed() > 0) {
+                result["bytes_per_second"] = state.get_bytes_processed() / seconds;
+            }
+            for (const auto &[counter, value]: state.get_counters().items()) {
+                result[counter] = value;
+            }
+
+            std::cerr << name << ": " << result["real_time"].get<double>() << " ns, " << iterations << " iterations" << std::endl;
+            results.push_back(result);
+            break;
+        }
+    }
+    return results;
+}
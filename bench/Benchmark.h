@@ -0,0 +1,127 @@
+#ifndef _H_BENCHMARK
+#define _H_BENCHMARK
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <nlohmann/json.hpp>
+
+/*
+*   A small harness in the style of Google Benchmark, without the dependency:
+*
+*       static void BM_Example(BenchmarkState &state) {
+*           for (auto _: state) {
+*               do_not_optimize(work());
+*           }
+*           state.set_items_processed(state.iterations());
+*       }
+*       BENCHMARK(BM_Example);
+*
+*   The loop runs with a growing number of iterations until it takes at least the minimum time.
+*   The results are written in the JSON format of Google Benchmark, so its compare.py works on them.
+*/
+class BenchmarkState {
+    public:
+        explicit BenchmarkState(uint64_t iterations);
+
+        class Iterator {
+            public:
+                /* the loop variable is never used */
+                struct [[gnu::unused]] Value {};
+
+                Iterator(BenchmarkState &state, uint64_t remaining) : m_state(state), m_remaining(remaining) {}
+                Value operator*() const { return {}; }
+                Iterator &operator++() { --m_remaining; return *this; }
+                bool operator!=(const Iterator &) const {
+                    if (m_remaining == 0) {
+                        m_state.stop_timer();
+                        return false;
+                    }
+                    return true;
+                }
+
+            private:
+                BenchmarkState &m_state;
+                uint64_t m_remaining;
+        };
+
+        Iterator begin();
+        Iterator end();
+
+        /* excludes setup inside the loop from the time */
+        void pause_timing();
+        void resume_timing();
+
+        uint64_t iterations() const;
+        void set_items_processed(uint64_t items);
+        void set_bytes_processed(uint64_t bytes);
+        /* an extra value in the result, e.g. the compression ratio */
+        void set_counter(const std::string &name, double value);
+
+        std::chrono::nanoseconds elapsed() const;
+        uint64_t get_items_processed() const;
+        uint64_t get_bytes_processed() const;
+        const nlohmann::json &get_counters() const;
+
+    private:
+        uint64_t m_iterations;
+        std::chrono::steady_clock::time_point m_start;
+        std::chrono::nanoseconds m_elapsed{0};
+        bool m_running = false;
+        uint64_t m_items = 0;
+        uint64_t m_bytes = 0;
+        nlohmann::json m_counters = nlohmann::json::object();
+
+        void start_timer();
+        void stop_timer();
+};
+
+/* keeps the compiler from removing a computation whose result is unused */
+template <typename T>
+inline void do_not_optimize(const T &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/* a fresh directory below the temp directory, removed with everything in it */
+class TemporaryDirectory {
+    public:
+        TemporaryDirectory()
+            : m_path(std::filesystem::temp_directory_path() / ("cearch-bench-" + std::to_string(getpid()) + "-" + std::to_string(counter++)))
+        {
+            std::filesystem::create_directories(m_path);
+        }
+        ~TemporaryDirectory() {
+            std::error_code ec;
+            std::filesystem::remove_all(m_path, ec);
+        }
+        std::string path() const { return m_path.string(); }
+
+    private:
+        static inline int counter = 0;
+        std::filesystem::path m_path;
+};
+
+class BenchmarkRegistry {
+    public:
+        using Function = std::function<void(BenchmarkState&)>;
+
+        static BenchmarkRegistry &instance();
+        int add(const std::string &name, Function function);
+
+        /* runs the benchmarks whose name contains the filter, the results in Google Benchmark JSON */
+        nlohmann::json run(const std::string &filter, std::chrono::milliseconds min_time) const;
+
+    private:
+        std::vector<std::pair<std::string, Function>> m_benchmarks;
+};
+
+#define BENCHMARK(function) \
+    static int function##_registered = BenchmarkRegistry::instance().add(#function, function)
+
+#endif
@@ -0,0 +1,73 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+#include "Corpus.h"
+
+Corpus::Corpus(const std::string &samples_dir) {
+    std::vector<std::filesystem::path> files;
+    for (const auto &entry: std::filesystem::directory_iterator(samples_dir)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".txt") {
+            files.push_back(entry.path());
+        }
+    }
+    /* the directory order differs between file systems */
+    std::sort(files.begin(), files.end());
+
+    for (const auto &file: files) {
+        std::ifstream in(file, std::ios::binary);
+        m_text.append(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        m_text += '\n';
+    }
+
+    std::istringstream words(m_text);
+    std::string word;
+    while (words >> word) {
+        m_words.push_back(word);
+    }
+    if (m_words.empty()) {
+        throw std::runtime_error("No sample text found in: " + samples_dir);
+    }
+}
+
+std::string Corpus::samples_dir = "samples";
+
+const Corpus &Corpus::samples() {
+    static Corpus corpus(samples_dir);
+    return corpus;
+}
+
+const std::string &Corpus::get_text() const { return m_text; }
+const std::vector<std::string> &Corpus::get_words() const { return m_words; }
+
+void Corpus::generate(const std::string &directory, size_t documents, uint64_t seed) const {
+    std::filesystem::create_directories(directory);
+
+    for (size_t i = 0; i < documents; ++i) {
+        /* every document has its own stream, so the corpus does not depend on the order of generation */
+        uint64_t state = seed * 1000003 + i;
+        std::mt19937_64 random(state);
+        size_t words = 50 + random() % 500;
+        state = random();
+
+        std::ofstream out(directory + "/doc" + std::to_string(i) + ".txt", std::ios::binary);
+        out << make_document(state, words);
+        if (!out) {
+            throw std::runtime_error("Failed to write the synthetic corpus to: " + directory);
+        }
+    }
+}
+
+std::string Corpus::make_document(uint64_t &state, size_t words) const {
+    std::mt19937_64 random(state);
+    std::string document;
+    for (size_t i = 0; i < words; ++i) {
+        document += m_words[random() % m_words.size()];
+        document += (i % 12 == 11) ? '\n' : ' ';
+    }
+    state = random();
+    return document;
+}
@@ -0,0 +1,39 @@
+#ifndef _H_CORPUS
+#define _H_CORPUS
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+*   Text for the benchmarks. The words of the sample books keep their natural, Zipf like frequencies,
+*   synthetic documents are made of words drawn at random positions of the samples.
+*   Only mt19937_64 is used for randomness, its output is the same with every standard library,
+*   so a seed generates the same corpus everywhere.
+*/
+class Corpus {
+    public:
+        /* reads every .txt file of the directory, throws std::runtime_error if there is none */
+        explicit Corpus(const std::string &samples_dir);
+
+        /* the corpus of samples_dir, shared by the benchmarks */
+        static const Corpus &samples();
+        static std::string samples_dir;
+
+        const std::string &get_text() const;
+        /* the whitespace separated words of the text, with punctuation and case */
+        const std::vector<std::string> &get_words() const;
+
+        /* writes documents doc<n>.txt of 50 to 549 words, 300 on average */
+        void generate(const std::string &directory, size_t documents, uint64_t seed = default_seed) const;
+        /* a text of about the given number of words */
+        std::string make_document(uint64_t &state, size_t words) const;
+
+        static constexpr uint64_t default_seed = 42;
+
+    private:
+        std::string m_text;
+        std::vector<std::string> m_words;
+};
+
+#endif
@@ -0,0 +1,395 @@
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+
+#include <unistd.h>
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+
+#include "LoadGenerator.h"
+
+#include "Metrics.h"
+
+namespace asio = boost::asio;
+namespace beast = boost::beast;
+namespace http = beast::http;
+using tcp = asio::ip::tcp;
+
+/* what one thread measured, merged after the run */
+struct LoadGenerator::Worker {
+    /* from the time the request was due */
+    Histogram latency;
+    /* from the time the request was sent */
+    Histogram service_time;
+    /* latency of the queries that overlapped an index update and of the others */
+    Histogram during_updates;
+    Histogram without_updates;
+    uint64_t requests = 0;
+    uint64_t errors = 0;
+};
+
+namespace {
+
+/* the maximum is known within the precision of the histogram */
+nlohmann::json summarize(const Histogram &histogram) {
+    auto ms = [](uint64_t ns) { return ns / 1e6; };
+    uint64_t count = histogram.get_count();
+    return {
+        {"count", count},
+        {"mean_ms", count > 0 ? ms(histogram.get_sum() / count) : 0.0},
+        {"p50_ms", ms(histogram.value_at_quantile(0.5))},
+        {"p90_ms", ms(histogram.value_at_quantile(0.9))},
+        {"p99_ms", ms(histogram.value_at_quantile(0.99))},
+        {"p999_ms", ms(histogram.value_at_quantile(0.999))},
+        {"max_ms", ms(histogram.value_at_quantile(1.0))}
+    };
+}
+
+uint64_t nanoseconds(std::chrono::steady_clock::duration duration) {
+    return std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+}
+
+}
+
+LoadGenerator::LoadGenerator(LoadOptions options, std::vector<std::string> queries)
+    : m_options(std::move(options)), m_queries(std::move(queries))
+{
+    if (m_queries.empty()) {
+        throw std::invalid_argument("No queries to send");
+    }
+    if (m_options.open_loop && m_options.rate <= 0) {
+        throw std::invalid_argument("The open loop needs a rate");
+    }
+    if (m_options.write_interval.count() > 0 && m_options.corpus_dir.empty()) {
+        throw std::invalid_argument("The mixed scenario needs the directory the server indexes");
+    }
+    if (m_options.write_interval.count() > 0) {
+        /* throws here rather than in the writer thread if the samples are missing */
+        Corpus::samples();
+    }
+    m_options.connections = std::max<size_t>(1, m_options.connections);
+
+    asio::io_context io;
+    m_endpoints = tcp::resolver(io).resolve(m_options.host, m_options.port);
+}
+
+nlohmann::json LoadGenerator::run() {
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    auto measure_start = start + m_options.warmup;
+    auto end = measure_start + m_options.duration;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (size_t i = 0; i < m_options.connections; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    Worker writer;
+    std::vector<std::string> written;
+
+    std::vector<std::thread> threads;
+    if (m_options.write_interval.count() > 0) {
+        threads.emplace_back([&]() { written = run_writer(writer, measure_start, end); });
+    }
+
+    if (!m_options.open_loop) {
+        for (size_t i = 0; i < workers.size(); ++i) {
+            threads.emplace_back([this, &workers, i, start, end]() { run_closed_loop(*workers[i], i, start, end); });
+        }
+        for (auto &thread: threads) {
+            thread.join();
+        }
+    } else {
+        /* the due times of the queries, the connections take them in order */
+        std::deque<clock::time_point> due_queries;
+        std::mutex mutex;
+        std::condition_variable ready;
+        bool dispatched = false;
+
+        for (auto &worker: workers) {
+            threads.emplace_back([&, worker = worker.get()]() {
+                while (true) {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    ready.wait(lock, [&]() { return !due_queries.empty() || dispatched; });
+                    if (due_queries.empty()) {
+                        return;
+                    }
+                    clock::time_point due = due_queries.front();
+                    due_queries.pop_front();
+                    lock.unlock();
+
+                    if (clock::now() > end + drain_timeout) {
+                        worker->errors += due >= measure_start;
+                        continue;
+                    }
+                    send_query(*worker, due, due >= measure_start);
+                }
+            });
+        }
+
+        /* exponential gaps between the arrivals, like independent users */
+        std::mt19937_64 random(m_options.seed);
+        std::exponential_distribution<double> gaps(m_options.rate);
+        for (auto due = start; due < end; due += std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(gaps(random)))) {
+            std::this_thread::sleep_until(due);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                due_queries.push_back(due);
+            }
+            ready.notify_one();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            dispatched = true;
+        }
+        ready.notify_all();
+        for (auto &thread: threads) {
+            thread.join();
+        }
+    }
+
+    /* the written documents are removed from the index again */
+    if (!written.empty()) {
+        for (const auto &filepath: written) {
+            std::filesystem::remove(filepath);
+        }
+        post("/index", "");
+    }
+
+    Worker total;
+    for (const auto &worker: workers) {
+        total.latency.merge(worker->latency);
+        total.service_time.merge(worker->service_time);
+        total.during_updates.merge(worker->during_updates);
+        total.without_updates.merge(worker->without_updates);
+        total.requests += worker->requests;
+        total.errors += worker->errors;
+    }
+
+    double seconds = std::chrono::duration<double>(m_options.duration).count();
+    nlohmann::json report = {
+        {"mode", m_options.open_loop ? "open" : "closed"},
+        {"connections", m_options.connections},
+        {"target_rate", m_options.rate},
+        {"duration_s", seconds},
+        {"queries", total.requests},
+        {"errors", total.errors},
+        {"qps", total.requests / seconds},
+        {"latency", summarize(total.latency)},
+        {"service_time", summarize(total.service_time)}
+    };
+    if (m_options.write_interval.count() > 0) {
+        report["index_updates"] = summarize(writer.latency);
+        report["index_updates"]["errors"] = writer.errors;
+        report["latency_during_updates"] = summarize(total.during_updates);
+        report["latency_without_updates"] = summarize(total.without_updates);
+    }
+    return report;
+}
+
+/* with a rate the connection keeps to its schedule, a late answer makes the next queries late */
+void LoadGenerator::run_closed_loop(Worker &worker, size_t index, std::chrono::steady_clock::time_point start,
+    std::chrono::steady_clock::time_point end)
+{
+    using clock = std::chrono::steady_clock;
+    auto measure_start = start + m_options.warmup;
+    clock::duration interval{0};
+    if (m_options.rate > 0) {
+        interval = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(m_options.connections / m_options.rate));
+    }
+
+    /* the connections are spread over the interval */
+    auto due = start + interval * index / m_options.connections;
+    while (true) {
+        auto now = clock::now();
+        if (interval.count() == 0) {
+            due = now;
+        } else if (due > now) {
+            std::this_thread::sleep_until(due);
+        }
+        if (due >= end) {
+            return;
+        }
+        send_query(worker, due, due >= measure_start);
+        due += interval;
+    }
+}
+
+void LoadGenerator::send_query(Worker &worker, std::chrono::steady_clock::time_point due, bool counted) {
+    std::string body = nlohmann::json{{"query", next_query()}, {"top_k", m_options.top_k}}.dump();
+
+    uint64_t updates_started = m_updates_started.load();
+    bool updating = updates_started != m_updates_finished.load();
+    auto sent = std::chrono::steady_clock::now();
+    int status = post("/query", body);
+    auto done = std::chrono::steady_clock::now();
+    updating = updating || m_updates_started.load() != updates_started;
+
+    if (!counted) {
+        return;
+    }
+    worker.requests++;
+    if (status != 200) {
+        worker.errors++;
+        return;
+    }
+
+    uint64_t latency = nanoseconds(done - due);
+    worker.latency.record(latency);
+    worker.service_time.record(nanoseconds(done - sent));
+    if (updating) {
+        worker.during_updates.record(latency);
+    } else {
+        worker.without_updates.record(latency);
+    }
+}
+
+const std::string &LoadGenerator::next_query() {
+    return m_queries[m_next_query++ % m_queries.size()];
+}
+
+/* writes a synthetic document and updates the index, one at a time, skipping the updates it is late for */
+std::vector<std::string> LoadGenerator::run_writer(Worker &worker, std::chrono::steady_clock::time_point start,
+    std::chrono::steady_clock::time_point end)
+{
+    std::vector<std::string> written;
+    uint64_t state = m_options.seed;
+    auto due = start;
+    while (due < end) {
+        std::this_thread::sleep_until(due);
+
+        std::string filepath = m_options.corpus_dir + "/cearch-load-" + std::to_string(getpid()) + "-" + std::to_string(written.size()) + ".txt";
+        std::ofstream(filepath) << Corpus::samples().make_document(state, 300);
+        written.push_back(filepath);
+
+        m_updates_started++;
+        auto sent = std::chrono::steady_clock::now();
+        int status = post("/index", "");
+        uint64_t latency = nanoseconds(std::chrono::steady_clock::now() - sent);
+        m_updates_finished++;
+
+        worker.requests++;
+        if (status != 200) {
+            worker.errors++;
+        } else {
+            worker.latency.record(latency);
+        }
+
+        due += m_options.write_interval;
+        due = std::max(due, std::chrono::steady_clock::now());
+    }
+    return written;
+}
+
+/* the server closes the connection after every response */
+int LoadGenerator::post(const std::string &target, const std::string &body) const {
+    thread_local asio::io_context io;
+    beast::error_code ec;
+    tcp::socket socket(io);
+    asio::connect(socket, m_endpoints, ec);
+    if (ec) {
+        return 0;
+    }
+    socket.set_option(tcp::no_delay(true), ec);
+
+    http::request<http::string_body> request{http::verb::post, target, 11};
+    request.set(http::field::host, m_options.host);
+    request.set(http::field::content_type, "application/json");
+    request.body() = body;
+    request.prepare_payload();
+    http::write(socket, request, ec);
+    if (ec) {
+        return 0;
+    }
+
+    beast::flat_buffer buffer;
+    http::response<http::string_body> response;
+    http::read(socket, buffer, response, ec);
+    if (ec && ec != http::error::end_of_stream) {
+        return 0;
+    }
+    socket.shutdown(tcp::socket::shutdown_both, ec);
+    return response.result_int();
+}
+
+std::vector<std::string> LoadGenerator::read_query_log(const std::string &filepath) {
+    std::ifstream file(filepath);
+    if (!file) {
+        throw std::runtime_error("Could not open the query log: " + filepath);
+    }
+
+    static const std::string marker = "Searching for: ";
+    std::vector<std::string> queries;
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t pos = line.find(marker);
+        if (pos != std::string::npos) {
+            line = line.substr(pos + marker.size());
+        }
+        if (!line.empty()) {
+            queries.push_back(line);
+        }
+    }
+    return queries;
+}
+
+std::vector<std::string> LoadGenerator::zipf_queries(const std::string &index_dir, size_t count, double exponent, uint64_t seed) {
+    std::ifstream file(index_dir + "/index.json");
+    if (!file) {
+        throw std::runtime_error("Could not open the index in: " + index_dir);
+    }
+    nlohmann::json index = nlohmann::json::parse(file);
+
+    std::unordered_map<std::string, uint64_t> doc_freqs;
+    for (const auto &doc: index["documents"]) {
+        for (const auto &[term, term_freq]: doc["concordance"].items()) {
+            doc_freqs[term]++;
+        }
+    }
+    if (doc_freqs.empty()) {
+        throw std::runtime_error("The index has no terms: " + index_dir);
+    }
+
+    std::vector<std::pair<std::string, uint64_t>> terms(doc_freqs.begin(), doc_freqs.end());
+    std::sort(terms.begin(), terms.end(), [](const auto &a, const auto &b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+
+    /* cumulative weights of the ranks, a draw is a binary search */
+    std::vector<double> cumulative;
+    cumulative.reserve(terms.size());
+    double total = 0;
+    for (size_t rank = 1; rank <= terms.size(); ++rank) {
+        total += 1.0 / std::pow(static_cast<double>(rank), exponent);
+        cumulative.push_back(total);
+    }
+
+    std::mt19937_64 random(seed);
+    std::uniform_real_distribution<double> uniform(0.0, total);
+    auto draw_term = [&]() -> const std::string & {
+        size_t rank = std::lower_bound(cumulative.begin(), cumulative.end(), uniform(random)) - cumulative.begin();
+        return terms[std::min(rank, terms.size() - 1)].first;
+    };
+
+    /* mostly single terms, like the queries of a search box */
+    std::vector<std::string> queries;
+    queries.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        std::string query = draw_term();
+        size_t extra_terms = i % 10 < 6 ? 0 : (i % 10 < 9 ? 1 : 2);
+        for (size_t t = 0; t < extra_terms; ++t) {
+            query += " " + draw_term();
+        }
+        queries.push_back(query);
+    }
+    return queries;
+}
@@ -0,0 +1,90 @@
+#ifndef _H_LOADGENERATOR
+#define _H_LOADGENERATOR
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <nlohmann/json.hpp>
+
+#include "Corpus.h"
+
+struct LoadOptions {
+    std::string host = "127.0.0.1";
+    std::string port = "8080";
+    /* closed loop: a connection sends its next query after the answer, open loop: queries arrive at the rate */
+    bool open_loop = false;
+    /* closed loop: concurrent clients, open loop: the most queries in flight */
+    size_t connections = 8;
+    /*
+    *   queries per second, arriving at random like independent users in the open loop,
+    *   the closed loop paces each connection to its share. 0 sends as fast as the server answers (closed only)
+    */
+    double rate = 0;
+    std::chrono::milliseconds duration{10000};
+    /* queries sent before the warm up ends are not counted */
+    std::chrono::milliseconds warmup{2000};
+    size_t top_k = 10;
+    /* mixed read/write: a document is added to corpus_dir and the index updated every write_interval, 0 for none */
+    std::chrono::milliseconds write_interval{0};
+    std::string corpus_dir;
+    uint64_t seed = Corpus::default_seed;
+};
+
+/*
+*   Load generator for the /query endpoint of a running cearch, see LoadOptions for the modes.
+*
+*   Latencies are measured from the time a query was due, not from the time it was sent:
+*   a query that waits for a connection because the server is slow counts the wait (coordinated
+*   omission correction, like wrk2). Without a rate there is no schedule, then both are the same.
+*   The service time from sending to the answer is reported as well.
+*
+*   In the mixed scenario queries that were in flight while the index was updated are reported
+*   separately, that difference is the effect of indexing on the query latency.
+*/
+class LoadGenerator {
+    public:
+        LoadGenerator(LoadOptions options, std::vector<std::string> queries);
+
+        /* runs for the warm up and the duration and returns the report */
+        nlohmann::json run();
+
+        /* the queries of a log, one per line, or the lines of a cearch log with "Searching for: <query>" */
+        static std::vector<std::string> read_query_log(const std::string &filepath);
+        /*
+        *   queries of 1 to 3 terms from the vocabulary in <index_dir>/index.json, the term of rank r by
+        *   document frequency is drawn with a probability proportional to 1 / r^exponent
+        */
+        static std::vector<std::string> zipf_queries(const std::string &index_dir, size_t count, double exponent, uint64_t seed);
+
+    private:
+        struct Worker;
+
+        LoadOptions m_options;
+        boost::asio::ip::tcp::resolver::results_type m_endpoints;
+        std::vector<std::string> m_queries;
+        std::atomic<size_t> m_next_query{0};
+
+        /* index updates of the mixed scenario, a query overlapped one if these changed or differed */
+        std::atomic<uint64_t> m_updates_started{0};
+        std::atomic<uint64_t> m_updates_finished{0};
+
+        /* open loop: queries still waiting this long after the end are counted as failed */
+        static constexpr std::chrono::seconds drain_timeout{10};
+
+        void run_closed_loop(Worker &worker, size_t index, std::chrono::steady_clock::time_point start,
+            std::chrono::steady_clock::time_point end);
+        /* returns the files it wrote */
+        std::vector<std::string> run_writer(Worker &worker, std::chrono::steady_clock::time_point start,
+            std::chrono::steady_clock::time_point end);
+        void send_query(Worker &worker, std::chrono::steady_clock::time_point due, bool counted);
+        const std::string &next_query();
+
+        /* status code of a POST, 0 if the request failed */
+        int post(const std::string &target, const std::string &body) const;
+};
+
+#endif
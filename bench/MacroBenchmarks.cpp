@@ -0,0 +1,246 @@
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Corpus.h"
+#include "MacroBenchmarks.h"
+
+#include "ContentAddressedStorage.h"
+#include "Metrics.h"
+#include "PositionalIndex.h"
+#include "PostingsFile.h"
+#include "QueryParser.h"
+
+namespace {
+
+uint64_t directory_bytes(const std::string &directory) {
+    uint64_t bytes = 0;
+    for (const auto &entry: std::filesystem::recursive_directory_iterator(directory)) {
+        if (entry.is_regular_file()) {
+            bytes += entry.file_size();
+        }
+    }
+    return bytes;
+}
+
+uint64_t file_bytes(const std::string &filepath) {
+    std::error_code ec;
+    uint64_t bytes = std::filesystem::file_size(filepath, ec);
+    return ec ? 0 : bytes;
+}
+
+double milliseconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+MacroBenchmarks::MacroBenchmarks(std::string corpus_dir, std::string label, std::string work_dir, IndexOptions options)
+    : m_corpus_dir(std::move(corpus_dir)), m_label(std::move(label)), m_index_dir(work_dir + "/index-" + m_label),
+    m_options(std::move(options))
+{
+}
+
+nlohmann::json MacroBenchmarks::run(const std::string &filter) const {
+    nlohmann::json results = nlohmann::json::array();
+
+    /* the later benchmarks need the index of the first one */
+    const std::pair<std::string, std::function<nlohmann::json()>> benchmarks[] = {
+        {"index_build/" + m_label, [this]() { return index_build(); }},
+        {"cold_start/" + m_label, [this]() { return cold_start(); }},
+        {"query_latency/" + m_label, [this]() { return query_latency(); }}
+    };
+
+    bool built = false;
+    for (const auto &[name, benchmark]: benchmarks) {
+        if (name.find(filter) == std::string::npos && !(name.starts_with("index_build") && !built)) {
+            continue;
+        }
+        auto result = run_isolated(name, benchmark);
+        built = built || name.starts_with("index_build");
+        if (name.find(filter) != std::string::npos) {
+            results.push_back(result);
+        }
+    }
+    return results;
+}
+
+nlohmann::json MacroBenchmarks::index_build() const {
+    std::filesystem::remove_all(m_index_dir);
+    std::filesystem::create_directories(m_index_dir);
+
+    auto start = std::chrono::steady_clock::now();
+    auto storage = std::make_unique<ContentAddressedStorage>(m_index_dir);
+    Index index(m_corpus_dir, m_index_dir, storage, m_options);
+    double elapsed = milliseconds_since(start);
+
+    int documents = index.get_document_counter();
+    return {
+        {"real_time", elapsed},
+        {"documents", documents},
+        {"documents_per_second", documents / (elapsed / 1000)},
+        {"corpus_bytes", directory_bytes(m_corpus_dir)},
+        {"index_bytes", directory_bytes(m_index_dir)},
+        {"postings_bytes", file_bytes(m_index_dir + "/" + PostingsFile::filename)},
+        {"positions_bytes", file_bytes(m_index_dir + "/" + PositionalIndex::stream_filename)}
+    };
+}
+
+nlohmann::json MacroBenchmarks::cold_start() const {
+    evict_page_cache(m_index_dir);
+    evict_page_cache(m_corpus_dir);
+
+    /* loading includes the check of the corpus for changed files */
+    auto start = std::chrono::steady_clock::now();
+    auto storage = std::make_unique<ContentAddressedStorage>(m_index_dir);
+    Index index(m_corpus_dir, m_index_dir, storage, m_options);
+    double elapsed = milliseconds_since(start);
+
+    return {
+        {"real_time", elapsed},
+        {"documents", index.get_document_counter()}
+    };
+}
+
+/* single terms, two terms of which either matches and two required terms, in the ratio 12:5:3 */
+nlohmann::json MacroBenchmarks::query_latency() const {
+    auto storage = std::make_unique<ContentAddressedStorage>(m_index_dir);
+    Index index(m_corpus_dir, m_index_dir, storage, m_options);
+
+    const auto &words = Corpus::samples().get_words();
+    std::mt19937_64 random(Corpus::default_seed);
+    auto draw_term = [&]() {
+        while (true) {
+            auto terms = index.get_analyzer().analyze(words[random() % words.size()]);
+            if (!terms.empty() && !terms.front().empty()) {
+                return terms.front();
+            }
+        }
+    };
+
+    std::vector<std::string> queries;
+    for (size_t i = 0; i < query_count; ++i) {
+        std::string query = draw_term();
+        if (i % 20 >= 17) {
+            query += " AND " + draw_term();
+        } else if (i % 20 >= 12) {
+            query += " " + draw_term();
+        }
+        queries.push_back(query);
+    }
+
+    QueryOptions options;
+    options.top_k = 10;
+    Histogram latencies;
+    uint64_t results = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto &query: queries) {
+        auto query_start = std::chrono::steady_clock::now();
+        auto parsed = QueryParser::parse(query, index.get_analyzer());
+        results += index.query_index(*parsed, options).results.size();
+        latencies.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - query_start).count());
+    }
+    double elapsed = milliseconds_since(start);
+
+    return {
+        {"real_time", elapsed * 1000 / queries.size()},
+        {"time_unit", "us"},
+        {"queries", queries.size()},
+        {"queries_per_second", queries.size() / (elapsed / 1000)},
+        {"results", results},
+        {"p50_ms", latencies.value_at_quantile(0.5) / 1e6},
+        {"p90_ms", latencies.value_at_quantile(0.9) / 1e6},
+        {"p99_ms", latencies.value_at_quantile(0.99) / 1e6},
+        {"p999_ms", latencies.value_at_quantile(0.999) / 1e6}
+    };
+}
+
+nlohmann::json MacroBenchmarks::run_isolated(const std::string &name, const std::function<nlohmann::json()> &benchmark) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        throw std::runtime_error("pipe failed");
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        throw std::runtime_error("fork failed");
+    }
+    if (pid == 0) {
+        /* the index reports its progress, the pipe only gets the result */
+        close(fds[0]);
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+
+        std::string output;
+        try {
+            output = benchmark().dump();
+        } catch (std::exception &e) {
+            output = nlohmann::json{{"error", e.what()}}.dump();
+        }
+        for (size_t done = 0; done < output.size();) {
+            ssize_t n = write(fds[1], output.data() + done, output.size() - done);
+            if (n <= 0) {
+                break;
+            }
+            done += n;
+        }
+        _exit(0);
+    }
+
+    close(fds[1]);
+    std::string output;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) {
+        output.append(buffer, n);
+    }
+    close(fds[0]);
+
+    int status = 0;
+    struct rusage usage {};
+    wait4(pid, &status, 0, &usage);
+
+    nlohmann::json result = {{"name", name}, {"run_type", "macro"}, {"iterations", 1}, {"time_unit", "ms"}};
+    if (output.empty()) {
+        result["error"] = "the benchmark process failed with status " + std::to_string(status);
+    } else {
+        result.update(nlohmann::json::parse(output));
+    }
+    if (result.contains("real_time")) {
+        result["cpu_time"] = result["real_time"];
+    }
+#ifdef __APPLE__
+    result["peak_rss_bytes"] = static_cast<uint64_t>(usage.ru_maxrss);
+#else
+    result["peak_rss_bytes"] = static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+
+    std::cerr << name << ": " << result.value("real_time", 0.0) << " " << result["time_unit"].get<std::string>() << ", peak RSS "
+        << result["peak_rss_bytes"].get<uint64_t>() / (1024 * 1024) << " MB" << std::endl;
+    return result;
+}
+
+void MacroBenchmarks::evict_page_cache(const std::string &directory) {
+#ifdef POSIX_FADV_DONTNEED
+    for (const auto &entry: std::filesystem::recursive_directory_iterator(directory)) {
+        if (!entry.is_regular_file()) {
+            continue;
+        }
+        int fd = open(entry.path().c_str(), O_RDONLY);
+        if (fd >= 0) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+    }
+#else
+    (void)directory;
+#endif
+}
@@ -0,0 +1,44 @@
+#ifndef _H_MACROBENCHMARKS
+#define _H_MACROBENCHMARKS
+
+#include <functional>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+#include "Index.h"
+
+/*
+*   End to end benchmarks over a directory of documents, each one in a forked child process,
+*   so its peak RSS is its own and a cold start really starts without the index in memory:
+*       index_build/<corpus>    builds a new index of the corpus with the given options, with the sizes of its files
+*       cold_start/<corpus>     loads that index with its files evicted from the page cache
+*       query_latency/<corpus>  latency distribution of queries drawn from the words of the samples
+*   They have to run before anything starts a thread, a forked child only has the forking thread.
+*/
+class MacroBenchmarks {
+    public:
+        MacroBenchmarks(std::string corpus_dir, std::string label, std::string work_dir, IndexOptions options = {});
+
+        /* the results of the benchmarks whose name contains the filter, in Google Benchmark JSON */
+        nlohmann::json run(const std::string &filter) const;
+
+        /* queries run by query_latency */
+        static constexpr size_t query_count = 2000;
+
+    private:
+        std::string m_corpus_dir;
+        std::string m_label;
+        std::string m_index_dir;
+        IndexOptions m_options;
+
+        nlohmann::json index_build() const;
+        nlohmann::json cold_start() const;
+        nlohmann::json query_latency() const;
+
+        /* runs the benchmark in a child process and adds the peak RSS of the child to its result */
+        static nlohmann::json run_isolated(const std::string &name, const std::function<nlohmann::json()> &benchmark);
+        static void evict_page_cache(const std::string &directory);
+};
+
+#endif
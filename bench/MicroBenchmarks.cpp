@@ -0,0 +1,364 @@
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string_view>
+#include <unordered_map>
+
+#include "Benchmark.h"
+#include "Corpus.h"
+
+#include "Analyzer.h"
+#include "ContentAddressedStorage.h"
+#include "Document.h"
+#include "DocumentFactory.h"
+#include "Index.h"
+#include "JsonReader.h"
+#include "JsonWriter.h"
+#include "XMLContentStrategy.h"
+#include "XMLTextExtractor.h"
+
+namespace {
+
+/* text of the samples, split like the indexer does */
+constexpr size_t tokenizer_chunk = 64 * 1024;
+/* documents stored by the content storage benchmarks, about the size of a synthetic document */
+constexpr size_t cas_document_words = 300;
+constexpr size_t cas_documents = 1000;
+/* documents of the serialized index for the load benchmarks */
+constexpr size_t index_documents = 2000;
+/* hits of the serialized result page */
+constexpr size_t result_page_hits = 2000;
+/* paragraphs of the XHTML document of the extraction benchmarks, about 1 MB */
+constexpr size_t xml_paragraphs = 500;
+
+void tokenize(std::string_view text, const Analyzer &analyzer, size_t &terms) {
+    size_t pos = 0;
+    while (pos < text.size()) {
+        while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos]))) {
+            pos++;
+        }
+        size_t end = pos;
+        while (end < text.size() && !std::isspace(static_cast<unsigned char>(text[end]))) {
+            end++;
+        }
+        if (end == pos) {
+            break;
+        }
+        terms += analyzer.analyze(std::string(text.substr(pos, end - pos))).size();
+        pos = end;
+    }
+}
+
+void run_tokenizer(BenchmarkState &state, const Analyzer &analyzer) {
+    const std::string &text = Corpus::samples().get_text();
+    std::string_view chunk(text.data(), std::min(text.size(), tokenizer_chunk));
+
+    size_t terms = 0;
+    for (auto _: state) {
+        tokenize(chunk, analyzer, terms);
+    }
+    do_not_optimize(terms);
+    state.set_bytes_processed(state.iterations() * chunk.size());
+}
+
+void BM_Tokenize(BenchmarkState &state) {
+    run_tokenizer(state, Analyzer());
+}
+BENCHMARK(BM_Tokenize);
+
+void BM_TokenizeStemmed(BenchmarkState &state) {
+    run_tokenizer(state, Analyzer(true, true, {"the", "and", "of", "a", "to", "in", "is", "it"}));
+}
+BENCHMARK(BM_TokenizeStemmed);
+
+void BM_CleanWord(BenchmarkState &state) {
+    const auto &words = Corpus::samples().get_words();
+    size_t i = 0;
+    for (auto _: state) {
+        std::string word = words[i++ % words.size()];
+        do_not_optimize(Document::clean_word(word));
+    }
+    state.set_items_processed(state.iterations());
+}
+BENCHMARK(BM_CleanWord);
+
+void BM_BM25(BenchmarkState &state) {
+    std::mt19937_64 random(Corpus::default_seed);
+    std::vector<std::array<int, 3>> postings(4096);
+    for (auto &posting: postings) {
+        posting = {static_cast<int>(1 + random() % 20), static_cast<int>(50 + random() % 500), static_cast<int>(1 + random() % 5000)};
+    }
+
+    double score = 0;
+    size_t i = 0;
+    for (auto _: state) {
+        const auto &[term_freq, doc_length, doc_freq] = postings[i++ % postings.size()];
+        score += Index::compute_bm25(term_freq, doc_length, 300, Index::compute_idf(10000, doc_freq));
+    }
+    do_not_optimize(score);
+    state.set_items_processed(state.iterations());
+}
+BENCHMARK(BM_BM25);
+
+/* a page of hits like /query answers without top_k */
+std::vector<std::pair<uint64_t, double>> make_results() {
+    std::mt19937_64 random(Corpus::default_seed);
+    std::uniform_real_distribution<double> scores(0.0, 20.0);
+    std::vector<std::pair<uint64_t, double>> results(result_page_hits);
+    for (auto &[docid, score]: results) {
+        docid = random() % 1000000;
+        score = scores(random);
+    }
+    return results;
+}
+
+void BM_ResultsJsonDom(BenchmarkState &state) {
+    auto results = make_results();
+    size_t bytes = 0;
+    for (auto _: state) {
+        nlohmann::json response;
+        for (const auto &[docid, score]: results) {
+            response["results"].push_back({{"docid", docid}, {"score", score}});
+        }
+        std::string body = response.dump();
+        bytes += body.size();
+        do_not_optimize(body);
+    }
+    state.set_bytes_processed(bytes);
+    state.set_items_processed(state.iterations() * results.size());
+}
+BENCHMARK(BM_ResultsJsonDom);
+
+void BM_ResultsJsonWriter(BenchmarkState &state) {
+    auto results = make_results();
+    size_t bytes = 0;
+    for (auto _: state) {
+        std::string body;
+        JsonWriter writer(body);
+        writer.begin_object().key("results").begin_array();
+        for (const auto &[docid, score]: results) {
+            writer.begin_object().key("docid").value(docid).key("score").value(score).end_object();
+        }
+        writer.end_array().end_object();
+        bytes += body.size();
+        do_not_optimize(body);
+    }
+    state.set_bytes_processed(bytes);
+    state.set_items_processed(state.iterations() * results.size());
+}
+BENCHMARK(BM_ResultsJsonWriter);
+
+void BM_QueryRequestJsonDom(BenchmarkState &state) {
+    std::string body = R"({"query": "white whale AND ship", "top_k": 10, "mode": "exhaustive", "explain": false})";
+    for (auto _: state) {
+        auto j = nlohmann::json::parse(body);
+        do_not_optimize(j["query"].get<std::string>());
+        do_not_optimize(j["top_k"].get<size_t>());
+    }
+    state.set_items_processed(state.iterations());
+}
+BENCHMARK(BM_QueryRequestJsonDom);
+
+void BM_QueryRequestJsonReader(BenchmarkState &state) {
+    std::string body = R"({"query": "white whale AND ship", "top_k": 10, "mode": "exhaustive", "explain": false})";
+    for (auto _: state) {
+        JsonReader reader(body);
+        std::string_view key;
+        reader.begin_object();
+        while (reader.next_key(key)) {
+            if (key == "query") {
+                do_not_optimize(reader.read_string());
+            } else if (key == "top_k") {
+                do_not_optimize(reader.read_unsigned());
+            } else {
+                reader.skip();
+            }
+        }
+        reader.finish();
+    }
+    state.set_items_processed(state.iterations());
+}
+BENCHMARK(BM_QueryRequestJsonReader);
+
+std::vector<std::string> make_documents(size_t count, uint64_t seed) {
+    std::vector<std::string> documents;
+    uint64_t state = seed;
+    for (size_t i = 0; i < count; ++i) {
+        documents.push_back(Corpus::samples().make_document(state, cas_document_words));
+    }
+    return documents;
+}
+
+/* the zstd dictionary is trained on the warm up documents before the time is taken */
+void run_cas_store(BenchmarkState &state, const std::string &codec) {
+    TemporaryDirectory directory;
+    ContentAddressedStorage storage(directory.path(), codec);
+    for (const auto &document: make_documents(ContentAddressedStorage::dictionary_samples, 1)) {
+        storage.store(document);
+    }
+    storage.flush();
+
+    uint64_t seed = 2;
+    uint64_t bytes = 0;
+    for (auto _: state) {
+        state.pause_timing();
+        std::string document = make_documents(1, seed++).front();
+        bytes += document.size();
+        state.resume_timing();
+
+        do_not_optimize(storage.store(document));
+    }
+    state.set_bytes_processed(bytes);
+    state.set_items_processed(state.iterations());
+}
+
+void run_cas_load(BenchmarkState &state, const std::string &codec) {
+    TemporaryDirectory directory;
+    ContentAddressedStorage storage(directory.path(), codec);
+    std::vector<std::string> hashes;
+    uint64_t content_bytes = 0;
+    for (const auto &document: make_documents(cas_documents, 1)) {
+        hashes.push_back(storage.store(document));
+        content_bytes += document.size();
+    }
+    storage.flush();
+
+    uint64_t stored_bytes = 0;
+    for (const auto &entry: std::filesystem::directory_iterator(directory.path())) {
+        if (entry.path().extension() == ".z") {
+            stored_bytes += entry.file_size();
+        }
+    }
+
+    uint64_t bytes = 0;
+    size_t i = 0;
+    for (auto _: state) {
+        std::string content = storage.load(hashes[i++ % hashes.size()]);
+        bytes += content.size();
+        do_not_optimize(content);
+    }
+    state.set_bytes_processed(bytes);
+    state.set_items_processed(state.iterations());
+    state.set_counter("compression_ratio", stored_bytes > 0 ? static_cast<double>(content_bytes) / stored_bytes : 0.0);
+}
+
+void BM_CasStoreZlib(BenchmarkState &state) { run_cas_store(state, "zlib"); }
+void BM_CasStoreZstd(BenchmarkState &state) { run_cas_store(state, "zstd"); }
+void BM_CasStoreLz4(BenchmarkState &state) { run_cas_store(state, "lz4"); }
+void BM_CasLoadZlib(BenchmarkState &state) { run_cas_load(state, "zlib"); }
+void BM_CasLoadZstd(BenchmarkState &state) { run_cas_load(state, "zstd"); }
+void BM_CasLoadLz4(BenchmarkState &state) { run_cas_load(state, "lz4"); }
+BENCHMARK(BM_CasStoreZlib);
+BENCHMARK(BM_CasStoreZstd);
+BENCHMARK(BM_CasStoreLz4);
+BENCHMARK(BM_CasLoadZlib);
+BENCHMARK(BM_CasLoadZstd);
+BENCHMARK(BM_CasLoadLz4);
+
+/* an XHTML file of paragraphs with inline markup, a script and a comment, like a saved web page */
+std::string write_xml_document(const std::string &directory) {
+    std::string xml = "<?xml version=\"1.0\"?>\n<html xmlns=\"http://www.w3.org/1999/xhtml\"><head><title>bench</title>"
+        "<script>var skipped = 1 < 2;</script></head><body>\n";
+    uint64_t state = 4;
+    for (size_t i = 0; i < xml_paragraphs; ++i) {
+        xml += "<div class=\"section\"><!-- paragraph " + std::to_string(i) + " --><p>";
+        xml += Corpus::samples().make_document(state, cas_document_words);
+        xml += " <b>bold</b> &amp; <i>italic</i></p></div>\n";
+    }
+    xml += "</body></html>\n";
+
+    std::string filepath = directory + "/document.xhtml";
+    std::ofstream(filepath) << xml;
+    return filepath;
+}
+
+/* the streaming extractor and the DOM fallback read the same file, so both include reading it */
+void run_xml_extract(BenchmarkState &state, bool dom) {
+    TemporaryDirectory directory;
+    std::string filepath = write_xml_document(directory.path());
+    XMLContentStrategy strategy;
+
+    size_t text_bytes = 0;
+    for (auto _: state) {
+        std::string text = dom ? strategy.read_content_dom(filepath) : XMLTextExtractor::extract_file(filepath);
+        text_bytes = text.size();
+        do_not_optimize(text);
+    }
+    state.set_bytes_processed(state.iterations() * std::filesystem::file_size(filepath));
+    state.set_counter("text_bytes", text_bytes);
+}
+
+void BM_XmlExtractStreaming(BenchmarkState &state) { run_xml_extract(state, false); }
+void BM_XmlExtractDom(BenchmarkState &state) { run_xml_extract(state, true); }
+BENCHMARK(BM_XmlExtractStreaming);
+BENCHMARK(BM_XmlExtractDom);
+
+/*
+*   index.json is the only format of the documents, a binary encoding of the same json (CBOR)
+*   shows what a binary index format would save on parsing
+*/
+const nlohmann::json &serialized_index() {
+    static nlohmann::json index = []() {
+        nlohmann::json j;
+        j["documents"] = nlohmann::json::array();
+        Analyzer analyzer;
+        uint64_t state = 3;
+        for (size_t docid = 1; docid <= index_documents; ++docid) {
+            std::string text = Corpus::samples().make_document(state, cas_document_words);
+            std::unordered_map<std::string, int> concordance;
+            int total_term_count = 0;
+            std::istringstream words(text);
+            std::string word;
+            while (words >> word) {
+                for (const auto &term: analyzer.analyze(word)) {
+                    concordance[term]++;
+                    total_term_count++;
+                }
+            }
+
+            auto doc = DocumentFactory::create_document(docid, "doc" + std::to_string(docid) + ".txt", ".txt");
+            std::string hash = ContentAddressedStorage::compute_sha256(text);
+            doc->set_content_hash(hash);
+            doc->set_concordance(std::move(concordance));
+            doc->set_total_term_count(total_term_count);
+            doc->set_indexed_at(std::chrono::system_clock::now());
+            j["documents"].push_back(doc->to_json());
+        }
+        return j;
+    }();
+    return index;
+}
+
+void load_documents(const nlohmann::json &j) {
+    for (const auto &doc_json: j["documents"]) {
+        do_not_optimize(DocumentFactory::from_json(doc_json));
+    }
+}
+
+void BM_IndexLoadJson(BenchmarkState &state) {
+    std::string text = serialized_index().dump();
+    for (auto _: state) {
+        load_documents(nlohmann::json::parse(text));
+    }
+    state.set_bytes_processed(state.iterations() * text.size());
+    state.set_items_processed(state.iterations() * index_documents);
+    state.set_counter("size_bytes", text.size());
+}
+BENCHMARK(BM_IndexLoadJson);
+
+void BM_IndexLoadCbor(BenchmarkState &state) {
+    std::vector<uint8_t> cbor = nlohmann::json::to_cbor(serialized_index());
+    for (auto _: state) {
+        load_documents(nlohmann::json::from_cbor(cbor));
+    }
+    state.set_bytes_processed(state.iterations() * cbor.size());
+    state.set_items_processed(state.iterations() * index_documents);
+    state.set_counter("size_bytes", cbor.size());
+}
+BENCHMARK(BM_IndexLoadCbor);
+
+}
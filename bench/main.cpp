@@ -0,0 +1,300 @@
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <nlohmann/json.hpp>
+
+#include "Benchmark.h"
+#include "Corpus.h"
+#include "LoadGenerator.h"
+#include "MacroBenchmarks.h"
+
+#include "PDFWorkerPool.h"
+
+/*
+*   ./cearch_bench [--samples <dir>] [--docs <n>] [--filter <text>] [--min-time <ms>] [--commit <id>] [--out <file>]
+*   ./cearch_bench generate <dir> [docs]
+*   ./cearch_bench compare <old.json> <new.json>
+*   ./cearch_bench load [options], see load_usage
+*/
+static void usage() {
+    std::cerr << "Usage: ./cearch_bench [--samples <dir>] [--docs <n>] [--filter <text>] [--min-time <ms>] [--commit <id>] [--out <file>]" << std::endl;
+    std::cerr << "       ./cearch_bench generate <dir> [docs]" << std::endl;
+    std::cerr << "       ./cearch_bench compare <old.json> <new.json>" << std::endl;
+    std::cerr << "       ./cearch_bench load --index <dir> | --queries <log> [options]" << std::endl;
+}
+
+static void load_usage() {
+    std::cerr << "Usage: ./cearch_bench load --index <dir> | --queries <log> [options]" << std::endl;
+    std::cerr << "  --index <dir>           Zipf distributed queries from the vocabulary of the index, --zipf <exponent> (1.0)" << std::endl;
+    std::cerr << "  --queries <log>         replays a query log, one query per line" << std::endl;
+    std::cerr << "  --host <host> --port <port>  of the server (127.0.0.1 8080)" << std::endl;
+    std::cerr << "  --open                  open loop at --rate, queries arrive independent of the answers" << std::endl;
+    std::cerr << "  --connections <n>       clients of the closed loop, queries in flight of the open loop (8)" << std::endl;
+    std::cerr << "  --rate <qps>            target rate, without it the closed loop sends as fast as it can" << std::endl;
+    std::cerr << "  --duration <s> --warmup <s>  measured time and time before it (10 2)" << std::endl;
+    std::cerr << "  --top-k <k>             top_k of the queries (10)" << std::endl;
+    std::cerr << "  --write-interval <ms> --corpus <dir>  mixed read/write, adds a document to the indexed directory" << std::endl;
+    std::cerr << "                          and updates the index every interval, --samples <dir> has the words (samples)" << std::endl;
+    std::cerr << "  --slo <p50|p90|p99|p999|max>:<ms>  exits with 1 if the latency is above, repeatable" << std::endl;
+}
+
+/* runs the load generator against a server, prints the report and checks the SLOs */
+static int load_main(int argc, const char *argv[]) {
+    LoadOptions options;
+    std::string index_dir;
+    std::string query_log;
+    double zipf_exponent = 1.0;
+    std::vector<std::pair<std::string, double>> slos;
+    for (int i = 2; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag == "--open") {
+            options.open_loop = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            load_usage();
+            return 2;
+        }
+        std::string value = argv[++i];
+        if (flag == "--index") {
+            index_dir = value;
+        } else if (flag == "--queries") {
+            query_log = value;
+        } else if (flag == "--zipf") {
+            zipf_exponent = std::stod(value);
+        } else if (flag == "--host") {
+            options.host = value;
+        } else if (flag == "--port") {
+            options.port = value;
+        } else if (flag == "--connections") {
+            options.connections = std::stoul(value);
+        } else if (flag == "--rate") {
+            options.rate = std::stod(value);
+        } else if (flag == "--duration") {
+            options.duration = std::chrono::milliseconds(static_cast<int64_t>(std::stod(value) * 1000));
+        } else if (flag == "--warmup") {
+            options.warmup = std::chrono::milliseconds(static_cast<int64_t>(std::stod(value) * 1000));
+        } else if (flag == "--top-k") {
+            options.top_k = std::stoul(value);
+        } else if (flag == "--write-interval") {
+            options.write_interval = std::chrono::milliseconds(std::stoul(value));
+        } else if (flag == "--corpus") {
+            options.corpus_dir = value;
+        } else if (flag == "--samples") {
+            Corpus::samples_dir = value;
+        } else if (flag == "--slo" && value.find(':') != std::string::npos) {
+            slos.emplace_back(value.substr(0, value.find(':')), std::stod(value.substr(value.find(':') + 1)));
+        } else {
+            load_usage();
+            return 2;
+        }
+    }
+    if (index_dir.empty() == query_log.empty()) {
+        load_usage();
+        return 2;
+    }
+
+    std::vector<std::string> queries = query_log.empty()
+        ? LoadGenerator::zipf_queries(index_dir, 100000, zipf_exponent, options.seed)
+        : LoadGenerator::read_query_log(query_log);
+    LoadGenerator generator(options, std::move(queries));
+    nlohmann::json report = generator.run();
+
+    bool met = true;
+    for (const auto &[quantile, limit_ms]: slos) {
+        std::string field = quantile + "_ms";
+        if (!report["latency"].contains(field)) {
+            throw std::invalid_argument("Unknown quantile of an SLO: " + quantile);
+        }
+        double value = report["latency"][field];
+        met = met && value <= limit_ms;
+        report["slo"].push_back({{"quantile", quantile}, {"limit_ms", limit_ms}, {"value_ms", value}, {"met", value <= limit_ms}});
+    }
+
+    std::cout << report.dump(4) << std::endl;
+    const auto &latency = report["latency"];
+    std::cerr << report["queries"] << " queries, " << report["errors"] << " errors, " << report["qps"].get<double>() << " qps, latency p50 "
+        << latency["p50_ms"].get<double>() << " ms, p99 " << latency["p99_ms"].get<double>() << " ms, p999 "
+        << latency["p999_ms"].get<double>() << " ms" << std::endl;
+    return met ? 0 : 1;
+}
+
+static nlohmann::json read_results(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Could not open " + path);
+    }
+    return nlohmann::json::parse(file);
+}
+
+/* the change of the time per benchmark, negative is faster */
+static int compare_main(const std::string &old_path, const std::string &new_path) {
+    nlohmann::json old_run = read_results(old_path);
+    nlohmann::json new_run = read_results(new_path);
+    std::map<std::string, nlohmann::json> old_results;
+    for (const auto &result: old_run["benchmarks"]) {
+        old_results[result["name"]] = result;
+    }
+
+    std::cout << std::left << std::setw(36) << "benchmark" << std::right << std::setw(17) << "old" << std::setw(17) << "new"
+        << std::setw(10) << "change" << std::setw(12) << "rss MB" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    for (const auto &result: new_run["benchmarks"]) {
+        std::string name = result["name"];
+        auto old_result = old_results.find(name);
+        if (old_result == old_results.end() || !result.contains("real_time") || !old_result->second.contains("real_time")) {
+            continue;
+        }
+        double old_time = old_result->second["real_time"];
+        double new_time = result["real_time"];
+        std::string unit = result.value("time_unit", "ns");
+        std::cout << std::left << std::setw(36) << name << std::right
+            << std::setw(14) << old_time << " " << std::setw(2) << unit
+            << std::setw(14) << new_time << " " << std::setw(2) << unit
+            << std::setw(9) << (old_time > 0 ? (new_time - old_time) / old_time * 100 : 0.0) << "%";
+        if (result.contains("peak_rss_bytes")) {
+            std::cout << std::setw(12) << result["peak_rss_bytes"].get<uint64_t>() / (1024.0 * 1024.0);
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
+
+static std::string current_date() {
+    std::time_t now = std::time(nullptr);
+    char buffer[32];
+    std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S%z", std::localtime(&now));
+    return buffer;
+}
+
+static std::string host_name() {
+    char buffer[256] = {};
+    gethostname(buffer, sizeof(buffer) - 1);
+    return buffer;
+}
+
+int main(int argc, const char *argv[]) {
+    /* the index starts this binary for its PDFWorkerPool */
+    if (argc == 2 && std::string(argv[1]) == "--pdf-worker") {
+        return PDFWorkerPool::worker_main();
+    }
+
+    try {
+        if (argc >= 3 && std::string(argv[1]) == "generate") {
+            size_t documents = argc >= 4 ? std::stoul(argv[3]) : 10000;
+            Corpus::samples().generate(argv[2], documents);
+            std::cerr << "Generated " << documents << " documents in " << argv[2] << std::endl;
+            return 0;
+        }
+        if (argc == 4 && std::string(argv[1]) == "compare") {
+            return compare_main(argv[2], argv[3]);
+        }
+        if (argc >= 2 && std::string(argv[1]) == "load") {
+            return load_main(argc, argv);
+        }
+
+        size_t documents = 10000;
+        std::string filter;
+        std::string commit = "unknown";
+        std::string out_path;
+        auto min_time = std::chrono::milliseconds(500);
+        for (int i = 1; i < argc; ++i) {
+            std::string flag = argv[i];
+            if (i + 1 >= argc) {
+                usage();
+                return 1;
+            }
+            std::string value = argv[++i];
+            if (flag == "--samples") {
+                Corpus::samples_dir = value;
+            } else if (flag == "--docs") {
+                documents = std::stoul(value);
+            } else if (flag == "--filter") {
+                filter = value;
+            } else if (flag == "--min-time") {
+                min_time = std::chrono::milliseconds(std::stoul(value));
+            } else if (flag == "--commit") {
+                commit = value;
+            } else if (flag == "--out") {
+                out_path = value;
+            } else {
+                usage();
+                return 1;
+            }
+        }
+
+        nlohmann::json benchmarks = nlohmann::json::array();
+        {
+            /* the macro benchmarks fork, so they run before the micro benchmarks start any thread */
+            TemporaryDirectory work_dir;
+            std::string synthetic_dir = work_dir.path() + "/synthetic";
+            Corpus::samples().generate(synthetic_dir, documents);
+
+            /* the synthetic corpus again with positions, once in the docid order of indexing and once reordered */
+            IndexOptions positional;
+            positional.positional = true;
+            IndexOptions reordered = positional;
+            reordered.reorder_docids = true;
+            std::string synthetic_label = "synthetic_" + std::to_string(documents);
+
+            const std::tuple<std::string, std::string, IndexOptions> corpora[] = {
+                {Corpus::samples_dir, "samples", {}},
+                {synthetic_dir, synthetic_label, {}},
+                {synthetic_dir, synthetic_label + "_positions", positional},
+                {synthetic_dir, synthetic_label + "_reordered", reordered}
+            };
+            for (const auto &[corpus_dir, label, options]: corpora) {
+                for (auto &result: MacroBenchmarks(corpus_dir, label, work_dir.path(), options).run(filter)) {
+                    benchmarks.push_back(std::move(result));
+                }
+            }
+        }
+        for (auto &result: BenchmarkRegistry::instance().run(filter, min_time)) {
+            benchmarks.push_back(std::move(result));
+        }
+
+        struct rusage usage {};
+        getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+        uint64_t peak_rss = usage.ru_maxrss;
+#else
+        uint64_t peak_rss = static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+
+        nlohmann::json results = {
+            {"context", {
+                {"date", current_date()},
+                {"host_name", host_name()},
+                {"num_cpus", std::thread::hardware_concurrency()},
+                {"git_commit", commit},
+                {"compiler", __VERSION__},
+                {"synthetic_documents", documents},
+                {"peak_rss_bytes", peak_rss}
+            }},
+            {"benchmarks", benchmarks}
+        };
+
+        if (out_path.empty()) {
+            std::cout << results.dump(4) << std::endl;
+        } else {
+            std::ofstream out(out_path);
+            out << results.dump(4) << std::endl;
+            std::cerr << "Wrote the results to " << out_path << std::endl;
+        }
+        return 0;
+    } catch (const std::exception &e) {
+        std::cerr << "Error in the benchmarks: " << e.what() << std::endl;
+        return 1;
+    }
+}
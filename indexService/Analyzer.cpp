@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <cctype>
+
+#include "Analyzer.h"
+#include "Document.h"
+#include "PorterStemmer.h"
+
+Analyzer::Analyzer(bool strip_possessives, bool stem, std::unordered_set<std::string> stopwords)
+    : m_strip_possessives(strip_possessives), m_stem(stem), m_stopwords(std::move(stopwords))
+{
+}
+
+std::vector<std::string> Analyzer::analyze(std::string word) const {
+    if (m_strip_possessives) {
+        strip_possessives(word);
+    }
+
+    std::vector<std::string> terms;
+    for (auto &term: Document::clean_word(word)) {
+        if (term.empty() || is_stopword(term)) {
+            continue;
+        }
+        terms.push_back(m_stem ? PorterStemmer::stem(term) : std::move(term));
+    }
+    return terms;
+}
+
+std::string Analyzer::normalize(const std::string &word) const {
+    if (is_stopword(word)) {
+        return "";
+    }
+    return m_stem ? PorterStemmer::stem(word) : word;
+}
+
+bool Analyzer::is_stopword(const std::string &term) const {
+    return !m_stopwords.empty() && m_stopwords.count(term) > 0;
+}
+
+bool Analyzer::is_plain() const {
+    return !m_strip_possessives && !m_stem && m_stopwords.empty();
+}
+
+/* removes 's and ’s (U+2019) at the end of the word or in front of punctuation */
+void Analyzer::strip_possessives(std::string &word) {
+    static const std::string apostrophes[] = {"'", "\xE2\x80\x99"};
+
+    for (const auto &apostrophe: apostrophes) {
+        size_t pos = 0;
+        while ((pos = word.find(apostrophe, pos)) != std::string::npos) {
+            size_t s = pos + apostrophe.size();
+            bool possessive = pos > 0 && s < word.size() && std::tolower(static_cast<unsigned char>(word[s])) == 's'
+                && (s + 1 == word.size() || !std::isalpha(static_cast<unsigned char>(word[s + 1])));
+
+            if (possessive) {
+                word.erase(pos, apostrophe.size() + 1);
+            } else {
+                pos = s;
+            }
+        }
+    }
+}
+
+nlohmann::json Analyzer::to_json() const {
+    std::vector<std::string> stopwords(m_stopwords.begin(), m_stopwords.end());
+    std::sort(stopwords.begin(), stopwords.end());
+    return {
+        {"strip_possessives", m_strip_possessives},
+        {"stem", m_stem},
+        {"stopwords", stopwords}
+    };
+}
+
+/* indexes without an analyzer entry were built before the analysis chain, their terms are only cleaned */
+Analyzer Analyzer::from_json(const nlohmann::json &j) {
+    return Analyzer(
+        j.value("strip_possessives", false),
+        j.value("stem", false),
+        j.value("stopwords", std::unordered_set<std::string>())
+    );
+}
@@ -0,0 +1,43 @@
+#ifndef _H_ANALYZER
+#define _H_ANALYZER
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+/*
+*   Turns a whitespace separated word into index terms, the same chain runs at index and at query time:
+*       possessives     "whale's" and "whale’s" become "whale" (optional)
+*       clean_word      lower case, split at every non alphabetic character
+*       stopwords       frequent words like "the" are dropped (optional)
+*       stemming        Porter stemmer, "whales" and "whaling" become "whale" (optional)
+*   The configuration is stored with the index, a query is always analyzed like the indexed documents.
+*   Dropped stopwords leave no gap, so the phrase "man of war" matches "man war".
+*/
+class Analyzer {
+    public:
+        Analyzer() = default;
+        Analyzer(bool strip_possessives, bool stem, std::unordered_set<std::string> stopwords);
+
+        std::vector<std::string> analyze(std::string word) const;
+        /* the term of a single lower case word, as found by the snippet tokenizer, empty for a stopword */
+        std::string normalize(const std::string &word) const;
+
+        bool is_stopword(const std::string &term) const;
+        /* true if no option is set, terms are only cleaned */
+        bool is_plain() const;
+
+        nlohmann::json to_json() const;
+        static Analyzer from_json(const nlohmann::json &j);
+
+    private:
+        bool m_strip_possessives = false;
+        bool m_stem = false;
+        std::unordered_set<std::string> m_stopwords;
+
+        static void strip_possessives(std::string &word);
+};
+
+#endif
@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <limits>
+#include <unordered_set>
+
+#include "BatchEvaluator.h"
+
+BatchEvaluator::BatchEvaluator(const TermDictionary &dictionary, const PostingsFile &postings, QueryEvaluator::ScoreFunction score)
+    : m_dictionary(dictionary), m_postings(postings), m_doc_lengths(postings.get_doc_lengths()), m_score(std::move(score))
+{
+}
+
+bool BatchEvaluator::supports(const QueryNode &query, const QueryOptions &options) {
+    return !options.impact_ordered && options.fuzzy == 0 && !options.proximity && options.timeout.count() == 0
+        && !options.collection_stats && query.is_bag_of_words();
+}
+
+void BatchEvaluator::add(size_t index, const QueryNode &query) {
+    std::vector<std::string> terms;
+    query.collect_terms(terms);
+
+    BatchQuery batch_query{index, {}};
+    std::unordered_set<uint32_t> distinct;
+    for (const auto &term: terms) {
+        auto term_id = m_dictionary.lookup(term);
+        /* like an empty iterator, a term without postings matches nothing */
+        if (!term_id || m_postings.get_doc_freq(*term_id) == 0) {
+            continue;
+        }
+        batch_query.term_ids.push_back(*term_id);
+        if (distinct.insert(*term_id).second) {
+            m_term_uses[*term_id]++;
+        }
+    }
+    m_queries.push_back(std::move(batch_query));
+}
+
+void BatchEvaluator::prepare(size_t threads) {
+    /* the terms that save the most scoring when shared come first */
+    std::vector<std::pair<size_t, uint32_t>> candidates;
+    for (const auto &[term_id, uses]: m_term_uses) {
+        if (uses > 1) {
+            candidates.emplace_back(m_postings.get_doc_freq(term_id) * (uses - 1), term_id);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), std::greater<>());
+
+    std::vector<std::pair<uint32_t, std::vector<double>*>> shared;
+    size_t shared_postings = 0;
+    for (const auto &[saved, term_id]: candidates) {
+        size_t postings = m_postings.get_doc_freq(term_id);
+        if (shared_postings + postings > max_shared_postings) {
+            continue;
+        }
+        shared_postings += postings;
+        /* the entries are created here, the threads only fill them */
+        shared.emplace_back(term_id, &m_shared_scores[term_id]);
+    }
+
+    std::atomic<size_t> next{0};
+    auto score_shared = [this, &shared, &next]() {
+        for (size_t i = next++; i < shared.size(); i = next++) {
+            score_postings(shared[i].first, *shared[i].second);
+        }
+    };
+    std::vector<std::future<void>> workers;
+    for (size_t i = 0; i < std::max<size_t>(1, std::min(threads, shared.size())); ++i) {
+        workers.push_back(std::async(std::launch::async, score_shared));
+    }
+    for (auto &worker: workers) {
+        worker.get();
+    }
+
+    /* grouped by the shared term with the most postings, queries without shared terms at the end */
+    std::vector<std::pair<uint32_t, size_t>> keys;
+    keys.reserve(m_queries.size());
+    for (size_t pos = 0; pos < m_queries.size(); ++pos) {
+        uint32_t key = std::numeric_limits<uint32_t>::max();
+        size_t key_postings = 0;
+        for (uint32_t term_id: m_queries[pos].term_ids) {
+            size_t postings = m_postings.get_doc_freq(term_id);
+            if (postings > key_postings && m_shared_scores.count(term_id)) {
+                key = term_id;
+                key_postings = postings;
+            }
+        }
+        keys.emplace_back(key, pos);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    m_groups.clear();
+    for (size_t i = 0; i < keys.size(); i += group_queries) {
+        std::vector<size_t> group;
+        for (size_t j = i; j < std::min(keys.size(), i + group_queries); ++j) {
+            group.push_back(keys[j].second);
+        }
+        m_groups.push_back(std::move(group));
+    }
+}
+
+size_t BatchEvaluator::get_group_count() const { return m_groups.size(); }
+size_t BatchEvaluator::get_shared_terms() const { return m_shared_scores.size(); }
+
+void BatchEvaluator::score_postings(uint32_t term_id, std::vector<double> &scores) const {
+    PostingsList postings = m_postings.get_postings(term_id);
+    auto docids = postings.get_docids();
+    auto term_freqs = postings.get_term_freqs();
+    int doc_freq = m_postings.get_doc_freq(term_id);
+
+    scores.resize(docids.size());
+    for (size_t i = 0; i < docids.size(); ++i) {
+        int doc_length = docids[i] < m_doc_lengths.size() ? m_doc_lengths[docids[i]] : 0;
+        scores[i] = m_score(term_freqs[i], doc_length, doc_freq);
+    }
+}
+
+void BatchEvaluator::evaluate(size_t group, size_t top_k, Accumulator &accumulator, const ResultFunction &on_result) const {
+    auto &scores = accumulator.scores;
+    auto &touched = accumulator.touched;
+    if (scores.size() < m_doc_lengths.size()) {
+        scores.assign(m_doc_lengths.size(), 0.0);
+    }
+
+    /* BM25 scores are positive, a docid with the score 0 has not been touched by the query yet */
+    auto accumulate = [&scores, &touched](uint64_t docid, double score) {
+        if (docid >= scores.size()) {
+            return;
+        }
+        if (scores[docid] == 0.0) {
+            touched.push_back(docid);
+        }
+        scores[docid] += score;
+    };
+
+    std::vector<double> unshared;
+    for (size_t pos: m_groups[group]) {
+        const auto &query = m_queries[pos];
+        auto start = std::chrono::steady_clock::now();
+        QueryResult query_result;
+
+        for (uint32_t term_id: query.term_ids) {
+            PostingsList postings = m_postings.get_postings(term_id);
+            auto docids = postings.get_docids();
+            auto shared = m_shared_scores.find(term_id);
+            const std::vector<double> *term_scores = &unshared;
+            if (shared != m_shared_scores.end()) {
+                term_scores = &shared->second;
+            } else {
+                score_postings(term_id, unshared);
+            }
+
+            for (size_t i = 0; i < docids.size(); ++i) {
+                accumulate(docids[i], (*term_scores)[i]);
+            }
+            query_result.stats.terms_processed++;
+            query_result.stats.postings_processed += docids.size();
+        }
+
+        auto &results = query_result.results;
+        results.reserve(touched.size());
+        for (uint64_t docid: touched) {
+            results.emplace_back(docid, scores[docid]);
+            scores[docid] = 0.0;
+        }
+        touched.clear();
+        query_result.stats.documents_scanned = results.size();
+
+        /* the order of the QueryEvaluator */
+        auto by_score = [](const auto &a, const auto &b) {
+            return a.second > b.second || (a.second == b.second && a.first < b.first);
+        };
+        if (top_k > 0 && top_k < results.size()) {
+            std::partial_sort(results.begin(), results.begin() + top_k, results.end(), by_score);
+            results.resize(top_k);
+        } else {
+            std::sort(results.begin(), results.end(), by_score);
+        }
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        query_result.stats.elapsed_ms = elapsed.count();
+        on_result(query.index, std::move(query_result));
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef _H_BATCHEVALUATOR
+#define _H_BATCHEVALUATOR
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "PostingsFile.h"
+#include "Query.h"
+#include "QueryEvaluator.h"
+#include "QueryParser.h"
+#include "TermDictionary.h"
+
+/*
+*   Evaluates a batch of bag of words queries term-at-a-time.
+*   The postings of a term that several queries of the batch use are scored once, the queries share the scores.
+*   The queries are grouped by their most expensive shared term, so the queries of a group, evaluated one after
+*   the other on the same thread, read the same scores. The scores of a query are summed in a dense array over the
+*   docids in the order of its terms, which gives the same results as the QueryEvaluator.
+*/
+class BatchEvaluator {
+    public:
+        /* called for every evaluated query with its index in the batch, from several threads at once */
+        using ResultFunction = std::function<void(size_t, QueryResult)>;
+
+        /* dense scores over the docids and the docids with a score, one per thread */
+        struct Accumulator {
+            std::vector<double> scores;
+            std::vector<uint64_t> touched;
+        };
+
+        BatchEvaluator(const TermDictionary &dictionary, const PostingsFile &postings, QueryEvaluator::ScoreFunction score);
+
+        /* plain term queries combined with OR, without fuzzy matching, proximity, timeout or collection statistics */
+        static bool supports(const QueryNode &query, const QueryOptions &options);
+
+        /* adds a supported query with its index in the batch */
+        void add(size_t index, const QueryNode &query);
+
+        /* scores the shared postings on the threads and groups the queries, call after the last add */
+        void prepare(size_t threads);
+
+        size_t get_group_count() const;
+        size_t get_shared_terms() const;
+
+        /* evaluates the queries of a group, thread safe after prepare */
+        void evaluate(size_t group, size_t top_k, Accumulator &accumulator, const ResultFunction &on_result) const;
+
+        /* queries per group, a group is the unit of work of a thread */
+        static constexpr size_t group_queries = 64;
+        /* memory for the shared scores, 8 bytes per posting, the most used terms are shared first */
+        static constexpr size_t max_shared_postings = 16 * 1024 * 1024;
+
+    private:
+        struct BatchQuery {
+            size_t index;
+            /* in the order of the query, a repeated term is scored again like by the QueryEvaluator */
+            std::vector<uint32_t> term_ids;
+        };
+
+        const TermDictionary &m_dictionary;
+        const PostingsFile &m_postings;
+        std::span<const uint32_t> m_doc_lengths;
+        QueryEvaluator::ScoreFunction m_score;
+
+        std::vector<BatchQuery> m_queries;
+        /* number of queries using a term */
+        std::unordered_map<uint32_t, size_t> m_term_uses;
+        /* score of every posting of the shared terms */
+        std::unordered_map<uint32_t, std::vector<double>> m_shared_scores;
+        /* positions in m_queries */
+        std::vector<std::vector<size_t>> m_groups;
+
+        void score_postings(uint32_t term_id, std::vector<double> &scores) const;
+};
+
+#endif
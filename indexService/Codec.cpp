@@ -0,0 +1,171 @@
+#include <stdexcept>
+
+#include <lz4.h>
+#include <zdict.h>
+#include <zlib.h>
+#include <zstd.h>
+
+#include "Codec.h"
+
+namespace {
+
+class ZlibCodec : public Codec {
+    public:
+        Id get_id() const override { return Id::Zlib; }
+        const char *name() const override { return "zlib"; }
+
+        std::vector<uint8_t> compress(std::string_view data) const override {
+            uLongf compressed_size = compressBound(data.size());
+            std::vector<uint8_t> compressed(compressed_size);
+
+            int res = ::compress(compressed.data(), &compressed_size, reinterpret_cast<const Bytef*>(data.data()), data.size());
+            if (res != Z_OK) {
+                throw std::runtime_error("zlib compression failed");
+            }
+            compressed.resize(compressed_size);
+            return compressed;
+        }
+
+        std::string decompress(const uint8_t *data, size_t size, size_t uncompressed_size) const override {
+            std::string decompressed(uncompressed_size, '\0');
+            uLongf decompressed_size = uncompressed_size;
+
+            int res = uncompress(reinterpret_cast<Bytef*>(decompressed.data()), &decompressed_size, data, size);
+            if (res != Z_OK || decompressed_size != uncompressed_size) {
+                throw std::runtime_error("zlib decompression failed");
+            }
+            return decompressed;
+        }
+};
+
+/* the contexts are per thread, they are expensive to create and not thread safe */
+class ZstdCodec : public Codec {
+    public:
+        static constexpr int level = 3;
+
+        ZstdCodec() = default;
+
+        explicit ZstdCodec(const std::string &dictionary)
+            : m_cdict(ZSTD_createCDict(dictionary.data(), dictionary.size(), level), ZSTD_freeCDict),
+              m_ddict(ZSTD_createDDict(dictionary.data(), dictionary.size()), ZSTD_freeDDict)
+        {
+            if (!m_cdict || !m_ddict) {
+                throw std::runtime_error("Invalid zstd dictionary");
+            }
+        }
+
+        Id get_id() const override { return m_cdict ? Id::ZstdDictionary : Id::Zstd; }
+        const char *name() const override { return m_cdict ? "zstd+dictionary" : "zstd"; }
+
+        std::vector<uint8_t> compress(std::string_view data) const override {
+            thread_local std::unique_ptr<ZSTD_CCtx, size_t (*)(ZSTD_CCtx*)> context(ZSTD_createCCtx(), ZSTD_freeCCtx);
+
+            std::vector<uint8_t> compressed(ZSTD_compressBound(data.size()));
+            size_t compressed_size = m_cdict
+                ? ZSTD_compress_usingCDict(context.get(), compressed.data(), compressed.size(), data.data(), data.size(), m_cdict.get())
+                : ZSTD_compressCCtx(context.get(), compressed.data(), compressed.size(), data.data(), data.size(), level);
+            if (ZSTD_isError(compressed_size)) {
+                throw std::runtime_error(std::string("zstd compression failed: ") + ZSTD_getErrorName(compressed_size));
+            }
+            compressed.resize(compressed_size);
+            return compressed;
+        }
+
+        std::string decompress(const uint8_t *data, size_t size, size_t uncompressed_size) const override {
+            thread_local std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> context(ZSTD_createDCtx(), ZSTD_freeDCtx);
+
+            std::string decompressed(uncompressed_size, '\0');
+            size_t decompressed_size = m_ddict
+                ? ZSTD_decompress_usingDDict(context.get(), decompressed.data(), decompressed.size(), data, size, m_ddict.get())
+                : ZSTD_decompressDCtx(context.get(), decompressed.data(), decompressed.size(), data, size);
+            if (ZSTD_isError(decompressed_size) || decompressed_size != uncompressed_size) {
+                throw std::runtime_error("zstd decompression failed");
+            }
+            return decompressed;
+        }
+
+    private:
+        std::shared_ptr<ZSTD_CDict> m_cdict;
+        std::shared_ptr<ZSTD_DDict> m_ddict;
+};
+
+class Lz4Codec : public Codec {
+    public:
+        Id get_id() const override { return Id::Lz4; }
+        const char *name() const override { return "lz4"; }
+
+        std::vector<uint8_t> compress(std::string_view data) const override {
+            if (data.size() > LZ4_MAX_INPUT_SIZE) {
+                throw std::runtime_error("Content too large for lz4");
+            }
+            std::vector<uint8_t> compressed(LZ4_compressBound(data.size()));
+            int compressed_size = LZ4_compress_default(data.data(), reinterpret_cast<char*>(compressed.data()), data.size(), compressed.size());
+            if (compressed_size <= 0 && !data.empty()) {
+                throw std::runtime_error("lz4 compression failed");
+            }
+            compressed.resize(compressed_size);
+            return compressed;
+        }
+
+        std::string decompress(const uint8_t *data, size_t size, size_t uncompressed_size) const override {
+            std::string decompressed(uncompressed_size, '\0');
+            int decompressed_size = LZ4_decompress_safe(reinterpret_cast<const char*>(data), decompressed.data(), size, uncompressed_size);
+            if (decompressed_size < 0 || static_cast<size_t>(decompressed_size) != uncompressed_size) {
+                throw std::runtime_error("lz4 decompression failed");
+            }
+            return decompressed;
+        }
+};
+
+}
+
+std::unique_ptr<Codec> Codec::create(const std::string &name) {
+    if (name == "zlib") {
+        return std::make_unique<ZlibCodec>();
+    }
+    if (name == "zstd") {
+        return std::make_unique<ZstdCodec>();
+    }
+    if (name == "lz4") {
+        return std::make_unique<Lz4Codec>();
+    }
+    throw std::invalid_argument("Unknown codec: " + name);
+}
+
+std::unique_ptr<Codec> Codec::create(Id id, const std::string &dictionary) {
+    switch (id) {
+        case Id::Zlib:
+            return std::make_unique<ZlibCodec>();
+        case Id::Zstd:
+            return std::make_unique<ZstdCodec>();
+        case Id::ZstdDictionary:
+            return create_zstd_dictionary(dictionary);
+        case Id::Lz4:
+            return std::make_unique<Lz4Codec>();
+    }
+    throw std::runtime_error("Unknown codec id " + std::to_string(static_cast<int>(id)));
+}
+
+std::unique_ptr<Codec> Codec::create_zstd_dictionary(const std::string &dictionary) {
+    if (dictionary.empty()) {
+        throw std::runtime_error("The zstd dictionary of the storage is missing");
+    }
+    return std::make_unique<ZstdCodec>(dictionary);
+}
+
+std::string Codec::train_dictionary(const std::vector<std::string> &samples, size_t max_size) {
+    std::string buffer;
+    std::vector<size_t> sizes;
+    for (const auto &sample: samples) {
+        buffer.append(sample);
+        sizes.push_back(sample.size());
+    }
+
+    std::string dictionary(max_size, '\0');
+    size_t size = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(), buffer.data(), sizes.data(), sizes.size());
+    if (ZDICT_isError(size)) {
+        return "";
+    }
+    dictionary.resize(size);
+    return dictionary;
+}
@@ -0,0 +1,51 @@
+#ifndef _H_CODEC
+#define _H_CODEC
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+*   Compression of the blobs of the content storage. The id of the codec is stored in the blob header,
+*   so blobs written with different codecs can be read side by side.
+*       zlib    the original format, default level
+*       zstd    level 3, optionally with a dictionary trained on a sample of the documents,
+*               which helps the ratio of many small, similar documents
+*       lz4     fastest decompression, for hot data that is read often, e.g. by snippets
+*   Throws std::runtime_error if compression or decompression fails.
+*/
+class Codec {
+    public:
+        enum class Id : uint8_t {
+            Zlib = 1,
+            Zstd = 2,
+            /* zstd with the dictionary of the storage */
+            ZstdDictionary = 3,
+            Lz4 = 4
+        };
+
+        virtual ~Codec() = default;
+
+        virtual Id get_id() const = 0;
+        virtual const char *name() const = 0;
+
+        virtual std::vector<uint8_t> compress(std::string_view data) const = 0;
+        /* the uncompressed size is known from the blob header */
+        virtual std::string decompress(const uint8_t *data, size_t size, size_t uncompressed_size) const = 0;
+
+        /* zlib, zstd or lz4, throws std::invalid_argument for other names */
+        static std::unique_ptr<Codec> create(const std::string &name);
+        /* a codec that reads blobs with this id, the dictionary is needed for Id::ZstdDictionary */
+        static std::unique_ptr<Codec> create(Id id, const std::string &dictionary = "");
+        static std::unique_ptr<Codec> create_zstd_dictionary(const std::string &dictionary);
+
+        /* trains a zstd dictionary of at most max_size bytes, empty if the samples are not suitable */
+        static std::string train_dictionary(const std::vector<std::string> &samples, size_t max_size = default_dictionary_size);
+
+        static constexpr size_t default_dictionary_size = 112 * 1024;
+};
+
+#endif
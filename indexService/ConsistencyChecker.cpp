@@ -0,0 +1,213 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "ConsistencyChecker.h"
+#include "DocumentFactory.h"
+
+nlohmann::json VerifyReport::to_json() const {
+    nlohmann::json j;
+    j["documents"] = documents;
+    j["blobs"] = blobs;
+    j["missing"] = missing;
+    j["corrupt"] = corrupt;
+    j["orphans"] = orphans;
+    j["unresolved"] = unresolved;
+    j["complete"] = complete;
+    j["next_docid"] = next_docid;
+
+    j["seconds"] = seconds;
+    j["documents_per_second"] = seconds > 0 ? documents / seconds : 0.0;
+    j["stored_mb_per_second"] = seconds > 0 ? stored_bytes / seconds / (1024 * 1024) : 0.0;
+    j["content_mb_per_second"] = seconds > 0 ? content_bytes / seconds / (1024 * 1024) : 0.0;
+
+    j["problems"] = nlohmann::json::array();
+    for (const auto &problem: problems) {
+        j["problems"].push_back({
+            {"content_hash", problem.content_hash},
+            {"status", problem.status},
+            {"error", problem.error},
+            {"action", problem.action},
+            {"docids", problem.docids}
+        });
+    }
+    return j;
+}
+
+ConsistencyChecker::ConsistencyChecker(std::shared_ptr<ContentAddressedStorage> content_store)
+    : m_content_store(std::move(content_store))
+{
+}
+
+VerifyReport ConsistencyChecker::verify(std::vector<Entry> entries, const VerifyOptions &options) {
+    auto start = std::chrono::high_resolution_clock::now();
+    VerifyReport report;
+
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.docid < b.docid; });
+    auto first = std::lower_bound(entries.begin(), entries.end(), m_next_docid,
+        [](const Entry &entry, uint64_t docid) { return entry.docid < docid; });
+    size_t remaining = entries.end() - first;
+    auto last = first + (options.limit == 0 ? remaining : std::min(options.limit, remaining));
+    report.documents = last - first;
+
+    /* documents with the same content share their blob, it is read once */
+    std::vector<std::string> hashes;
+    std::unordered_map<std::string, std::vector<const Entry*>> documents_by_hash;
+    for (auto it = first; it != last; ++it) {
+        auto &documents = documents_by_hash[it->content_hash];
+        if (documents.empty()) {
+            hashes.push_back(it->content_hash);
+        }
+        documents.push_back(&*it);
+    }
+    report.blobs = hashes.size();
+
+    std::atomic<size_t> next{0};
+    std::mutex report_mutex;
+    auto check_blobs = [&]() {
+        for (size_t i = next++; i < hashes.size(); i = next++) {
+            const auto &hash = hashes[i];
+            auto check = m_content_store->verify(hash);
+
+            VerifyReport::Problem problem;
+            if (check.status != ContentAddressedStorage::BlobCheck::Status::Ok) {
+                const auto &documents = documents_by_hash.at(hash);
+                problem.content_hash = hash;
+                problem.status = check.status == ContentAddressedStorage::BlobCheck::Status::Missing ? "missing" : "corrupt";
+                problem.error = check.error;
+                for (const Entry *entry: documents) {
+                    problem.docids.push_back(entry->docid);
+                }
+                if (options.repair) {
+                    repair(problem, documents);
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(report_mutex);
+            report.stored_bytes += check.stored_bytes;
+            report.content_bytes += check.content_bytes;
+            if (!problem.content_hash.empty()) {
+                report.problems.push_back(std::move(problem));
+            }
+        }
+    };
+
+    size_t threads = std::max<size_t>(1, std::min(options.concurrency, hashes.size()));
+    std::vector<std::future<void>> workers;
+    for (size_t i = 0; i < threads; ++i) {
+        workers.push_back(std::async(std::launch::async, check_blobs));
+    }
+    for (auto &worker: workers) {
+        worker.get();
+    }
+    if (options.repair) {
+        m_content_store->flush();
+    }
+
+    if (last == entries.end()) {
+        find_orphans(entries, options, report);
+        report.complete = true;
+        m_next_docid = 0;
+    } else {
+        m_next_docid = last->docid;
+    }
+    report.next_docid = m_next_docid;
+
+    for (const auto &problem: report.problems) {
+        if (problem.status == "missing") {
+            report.missing++;
+        } else if (problem.status == "corrupt") {
+            report.corrupt++;
+        }
+        bool resolved = problem.action == "restored" || (problem.status == "orphan" && problem.action == "quarantined");
+        if (!resolved) {
+            report.unresolved++;
+        }
+    }
+    std::sort(report.problems.begin(), report.problems.end(),
+        [](const auto &a, const auto &b) { return a.content_hash < b.content_hash; });
+
+    std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start;
+    report.seconds = duration.count();
+    return report;
+}
+
+/* a corrupt blob is quarantined in any case, the content is restored from the first file that still has it */
+void ConsistencyChecker::repair(VerifyReport::Problem &problem, const std::vector<const Entry*> &entries) {
+    if (problem.status == "corrupt") {
+        m_content_store->quarantine(problem.content_hash);
+    }
+
+    problem.action = "source_missing";
+    for (const Entry *entry: entries) {
+        std::error_code ec;
+        if (entry->filepath.empty() || !std::filesystem::is_regular_file(entry->filepath, ec)) {
+            continue;
+        }
+
+        try {
+            auto doc = DocumentFactory::create_document(entry->docid, entry->filepath, entry->extension);
+            Content content = doc->get_file_content();
+            if (ContentAddressedStorage::compute_sha256(content.view()) != problem.content_hash) {
+                problem.action = "source_changed";
+                continue;
+            }
+            m_content_store->store(content.view());
+            problem.action = "restored";
+            return;
+        } catch (std::exception &e) {
+            problem.error += std::string(problem.error.empty() ? "" : "; ") + "repair: " + e.what();
+        }
+    }
+}
+
+void ConsistencyChecker::find_orphans(const std::vector<Entry> &entries, const VerifyOptions &options, VerifyReport &report) {
+    std::unordered_set<std::string> referenced;
+    for (const auto &entry: entries) {
+        referenced.insert(entry.content_hash);
+    }
+
+    for (const auto &hash: m_content_store->list_blobs()) {
+        if (referenced.count(hash) > 0) {
+            continue;
+        }
+        VerifyReport::Problem problem;
+        problem.content_hash = hash;
+        problem.status = "orphan";
+        if (options.repair && m_content_store->quarantine(hash)) {
+            problem.action = "quarantined";
+        }
+        report.orphans++;
+        report.problems.push_back(std::move(problem));
+    }
+}
+
+std::vector<ConsistencyChecker::Entry> ConsistencyChecker::read_entries(const std::string &index_filepath) {
+    std::ifstream file(index_filepath);
+    if (!file) {
+        throw std::runtime_error("Failed to open index file for reading: " + index_filepath);
+    }
+
+    nlohmann::json j;
+    file >> j;
+
+    std::vector<Entry> entries;
+    if (j.contains("documents") && j["documents"].is_array()) {
+        for (const auto &doc_json: j["documents"]) {
+            entries.push_back({
+                doc_json.at("docid").get<uint64_t>(),
+                doc_json.at("content_hash").get<std::string>(),
+                doc_json.value("filepath", ""),
+                doc_json.at("file_extension").get<std::string>()
+            });
+        }
+    }
+    return entries;
+}
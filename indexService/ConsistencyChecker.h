@@ -0,0 +1,93 @@
+#ifndef _H_CONSISTENCYCHECKER
+#define _H_CONSISTENCYCHECKER
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "ContentAddressedStorage.h"
+
+struct VerifyOptions {
+    /* blobs read at the same time */
+    size_t concurrency = 1;
+    /* documents checked in one step, 0 for all the remaining */
+    size_t limit = 0;
+    /* quarantine bad blobs and orphans, store the content of bad documents again from their files */
+    bool repair = false;
+};
+
+struct VerifyReport {
+    struct Problem {
+        std::string content_hash;
+        /* missing, corrupt or orphan */
+        std::string status;
+        std::string error;
+        /* none, quarantined, restored, source_changed or source_missing */
+        std::string action = "none";
+        std::vector<uint64_t> docids;
+    };
+
+    size_t documents = 0;
+    size_t blobs = 0;
+    size_t missing = 0;
+    size_t corrupt = 0;
+    size_t orphans = 0;
+    /* problems which are not fixed by the repair */
+    size_t unresolved = 0;
+    uint64_t stored_bytes = 0;
+    uint64_t content_bytes = 0;
+    double seconds = 0;
+
+    /* true if the step reached the last document, the next step starts over */
+    bool complete = false;
+    uint64_t next_docid = 0;
+
+    std::vector<Problem> problems;
+
+    nlohmann::json to_json() const;
+};
+
+/*
+*   Checks the content storage against the documents of an index:
+*       missing   a content hash of the index has no blob
+*       corrupt   the blob does not decompress, or its content has a different SHA-256
+*       orphan    a blob no document refers to, only searched by the step that reaches the last document
+*
+*   The blobs are read by options.concurrency threads, one blob at a time each, which bounds the I/O.
+*   A step checks up to options.limit documents in docid order and the next step continues after them,
+*   so a running server checks its storage in short steps between queries.
+*
+*   The repair moves bad blobs and orphans into the quarantine directory of the storage. The content of a
+*   document with a bad blob is extracted from its file again, if it still has the indexed hash the blob
+*   is restored. Otherwise the file changed since it was indexed and the next start of the server indexes it again.
+*/
+class ConsistencyChecker {
+    public:
+        struct Entry {
+            uint64_t docid;
+            std::string content_hash;
+            std::string filepath;
+            std::string extension;
+        };
+
+        explicit ConsistencyChecker(std::shared_ptr<ContentAddressedStorage> content_store);
+
+        /* every document of the index is needed to find the orphans, the step starts at the cursor */
+        VerifyReport verify(std::vector<Entry> entries, const VerifyOptions &options);
+
+        /* the documents of index.json, without building the index */
+        static std::vector<Entry> read_entries(const std::string &index_filepath);
+
+    private:
+        std::shared_ptr<ContentAddressedStorage> m_content_store;
+        /* first docid of the next step */
+        uint64_t m_next_docid = 0;
+
+        void repair(VerifyReport::Problem &problem, const std::vector<const Entry*> &entries);
+        void find_orphans(const std::vector<Entry> &entries, const VerifyOptions &options, VerifyReport &report);
+};
+
+#endif
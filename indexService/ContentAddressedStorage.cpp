@@ -1,55 +1,327 @@
+#include <cctype>
 #include <sstream>
 #include <fstream>
 #include <iomanip>
 #include <vector>
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
 
 #include <openssl/sha.h>
 
 #include "ContentAddressedStorage.h"
 
-ContentAddressedStorage::ContentAddressedStorage(const std::string &storage_dir)
-    :m_storage_dir(storage_dir) 
+ContentAddressedStorage::ContentAddressedStorage(const std::string &storage_dir, const std::string &codec, bool train)
+    :m_storage_dir(storage_dir), m_codec_name(codec)
 {
     /* TODO: remove trailing / from storage dir */
 
     /* TODO: check if the dir exists and is accesable? */
+
+    std::ifstream dictionary(dictionary_path(), std::ios::binary);
+    if (dictionary) {
+        std::string content((std::istreambuf_iterator<char>(dictionary)), std::istreambuf_iterator<char>());
+        m_dictionary_codec = Codec::create_zstd_dictionary(content);
+    }
+
+    if (codec == "zstd" && m_dictionary_codec) {
+        m_codec = m_dictionary_codec;
+    } else {
+        m_codec = Codec::create(codec);
+        m_training = train && codec == "zstd";
+    }
 }
 
-std::string ContentAddressedStorage::store(const std::string &content) {
-    std::vector<Bytef> compressed_content;
+std::string ContentAddressedStorage::store(std::string_view content) {
     std::string hash = compute_sha256(content);
 
+    /* the same content is stored once, e.g. copies of a file or files that did not change */
+    if (exists(hash)) {
+        return hash;
+    }
+
+    std::shared_ptr<const Codec> codec;
+    std::vector<std::pair<std::string, std::string>> samples;
+    {
+        std::lock_guard<std::mutex> lock(m_codec_mutex);
+        if (m_training && content.size() <= max_sample_size) {
+            m_samples.emplace_back(hash, std::string(content));
+            m_sample_bytes += content.size();
+            if (m_samples.size() >= dictionary_samples || m_sample_bytes >= dictionary_sample_bytes) {
+                samples = take_samples();
+            }
+        } else {
+            codec = m_codec;
+        }
+    }
+
+    /* other threads store with the codec without a dictionary while it is trained */
+    if (!samples.empty()) {
+        train_dictionary(samples);
+    }
+    if (!codec) {
+        return hash;
+    }
+
+    write_blob(hash, content, *codec);
+    return hash;
+}
+
+std::vector<std::pair<std::string, std::string>> ContentAddressedStorage::take_samples() {
+    std::vector<std::pair<std::string, std::string>> samples;
+    samples.swap(m_samples);
+    m_sample_bytes = 0;
+    m_training = false;
+    return samples;
+}
+
+void ContentAddressedStorage::train_dictionary(const std::vector<std::pair<std::string, std::string>> &samples) {
+    std::vector<std::string> contents;
+    for (const auto &sample: samples) {
+        contents.push_back(sample.second);
+    }
+
+    std::shared_ptr<const Codec> codec;
+    std::string dictionary = Codec::train_dictionary(contents);
+    if (dictionary.empty()) {
+        std::cerr << "Training a zstd dictionary on " << contents.size() << " documents failed, compressing without" << std::endl;
+        std::lock_guard<std::mutex> lock(m_codec_mutex);
+        codec = m_codec;
+    } else {
+        std::ofstream out(dictionary_path(), std::ios::binary);
+        out.write(dictionary.data(), dictionary.size());
+        if (!out) {
+            throw std::runtime_error("Failed to write the zstd dictionary: " + dictionary_path());
+        }
+        codec = Codec::create_zstd_dictionary(dictionary);
+        {
+            std::lock_guard<std::mutex> lock(m_codec_mutex);
+            m_dictionary_codec = codec;
+            m_codec = codec;
+        }
+        std::cout << "Trained a zstd dictionary of " << dictionary.size() << " bytes on " << contents.size() << " documents" << std::endl;
+    }
+
+    for (const auto &sample: samples) {
+        write_blob(sample.first, sample.second, *codec);
+    }
+}
+
+void ContentAddressedStorage::write_blob(const std::string &hash, std::string_view content, const Codec &codec) {
+    std::vector<uint8_t> blob;
     try {
-        compressed_content = compress_content(content); 
+        blob = codec.compress(content);
     } catch (std::exception &e) {
         throw std::runtime_error("Compressing the content failed during storage");
     }
 
+    uint8_t header[blob_header_size] = {};
+    std::copy(std::begin(blob_magic), std::end(blob_magic), header);
+    header[4] = static_cast<uint8_t>(codec.get_id());
+    for (int i = 0; i < 8; ++i) {
+        header[8 + i] = static_cast<uint8_t>(static_cast<uint64_t>(content.size()) >> (8 * i));
+    }
+    blob.insert(blob.begin(), std::begin(header), std::end(header));
+
     /* store in filesystem */
-    std::string filepath = m_storage_dir + "/" + hash + ".z";
+    std::string filepath = blob_path(hash);
+    m_written = true;
+
+    if (m_io) {
+        std::unique_lock<std::mutex> lock(m_writes_mutex);
+        while (m_pending_writes.size() >= m_io->get_queue_depth()) {
+            std::future<void> oldest = std::move(m_pending_writes.front());
+            m_pending_writes.pop_front();
+            lock.unlock();
+            std::string error;
+            try {
+                oldest.get();
+            } catch (std::exception &e) {
+                error = e.what();
+            }
+            lock.lock();
+            if (!error.empty() && m_write_error.empty()) {
+                m_write_error = error;
+            }
+        }
+        m_pending_writes.push_back(m_io->write_file(filepath, std::move(blob)));
+        return;
+    }
 
-    /* TODO: can this fail? */
     std::ofstream out(filepath, std::ios::binary);
-    out.write(reinterpret_cast<char*>(compressed_content.data()), compressed_content.size());
+    out.write(reinterpret_cast<char*>(blob.data()), blob.size());
+    if (!out) {
+        throw std::runtime_error("Failed to write content to storage: " + filepath);
+    }
+}
 
-    return hash;
+void ContentAddressedStorage::set_io_backend(std::shared_ptr<IOBackend> io) {
+    flush();
+    m_io = std::move(io);
+}
+
+void ContentAddressedStorage::flush() {
+    std::vector<std::pair<std::string, std::string>> samples;
+    {
+        std::lock_guard<std::mutex> lock(m_codec_mutex);
+        if (m_training && !m_samples.empty()) {
+            samples = take_samples();
+        }
+    }
+    if (!samples.empty()) {
+        train_dictionary(samples);
+    }
+
+    std::deque<std::future<void>> writes;
+    std::string error;
+    {
+        std::lock_guard<std::mutex> lock(m_writes_mutex);
+        writes.swap(m_pending_writes);
+        error.swap(m_write_error);
+    }
+
+    /* every write is awaited, the first error is reported */
+    for (auto &write: writes) {
+        try {
+            write.get();
+        } catch (std::exception &e) {
+            if (error.empty()) {
+                error = e.what();
+            }
+        }
+    }
+    if (!error.empty()) {
+        throw std::runtime_error("Writing to the content storage failed: " + error);
+    }
+
+    if (m_written.exchange(false)) {
+        std::ofstream out(codec_path());
+        out << m_codec_name << std::endl;
+        if (!out) {
+            throw std::runtime_error("Failed to write the codec of the content storage: " + codec_path());
+        }
+    }
+}
+
+std::string ContentAddressedStorage::saved_codec(const std::string &storage_dir) {
+    std::ifstream in(storage_dir + "/codec");
+    std::string codec;
+    if (!(in >> codec)) {
+        return default_codec;
+    }
+    return codec;
 }
 
 std::string ContentAddressedStorage::load(const std::string &hash) const {
+    std::string filepath = blob_path(hash);
+
+    std::ifstream in(filepath, std::ios::binary | std::ios::ate);
+    if (!in) {
+        throw std::runtime_error("Content not found in storage: " + hash);
+    }
+
+    std::vector<Bytef> compressed_data(in.tellg());
+    in.seekg(0);
+    if (!in.read(reinterpret_cast<char*>(compressed_data.data()), compressed_data.size())) {
+        throw std::runtime_error("Failed to read content from storage: " + hash);
+    }
+
+    bool has_header = compressed_data.size() >= blob_header_size
+        && std::equal(std::begin(blob_magic), std::end(blob_magic), compressed_data.begin());
+    if (!has_header) {
+        return decompress_content(compressed_data);
+    }
+
+    auto id = static_cast<Codec::Id>(compressed_data[4]);
+    uint64_t size = 0;
+    for (int i = 0; i < 8; ++i) {
+        size |= static_cast<uint64_t>(compressed_data[8 + i]) << (8 * i);
+    }
+    if (size == 0) {
+        return "";
+    }
+
+    std::shared_ptr<const Codec> codec;
+    if (id == Codec::Id::ZstdDictionary) {
+        if (!m_dictionary_codec) {
+            throw std::runtime_error("The zstd dictionary of the storage is missing, needed for: " + hash);
+        }
+        codec = m_dictionary_codec;
+    } else {
+        /* the codecs without a dictionary are stateless, one instance per id is enough */
+        static const std::shared_ptr<const Codec> codecs[] = {
+            Codec::create(Codec::Id::Zlib), Codec::create(Codec::Id::Zstd), Codec::create(Codec::Id::Lz4)
+        };
+        for (const auto &candidate: codecs) {
+            if (candidate->get_id() == id) {
+                codec = candidate;
+            }
+        }
+        if (!codec) {
+            throw std::runtime_error("Unknown codec in blob: " + hash);
+        }
+    }
 
-    //std::ifstream in(compressed_content_path, std::ios::binary);
-    //std::vector<Bytef> compressed_data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
-    return "";
+    return codec->decompress(compressed_data.data() + blob_header_size, compressed_data.size() - blob_header_size, size);
 }
 
 bool ContentAddressedStorage::exists(const std::string &hash) const {
-    return true;
+    std::error_code ec;
+    return std::filesystem::exists(blob_path(hash), ec);
 }
 
+ContentAddressedStorage::BlobCheck ContentAddressedStorage::verify(const std::string &hash) const {
+    BlobCheck check;
+    std::error_code ec;
+    check.stored_bytes = std::filesystem::file_size(blob_path(hash), ec);
+    if (ec) {
+        check.status = BlobCheck::Status::Missing;
+        check.stored_bytes = 0;
+        return check;
+    }
+
+    try {
+        std::string content = load(hash);
+        check.content_bytes = content.size();
+        if (compute_sha256(content) != hash) {
+            check.status = BlobCheck::Status::Corrupt;
+            check.error = "content does not match its hash";
+        }
+    } catch (std::exception &e) {
+        check.status = BlobCheck::Status::Corrupt;
+        check.error = e.what();
+    }
+    return check;
+}
+
+/* blobs are named by the hex SHA-256 of their content, e.g. the dictionary and the index files are not blobs */
+std::vector<std::string> ContentAddressedStorage::list_blobs() const {
+    std::vector<std::string> hashes;
+    for (const auto &entry: std::filesystem::directory_iterator(m_storage_dir)) {
+        if (!entry.is_regular_file() || entry.path().extension() != ".z") {
+            continue;
+        }
+        std::string hash = entry.path().stem().string();
+        bool is_hash = hash.size() == 2 * SHA256_DIGEST_LENGTH
+            && std::all_of(hash.begin(), hash.end(), [](char c) { return std::isdigit(c) || (c >= 'a' && c <= 'f'); });
+        if (is_hash) {
+            hashes.push_back(hash);
+        }
+    }
+    return hashes;
+}
 
-std::string ContentAddressedStorage::compute_sha256(const std::string &data) const {
+bool ContentAddressedStorage::quarantine(const std::string &hash) {
+    std::filesystem::create_directories(quarantine_dir());
+
+    std::error_code ec;
+    std::filesystem::rename(blob_path(hash), quarantine_dir() + "/" + hash + ".z", ec);
+    return !ec;
+}
+
+std::string ContentAddressedStorage::compute_sha256(std::string_view data) {
     unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256(reinterpret_cast<const unsigned char*>(data.c_str()), data.size(), hash);
+    SHA256(reinterpret_cast<const unsigned char*>(data.data()), data.size(), hash);
 
     std::ostringstream oss;
     for (int i = 0; i < SHA256_DIGEST_LENGTH; ++i) {
@@ -59,30 +331,41 @@ std::string ContentAddressedStorage::compute_sha256(const std::string &data) con
     return oss.str();
 }
 
-std::vector<Bytef> ContentAddressedStorage::compress_content(const std::string &data) const {
-    uLong src_len = data.size();
-    uLong dest_len = compressBound(src_len);
-    std::vector<Bytef> compressed_data(dest_len);
+std::string ContentAddressedStorage::blob_path(const std::string &hash) const {
+    return m_storage_dir + "/" + hash + ".z";
+}
 
-    int res = compress(compressed_data.data(), &dest_len, reinterpret_cast<const Bytef*>(data.data()), src_len);
+std::string ContentAddressedStorage::dictionary_path() const {
+    return m_storage_dir + "/zstd.dict";
+}
 
-    if (res != Z_OK) {
-        throw std::runtime_error("Compression failed");
-    }
+std::string ContentAddressedStorage::codec_path() const {
+    return m_storage_dir + "/codec";
+}
 
-    return compressed_data;
+std::string ContentAddressedStorage::quarantine_dir() const {
+    return m_storage_dir + "/quarantine";
 }
 
+/* blobs without header, zlib without the uncompressed size */
 std::string ContentAddressedStorage::decompress_content(std::vector<Bytef> &data) const {
-    /* 10 MB Buffer */
-    uLongf decompressed_size = 10 * 1024 * 1024; 
-    std::vector<char> decompressed(decompressed_size);
+    /* the uncompressed size is not stored, start with a guess and grow the buffer until it fits */
+    uLongf buffer_size = std::max<uLongf>(data.size() * 4, 64 * 1024);
+    const uLongf max_buffer_size = 1024UL * 1024 * 1024;
 
-    int res = uncompress(reinterpret_cast<Bytef*>(decompressed.data()), &decompressed_size, data.data(), data.size());
+    while (true) {
+        std::string decompressed(buffer_size, '\0');
+        uLongf decompressed_size = buffer_size;
 
-    if (res != Z_OK) {
-        throw std::runtime_error("Failed to decompress document content.");
-    }
+        int res = uncompress(reinterpret_cast<Bytef*>(decompressed.data()), &decompressed_size, data.data(), data.size());
 
-    return std::string(decompressed.data(), decompressed_size);
+        if (res == Z_OK) {
+            decompressed.resize(decompressed_size);
+            return decompressed;
+        }
+        if (res != Z_BUF_ERROR || buffer_size >= max_buffer_size) {
+            throw std::runtime_error("Failed to decompress document content.");
+        }
+        buffer_size *= 2;
+    }
 }
\ No newline at end of file
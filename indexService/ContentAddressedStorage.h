@@ -1,32 +1,117 @@
 #ifndef _H_CAS
 #define _H_CAS
 
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include <zlib.h>
 
+#include "Codec.h"
+#include "IOBackend.h"
+
 /*
 *   Stores files in a directory by the files hash, files are compressed before storage.
 *   The Hash of the original file content is used for storage
+*
+*   Blob layout, integers little endian:
+*       "CBLB", u8 codec id, 3 bytes zero, u64 uncompressed size, compressed content
+*   Blobs without the magic were written before the header existed and are plain zlib.
+*
+*   With the zstd codec the first documents are kept back as samples to train a dictionary,
+*   which is stored as zstd.dict next to the blobs. They are written once the dictionary is trained,
+*   at the latest by flush. flush also saves the name of the codec as codec next to the blobs,
+*   tools that open an existing storage use it, see saved_codec.
 */
 class ContentAddressedStorage {
     public:
-        ContentAddressedStorage(const std::string &storage_dir);
+        /* with train false, zstd without a saved dictionary compresses without one */
+        ContentAddressedStorage(const std::string &storage_dir, const std::string &codec = default_codec, bool train = true);
         ~ContentAddressedStorage() = default;
 
-        /* stores content and returns hash */
-        std::string store(const std::string &content);
+        /* stores content and returns hash, content that is already stored is not written again */
+        std::string store(std::string_view content);
         /* searches hash and returns uncompressed content */
         std::string load(const std::string &hash) const;
 
+        /* true if the blob is on disk, blobs of pending writes may not be */
         bool exists(const std::string &hash) const;
 
+        /* result of reading a blob back, see verify */
+        struct BlobCheck {
+            enum class Status { Ok, Missing, Corrupt };
+            Status status = Status::Ok;
+            /* size of the blob on disk and of the decompressed content */
+            uint64_t stored_bytes = 0;
+            uint64_t content_bytes = 0;
+            std::string error;
+        };
+
+        /* reads the blob and checks that it decompresses to content with this hash */
+        BlobCheck verify(const std::string &hash) const;
+        /* hashes of all blobs on disk, other files in the directory are ignored */
+        std::vector<std::string> list_blobs() const;
+        /* moves the blob into the quarantine directory of the storage, false if there is no blob */
+        bool quarantine(const std::string &hash);
+
+        /* with a backend, blobs are written asynchronously and flush has to be called before they are read */
+        void set_io_backend(std::shared_ptr<IOBackend> io);
+        /* waits for all pending writes, throws std::runtime_error if one of them failed */
+        void flush();
+
+        static constexpr const char *default_codec = "zstd";
+        /* the dictionary is trained when either limit is reached, larger documents are not used as samples */
+        static constexpr size_t dictionary_samples = 1000;
+        static constexpr size_t dictionary_sample_bytes = 16 * 1024 * 1024;
+        static constexpr size_t max_sample_size = 64 * 1024;
+
+        static std::string compute_sha256(std::string_view data);
+        /* the codec the storage was written with, default_codec if it has not been saved */
+        static std::string saved_codec(const std::string &storage_dir);
+
     private:
+        static constexpr char blob_magic[4] = {'C', 'B', 'L', 'B'};
+        static constexpr size_t blob_header_size = 16;
+
         std::string m_storage_dir;
 
-        std::string compute_sha256(const std::string &data) const;
-        std::vector<Bytef> compress_content(const std::string &data) const;
+        std::shared_ptr<IOBackend> m_io;
+        /* at most the queue depth of writes is pending, a further write waits for the oldest one */
+        std::mutex m_writes_mutex;
+        std::deque<std::future<void>> m_pending_writes;
+        /* first failure of an already awaited write, reported by flush */
+        std::string m_write_error;
+        /* a blob was written since the last flush, which saves the codec name */
+        std::atomic<bool> m_written{false};
+
+        /* codec for new blobs, replaced by the dictionary codec after training */
+        std::string m_codec_name;
+        std::mutex m_codec_mutex;
+        std::shared_ptr<const Codec> m_codec;
+        /* reads and writes Id::ZstdDictionary blobs, only set if zstd.dict exists or was trained */
+        std::shared_ptr<const Codec> m_dictionary_codec;
+
+        bool m_training = false;
+        std::vector<std::pair<std::string, std::string>> m_samples;
+        size_t m_sample_bytes = 0;
+
+        /* takes the samples and stops sampling, called with the codec mutex held */
+        std::vector<std::pair<std::string, std::string>> take_samples();
+        /* called without the codec mutex, the samples are written with the new codec */
+        void train_dictionary(const std::vector<std::pair<std::string, std::string>> &samples);
+        void write_blob(const std::string &hash, std::string_view content, const Codec &codec);
+        std::string blob_path(const std::string &hash) const;
+        std::string dictionary_path() const;
+        std::string codec_path() const;
+        std::string quarantine_dir() const;
+
         std::string decompress_content(std::vector<Bytef> &data) const;
 };
 
-#endif
\ No newline at end of file
+#endif
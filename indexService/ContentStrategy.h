@@ -2,11 +2,51 @@
 #define _H_CONTENTSTRATEGY
 
 #include <string>
+#include <string_view>
+#include <utility>
+
+#include "MappedFile.h"
+
+/*
+*   Text of a document, either extracted into a string or the mapped file itself for plain text.
+*   The view is valid as long as the Content lives, a mapped file is unmapped when it is destroyed.
+*/
+class Content {
+   public:
+    explicit Content(std::string text) : m_text(std::move(text)) {}
+    explicit Content(MappedFile file) : m_file(std::move(file)) {}
+
+    std::string_view view() const {
+        if (m_file.is_open()) {
+            return std::string_view(reinterpret_cast<const char*>(m_file.data()), m_file.size());
+        }
+        return m_text;
+    }
+
+   private:
+    std::string m_text;
+    MappedFile m_file;
+};
 
 class ContentStrategy {
    public:
     virtual ~ContentStrategy() = default;
     virtual std::string read_content(const std::string &filepath) const = 0;
+
+    /* view based read, strategies that can hand out the file without copying it override this */
+    virtual Content read_view(const std::string &filepath) const {
+        return Content(read_content(filepath));
+    }
+
+    /*
+    *   Strategies that extract the text from the bytes of the file return true, the index then reads
+    *   the file with its IOBackend and hands the bytes to parse_raw. The others read the file themselves.
+    */
+    virtual bool parses_raw() const { return false; }
+    virtual Content parse_raw(const std::string &filepath, std::string raw) const {
+        (void)raw;
+        return read_view(filepath);
+    }
 };
 
-#endif
\ No newline at end of file
+#endif
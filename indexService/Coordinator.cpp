@@ -0,0 +1,448 @@
+#include <algorithm>
+#include <iostream>
+
+#include <boost/beast/core.hpp>
+
+#include "Coordinator.h"
+#include "Logger.h"
+#include "Query.h"
+
+namespace asio = boost::asio;
+namespace beast = boost::beast;
+namespace http = beast::http;
+using tcp = asio::ip::tcp;
+using json = nlohmann::json;
+
+/* state of one round of requests to the shards */
+struct Coordinator::Gather {
+    struct ShardState {
+        bool finished = false;
+        size_t first_replica = 0;
+        size_t attempts = 0;
+        size_t in_flight = 0;
+        std::unique_ptr<asio::steady_timer> hedge_timer;
+    };
+
+    Gather(asio::io_context &io, size_t shards) : deadline_timer(io), replies(shards), state(shards) {}
+
+    std::string target;
+    std::vector<std::string> bodies;
+    std::chrono::steady_clock::time_point deadline;
+    asio::steady_timer deadline_timer;
+    std::vector<ShardReply> replies;
+    std::vector<ShardState> state;
+    size_t pending = 0;
+    bool done = false;
+    GatherCallback callback;
+};
+
+namespace {
+
+/* HTTP front end of the coordinator, like Session, the answer to a query is written when the shards answered */
+class CoordinatorSession : public std::enable_shared_from_this<CoordinatorSession> {
+    public:
+        CoordinatorSession(tcp::socket socket, Coordinator &coordinator)
+            : m_stream(std::move(socket)), m_coordinator(coordinator) {}
+
+        void start() {
+            read_request();
+        }
+
+    private:
+        beast::tcp_stream m_stream;
+        beast::flat_buffer m_buffer;
+        http::request<http::string_body> m_request;
+        http::response<http::string_body> m_response;
+        Coordinator &m_coordinator;
+
+        static constexpr std::chrono::seconds keep_alive_timeout{30};
+
+        void read_request() {
+            auto self = shared_from_this();
+            m_request = {};
+            m_stream.expires_after(keep_alive_timeout);
+            http::async_read(m_stream, m_buffer, m_request, [self](beast::error_code ec, std::size_t) {
+                if (!ec) {
+                    self->handle_request();
+                } else if (ec != http::error::end_of_stream && ec != beast::error::timeout) {
+                    Logger::error() << "ERROR: reading http request: " << ec.message();
+                }
+            });
+        }
+
+        void handle_request() {
+            std::string target(m_request.target());
+            if (target == "/statistics") {
+                respond(http::status::ok, m_coordinator.get_statistics());
+                return;
+            }
+            if (target != "/query" || m_request.method() != http::verb::post) {
+                respond(http::status::not_found, {{"error", "404 Not Found"}});
+                return;
+            }
+
+            auto self = shared_from_this();
+            try {
+                m_coordinator.query(json::parse(m_request.body()), [self](http::status status, json body) {
+                    self->respond(status, body);
+                });
+            } catch (const json::parse_error &e) {
+                respond(http::status::bad_request, {{"error", "Malformed JSON in request body"}});
+            } catch (const json::type_error &e) {
+                respond(http::status::bad_request, {{"error", "Invalid type of a query option"}});
+            }
+        }
+
+        void respond(http::status status, const json &body) {
+            m_response = {status, 11};
+            m_response.set(http::field::server, "Cearch");
+            m_response.set(http::field::content_type, "application/json");
+            m_response.body() = body.dump();
+            m_response.keep_alive(m_request.keep_alive());
+            m_response.prepare_payload();
+
+            auto self = shared_from_this();
+            m_stream.expires_after(keep_alive_timeout);
+            http::async_write(m_stream, m_response, [self](beast::error_code ec, std::size_t) {
+                if (ec) {
+                    Logger::error() << "ERROR: writing http response: " << ec.message();
+                } else if (self->m_response.keep_alive()) {
+                    self->read_request();
+                } else {
+                    beast::error_code shutdown_ec;
+                    self->m_stream.socket().shutdown(tcp::socket::shutdown_send, shutdown_ec);
+                }
+            });
+        }
+};
+
+}
+
+Coordinator::Coordinator(asio::io_context &io, unsigned short port, const std::vector<std::vector<std::string>> &shards,
+    CoordinatorOptions options)
+    : m_io(io), m_acceptor(io), m_options(options)
+{
+    if (shards.empty()) {
+        throw std::invalid_argument("The coordinator needs at least one shard");
+    }
+    for (const auto &replicas: shards) {
+        auto shard = std::make_unique<Shard>();
+        shard->client = std::make_unique<ShardClient>(io, replicas);
+        m_shards.push_back(std::move(shard));
+    }
+
+    tcp::endpoint endpoint(tcp::v4(), port);
+    m_acceptor.open(endpoint.protocol());
+    m_acceptor.set_option(asio::socket_base::reuse_address(true));
+    m_acceptor.bind(endpoint);
+    m_acceptor.listen(asio::socket_base::max_listen_connections);
+    do_accept();
+}
+
+void Coordinator::do_accept() {
+    m_acceptor.async_accept([this](boost::system::error_code error_code, tcp::socket socket) {
+        if (!error_code) {
+            socket.set_option(tcp::no_delay(true), error_code);
+            std::make_shared<CoordinatorSession>(std::move(socket), *this)->start();
+            do_accept();
+        } else {
+            std::cerr << "ERROR: " << error_code << std::endl;
+        }
+    });
+}
+
+void Coordinator::query(const json &request, QueryCallback callback) {
+    if (!request.contains("query") || !request["query"].is_string()) {
+        callback(http::status::bad_request, {{"error", "Missing or invalid 'query' field in JSON body"}});
+        return;
+    }
+    if (request.contains("mode") && request["mode"] == "impact") {
+        callback(http::status::bad_request, {{"error", "Impact ordered search is scored with local statistics, it is not supported across shards"}});
+        return;
+    }
+
+    size_t top_k = m_options.default_top_k;
+    if (request.contains("top_k")) {
+        top_k = request["top_k"].get<size_t>();
+    }
+    auto timeout = std::chrono::steady_clock::duration(m_options.timeout);
+    if (request.contains("timeout_ms")) {
+        timeout = std::chrono::milliseconds(request["timeout_ms"].get<int64_t>());
+    }
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    /* first round: the statistics of the whole collection */
+    std::vector<std::string> bodies(m_shards.size(), json{{"query", request["query"]}}.dump());
+    scatter("/shard/stats", std::move(bodies), deadline, [this, request, top_k, deadline, callback](std::vector<ShardReply> replies) {
+        CollectionStats stats;
+        std::vector<bool> queried(m_shards.size(), false);
+        json failures = json::array();
+        for (size_t i = 0; i < replies.size(); ++i) {
+            if (replies[i].status == 400) {
+                /* the query itself is invalid, every shard would say so */
+                json error = json::parse(replies[i].body, nullptr, false);
+                callback(http::status::bad_request, error.is_discarded() ? json{{"error", replies[i].body}} : error);
+                return;
+            }
+            json shard_stats = json::parse(replies[i].body, nullptr, false);
+            if (replies[i].status != 200 || shard_stats.is_discarded()) {
+                failures.push_back({{"shard", i}, {"error", replies[i].status != 0 ? "status " + std::to_string(replies[i].status) : replies[i].error}});
+                continue;
+            }
+            stats.add(CollectionStats::from_json(shard_stats));
+            queried[i] = true;
+        }
+        if (std::none_of(queried.begin(), queried.end(), [](bool q) { return q; })) {
+            callback(http::status::service_unavailable, {{"error", "No shard answered"}, {"failed", failures}});
+            return;
+        }
+
+        /* second round: every shard scores with the collection statistics */
+        json shard_request = request;
+        shard_request["collection_stats"] = stats.to_json();
+        shard_request["top_k"] = top_k;
+        if (request.contains("timeout_ms")) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            shard_request["timeout_ms"] = std::max<int64_t>(1, remaining.count());
+        }
+        std::string body = shard_request.dump();
+        std::vector<std::string> query_bodies(m_shards.size());
+        for (size_t i = 0; i < m_shards.size(); ++i) {
+            if (queried[i]) {
+                query_bodies[i] = body;
+            }
+        }
+
+        scatter("/query", std::move(query_bodies), deadline, [this, top_k, queried, failures, callback](std::vector<ShardReply> replies) {
+            merge_results(top_k, queried, replies, failures, callback);
+        });
+    });
+}
+
+void Coordinator::merge_results(size_t top_k, const std::vector<bool> &queried, const std::vector<ShardReply> &replies,
+    json failures, const QueryCallback &callback) const
+{
+    json hits = json::array();
+    json stats = json::object();
+    bool partial = !failures.empty();
+    size_t answered = 0;
+    for (size_t i = 0; i < replies.size(); ++i) {
+        if (!queried[i]) {
+            continue;
+        }
+        json body = json::parse(replies[i].body, nullptr, false);
+        if (replies[i].status != 200 || body.is_discarded()) {
+            failures.push_back({{"shard", i}, {"error", replies[i].status != 0 ? "status " + std::to_string(replies[i].status) : replies[i].error}});
+            partial = true;
+            continue;
+        }
+
+        answered++;
+        partial = partial || body.value("partial", false);
+        if (body.contains("results")) {
+            for (auto &hit: body["results"]) {
+                hit["shard"] = i;
+                hits.push_back(std::move(hit));
+            }
+        }
+        /* the work of all shards, the elapsed time of the slowest one */
+        if (body.contains("stats")) {
+            for (const auto &[key, value]: body["stats"].items()) {
+                if (!value.is_number()) {
+                    continue;
+                }
+                if (value.is_number_float()) {
+                    double current = stats.value(key, 0.0);
+                    stats[key] = key == "elapsed_ms" ? std::max(current, value.get<double>()) : current + value.get<double>();
+                } else {
+                    stats[key] = stats.value(key, uint64_t(0)) + value.get<uint64_t>();
+                }
+            }
+        }
+    }
+
+    /* ties in a fixed order, so the same query gives the same answer */
+    std::sort(hits.begin(), hits.end(), [](const json &a, const json &b) {
+        double score_a = a.value("score", 0.0);
+        double score_b = b.value("score", 0.0);
+        if (score_a != score_b) {
+            return score_a > score_b;
+        }
+        if (a["shard"] != b["shard"]) {
+            return a["shard"].get<size_t>() < b["shard"].get<size_t>();
+        }
+        return a.value("docid", uint64_t{0}) < b.value("docid", uint64_t{0});
+    });
+    if (top_k > 0 && hits.size() > top_k) {
+        hits.erase(hits.begin() + top_k, hits.end());
+    }
+
+    json response;
+    response["results"] = std::move(hits);
+    response["partial"] = partial;
+    response["stats"] = std::move(stats);
+    response["shards"] = {
+        {"total", replies.size()},
+        {"answered", answered},
+        {"failed", std::move(failures)}
+    };
+    callback(http::status::ok, std::move(response));
+}
+
+void Coordinator::scatter(const std::string &target, std::vector<std::string> bodies,
+    std::chrono::steady_clock::time_point deadline, GatherCallback callback)
+{
+    auto gather = std::make_shared<Gather>(m_io, m_shards.size());
+    gather->target = target;
+    gather->bodies = std::move(bodies);
+    gather->deadline = deadline;
+    gather->callback = std::move(callback);
+    for (size_t i = 0; i < m_shards.size(); ++i) {
+        if (gather->bodies[i].empty()) {
+            gather->state[i].finished = true;
+        } else {
+            gather->pending++;
+        }
+    }
+    if (gather->pending == 0) {
+        asio::post(m_io, [this, gather]() { complete(gather); });
+        return;
+    }
+
+    gather->deadline_timer.expires_at(deadline);
+    gather->deadline_timer.async_wait([this, gather](boost::system::error_code ec) {
+        if (!ec) {
+            complete(gather);
+        }
+    });
+
+    for (size_t i = 0; i < m_shards.size(); ++i) {
+        if (gather->state[i].finished) {
+            continue;
+        }
+        send_attempt(gather, i, false);
+
+        /* hedging needs another replica, a single one would only queue the request behind the slow one */
+        if (m_shards[i]->client->get_replica_count() > 1) {
+            auto &timer = gather->state[i].hedge_timer;
+            timer = std::make_unique<asio::steady_timer>(m_io, hedge_delay(*m_shards[i]));
+            timer->async_wait([this, gather, i](boost::system::error_code ec) {
+                if (ec || gather->done || gather->state[i].finished) {
+                    return;
+                }
+                m_shards[i]->hedges++;
+                send_attempt(gather, i, true);
+            });
+        }
+    }
+}
+
+void Coordinator::send_attempt(std::shared_ptr<Gather> gather, size_t shard_index, bool hedge) {
+    Shard &shard = *m_shards[shard_index];
+    auto &state = gather->state[shard_index];
+    size_t replicas = shard.client->get_replica_count();
+    if (state.attempts == 0) {
+        /* the first attempts go round robin over the replicas */
+        state.first_replica = shard.next_replica++ % replicas;
+    }
+    size_t replica = (state.first_replica + state.attempts) % replicas;
+    state.attempts++;
+    state.in_flight++;
+    shard.requests++;
+
+    auto start = std::chrono::steady_clock::now();
+    shard.client->post(replica, gather->target, gather->bodies[shard_index], gather->deadline,
+        [this, gather, shard_index, hedge, start](ShardReply reply) {
+            Shard &shard = *m_shards[shard_index];
+            auto &state = gather->state[shard_index];
+            state.in_flight--;
+
+            /* a bad request is an answer, the query is invalid */
+            bool failed = reply.status == 0 || reply.status >= 500;
+            if (failed) {
+                shard.failures++;
+            } else {
+                shard.latencies.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+            }
+            if (gather->done || state.finished) {
+                return;
+            }
+
+            if (!failed) {
+                if (hedge) {
+                    shard.hedge_wins++;
+                }
+                finish_shard(gather, shard_index, std::move(reply));
+                return;
+            }
+            /* the other attempt may still answer, otherwise the next replica is tried */
+            if (state.in_flight > 0) {
+                return;
+            }
+            if (state.attempts < shard.client->get_replica_count() && std::chrono::steady_clock::now() < gather->deadline) {
+                send_attempt(gather, shard_index, false);
+                return;
+            }
+            finish_shard(gather, shard_index, std::move(reply));
+        });
+}
+
+void Coordinator::finish_shard(std::shared_ptr<Gather> gather, size_t shard, ShardReply reply) {
+    auto &state = gather->state[shard];
+    state.finished = true;
+    if (state.hedge_timer) {
+        state.hedge_timer->cancel();
+    }
+    gather->replies[shard] = std::move(reply);
+    if (--gather->pending == 0) {
+        complete(gather);
+    }
+}
+
+void Coordinator::complete(std::shared_ptr<Gather> gather) {
+    if (gather->done) {
+        return;
+    }
+    gather->done = true;
+    gather->deadline_timer.cancel();
+    for (size_t i = 0; i < gather->state.size(); ++i) {
+        auto &state = gather->state[i];
+        if (state.hedge_timer) {
+            state.hedge_timer->cancel();
+        }
+        if (!state.finished) {
+            gather->replies[i].error = "timed out";
+        }
+    }
+    auto callback = std::move(gather->callback);
+    callback(std::move(gather->replies));
+}
+
+std::chrono::steady_clock::duration Coordinator::hedge_delay(const Shard &shard) const {
+    if (shard.latencies.get_count() < m_options.min_hedge_samples) {
+        return m_options.default_hedge_delay;
+    }
+    auto p95 = std::chrono::nanoseconds(shard.latencies.value_at_quantile(0.95));
+    return std::max<std::chrono::steady_clock::duration>(p95, m_options.min_hedge_delay);
+}
+
+json Coordinator::get_statistics() const {
+    json shards = json::array();
+    for (const auto &shard: m_shards) {
+        json replicas = json::array();
+        for (size_t r = 0; r < shard->client->get_replica_count(); ++r) {
+            replicas.push_back(shard->client->get_address(r));
+        }
+        shards.push_back({
+            {"replicas", replicas},
+            {"requests", shard->requests},
+            {"failures", shard->failures},
+            {"hedges", shard->hedges},
+            {"hedge_wins", shard->hedge_wins},
+            {"p50_ms", shard->latencies.value_at_quantile(0.5) / 1e6},
+            {"p95_ms", shard->latencies.value_at_quantile(0.95) / 1e6},
+            {"hedge_delay_ms", std::chrono::duration<double, std::milli>(hedge_delay(*shard)).count()}
+        });
+    }
+    return {{"shards", shards}};
+}
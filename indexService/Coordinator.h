@@ -0,0 +1,91 @@
+#ifndef _H_COORDINATOR
+#define _H_COORDINATOR
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/beast/http.hpp>
+#include <nlohmann/json.hpp>
+
+#include "Metrics.h"
+#include "ShardClient.h"
+
+struct CoordinatorOptions {
+    /* the answer contains the shards that responded by then, unless the query has its own "timeout_ms" */
+    std::chrono::milliseconds timeout{1000};
+    /* a shard slower than its 95th percentile gets a hedged request to its next replica, but not sooner than this */
+    std::chrono::milliseconds min_hedge_delay{2};
+    /* hedge delay of a shard with fewer than min_hedge_samples answers */
+    std::chrono::milliseconds default_hedge_delay{20};
+    size_t min_hedge_samples = 20;
+    /* results per query if the query has no "top_k" */
+    size_t default_top_k = 10;
+};
+
+/*
+*   Scatter-gather search over cearch shards, every shard holds a part of the documents.
+*   A query runs in two rounds, each sent to all shards in parallel:
+*       1. POST /shard/stats collects the document counts and the document frequencies of the query terms,
+*          the sums are the statistics of the whole collection
+*       2. POST /query with these "collection_stats", so every shard scores like a single index would,
+*          the per shard top k are merged into the global top k
+*   Results are identified by the shard and its docid.
+*
+*   Slow shards are hedged: when a replica has not answered within the shard's 95th percentile latency the request
+*   is sent to the next replica as well and the first answer wins. A failing replica is replaced by the next one.
+*   Shards without an answer by the deadline are left out, the response is then "partial" and names them.
+*   Everything runs on the thread of the io_context.
+*/
+class Coordinator {
+    public:
+        using QueryCallback = std::function<void(boost::beast::http::status, nlohmann::json)>;
+
+        /* @param shards the replicas of every shard as host:port */
+        Coordinator(boost::asio::io_context &io, unsigned short port, const std::vector<std::vector<std::string>> &shards,
+            CoordinatorOptions options = {});
+
+        /* the request is the body of a /query, impact ordered search is not supported */
+        void query(const nlohmann::json &request, QueryCallback callback);
+
+        /* requests, failures, hedges and latencies per shard */
+        nlohmann::json get_statistics() const;
+
+    private:
+        struct Shard {
+            std::unique_ptr<ShardClient> client;
+            /* answers in nanoseconds, for the hedge delay */
+            Histogram latencies;
+            size_t next_replica = 0;
+            uint64_t requests = 0;
+            uint64_t failures = 0;
+            uint64_t hedges = 0;
+            uint64_t hedge_wins = 0;
+        };
+        struct Gather;
+        using GatherCallback = std::function<void(std::vector<ShardReply>)>;
+
+        boost::asio::io_context &m_io;
+        boost::asio::ip::tcp::acceptor m_acceptor;
+        std::vector<std::unique_ptr<Shard>> m_shards;
+        CoordinatorOptions m_options;
+
+        void do_accept();
+
+        /* sends the body of every shard to it, shards with an empty body are skipped */
+        void scatter(const std::string &target, std::vector<std::string> bodies,
+            std::chrono::steady_clock::time_point deadline, GatherCallback callback);
+        void send_attempt(std::shared_ptr<Gather> gather, size_t shard, bool hedge);
+        void finish_shard(std::shared_ptr<Gather> gather, size_t shard, ShardReply reply);
+        void complete(std::shared_ptr<Gather> gather);
+        std::chrono::steady_clock::duration hedge_delay(const Shard &shard) const;
+
+        /* queried marks the shards of the second round, failures has the shards lost in the first one */
+        void merge_results(size_t top_k, const std::vector<bool> &queried, const std::vector<ShardReply> &replies,
+            nlohmann::json failures, const QueryCallback &callback) const;
+};
+
+#endif
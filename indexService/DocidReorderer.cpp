@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <future>
+#include <numeric>
+
+#include "DocidReorderer.h"
+
+DocidReorderer::Scratch::Scratch(size_t term_count)
+    : left_degrees(term_count), right_degrees(term_count), left_gains(term_count), right_gains(term_count), seen(term_count)
+{
+}
+
+DocidReorderer::DocidReorderer(std::vector<std::vector<uint32_t>> documents, size_t term_count)
+    : m_documents(std::move(documents)), m_shared_terms(m_documents.size()), m_term_count(term_count)
+{
+    std::vector<uint32_t> doc_freqs(term_count, 0);
+    for (const auto &terms: m_documents) {
+        for (uint32_t term_id: terms) {
+            doc_freqs[term_id]++;
+        }
+    }
+    for (size_t i = 0; i < m_documents.size(); ++i) {
+        auto &terms = m_documents[i];
+        auto shared_end = std::partition(terms.begin(), terms.end(), [&doc_freqs](uint32_t term_id) {
+            return doc_freqs[term_id] > 1;
+        });
+        m_shared_terms[i] = shared_end - terms.begin();
+    }
+
+    m_log2.resize(m_documents.size() + 2, 0.0);
+    for (size_t i = 1; i < m_log2.size(); ++i) {
+        m_log2[i] = std::log2(static_cast<double>(i));
+    }
+}
+
+std::vector<uint32_t> DocidReorderer::reorder(size_t threads) const {
+    std::vector<uint32_t> order(m_documents.size());
+    std::iota(order.begin(), order.end(), 0);
+
+    /* the halves are bisected on their own threads down to one part per thread */
+    size_t parallel_depth = std::bit_width(std::max<size_t>(threads, 1) - 1);
+    Scratch scratch(m_term_count);
+    bisect(order, parallel_depth, scratch);
+    return order;
+}
+
+DocidReorderer::GapCost DocidReorderer::gap_cost(const std::vector<uint32_t> &order) const {
+    GapCost cost;
+    /* the docid of the previous posting of every term, docids start at 1 */
+    std::vector<uint32_t> previous(m_term_count, 0);
+    uint64_t postings = 0;
+    double bits = 0.0;
+    for (uint32_t docid = 1; docid <= order.size(); ++docid) {
+        for (uint32_t term_id: m_documents[order[docid - 1]]) {
+            uint32_t gap = docid - previous[term_id];
+            previous[term_id] = docid;
+            bits += m_log2[gap];
+            cost.varint_bytes += std::bit_width(gap) / 7 + (std::bit_width(gap) % 7 != 0);
+            postings++;
+        }
+    }
+    cost.bits_per_posting = postings > 0 ? bits / postings : 0.0;
+    return cost;
+}
+
+std::span<const uint32_t> DocidReorderer::shared_terms(uint32_t document) const {
+    return {m_documents[document].data(), m_shared_terms[document]};
+}
+
+void DocidReorderer::bisect(std::span<uint32_t> documents, size_t parallel_depth, Scratch &scratch) const {
+    if (documents.size() <= min_partition) {
+        std::sort(documents.begin(), documents.end());
+        return;
+    }
+
+    for (size_t i = 0; i < max_iterations; ++i) {
+        if (!swap_round(documents, scratch)) {
+            break;
+        }
+    }
+
+    auto left = documents.first(documents.size() / 2);
+    auto right = documents.subspan(documents.size() / 2);
+    if (parallel_depth == 0) {
+        bisect(left, 0, scratch);
+        bisect(right, 0, scratch);
+        return;
+    }
+    auto right_done = std::async(std::launch::async, [this, right, parallel_depth]() {
+        Scratch right_scratch(m_term_count);
+        bisect(right, parallel_depth - 1, right_scratch);
+    });
+    bisect(left, parallel_depth - 1, scratch);
+    right_done.get();
+}
+
+bool DocidReorderer::swap_round(std::span<uint32_t> documents, Scratch &scratch) const {
+    auto left = documents.first(documents.size() / 2);
+    auto right = documents.subspan(documents.size() / 2);
+
+    scratch.terms.clear();
+    auto count = [&scratch](std::span<const uint32_t> terms, std::vector<uint32_t> &degrees) {
+        for (uint32_t term_id: terms) {
+            if (!scratch.seen[term_id]) {
+                scratch.seen[term_id] = 1;
+                scratch.left_degrees[term_id] = 0;
+                scratch.right_degrees[term_id] = 0;
+                scratch.terms.push_back(term_id);
+            }
+            degrees[term_id]++;
+        }
+    };
+    for (uint32_t document: left) {
+        count(shared_terms(document), scratch.left_degrees);
+    }
+    for (uint32_t document: right) {
+        count(shared_terms(document), scratch.right_degrees);
+    }
+
+    /*
+    *   A term in d of the n documents of a half costs about d * log2(n / (d + 1)) bits there.
+    *   The gain of a document moving to the other half is the sum of what the move saves on each of its terms.
+    */
+    double log_left = m_log2[left.size()];
+    double log_right = m_log2[right.size()];
+    auto cost = [this, log_left, log_right](uint32_t left_degree, uint32_t right_degree) {
+        return left_degree * (log_left - m_log2[left_degree + 1]) + right_degree * (log_right - m_log2[right_degree + 1]);
+    };
+    for (uint32_t term_id: scratch.terms) {
+        scratch.seen[term_id] = 0;
+        uint32_t left_degree = scratch.left_degrees[term_id];
+        uint32_t right_degree = scratch.right_degrees[term_id];
+        double current = cost(left_degree, right_degree);
+        scratch.left_gains[term_id] = left_degree > 0 ? current - cost(left_degree - 1, right_degree + 1) : 0.0;
+        scratch.right_gains[term_id] = right_degree > 0 ? current - cost(left_degree + 1, right_degree - 1) : 0.0;
+    }
+
+    auto gains = [this](std::span<const uint32_t> half, const std::vector<double> &term_gains, auto &out) {
+        out.clear();
+        for (uint32_t document: half) {
+            double gain = 0.0;
+            for (uint32_t term_id: shared_terms(document)) {
+                gain += term_gains[term_id];
+            }
+            out.emplace_back(gain, document);
+        }
+        /* the largest gains first, ties in the current order so the result is deterministic */
+        std::sort(out.begin(), out.end(), [](const auto &a, const auto &b) {
+            return a.first > b.first || (a.first == b.first && a.second < b.second);
+        });
+    };
+    gains(left, scratch.left_gains, scratch.left);
+    gains(right, scratch.right_gains, scratch.right);
+
+    size_t swaps = 0;
+    while (swaps < scratch.left.size() && swaps < scratch.right.size()
+        && scratch.left[swaps].first + scratch.right[swaps].first > 0.0) {
+        swaps++;
+    }
+    for (size_t i = 0; i < swaps; ++i) {
+        left[i] = scratch.right[i].second;
+        right[i] = scratch.left[i].second;
+    }
+    for (size_t i = swaps; i < left.size(); ++i) {
+        left[i] = scratch.left[i].second;
+    }
+    for (size_t i = swaps; i < right.size(); ++i) {
+        right[i] = scratch.right[i].second;
+    }
+    return swaps > 0;
+}
@@ -0,0 +1,69 @@
+#ifndef _H_DOCIDREORDERER
+#define _H_DOCIDREORDERER
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/*
+*   Finds an order of the documents in which documents sharing terms are close, so the postings have small
+*   docid gaps and a query reads the documents of a term from few places of the document lengths and positions.
+*
+*   Recursive graph bisection (Dhulipala et al., "Compressing Graphs and Indexes with Recursive Graph Bisection"):
+*   the documents are split in two halves, then the documents whose move to the other half lowers the estimated
+*   cost of the gaps the most are swapped pairwise, for a few rounds. Both halves are split again the same way
+*   until a part has min_partition documents, which keep their current order. Terms of a single document cannot
+*   get smaller gaps and are left out of the bisection.
+*/
+class DocidReorderer {
+    public:
+        /* the docid gaps of the postings in an order */
+        struct GapCost {
+            /* the average log2 of the gaps, what the bisection minimizes */
+            double bits_per_posting = 0.0;
+            /* the gaps as varints, like the docid deltas of positions.bin */
+            uint64_t varint_bytes = 0;
+        };
+
+        /* the distinct term ids of every document, the documents in their current order */
+        DocidReorderer(std::vector<std::vector<uint32_t>> documents, size_t term_count);
+
+        /* the new order: at every new position the position of the document in the current order */
+        std::vector<uint32_t> reorder(size_t threads) const;
+        GapCost gap_cost(const std::vector<uint32_t> &order) const;
+
+        /* rounds of swaps per bisection, fewer if a round swaps nothing */
+        static constexpr size_t max_iterations = 20;
+        static constexpr size_t min_partition = 32;
+
+    private:
+        /* per thread, indexed by term id */
+        struct Scratch {
+            explicit Scratch(size_t term_count);
+
+            std::vector<uint32_t> left_degrees;
+            std::vector<uint32_t> right_degrees;
+            std::vector<double> left_gains;
+            std::vector<double> right_gains;
+            std::vector<uint8_t> seen;
+            /* the terms of the documents being bisected */
+            std::vector<uint32_t> terms;
+            /* move gain and document of both halves */
+            std::vector<std::pair<double, uint32_t>> left;
+            std::vector<std::pair<double, uint32_t>> right;
+        };
+
+        std::vector<std::vector<uint32_t>> m_documents;
+        /* the terms of a document that occur in other documents too come first */
+        std::vector<uint32_t> m_shared_terms;
+        size_t m_term_count;
+        /* log2 of 0 to the document count + 1, 0 for 0 */
+        std::vector<double> m_log2;
+
+        std::span<const uint32_t> shared_terms(uint32_t document) const;
+        void bisect(std::span<uint32_t> documents, size_t parallel_depth, Scratch &scratch) const;
+        /* one round of swaps between the halves, false if nothing was swapped */
+        bool swap_round(std::span<uint32_t> documents, Scratch &scratch) const;
+};
+
+#endif
@@ -38,16 +38,28 @@ const std::string& Document::get_content_hash() const {
     return m_content_hash;
 }
 
+void Document::set_file_stat(uint64_t size, int64_t mtime) {
+    m_file_size = size;
+    m_mtime = mtime;
+}
+
+void Document::set_docid(uint64_t docid) {
+    m_docid = docid;
+}
+
+uint64_t Document::get_file_size() const { return m_file_size; }
+int64_t Document::get_mtime() const { return m_mtime; }
+
 /* concordence contains every term in the document and its counter */
-std::unordered_map<std::string, int> Document::get_concordance() {
+const std::unordered_map<std::string, int> &Document::get_concordance() const {
     return concordance;
 }
 
-uint64_t Document::get_docid() {
+uint64_t Document::get_docid() const {
     return m_docid;
 }
 
-int Document::get_total_term_count() {
+int Document::get_total_term_count() const {
     return m_total_term_count;
 }
 
@@ -69,6 +81,18 @@ std::string Document::get_file_content_as_string() {
     return file_content;
 }
 
+Content Document::get_file_content() {
+    return m_strategy->read_view(filepath);
+}
+
+bool Document::parses_raw_content() const {
+    return m_strategy->parses_raw();
+}
+
+Content Document::parse_file_content(std::string raw) {
+    return m_strategy->parse_raw(filepath, std::move(raw));
+}
+
 std::string Document::read_content() {
     return m_strategy->read_content(filepath);
 }
@@ -81,7 +105,7 @@ bool Document::contains_term(const std::string &term) {
 }
 
 /*
-*   TODO: detect word that end with 's, remove the 's
+*   Possessives ('s) are stripped by the Analyzer before the word is cleaned
 */
 std::vector<std::string> Document::clean_word(std::string &word) {
     std::vector<std::string> clean_words;
@@ -113,6 +137,9 @@ nlohmann::json Document::to_json() const {
     return {
         {"docid", m_docid},
         {"content_hash", m_content_hash},
+        {"filepath", filepath},
+        {"file_size", m_file_size},
+        {"mtime", m_mtime},
         {"file_extension", file_extension},
         {"total_term_count", m_total_term_count},
         {"concordance", concordance},
@@ -34,16 +34,27 @@ class Document {
         void set_total_term_count(int term_count);
         void set_indexed_at(std::chrono::system_clock::time_point time);
         void set_content_hash(std::string &hash);
+        /* size and modification time of the file when it was indexed, to skip unchanged files */
+        void set_file_stat(uint64_t size, int64_t mtime);
+        /* only by the index, which keeps its documents by docid */
+        void set_docid(uint64_t docid);
 
         /* getter functions */
-        uint64_t get_docid();
-        int get_total_term_count();
-        std::unordered_map<std::string, int> get_concordance();
+        uint64_t get_docid() const;
+        int get_total_term_count() const;
+        const std::unordered_map<std::string, int> &get_concordance() const;
         int get_term_frequency(const std::string &term);
         std::string get_filepath() const;
         std::string get_extension();
         std::string get_file_content_as_string();
+        /* the content as a view, plain text files are mapped instead of copied */
+        Content get_file_content();
+        /* true if the text is extracted from the bytes of the file, which the caller reads */
+        bool parses_raw_content() const;
+        Content parse_file_content(std::string raw);
         const std::string& get_content_hash() const;
+        uint64_t get_file_size() const;
+        int64_t get_mtime() const;
 
         /* JSON Serialization, deserialization is done in DocumentFactory */
         nlohmann::json to_json() const;
@@ -56,6 +67,8 @@ class Document {
         std::unique_ptr<ContentStrategy> m_strategy;
         std::chrono::system_clock::time_point indexed_at;
         std::string m_content_hash;
+        uint64_t m_file_size = 0;
+        int64_t m_mtime = 0;
 
         /* every term in the document and a counter for that term */
         std::unordered_map<std::string, int> concordance;
@@ -43,10 +43,15 @@ std::unique_ptr<Document> DocumentFactory::from_json(const nlohmann::json &j) {
         throw std::runtime_error("Unsupported file extension in JSON: " + extension);
     }
 
-    auto doc = std::make_unique<Document>(docid, extension, std::move(strategy));
+    /* indexes written before incremental indexing have no file path, their documents are never matched to files */
+    auto doc = std::make_unique<Document>(docid, j.value("filepath", ""), extension, std::move(strategy));
 
     doc->set_content_hash(content_hash);
-    doc->set_concordance(j.at("concordance").get<std::unordered_map<std::string, int>>());
+    doc->set_file_stat(j.value("file_size", uint64_t(0)), j.value("mtime", int64_t(0)));
+    /* a read only index loads its documents without the concordances */
+    if (j.contains("concordance")) {
+        doc->set_concordance(j["concordance"].get<std::unordered_map<std::string, int>>());
+    }
     doc->set_total_term_count(j.at("total_term_count"));
     auto seconds_since_epoch = j.at("indexed_at").get<int64_t>();
     doc->set_indexed_at(std::chrono::system_clock::time_point(std::chrono::seconds(seconds_since_epoch)));
@@ -0,0 +1,192 @@
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "IOBackend.h"
+#ifdef CEARCH_HAVE_LIBURING
+#include "UringIOBackend.h"
+#endif
+
+namespace {
+
+/* blocking I/O on a fixed number of threads, the portable fallback */
+class ThreadPoolIOBackend : public IOBackend {
+    public:
+        explicit ThreadPoolIOBackend(size_t queue_depth);
+        ~ThreadPoolIOBackend() override;
+
+        std::future<std::string> read_file(const std::string &filepath) override;
+        std::future<void> write_file(const std::string &filepath, std::vector<uint8_t> data) override;
+        const char *name() const override { return "threads"; }
+
+    private:
+        std::vector<std::thread> m_threads;
+        std::deque<std::function<void()>> m_tasks;
+        std::mutex m_mutex;
+        std::condition_variable m_task_added;
+        bool m_stop = false;
+
+        void submit(std::function<void()> task);
+        void run();
+};
+
+ThreadPoolIOBackend::ThreadPoolIOBackend(size_t queue_depth)
+    : IOBackend(queue_depth)
+{
+    for (size_t i = 0; i < queue_depth; ++i) {
+        m_threads.emplace_back(&ThreadPoolIOBackend::run, this);
+    }
+}
+
+/* the queued operations are finished before the threads stop */
+ThreadPoolIOBackend::~ThreadPoolIOBackend() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_task_added.notify_all();
+    for (auto &thread: m_threads) {
+        thread.join();
+    }
+}
+
+std::future<std::string> ThreadPoolIOBackend::read_file(const std::string &filepath) {
+    auto task = std::make_shared<std::packaged_task<std::string()>>([filepath]() {
+        size_t size = 0;
+        int fd = open_for_read(filepath, size);
+
+        std::string content(size, '\0');
+        size_t done = 0;
+        while (done < size) {
+            ssize_t n = pread(fd, content.data() + done, size - done, done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                int error = errno;
+                close(fd);
+                throw std::runtime_error("Failed to read " + filepath + ": " + std::strerror(error));
+            }
+            if (n == 0) {
+                /* the file was truncated since it was opened */
+                content.resize(done);
+                break;
+            }
+            done += n;
+        }
+        close(fd);
+        return content;
+    });
+
+    auto future = task->get_future();
+    submit([task]() { (*task)(); });
+    return future;
+}
+
+std::future<void> ThreadPoolIOBackend::write_file(const std::string &filepath, std::vector<uint8_t> data) {
+    auto task = std::make_shared<std::packaged_task<void()>>([filepath, data = std::move(data)]() {
+        int fd = open_for_write(filepath);
+
+        size_t done = 0;
+        while (done < data.size()) {
+            ssize_t n = pwrite(fd, data.data() + done, data.size() - done, done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                int error = errno;
+                close(fd);
+                throw std::runtime_error("Failed to write " + filepath + ": " + std::strerror(error));
+            }
+            done += n;
+        }
+        close(fd);
+    });
+
+    auto future = task->get_future();
+    submit([task]() { (*task)(); });
+    return future;
+}
+
+void ThreadPoolIOBackend::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+    m_task_added.notify_one();
+}
+
+void ThreadPoolIOBackend::run() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_task_added.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+            if (m_tasks.empty()) {
+                return;
+            }
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+    }
+}
+
+}
+
+IOBackend::IOBackend(size_t queue_depth)
+    : m_queue_depth(queue_depth)
+{
+}
+
+size_t IOBackend::get_queue_depth() const { return m_queue_depth; }
+
+std::shared_ptr<IOBackend> IOBackend::create(size_t queue_depth) {
+    if (queue_depth == 0) {
+        return nullptr;
+    }
+
+#ifdef CEARCH_HAVE_LIBURING
+    try {
+        return std::make_shared<UringIOBackend>(queue_depth);
+    } catch (std::exception &e) {
+        std::cerr << "io_uring is not available, using threads for I/O: " << e.what() << std::endl;
+    }
+#endif
+
+    return std::make_shared<ThreadPoolIOBackend>(queue_depth);
+}
+
+int IOBackend::open_for_read(const std::string &filepath, size_t &size) {
+    int fd = open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open file: " + filepath + ": " + std::strerror(errno));
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int error = errno;
+        close(fd);
+        throw std::runtime_error("Failed to stat file: " + filepath + ": " + std::strerror(error));
+    }
+    size = st.st_size;
+    return fd;
+}
+
+int IOBackend::open_for_write(const std::string &filepath) {
+    int fd = open(filepath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to create file: " + filepath + ": " + std::strerror(errno));
+    }
+    return fd;
+}
@@ -0,0 +1,45 @@
+#ifndef _H_IOBACKEND
+#define _H_IOBACKEND
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+*   Asynchronous whole file reads and writes for indexing, source files and content storage blobs.
+*   At most queue_depth operations are in flight, further requests wait in the backend.
+*   With CEARCH_HAVE_LIBURING (make LIBURING=1) the operations are batched on an io_uring,
+*   otherwise, or if the kernel does not support io_uring, a pool of queue_depth threads does blocking I/O.
+*/
+class IOBackend {
+    public:
+        virtual ~IOBackend() = default;
+
+        IOBackend(const IOBackend &) = delete;
+        IOBackend &operator=(const IOBackend &) = delete;
+
+        /* the content of the file, the future throws std::runtime_error if it cannot be read */
+        virtual std::future<std::string> read_file(const std::string &filepath) = 0;
+        /* creates or replaces the file */
+        virtual std::future<void> write_file(const std::string &filepath, std::vector<uint8_t> data) = 0;
+
+        virtual const char *name() const = 0;
+        size_t get_queue_depth() const;
+
+        /* io_uring if available, the thread pool otherwise, nullptr for a queue depth of 0 (synchronous I/O) */
+        static std::shared_ptr<IOBackend> create(size_t queue_depth);
+
+    protected:
+        explicit IOBackend(size_t queue_depth);
+
+        size_t m_queue_depth;
+
+        /* throw std::runtime_error with the reason */
+        static int open_for_read(const std::string &filepath, size_t &size);
+        static int open_for_write(const std::string &filepath);
+};
+
+#endif
@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include "ImpactIndex.h"
+
+static_assert(std::endian::native == std::endian::little, "impact.bin is read in place as little endian");
+
+namespace {
+
+template <typename T>
+void write_array(std::ofstream &out, const T *data, size_t count) {
+    out.write(reinterpret_cast<const char*>(data), count * sizeof(T));
+}
+
+}
+
+/*
+*   Quantizes the BM25 score of every posting to 8 bit.
+*   One global scale is used for all terms, so impacts of different terms can be compared and summed.
+*   The scores are computed twice, once for the maximum that defines the scale and once per term while its
+*   segments are built, so only the quantized postings are held in memory.
+*/
+void ImpactIndex::save(const std::string &filepath, const PostingsFile &postings, const ScoreFunction &score) {
+    auto doc_lengths = postings.get_doc_lengths();
+    auto score_postings = [&](uint32_t term_id, const auto &on_posting) {
+        PostingsList list = postings.get_postings(term_id);
+        int doc_freq = list.size();
+        for (auto cursor = list.cursor(); !cursor.at_end(); cursor.next()) {
+            uint64_t docid = cursor.docid();
+            int doc_length = docid < doc_lengths.size() ? doc_lengths[docid] : 0;
+            on_posting(docid, score(cursor.term_freq(), doc_length, doc_freq));
+        }
+    };
+
+    uint64_t term_count = postings.get_term_count();
+    double max_score = 0.0;
+    for (uint32_t term_id = 0; term_id < term_count; ++term_id) {
+        score_postings(term_id, [&max_score](uint64_t, double s) { max_score = std::max(max_score, s); });
+    }
+    double impact_scale = max_score > 0.0 ? max_score / 255.0 : 1.0;
+
+    std::vector<uint64_t> term_segments{0};
+    std::vector<uint64_t> segment_offsets{0};
+    std::vector<uint8_t> impacts;
+    std::vector<uint64_t> docids;
+    term_segments.reserve(term_count + 1);
+    std::vector<std::pair<uint8_t, uint64_t>> term_postings;
+    for (uint32_t term_id = 0; term_id < term_count; ++term_id) {
+        term_postings.clear();
+        score_postings(term_id, [&](uint64_t docid, double s) {
+            /* never quantize a matching posting to zero */
+            uint8_t impact = std::clamp<long>(std::lround(s / impact_scale), 1, 255);
+            term_postings.emplace_back(impact, docid);
+        });
+        /* highest impact first, stable keeps the docid order within a segment */
+        std::stable_sort(term_postings.begin(), term_postings.end(),
+            [](const auto &a, const auto &b) {
+                return a.first > b.first;
+            }
+        );
+
+        for (size_t i = 0; i < term_postings.size(); ++i) {
+            if (i == 0 || term_postings[i].first != term_postings[i - 1].first) {
+                if (i > 0) {
+                    segment_offsets.push_back(docids.size());
+                }
+                impacts.push_back(term_postings[i].first);
+            }
+            docids.push_back(term_postings[i].second);
+        }
+        if (!term_postings.empty()) {
+            segment_offsets.push_back(docids.size());
+        }
+        term_segments.push_back(impacts.size());
+    }
+    impacts.resize((impacts.size() + 7) / 8 * 8, 0);
+
+    std::string temporary_path = filepath + ".tmp";
+    {
+        std::ofstream out(temporary_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw std::runtime_error("Failed to open impact file for writing: " + temporary_path);
+        }
+
+        uint32_t zero = 0;
+        uint64_t header[3] = {term_count, segment_offsets.size() - 1, docids.size()};
+        out.write("CIF1", 4);
+        write_array(out, &zero, 1);
+        write_array(out, header, 3);
+        write_array(out, &impact_scale, 1);
+        write_array(out, term_segments.data(), term_segments.size());
+        write_array(out, segment_offsets.data(), segment_offsets.size());
+        write_array(out, impacts.data(), impacts.size());
+        write_array(out, docids.data(), docids.size());
+
+        if (!out.flush()) {
+            throw std::runtime_error("Failed to write impact file: " + temporary_path);
+        }
+    }
+    std::filesystem::rename(temporary_path, filepath);
+}
+
+void ImpactIndex::open(const std::string &filepath) {
+    MappedFile file(filepath, MappedFile::Access::Random);
+    const uint8_t *data = file.data();
+    uint64_t size = file.size();
+
+    if (size < header_size || std::memcmp(data, "CIF1", 4) != 0) {
+        throw std::runtime_error("Invalid impact file: " + filepath);
+    }
+    uint64_t header[3];
+    double impact_scale;
+    std::memcpy(header, data + 8, sizeof(header));
+    std::memcpy(&impact_scale, data + 32, sizeof(impact_scale));
+
+    uint64_t term_count = header[0];
+    uint64_t segment_count = header[1];
+    uint64_t postings_count = header[2];
+    /* the sizes are checked before anything is read behind the header */
+    uint64_t words = (size - header_size) / 8;
+    if (term_count >= words || segment_count >= words || postings_count > words) {
+        throw std::runtime_error("Corrupt impact file header: " + filepath);
+    }
+    uint64_t impact_bytes = (segment_count + 7) / 8 * 8;
+    uint64_t expected = header_size + 8 * (term_count + 1 + segment_count + 1 + postings_count) + impact_bytes;
+    if (expected != size) {
+        throw std::runtime_error("Impact file has the wrong size: " + filepath);
+    }
+
+    const uint64_t *term_segments = reinterpret_cast<const uint64_t*>(data + header_size);
+    const uint64_t *segment_offsets = term_segments + term_count + 1;
+    if (term_segments[term_count] != segment_count || segment_offsets[segment_count] != postings_count) {
+        throw std::runtime_error("Corrupt impact offsets: " + filepath);
+    }
+    for (uint64_t term_id = 0; term_id < term_count; ++term_id) {
+        if (term_segments[term_id + 1] < term_segments[term_id]) {
+            throw std::runtime_error("Corrupt impact offsets: " + filepath);
+        }
+    }
+    for (uint64_t segment = 0; segment < segment_count; ++segment) {
+        if (segment_offsets[segment + 1] < segment_offsets[segment]) {
+            throw std::runtime_error("Corrupt impact offsets: " + filepath);
+        }
+    }
+
+    m_term_count = term_count;
+    m_postings_count = postings_count;
+    m_impact_scale = impact_scale;
+    m_term_segments = term_segments;
+    m_segment_offsets = segment_offsets;
+    m_impacts = reinterpret_cast<const uint8_t*>(segment_offsets + segment_count + 1);
+    m_docids = reinterpret_cast<const uint64_t*>(m_impacts + impact_bytes);
+    m_file = std::move(file);
+}
+
+bool ImpactIndex::is_open() const { return m_file.is_open(); }
+
+/*
+*   Score-at-a-time query processing, the segments of all query terms are merged into one list
+*   ordered by impact and read from the highest to the lowest impact until the budget is exhausted.
+*/
+QueryResult ImpactIndex::query(const std::vector<uint32_t> &term_ids, size_t postings_budget,
+    std::chrono::steady_clock::time_point deadline, size_t top_k) const
+{
+    QueryResult query_result;
+    bool has_deadline = deadline != std::chrono::steady_clock::time_point::max();
+
+    std::vector<Segment> segments;
+    size_t total_postings = 0;
+    for (uint32_t term_id: term_ids) {
+        if (term_id >= m_term_count || m_term_segments[term_id] == m_term_segments[term_id + 1]) {
+            continue;
+        }
+        query_result.stats.terms_processed++;
+        for (uint64_t segment = m_term_segments[term_id]; segment < m_term_segments[term_id + 1]; ++segment) {
+            uint64_t first = m_segment_offsets[segment];
+            uint64_t count = m_segment_offsets[segment + 1] - first;
+            segments.push_back({m_impacts[segment], {m_docids + first, count}});
+            total_postings += count;
+        }
+    }
+
+    /* stable, so segments of the same impact are read in query term order */
+    std::stable_sort(segments.begin(), segments.end(),
+        [](const Segment &a, const Segment &b) {
+            return a.impact > b.impact;
+        }
+    );
+
+    std::unordered_map<uint64_t, uint32_t> accumulators;
+    size_t processed = 0;
+    bool budget_exhausted = false;
+
+    for (const Segment &segment: segments) {
+        for (uint64_t docid: segment.docids) {
+            accumulators[docid] += segment.impact;
+            processed++;
+
+            if (postings_budget > 0 && processed >= postings_budget) {
+                budget_exhausted = true;
+                break;
+            }
+
+            if (has_deadline && processed % clock_check_interval == 0 && std::chrono::steady_clock::now() >= deadline) {
+                budget_exhausted = true;
+                break;
+            }
+        }
+
+        /* segment granularity check, catches many small segments */
+        if (budget_exhausted || (has_deadline && std::chrono::steady_clock::now() >= deadline)) {
+            break;
+        }
+    }
+
+    /* only partial if postings were left unread */
+    query_result.partial = processed < total_postings;
+    query_result.stats.postings_processed = processed;
+    query_result.stats.documents_scanned = accumulators.size();
+
+    auto &result = query_result.results;
+    result.reserve(accumulators.size());
+    for (const auto &[docid, impact]: accumulators) {
+        result.emplace_back(docid, impact * m_impact_scale);
+    }
+
+    auto by_score = [](const auto &a, const auto &b) {
+        /* tie break by docid, so results are deterministic */
+        return a.second > b.second || (a.second == b.second && a.first < b.first);
+    };
+
+    if (top_k > 0 && top_k < result.size()) {
+        std::partial_sort(result.begin(), result.begin() + top_k, result.end(), by_score);
+        result.resize(top_k);
+    } else {
+        std::sort(result.begin(), result.end(), by_score);
+    }
+
+    return query_result;
+}
+
+size_t ImpactIndex::get_term_count() const { return m_term_count; }
+size_t ImpactIndex::get_postings_count() const { return m_postings_count; }
+uint64_t ImpactIndex::get_size_bytes() const { return m_file.size(); }
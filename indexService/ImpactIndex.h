@@ -0,0 +1,88 @@
+#ifndef _H_IMPACTINDEX
+#define _H_IMPACTINDEX
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "PostingsFile.h"
+#include "Query.h"
+
+/*
+*   Second index layout next to the per document concordances.
+*   For every term the postings are grouped into segments of equal quantized impact (the precomputed
+*   BM25 contribution of the term for a document), the segments are sorted by descending impact.
+*
+*   Queries are processed score-at-a-time: the segments of all query terms are read highest impact first,
+*   so processing can stop after a budget of postings or time and still return the best results found so far.
+*
+*   The segments are memory mapped from impact.bin, written next to postings.bin when the postings are built,
+*   so every process serving the index shares one copy in the page cache.
+*   File layout, all integers in host byte order (little endian), every array aligned to 8 bytes:
+*       "CIF1", u32 zero, u64 term_count, u64 segment_count, u64 postings_count, f64 impact_scale
+*       u64 term_segments[term_count + 1]       first segment of every term, the last entry is segment_count
+*       u64 segment_offsets[segment_count + 1]  first posting of every segment, the last entry is postings_count
+*       u8 impacts[segment_count]               padded with zeros to a multiple of 8
+*       u64 docids[postings_count]              docid ordered within a segment
+*/
+class ImpactIndex {
+    public:
+        /* computes the score of a term for a document: term_freq, doc_length, doc_freq */
+        using ScoreFunction = std::function<double(int, int, int)>;
+
+        ImpactIndex() = default;
+        ~ImpactIndex() = default;
+
+        /*
+        *   Quantizes the postings of every term id and writes a new file next to filepath, then renames it,
+        *   processes that mapped the old file keep reading it
+        */
+        static void save(const std::string &filepath, const PostingsFile &postings, const ScoreFunction &score);
+        /* maps a saved file, replaces the mapping of a previous one */
+        void open(const std::string &filepath);
+        bool is_open() const;
+
+        /*
+        *   @param postings_budget stop after this many postings were processed, 0 means no limit
+        *   @param deadline stop when this point in time is reached, time_point::max() means no limit
+        *   @param top_k return only the k best results, 0 means all results
+        */
+        QueryResult query(const std::vector<uint32_t> &term_ids, size_t postings_budget,
+            std::chrono::steady_clock::time_point deadline, size_t top_k) const;
+
+        /* term ids, including those without postings */
+        size_t get_term_count() const;
+        size_t get_postings_count() const;
+        uint64_t get_size_bytes() const;
+
+        static constexpr const char *filename = "impact.bin";
+
+    private:
+        /* all postings of a term that share the same quantized impact */
+        struct Segment {
+            uint8_t impact;
+            std::span<const uint64_t> docids;
+        };
+
+        MappedFile m_file;
+        uint64_t m_term_count = 0;
+        uint64_t m_postings_count = 0;
+        const uint64_t *m_term_segments = nullptr;
+        const uint64_t *m_segment_offsets = nullptr;
+        const uint8_t *m_impacts = nullptr;
+        const uint64_t *m_docids = nullptr;
+
+        /* maps a quantized impact back to a BM25 score */
+        double m_impact_scale = 0.0;
+
+        static constexpr size_t header_size = 40;
+        /* check the clock only every n postings, reading the clock is not free */
+        static constexpr size_t clock_check_interval = 4096;
+};
+
+#endif
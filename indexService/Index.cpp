@@ -1,3 +1,8 @@
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <deque>
+#include <numeric>
 #include <iostream>
 #include <filesystem>
 #include <fstream>
@@ -5,36 +10,88 @@
 #include <chrono>
 
 #include "Index.h"
+#include "BatchEvaluator.h"
+#include "DocidReorderer.h"
 #include "DocumentFactory.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "QueryEvaluator.h"
 
 /*
 *   @param directory The directoy which should be crawled and indexed   
 *   @param index_path The path in which the index should be stored on filesystem
 *   @param threads_used The number of threads which should be used during indexing. Must be >=0   
+*   @param options Only used when a new index is built, e.g. whether positions are stored
 * 
 *   TODO: remove Indexing from the constructor, trigger from outside (http server)
 */
-Index::Index(std::string directory, std::string index_path, std::unique_ptr<ContentAddressedStorage> &content_store)
-    : index_path(index_path), m_total_term_count(0), m_content_store(std::move(content_store))
+Index::Index(std::string directory, std::string index_path, std::unique_ptr<ContentAddressedStorage> &content_store,
+    const IndexOptions &options)
+    : m_directory(directory), index_path(index_path), m_options(options), m_content_store(std::move(content_store)),
+      m_snippet_generator(m_content_store), m_checker(m_content_store), m_total_term_count(0)
 {
     /* Check wether a index is present in the filesystem and can be loaded */
     std::string index_filepath = index_path + "/index.json";
-    std::chrono::duration<double> indexing_duration;
-    if (is_index_present()) {
+    std::chrono::duration<double> indexing_duration{0};
+    if (m_options.read_only) {
+        /* the postings and the dictionary are mapped, so processes serving the same index share them */
+        if (!is_index_present()) {
+            throw std::runtime_error("No index to serve in: " + index_path);
+        }
+        load_index_from_file(index_filepath, false);
+        m_positional_index.open(index_path);
+        if (!open_postings()) {
+            throw std::runtime_error("The files of the index in " + index_path + " do not match, it is being written");
+        }
+        m_positional_index.validate();
+    } else if (is_index_present()) {
         std::cout << "Loading existing index found in: " << index_path << std::endl; 
         load_index_from_file(index_filepath);
+        /* positions are present if the index was built with them */
+        m_positional_index.open(index_path);
+        try {
+            auto update_start = std::chrono::high_resolution_clock::now();
+            m_changed_documents = update_index(directory, index_filepath);
+            indexing_duration = std::chrono::high_resolution_clock::now() - update_start;
+        } catch (std::exception &e) {
+            /* a reload keeps the generation it would have replaced */
+            std::cerr << "Caught Exception updating index: " << e.what() << std::endl;
+            throw;
+        }
+        /* without changes the files of the last run are still valid, unless they are missing or do not match */
+        if (m_changed_documents > 0 || !open_postings()) {
+            build_postings();
+            build_impact_index();
+        } else {
+            std::cout << "Index unchanged, mapped the postings of the last run" << std::endl;
+        }
     } else {
         std::cout << "Building new Index" << std::endl;
         try {
+            std::unordered_set<std::string> stopwords;
+            if (!m_options.stopwords_path.empty()) {
+                stopwords = read_stopwords(m_options.stopwords_path);
+            }
+            m_analyzer = Analyzer(m_options.strip_possessives, m_options.stem, std::move(stopwords));
+
             /* performance measurement */
             auto index_start = std::chrono::high_resolution_clock::now();
-            build_document_index(directory);
+            m_changed_documents = build_document_index(directory);
             auto index_end = std::chrono::high_resolution_clock::now();
             indexing_duration = index_end - index_start;
             set_avg_doc_length();
+            if (m_options.reorder_docids) {
+                reorder_documents();
+            }
+            if (m_options.positional) {
+                m_positional_index.save(index_path);
+            }
             save_index_to_file(index_filepath);
+            build_postings();
+            build_impact_index();
         } catch (std::exception &e) {
             std::cerr << "Caught Exception building index: " << e.what() << std::endl;
+            throw;
         }
     }
 
@@ -47,58 +104,224 @@ Index::Index(std::string directory, std::string index_path, std::unique_ptr<Cont
 /*
 *   Queries the index and returns the result ordered by BM25 ranking
 *   returns a sorted by rank ascending vector of pairs <document->filepath, tfidf-rank>
+*   with options.impact_ordered the impact ordered postings are used, the search stops when the budget is exhausted
 *
-*   TODO: timeout based search?
+*   With options.timeout the deadline is checked cooperatively while the postings are traversed,
+*   when it is reached the best results found so far are returned and marked as partial.
 *   TODO: Split index in Buckets/Shards, use threads to search the buckets
 */
-std::vector<std::pair<uint64_t, double>> Index::query_index(const std::vector<std::string> &input_values) {
-    std::unordered_map<uint64_t, double> score_map;
+QueryResult Index::query_index(const QueryNode &query, const QueryOptions &options) {
+    QueryResult query_result;
 
     /* measure query performance in milliseconds */
     std::chrono::duration<double, std::milli> query_duration;
     auto query_start = std::chrono::high_resolution_clock::now();
 
-    for (const auto &term: input_values) {
-        int doc_freq = 0;
-        std::vector<std::tuple<uint64_t, int, int>> term_data;
+    auto deadline = std::chrono::steady_clock::time_point::max();
+    if (options.timeout.count() > 0) {
+        deadline = std::chrono::steady_clock::now() + options.timeout;
+    }
 
-        for (const auto &[docid, doc]: documents) {
-            int term_freq = doc->get_term_frequency(term);
+    if (options.impact_ordered) {
+        /* the impact ordered postings can only answer disjunctive queries */
+        if (!query.is_bag_of_words()) {
+            throw std::invalid_argument("Impact ordered search supports only plain term queries");
+        }
+        if (options.fuzzy > 0) {
+            throw std::invalid_argument("Impact ordered search does not support fuzzy matching");
+        }
+        if (options.collection_stats) {
+            throw std::invalid_argument("Impact ordered search is scored with the local statistics only");
+        }
+        std::vector<std::string> terms;
+        query.collect_terms(terms);
+        std::vector<uint32_t> term_ids;
+        for (const auto &term: terms) {
+            if (auto term_id = m_dictionary.lookup(term)) {
+                term_ids.push_back(*term_id);
+            }
+        }
+
+        if (options.time_budget.count() > 0) {
+            deadline = std::min(deadline, std::chrono::steady_clock::now() + options.time_budget);
+        }
+        {
+            /* score-at-a-time, traversal, scoring and top k selection are one loop */
+            Metrics::Timer postings_timer(Metrics::Stage::Postings);
+            query_result = m_impact_index.query(term_ids, options.postings_budget, deadline, options.top_k);
+        }
+
+        query_duration = std::chrono::high_resolution_clock::now() - query_start;
+        query_result.stats.elapsed_ms = query_duration.count();
+        record_query_metrics(query_result);
+        Logger::info() << "Impact ordered query took: " << query_duration.count() << " milliseconds";
+        return query_result;
+    }
+
+    int total_docs = get_document_counter();
+    uint64_t avg_doc_length = m_avg_doc_length;
+    const CollectionStats *collection = options.collection_stats.get();
+    if (collection && collection->documents > 0) {
+        /* computed like set_avg_doc_length, so a sharded collection scores like a single index */
+        total_docs = collection->documents;
+        avg_doc_length = collection->total_term_count / collection->documents;
+    }
 
-            if (term_freq > 0) {
-                doc_freq++;
+    QueryEvaluator evaluator(m_dictionary, m_postings, m_positional_index,
+        [total_docs, avg_doc_length](int term_freq, int doc_length, int doc_freq) {
+            return compute_bm25(term_freq, doc_length, avg_doc_length, compute_idf(total_docs, doc_freq));
+        },
+        deadline
+    );
+    if (collection && collection->documents > 0) {
+        int local_docs = std::max(1, get_document_counter());
+        evaluator.set_doc_freqs([this, collection, local_docs](uint32_t term_id, int local_doc_freq) {
+            auto it = collection->doc_freqs.find(m_dictionary.term(term_id));
+            if (it != collection->doc_freqs.end()) {
+                return static_cast<int>(it->second);
             }
-            
-            int doc_length = doc->get_total_term_count();
-            /* temp store term_freq and doc_length for BM25 */
-            term_data.emplace_back(doc->get_docid(), term_freq, doc_length);
+            return static_cast<int>(static_cast<uint64_t>(local_doc_freq) * collection->documents / local_docs);
+        });
+    }
+    query_result = evaluator.evaluate(query, options);
+
+    auto query_end = std::chrono::high_resolution_clock::now();
+    query_duration = query_end - query_start;
+    Logger::info() << "Query took: " << query_duration.count() << " milliseconds";
+
+    query_result.stats.elapsed_ms = query_duration.count();
+    record_query_metrics(query_result);
+    return query_result;
+}
+
+/*
+*   The bag of words queries are scored term-at-a-time by the BatchEvaluator, the other queries one by one.
+*   Groups of batch queries and single queries are taken by the threads from one queue.
+*/
+void Index::query_batch(const std::vector<std::string_view> &queries, const QueryOptions &options, const BatchResultFunction &on_result,
+    const std::atomic<bool> *cancelled) {
+    auto start = std::chrono::steady_clock::now();
+    int total_docs = get_document_counter();
+    uint64_t avg_doc_length = m_avg_doc_length;
+    BatchEvaluator batch(m_dictionary, m_postings,
+        [total_docs, avg_doc_length](int term_freq, int doc_length, int doc_freq) {
+            return compute_bm25(term_freq, doc_length, avg_doc_length, compute_idf(total_docs, doc_freq));
         }
+    );
 
-        double idf = compute_idf(get_document_counter(), doc_freq);
+    std::vector<std::unique_ptr<QueryNode>> parsed(queries.size());
+    std::vector<size_t> singles;
+    {
+        Metrics::Timer parse_timer(Metrics::Stage::QueryParse);
+        for (size_t i = 0; i < queries.size(); ++i) {
+            try {
+                parsed[i] = QueryParser::parse(queries[i], m_analyzer);
+            } catch (const std::invalid_argument &e) {
+                on_result(i, QueryResult(), e.what());
+                continue;
+            }
+            if (BatchEvaluator::supports(*parsed[i], options)) {
+                batch.add(i, *parsed[i]);
+            } else {
+                singles.push_back(i);
+            }
+        }
+    }
 
-        for (const auto &[doc, tf, dl]: term_data) {
-            double score = compute_bm25(tf, dl, m_avg_doc_length, idf);
-            if (score > 0.0) {
-                score_map[doc] += score;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    batch.prepare(threads);
+    size_t groups = batch.get_group_count();
+
+    auto on_batch_result = [this, &on_result](size_t index, QueryResult query_result) {
+        record_query_metrics(query_result);
+        on_result(index, query_result, "");
+    };
+    std::atomic<size_t> next{0};
+    auto evaluate = [&]() {
+        BatchEvaluator::Accumulator accumulator;
+        for (size_t item = next++; item < groups + singles.size(); item = next++) {
+            if (cancelled && *cancelled) {
+                return;
+            }
+            if (item < groups) {
+                batch.evaluate(item, options.top_k, accumulator, on_batch_result);
+                continue;
+            }
+            size_t index = singles[item - groups];
+            try {
+                on_result(index, query_index(*parsed[index], options), "");
+            } catch (const std::invalid_argument &e) {
+                on_result(index, QueryResult(), e.what());
             }
         }
+    };
+
+    std::vector<std::future<void>> workers;
+    for (size_t i = 0; i < std::min(threads, std::max<size_t>(1, groups + singles.size())); ++i) {
+        workers.push_back(std::async(std::launch::async, evaluate));
+    }
+    for (auto &worker: workers) {
+        worker.get();
+    }
+
+    Metrics::instance().add(Metrics::Counter::BatchQueries, queries.size());
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    Logger::info() << "Batch of " << queries.size() << " queries took: " << elapsed.count() << " milliseconds, "
+        << singles.size() << " evaluated one by one, " << batch.get_shared_terms() << " terms shared";
+}
+
+void Index::record_query_metrics(const QueryResult &query_result) {
+    auto &metrics = Metrics::instance();
+    metrics.add(Metrics::Counter::Queries);
+    metrics.add(Metrics::Counter::PostingsProcessed, query_result.stats.postings_processed);
+    metrics.add(Metrics::Counter::DocumentsScanned, query_result.stats.documents_scanned);
+    if (query_result.partial) {
+        metrics.add(Metrics::Counter::PartialQueries);
     }
+}
 
-    /* move scores into sortable vector */
-    std::vector<std::pair<uint64_t, double>> result(score_map.begin(), score_map.end());
+/*
+*   Statistics of the terms of a query in this index, the coordinator sums them over the shards.
+*   Wildcards are expanded here, fuzzy matches are estimated by each shard, see CollectionStats.
+*/
+CollectionStats Index::get_collection_stats(const QueryNode &query) const {
+    CollectionStats stats;
+    stats.documents = documents.size();
+    stats.total_term_count = m_total_term_count;
 
-    /* Sort the result ascending by rank */
-    std::sort(result.begin(), result.end(),
-        [](const auto &a, const auto &b) { 
-            return a.second > b.second; 
+    std::vector<std::string> terms;
+    query.collect_terms(terms);
+    for (const auto &term: terms) {
+        auto term_id = m_dictionary.lookup(term);
+        stats.doc_freqs[term] = term_id ? m_postings.get_doc_freq(*term_id) : 0;
+    }
+    /*
+    *   The local expansions of a wildcard, a term missing in a shard counts 0 there, so the sums are exact
+    *   unless an expansion ran out of time; then the shard estimates the missing terms like fuzzy matches.
+    */
+    std::vector<std::string> patterns;
+    query.collect_patterns(patterns);
+    auto deadline = std::chrono::steady_clock::now() + QueryEvaluator::expansion_time_budget;
+    for (const auto &pattern: patterns) {
+        for (uint32_t term_id: m_dictionary.expand_wildcard(pattern, QueryEvaluator::max_wildcard_terms, deadline).ids) {
+            if (m_postings.get_doc_freq(term_id) > 0) {
+                stats.doc_freqs[m_dictionary.term(term_id)] = m_postings.get_doc_freq(term_id);
+            }
         }
-    );
+    }
+    return stats;
+}
 
-    auto query_end = std::chrono::high_resolution_clock::now();
-    query_duration = query_end - query_start;
-    std::cout << "Query took: " << query_duration.count() << " milliseconds" << std::endl;
+/* bag of words query, the terms are combined with OR */
+QueryResult Index::query_index(const std::vector<std::string> &input_values, const QueryOptions &options) {
+    auto query = QueryNode::make_boolean();
+    for (const auto &term: input_values) {
+        if (!term.empty()) {
+            query->should.push_back(QueryNode::make_term(term));
+        }
+    }
 
-    return result;
+    return query_index(*query, options);
 }
 
 /*
@@ -107,42 +330,303 @@ std::vector<std::pair<uint64_t, double>> Index::query_index(const std::vector<st
 const Document& Index::get_document_by_id(uint64_t docid) const {
     auto it = documents.find(docid);
     if (it == documents.end()) {
-        std::cerr << "Document with docid: " << docid << " not found in index" << std::endl;
+        Logger::error() << "Document with docid: " << docid << " not found in index";
         throw std::out_of_range("Invalid document ID");
     }
 
     return *it->second;
 }
 
+/*
+*   Loads the content of the documents from the content storage, only the requested hits are decompressed
+*/
+std::vector<std::vector<std::string>> Index::get_snippets(const std::vector<uint64_t> &docids, const QueryNode &query,
+    int fuzzy, size_t snippets_per_hit, std::chrono::milliseconds budget)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::vector<std::string> content_hashes;
+    for (uint64_t docid: docids) {
+        content_hashes.push_back(get_document_by_id(docid).get_content_hash());
+    }
+
+    std::vector<std::string> terms;
+    query.collect_terms(terms);
+
+    /* the terms matched by fuzzy terms and wildcards are highlighted, expanded the same way as for the search */
+    auto deadline = std::chrono::steady_clock::now() + QueryEvaluator::expansion_time_budget;
+    if (fuzzy > 0) {
+        for (size_t i = 0, n = terms.size(); i < n; ++i) {
+            int max_edits = QueryEvaluator::fuzzy_edits(terms[i], fuzzy);
+            if (max_edits == 0) {
+                continue;
+            }
+            auto expansion = m_dictionary.expand_fuzzy(terms[i], max_edits, QueryEvaluator::max_fuzzy_terms, deadline);
+            for (const auto &match: expansion.matches) {
+                terms.push_back(m_dictionary.term(match.id));
+            }
+        }
+    }
+
+    std::vector<std::string> patterns;
+    query.collect_patterns(patterns);
+    for (const auto &pattern: patterns) {
+        for (uint32_t term_id: m_dictionary.expand_wildcard(pattern, QueryEvaluator::max_wildcard_terms, deadline).ids) {
+            terms.push_back(m_dictionary.term(term_id));
+        }
+    }
+
+    auto snippets = m_snippet_generator.generate(content_hashes, terms, m_analyzer, snippets_per_hit, std::chrono::steady_clock::now() + budget);
+
+    std::chrono::duration<double, std::milli> duration = std::chrono::high_resolution_clock::now() - start;
+    Metrics::instance().record(Metrics::Stage::Snippets, std::chrono::duration_cast<std::chrono::nanoseconds>(duration));
+    Logger::info() << "Snippets for " << docids.size() << " hits took: " << duration.count() << " milliseconds";
+    return snippets;
+}
+
+VerifyReport Index::verify_content(const VerifyOptions &options) {
+    std::vector<ConsistencyChecker::Entry> entries;
+    entries.reserve(documents.size());
+    for (const auto &[docid, doc]: documents) {
+        entries.push_back({docid, doc->get_content_hash(), doc->get_filepath(), doc->get_extension()});
+    }
+
+    std::lock_guard<std::mutex> lock(m_verify_mutex);
+    VerifyReport report = m_checker.verify(std::move(entries), options);
+    Logger::info() << "Verified " << report.documents << " documents in " << report.seconds << " seconds, "
+        << report.problems.size() << " problems" << (report.complete ? ", check complete" : "");
+    return report;
+}
+
 /*
 *   for statistics
 */
 int Index::get_document_counter() { return documents.size(); }
 int Index::get_total_term_count() { return m_total_term_count;}
 int Index::get_avg_doc_length() { return m_avg_doc_length; }
+const PositionalIndex &Index::get_positional_index() const { return m_positional_index; }
+const TermDictionary &Index::get_term_dictionary() const { return m_dictionary; }
+size_t Index::get_changed_documents() const { return m_changed_documents; }
+const Analyzer &Index::get_analyzer() const { return m_analyzer; }
 
-/* read content of a single document and create concordance */
-void Index::index_document(std::unique_ptr<Document> &doc) {
-    std::string content = doc->get_file_content_as_string();
-    /* only the raw content is stored, after filtering via content strategy */
-    std::string content_hash = m_content_store->store(content);
+uint64_t Index::get_index_size_bytes() {
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(index_path + "/index.json", ec);
+    return ec ? 0 : size;
+}
+
+/*
+*   Brings a loaded index up to date with the directory, see build_document_index.
+*   The index is only written again if documents were added or removed.
+*/
+size_t Index::update_index(std::string directory, std::string index_filepath) {
+    for (const auto &[docid, doc]: documents) {
+        if (doc->get_filepath().empty()) {
+            std::cout << "Index was built without file paths, it is not updated" << std::endl;
+            return 0;
+        }
+    }
+
+    /* new documents get positions if the loaded index has them */
+    m_options.positional = m_positional_index.is_available();
+    uint64_t first_new_docid = m_docid_counter.load();
+
+    size_t changed = build_document_index(directory);
+    if (changed == 0) {
+        std::cout << "Index is up to date" << std::endl;
+        return 0;
+    }
+
+    set_avg_doc_length();
+    if (m_options.positional) {
+        m_positional_index.carry_over(index_path, [this, first_new_docid](uint64_t docid) {
+            return docid < first_new_docid && documents.count(docid) > 0;
+        });
+    }
+    /* the new documents got docids behind all others, the order is found again for all of them */
+    if (m_options.reorder_docids) {
+        reorder_documents();
+    }
+    if (m_options.positional) {
+        m_positional_index.save(index_path);
+    }
+    save_index_to_file(index_filepath);
+    return changed;
+}
+
+size_t Index::warm_up(const std::vector<std::string> &queries) const {
+    m_dictionary.prefetch();
+    m_postings.prefetch_doc_lengths();
+    m_positional_index.prefetch();
+
+    std::unordered_set<uint32_t> term_ids;
+    for (const auto &query: queries) {
+        try {
+            std::vector<std::string> terms;
+            QueryParser::parse(query, m_analyzer)->collect_terms(terms);
+            for (const auto &term: terms) {
+                if (auto term_id = m_dictionary.lookup(term)) {
+                    term_ids.insert(*term_id);
+                }
+            }
+        } catch (const std::exception &) {
+            /* a query that does not parse has nothing to warm up */
+        }
+    }
+
+    for (uint32_t term_id: term_ids) {
+        m_postings.prefetch(term_id);
+    }
+    return term_ids.size();
+}
 
+/* only between indexing runs or under the index mutex, the blob stays in the storage */
+void Index::remove_document(uint64_t docid) {
+    auto it = documents.find(docid);
+    if (it == documents.end()) {
+        return;
+    }
+
+    const Document &doc = *it->second;
+    m_total_term_count -= doc.get_total_term_count();
+    auto file = m_file_docids.find(doc.get_filepath());
+    if (file != m_file_docids.end() && file->second == docid) {
+        m_file_docids.erase(file);
+    }
+    auto content = m_content_docids.find(doc.get_content_hash());
+    if (content != m_content_docids.end() && content->second == docid) {
+        m_content_docids.erase(content);
+    }
+    documents.erase(it);
+}
+
+/*
+*   Gives the documents the docids 1 to n in the order of the DocidReorderer, before the postings, the positions
+*   and index.json are written. The docids of the documents change, so do the ones /query returns.
+*/
+void Index::reorder_documents() {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::vector<uint64_t> docids;
+    docids.reserve(documents.size());
+    for (const auto &[docid, doc]: documents) {
+        docids.push_back(docid);
+    }
+    std::sort(docids.begin(), docids.end());
+
+    /* the terms of every document as ids, the documents in their current order */
+    std::unordered_map<std::string_view, uint32_t> term_ids;
+    std::vector<std::vector<uint32_t>> document_terms(docids.size());
+    for (size_t i = 0; i < docids.size(); ++i) {
+        const auto &concordance = documents.at(docids[i])->get_concordance();
+        document_terms[i].reserve(concordance.size());
+        for (const auto &[term, term_freq]: concordance) {
+            auto [it, inserted] = term_ids.emplace(term, term_ids.size());
+            document_terms[i].push_back(it->second);
+        }
+    }
+
+    std::vector<uint32_t> identity(docids.size());
+    std::iota(identity.begin(), identity.end(), 0);
+    DocidReorderer reorderer(std::move(document_terms), term_ids.size());
+    term_ids = {};
+    auto before = reorderer.gap_cost(identity);
+    auto order = reorderer.reorder(std::max(1u, std::thread::hardware_concurrency()));
+    auto after = reorderer.gap_cost(order);
+
+    std::unordered_map<uint64_t, uint64_t> new_docids;
+    std::unordered_map<uint64_t, std::unique_ptr<Document>> reordered;
+    for (size_t i = 0; i < order.size(); ++i) {
+        uint64_t docid = docids[order[i]];
+        auto doc = std::move(documents.at(docid));
+        doc->set_docid(i + 1);
+        new_docids.emplace(docid, i + 1);
+        reordered.emplace(i + 1, std::move(doc));
+    }
+    documents = std::move(reordered);
+    for (auto &[filepath, docid]: m_file_docids) {
+        docid = new_docids.at(docid);
+    }
+    for (auto &[hash, docid]: m_content_docids) {
+        docid = new_docids.at(docid);
+    }
+    m_positional_index.renumber([&new_docids](uint64_t docid) -> uint64_t {
+        auto it = new_docids.find(docid);
+        return it != new_docids.end() ? it->second : 0;
+    });
+    m_docid_counter = documents.size() + 1;
+
+    std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start;
+    Metrics::instance().record(Metrics::Stage::IndexReorder, std::chrono::duration_cast<std::chrono::nanoseconds>(duration));
+    std::cout << "Reordered " << documents.size() << " documents in " << duration.count() << " seconds, docid gaps: ";
+    std::cout << before.bits_per_posting << " -> " << after.bits_per_posting << " bits per posting, ";
+    std::cout << before.varint_bytes << " -> " << after.varint_bytes << " bytes as varints" << std::endl;
+}
+
+/*
+*   Create the concordance of a single document from its content.
+*   Plain text is hashed, compressed and tokenized without a copy of the content.
+*   If a document with the same content is in the index already, its concordance is copied instead,
+*   unless positions are needed.
+*/
+void Index::index_document(std::unique_ptr<Document> &doc, const Content &content) {
     std::unordered_map<std::string, int> concordance;
-    std::istringstream iss(content);
-    std::string word;
+    std::unordered_map<std::string, std::vector<uint32_t>> positions;
+    std::string content_hash;
     int total_term_count = 0;
 
-    while (iss >> word) {
-        /* split the word if necessary */
-        std::vector<std::string> clean_words = Document::clean_word(word);
-        for (const auto &clean_word : clean_words) {
-            if (!clean_word.empty() && clean_word.find_first_not_of(' ') != std::string::npos) {
-                concordance[clean_word]++;
+    std::string_view text = content.view();
+    /* only the raw content is stored, after filtering via content strategy */
+    Metrics::Timer store_timer(Metrics::Stage::IndexStore);
+    content_hash = m_content_store->store(text);
+    store_timer.stop();
+
+    Metrics::Timer analyze_timer(Metrics::Stage::IndexAnalyze);
+
+    bool known_content = false;
+    if (!m_options.positional) {
+        std::lock_guard<std::mutex> lock(m_index_mutex);
+        auto known = m_content_docids.find(content_hash);
+        if (known != m_content_docids.end()) {
+            const Document &other = *documents.at(known->second);
+            concordance = other.get_concordance();
+            total_term_count = other.get_total_term_count();
+            known_content = true;
+        }
+    }
+
+    if (!known_content) {
+        /* words are separated by whitespace, like reading the text with operator>> */
+        size_t pos = 0;
+        while (pos < text.size()) {
+            while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos]))) {
+                pos++;
+            }
+            size_t end = pos;
+            while (end < text.size() && !std::isspace(static_cast<unsigned char>(text[end]))) {
+                end++;
+            }
+            if (end == pos) {
+                break;
+            }
+
+            /* split the word if necessary, stopwords are dropped */
+            for (const auto &term: m_analyzer.analyze(std::string(text.substr(pos, end - pos)))) {
+                concordance[term]++;
+                /* the position of a term is its index among the terms of the document */
+                if (m_options.positional) {
+                    positions[term].push_back(total_term_count);
+                }
                 total_term_count++;
-            } 
+            }
+            pos = end;
         }
     }
 
+    if (m_options.positional) {
+        m_positional_index.add_document(doc->get_docid(), positions);
+    }
+
     doc->set_concordance(concordance);
     doc->set_total_term_count(total_term_count);
     doc->set_indexed_at(std::chrono::system_clock::now());
@@ -152,53 +636,189 @@ void Index::index_document(std::unique_ptr<Document> &doc) {
 /*
 *   Moves trough a directy and try's to create a Document for every file in the dir
 *   For every supported file extension in the dir, a Document is created and stored in the document index
+*
+*   Two stages: this thread creates the documents in crawl order and starts reading their files with the
+*   I/O backend, a thread per core takes the documents in that order, extracts and indexes them.
+*   At most queue depth + threads documents are read ahead of the indexing threads.
+*
+*   Files that are in the index already with the same size and modification time are skipped,
+*   changed files replace their document and documents of files that are gone are removed.
+*   Returns the number of documents indexed and removed.
 */
-void Index::build_document_index(std::string directory) {
+size_t Index::build_document_index(std::string directory) {
     /* check if the param is a directory */
-    if (std::filesystem::status(directory).type() == std::filesystem::file_type::directory) {
-        std::cout << "Building index of directory: " << directory << std::endl;
-        if (std::filesystem::exists(directory)) {
-            for (auto const &entry : std::filesystem::recursive_directory_iterator(directory)) {
-                std::string filepath = entry.path();
-                std::string file_extension = std::filesystem::path(entry.path()).extension();
-                
-                m_futures.push_back(std::async(std::launch::async, [this, filepath, file_extension]() {
-                    try {
-                        /* create unique id */
-                        uint64_t docid = m_docid_counter.fetch_add(1);
-                        std::unique_ptr<Document> new_doc = DocumentFactory::create_document(docid, filepath, file_extension);
-                        /* read documents content */
-                        index_document(new_doc);
-
-                        /* thread safety with lock_guard */
-                        {
-                            std::lock_guard<std::mutex> lock(m_index_mutex);
-                            m_total_term_count += new_doc->get_total_term_count();
-                            /* place the document into the index */
-                            documents.emplace(docid, std::move(new_doc));
-                        }
-                    } catch (std::exception &e) {
-                        std::cerr << "Error indexing " << filepath << ": ";
-                        std::cerr << e.what() << std::endl;
-                    }
-                }));
+    if (std::filesystem::status(directory).type() != std::filesystem::file_type::directory) {
+        std::cerr << "No directoy given to index" << std::endl;
+        throw std::runtime_error("Directory to index not found: " + directory);
+    }
+    std::cout << "Building index of directory: " << directory << std::endl;
+
+    m_io = IOBackend::create(m_options.io_queue_depth);
+    m_content_store->set_io_backend(m_io);
+    if (m_io) {
+        std::cout << "I/O backend: " << m_io->name() << ", queue depth " << m_io->get_queue_depth() << std::endl;
+    }
+
+    /* files of the index which were not found yet */
+    std::unordered_map<std::string, uint64_t> unseen_files = m_file_docids;
+    size_t unchanged = 0;
+    size_t replaced = 0;
+    size_t removed = 0;
+    bool crawled_all = false;
+    std::atomic<size_t> indexed{0};
+
+    struct PendingDocument {
+        std::unique_ptr<Document> doc;
+        /* the bytes of the file, not valid if the document reads its file itself */
+        std::future<std::string> raw;
+    };
+
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t read_ahead = (m_io ? m_io->get_queue_depth() : 0) + threads;
+    std::deque<PendingDocument> pending;
+    std::mutex pending_mutex;
+    std::condition_variable document_added;
+    std::condition_variable document_taken;
+    bool crawled = false;
+
+    auto index_pending = [&]() {
+        while (true) {
+            PendingDocument next;
+            {
+                std::unique_lock<std::mutex> lock(pending_mutex);
+                document_added.wait(lock, [&]() { return crawled || !pending.empty(); });
+                if (pending.empty()) {
+                    return;
+                }
+                next = std::move(pending.front());
+                pending.pop_front();
             }
+            document_taken.notify_one();
+
+            std::string filepath = next.doc->get_filepath();
+            try {
+                /* time spent waiting for the I/O backend, the extraction reads the file itself otherwise */
+                bool has_raw = next.raw.valid();
+                std::string raw;
+                if (has_raw) {
+                    Metrics::Timer read_timer(Metrics::Stage::IndexRead);
+                    raw = next.raw.get();
+                }
+
+                /* the content, and with it a mapped file, only lives while the document is indexed */
+                Metrics::Timer extract_timer(Metrics::Stage::IndexExtract);
+                Content content = has_raw ? next.doc->parse_file_content(std::move(raw)) : next.doc->get_file_content();
+                extract_timer.stop();
+                index_document(next.doc, content);
+                Metrics::instance().add(Metrics::Counter::DocumentsIndexed);
 
-            /* await the futures, TODO: maybe we can just continue and let the indexing run in the background */
-            for (auto &fut: m_futures) {
-                fut.get();
+                /* thread safety with lock_guard */
+                std::lock_guard<std::mutex> lock(m_index_mutex);
+                m_total_term_count += next.doc->get_total_term_count();
+                /* place the document into the index */
+                uint64_t docid = next.doc->get_docid();
+                m_file_docids[filepath] = docid;
+                m_content_docids.emplace(next.doc->get_content_hash(), docid);
+                documents.emplace(docid, std::move(next.doc));
+                indexed++;
+            } catch (std::exception &e) {
+                Metrics::instance().add(Metrics::Counter::IndexErrors);
+                std::cerr << "Error indexing " << filepath << ": ";
+                std::cerr << e.what() << std::endl;
             }
         }
-    } else {
-        std::cerr << "No directoy given to index" << std::endl;
-        throw std::runtime_error("Directory to index not found: " + directory);
+    };
+
+    std::vector<std::thread> indexing_threads;
+    for (size_t i = 0; i < threads; ++i) {
+        indexing_threads.emplace_back(index_pending);
+    }
+
+    try {
+        for (auto const &entry : std::filesystem::recursive_directory_iterator(directory)) {
+            std::string filepath = entry.path();
+            std::string file_extension = std::filesystem::path(entry.path()).extension();
+
+            std::error_code ec;
+            uint64_t file_size = 0;
+            int64_t mtime = 0;
+            if (entry.is_regular_file(ec)) {
+                file_size = entry.file_size(ec);
+                mtime = entry.last_write_time(ec).time_since_epoch().count();
+            }
+
+            auto known = unseen_files.find(filepath);
+            if (known != unseen_files.end()) {
+                uint64_t docid = known->second;
+                unseen_files.erase(known);
+
+                std::lock_guard<std::mutex> lock(m_index_mutex);
+                const Document &doc = *documents.at(docid);
+                if (doc.get_file_size() == file_size && doc.get_mtime() == mtime) {
+                    unchanged++;
+                    continue;
+                }
+                remove_document(docid);
+                replaced++;
+            }
+
+            PendingDocument next;
+            try {
+                next.doc = DocumentFactory::create_document(m_docid_counter.load(), filepath, file_extension);
+            } catch (std::exception &e) {
+                std::cerr << "Error indexing " << filepath << ": ";
+                std::cerr << e.what() << std::endl;
+                continue;
+            }
+            /* create unique id */
+            m_docid_counter.fetch_add(1);
+            next.doc->set_file_stat(file_size, mtime);
+
+            if (m_io && next.doc->parses_raw_content()) {
+                next.raw = m_io->read_file(filepath);
+            }
+
+            std::unique_lock<std::mutex> lock(pending_mutex);
+            document_taken.wait(lock, [&]() { return pending.size() < read_ahead; });
+            pending.push_back(std::move(next));
+            lock.unlock();
+            document_added.notify_one();
+        }
+        crawled_all = true;
+    } catch (std::exception &e) {
+        std::cerr << "Crawling " << directory << " failed: " << e.what() << std::endl;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        crawled = true;
+    }
+    document_added.notify_all();
+    for (auto &thread: indexing_threads) {
+        thread.join();
+    }
+
+    /* the blobs have to be complete before snippets read them */
+    m_content_store->flush();
+
+    /* after a failed crawl the missing files may still exist */
+    if (crawled_all) {
+        for (const auto &[filepath, docid]: unseen_files) {
+            remove_document(docid);
+            removed++;
+        }
     }
+
+    std::cout << "Indexed " << indexed << " files (" << replaced << " changed), skipped " << unchanged;
+    std::cout << " unchanged files, removed " << removed << " documents" << std::endl;
+    return indexed + replaced + removed;
 }
 
 /*
-*   read stopwords from a txt file, save them in vector
+*   read stopwords from a txt file, lower case, an unreadable file means no stopwords
 */
-void Index::read_stopwords(const std::string &filepath) {
+std::unordered_set<std::string> Index::read_stopwords(const std::string &filepath) {
+    std::unordered_set<std::string> stopwords;
     try {
         std::ifstream file(filepath);
         if (!file.is_open()) {
@@ -210,18 +830,147 @@ void Index::read_stopwords(const std::string &filepath) {
         std::stringstream iss(content);
         std::string word;
         while (iss >> word) {
-            stopwords.push_back(word);
+            std::transform(word.begin(), word.end(), word.begin(),
+                           [](unsigned char c) { return std::tolower(c); });
+            stopwords.insert(word);
         }
     } catch (std::exception &e) {
         std::cerr << "Exception ocurred reading stop words: " << e.what() << std::endl;
         stopwords.clear();
-        return;
     }
+
+    std::cout << "Stopwords: " << stopwords.size() << " words" << std::endl;
+    return stopwords;
+}
+
+/*
+*   Builds the sorted term dictionary and inverts the concordances into docid ordered postings with skip pointers.
+*   The dictionary is written to terms.dict and the postings to postings.bin, both are mapped from there,
+*   the postings are indexed by term id.
+*/
+void Index::build_postings() {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    /* postings have to be appended in docid order */
+    std::vector<uint64_t> docids;
+    docids.reserve(documents.size());
+    for (const auto &[docid, doc]: documents) {
+        docids.push_back(docid);
+    }
+    std::sort(docids.begin(), docids.end());
+
+    /* the views point into the concordances, they live as long as the documents */
+    std::unordered_map<std::string_view, uint32_t> term_ids;
+    for (const auto &[docid, doc]: documents) {
+        for (const auto &[term, term_freq]: doc->get_concordance()) {
+            term_ids.emplace(term, 0);
+        }
+    }
+
+    std::vector<std::string_view> sorted_terms;
+    sorted_terms.reserve(term_ids.size());
+    for (const auto &[term, id]: term_ids) {
+        sorted_terms.push_back(term);
+    }
+    std::sort(sorted_terms.begin(), sorted_terms.end());
+
+    /* what the terms would take as keys of a hash map: the string, its heap buffer and a node */
+    uint64_t hashed_bytes = 0;
+    for (uint32_t id = 0; id < sorted_terms.size(); ++id) {
+        term_ids[sorted_terms[id]] = id;
+        hashed_bytes += sizeof(std::string) + 2 * sizeof(void*) + (sorted_terms[id].size() > 15 ? sorted_terms[id].size() + 1 : 0);
+    }
+
+    std::vector<PostingsList> postings(sorted_terms.size());
+    std::vector<uint32_t> doc_lengths(m_docid_counter.load(), 0);
+    for (uint64_t docid: docids) {
+        const auto &doc = documents.at(docid);
+        if (docid >= doc_lengths.size()) {
+            doc_lengths.resize(docid + 1, 0);
+        }
+        doc_lengths[docid] = doc->get_total_term_count();
+
+        for (const auto &[term, term_freq]: doc->get_concordance()) {
+            postings[term_ids.at(term)].add(docid, term_freq);
+        }
+    }
+
+    for (auto &list: postings) {
+        list.finalize();
+    }
+
+    std::string dictionary_path = index_path + "/terms.dict";
+    m_dictionary.build(sorted_terms);
+    m_dictionary.save(dictionary_path);
+    m_dictionary.open(dictionary_path);
+
+    std::string postings_path = index_path + "/" + PostingsFile::filename;
+    PostingsFile::save(postings_path, postings, doc_lengths);
+    postings = {};
+    m_postings.open(postings_path);
+
+    std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start;
+    Metrics::instance().record(Metrics::Stage::IndexPostings, std::chrono::duration_cast<std::chrono::nanoseconds>(duration));
+    std::cout << "Postings: " << m_postings.get_term_count() << " terms, " << m_postings.get_size_bytes() << " bytes, built in ";
+    std::cout << duration.count() << " seconds" << std::endl;
+    std::cout << "Term dictionary: " << m_dictionary.get_size_bytes() << " bytes, ";
+    std::cout << hashed_bytes << " bytes as hashed strings" << std::endl;
+}
+
+/*
+*   Maps terms.dict, postings.bin and impact.bin as they are on disk.
+*   Returns false if one is missing, corrupt or they do not belong together, the files are replaced one by one
+*   when the index is written, so they have to be of the same run and cover every docid.
+*/
+bool Index::open_postings() {
+    std::string dictionary_path = index_path + "/terms.dict";
+    std::string postings_path = index_path + "/" + PostingsFile::filename;
+    std::string impact_path = index_path + "/" + ImpactIndex::filename;
+    if (!std::filesystem::exists(dictionary_path) || !std::filesystem::exists(postings_path)
+        || !std::filesystem::exists(impact_path)) {
+        return false;
+    }
+
+    try {
+        m_dictionary.open(dictionary_path);
+        m_postings.open(postings_path);
+        m_impact_index.open(impact_path);
+    } catch (std::exception &e) {
+        std::cerr << "Failed to map the postings in " << index_path << ": " << e.what() << std::endl;
+        return false;
+    }
+    return m_postings.get_term_count() == m_dictionary.size() && m_postings.get_doc_lengths().size() >= m_docid_counter.load()
+        && m_impact_index.get_term_count() == m_postings.get_term_count()
+        && m_impact_index.get_postings_count() == m_postings.get_postings_count();
+}
+
+/*
+*   Precomputes the BM25 score of every posting for the impact ordered layout and writes it to impact.bin,
+*   needs the average document length and the postings, so call it after build_postings.
+*   Runs in the constructor, on the thread that loads a generation, never inside a query.
+*/
+void Index::build_impact_index() {
+    std::call_once(m_impact_index_flag, [this]() {
+        auto start = std::chrono::high_resolution_clock::now();
+        int total_docs = get_document_counter();
+
+        std::string impact_path = index_path + "/" + ImpactIndex::filename;
+        ImpactIndex::save(impact_path, m_postings, [this, total_docs](int term_freq, int doc_length, int doc_freq) {
+            return compute_bm25(term_freq, doc_length, m_avg_doc_length, compute_idf(total_docs, doc_freq));
+        });
+        m_impact_index.open(impact_path);
+
+        std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start;
+        Metrics::instance().record(Metrics::Stage::IndexImpact, std::chrono::duration_cast<std::chrono::nanoseconds>(duration));
+        std::cout << "Impact index: " << m_impact_index.get_postings_count() << " postings, ";
+        std::cout << m_impact_index.get_size_bytes() << " bytes, built in " << duration.count() << " seconds" << std::endl;
+    });
 }
 
 void Index::set_avg_doc_length() {
     std::lock_guard<std::mutex> lock(m_index_mutex);
-    m_avg_doc_length = m_total_term_count / get_document_counter();
+    int document_count = get_document_counter();
+    m_avg_doc_length = document_count > 0 ? m_total_term_count / document_count : 0;
 }
 
 double Index::compute_idf(int total_docs, int doc_freq) {
@@ -235,33 +984,45 @@ double Index::compute_bm25(int term_freq, int doc_length, double avg_doc_len, do
 }
 
 void Index::save_index_to_file(std::string filepath) {
+    Metrics::Timer save_timer(Metrics::Stage::IndexSave);
     nlohmann::json j;
 
     /* save docid counter, otherwise duplicates will be created after loading the index */
     j["docid_counter"] = m_docid_counter.load();
+    /* queries have to be analyzed like the documents */
+    j["analyzer"] = m_analyzer.to_json();
 
     j["documents"] = nlohmann::json::array();
     for (const auto &[docid, doc]: documents) {
         j["documents"].push_back(doc->to_json());
     }
 
-    std::ofstream file(filepath);
-    if (!file) {
-        throw std::runtime_error("Failed to open index file for writing");
-    }
+    /* replaced by rename, a reload never reads a half written file */
+    {
+        std::ofstream file(filepath + ".tmp", std::ios::trunc);
+        if (!file) {
+            throw std::runtime_error("Failed to open index file for writing");
+        }
 
-    file << j.dump(4);
+        file << j.dump(4);
+        if (!file.flush()) {
+            throw std::runtime_error("Failed to write index file");
+        }
+    }
+    std::filesystem::rename(filepath + ".tmp", filepath);
     write_index_marker();
 }
 
-void Index::load_index_from_file(std::string filepath) {
+void Index::load_index_from_file(std::string filepath, bool with_terms) {
     std::ifstream file(filepath);
     if (!file) {
         throw std::runtime_error("Failed to open index file for reading");
     }
 
-    nlohmann::json j;
-    file >> j;
+    /* the concordances are most of the file, without terms they are dropped while parsing */
+    nlohmann::json j = nlohmann::json::parse(file, [with_terms](int, nlohmann::json::parse_event_t event, nlohmann::json &parsed) {
+        return with_terms || event != nlohmann::json::parse_event_t::key || parsed != "concordance";
+    });
 
     /* load docid counter */
     if (j.contains("docid_counter")) {
@@ -271,12 +1032,20 @@ void Index::load_index_from_file(std::string filepath) {
         m_docid_counter = 1;
     }
 
+    if (j.contains("analyzer")) {
+        m_analyzer = Analyzer::from_json(j["analyzer"]);
+    }
+
     /* load documents */
     if (j.contains("documents") && j["documents"].is_array()) {
         /* TODO: make this also multithreaded? */
         for (const auto &doc_json: j["documents"]) {
             auto doc = DocumentFactory::from_json(doc_json);
             m_total_term_count += doc->get_total_term_count();
+            if (!doc->get_filepath().empty()) {
+                m_file_docids[doc->get_filepath()] = doc->get_docid();
+            }
+            m_content_docids.emplace(doc->get_content_hash(), doc->get_docid());
             documents.emplace(doc->get_docid(), std::move(doc));
         }
     }
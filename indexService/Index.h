@@ -1,66 +1,167 @@
 #ifndef _H_INDEX
 #define _H_INDEX
 
+#include <atomic>
+#include <chrono>
 #include <exception>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <future>
 
+#include "Analyzer.h"
+#include "ConsistencyChecker.h"
 #include "Document.h"
 #include "ContentAddressedStorage.h"
+#include "ImpactIndex.h"
+#include "IOBackend.h"
+#include "PositionalIndex.h"
+#include "PostingsFile.h"
+#include "Query.h"
+#include "QueryParser.h"
+#include "SnippetGenerator.h"
+#include "TermDictionary.h"
+
+/* options for building a new index */
+struct IndexOptions {
+    /* store token positions for phrase queries and proximity ranking */
+    bool positional = false;
+    /* analysis chain, see Analyzer */
+    bool strip_possessives = false;
+    bool stem = false;
+    /* whitespace separated stopwords, empty for none */
+    std::string stopwords_path;
+    /* reads and writes in flight during indexing, 0 reads with mmap and writes synchronously,
+     * which is faster for plain text than copying every file through the backend */
+    size_t io_queue_depth = 0;
+    /* renumber the documents after a build or update so that documents sharing terms get close docids, see DocidReorderer */
+    bool reorder_docids = false;
+    /* serve a saved index as it is: nothing is indexed, the postings are mapped and the documents are loaded without their terms */
+    bool read_only = false;
+};
 
 class Index {
     public:
-        Index(std::string directory, std::string index_path, std::unique_ptr<ContentAddressedStorage> &content_store);
+        Index(std::string directory, std::string index_path, std::unique_ptr<ContentAddressedStorage> &content_store,
+            const IndexOptions &options = {});
         ~Index() = default;
 
-        std::vector<std::pair<uint64_t, double>> query_index(const std::vector<std::string> &input_values);
+        QueryResult query_index(const QueryNode &query, const QueryOptions &options = {});
+        QueryResult query_index(const std::vector<std::string> &input_values, const QueryOptions &options = {});
+
+        /* a query of a batch: its index in the batch, the results and the error if it failed */
+        using BatchResultFunction = std::function<void(size_t, const QueryResult &, const std::string &)>;
+        /*
+        *   Evaluates the queries with the same options on all cores, bag of words queries share the scoring of
+        *   their common terms, see BatchEvaluator. on_result is called for every query as soon as it is done,
+        *   in no particular order and from several threads at once. Once cancelled is set, e.g. because the client
+        *   is gone, no further query is started and the call returns when the running ones are done.
+        */
+        void query_batch(const std::vector<std::string_view> &queries, const QueryOptions &options, const BatchResultFunction &on_result,
+            const std::atomic<bool> *cancelled = nullptr);
         const Document &get_document_by_id(uint64_t docid) const;
+        /* document count, term count and the document frequencies of the query terms, for scoring across shards */
+        CollectionStats get_collection_stats(const QueryNode &query) const;
+
+        /* snippets with highlighted query terms for each docid, generated in parallel within the budget */
+        std::vector<std::vector<std::string>> get_snippets(const std::vector<uint64_t> &docids, const QueryNode &query,
+            int fuzzy, size_t snippets_per_hit, std::chrono::milliseconds budget);
 
-        /* TODO: implement a consistency check against the content storage, are hashes from index present in filesystem? */
+        /*
+        *   Reads the term dictionary, the document lengths, the positions and the postings of the terms of the
+        *   queries into memory before the index serves them, returns the number of terms read
+        */
+        size_t warm_up(const std::vector<std::string> &queries) const;
+
+        /* one step of the consistency check of the content storage, see ConsistencyChecker */
+        VerifyReport verify_content(const VerifyOptions &options);
 
         int get_document_counter();
         int get_total_term_count();
         int get_avg_doc_length();
+        uint64_t get_index_size_bytes();
+        const PositionalIndex &get_positional_index() const;
+        const TermDictionary &get_term_dictionary() const;
+        /* documents the constructor indexed or removed, 0 for an index that was up to date or is read only */
+        size_t get_changed_documents() const;
+        const Analyzer &get_analyzer() const;
+
+        /* BM25 */
+        static double compute_idf(int total_docs, int doc_freq);
+        static double compute_bm25(int term_freq, int doc_length, double avg_doc_len, double idf, double k1 = 1.2, double b = 0.75);
 
     private:
         /* holds a reference to every document in the index */
         std::unordered_map<uint64_t, std::unique_ptr<Document>> documents;
-        std::vector<std::string> stopwords;
 
+        std::string m_directory;
         std::string index_path;
+        IndexOptions m_options;
+        /* loaded from index.json for an existing index */
+        Analyzer m_analyzer;
 
         /* content storage */
         std::shared_ptr<ContentAddressedStorage> m_content_store;       
+        SnippetGenerator m_snippet_generator;
+
+        /* remembers where the last step of the consistency check stopped, one step at a time */
+        ConsistencyChecker m_checker;
+        std::mutex m_verify_mutex;
+
+        /* sorted terms, memory mapped from terms.dict, a term id is the rank of the term */
+        TermDictionary m_dictionary;
+
+        /* docid ordered postings per term id and the length of every document by docid, mapped from postings.bin */
+        PostingsFile m_postings;
+
+        /* optional token positions, lazily loaded from their own files */
+        PositionalIndex m_positional_index;
+
+        /* postings ordered by impact for early terminating queries, mapped from impact.bin, the flag guards its build */
+        ImpactIndex m_impact_index;
+        std::once_flag m_impact_index_flag;
 
         /* relevant for BM25 */
         uint64_t m_total_term_count;
         uint64_t m_avg_doc_length;
 
-        /* Parallelization with future */
-        std::vector<std::future<void>> m_futures;
+        /* Parallelization: files are read by the I/O backend and indexed on a thread per core */
+        std::shared_ptr<IOBackend> m_io;
         std::mutex m_index_mutex;
         std::atomic<uint64_t> m_docid_counter{1};
+        size_t m_changed_documents = 0;
+
+        /* incremental indexing: the document of every file and a document for every content hash */
+        std::unordered_map<std::string, uint64_t> m_file_docids;
+        std::unordered_map<std::string, uint64_t> m_content_docids;
 
         /* Indexing */
-        void index_document(std::unique_ptr<Document> &doc);
-        void build_document_index(std::string directory);
-        void read_stopwords(const std::string &filepath);
+        void index_document(std::unique_ptr<Document> &doc, const Content &content);
+        size_t build_document_index(std::string directory);
+        size_t update_index(std::string directory, std::string index_filepath);
+        void remove_document(uint64_t docid);
+        void reorder_documents();
+        std::unordered_set<std::string> read_stopwords(const std::string &filepath);
+        void build_postings();
+        bool open_postings();
+        void build_impact_index();
 
         /* file persistence */
         void write_index_marker();
         bool is_index_present();
         void save_index_to_file(std::string filepath);
-        void load_index_from_file(std::string filepath);
+        /* without terms the concordances are skipped, the documents then only describe their files */
+        void load_index_from_file(std::string filepath, bool with_terms = true);
+
+        void record_query_metrics(const QueryResult &query_result);
 
         /* BM25 Stuff */
         void set_avg_doc_length();
-        double compute_idf(int total_docs, int doc_freq);
-        double compute_bm25(int term_freq, int doc_length, double avg_doc_len, double idf, double k1 = 1.2, double b = 0.75);
 };
 
 #endif
\ No newline at end of file
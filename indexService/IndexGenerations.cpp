@@ -0,0 +1,139 @@
+#include <malloc.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+#include "IndexGenerations.h"
+#include "Logger.h"
+
+IndexGenerations::IndexGenerations(boost::asio::io_context &io, Factory factory)
+    : m_io(io), m_factory(std::move(factory)), m_current(m_factory())
+{
+}
+
+IndexGenerations::~IndexGenerations() {
+    if (m_signals) {
+        boost::system::error_code ec;
+        m_signals->cancel(ec);
+    }
+    if (m_reload_thread.joinable()) {
+        m_reload_thread.join();
+    }
+    if (m_release_thread.joinable()) {
+        m_release_thread.join();
+    }
+}
+
+std::shared_ptr<Index> IndexGenerations::current() const { return m_current; }
+uint64_t IndexGenerations::get_generation() const { return m_generation; }
+bool IndexGenerations::is_reloading() const { return m_reloading; }
+
+bool IndexGenerations::reload(Done on_done) {
+    if (m_reloading) {
+        return false;
+    }
+    /* the thread of the last reload has posted its result already */
+    if (m_reload_thread.joinable()) {
+        m_reload_thread.join();
+    }
+
+    m_reloading = true;
+    std::vector<std::string> queries(m_recent_queries.begin(), m_recent_queries.end());
+    Logger::info() << "Loading index generation " << m_generation + 1;
+
+    m_reload_thread = std::thread([this, serving = m_current, queries = std::move(queries), on_done = std::move(on_done)]() mutable {
+        /* the threads started for indexing inherit the priority, queries keep the CPU */
+        setpriority(PRIO_PROCESS, syscall(SYS_gettid), reload_nice);
+        /* the generation before the last one is freed by now, at most two are in memory while loading */
+        if (m_release_thread.joinable()) {
+            m_release_thread.join();
+        }
+        std::shared_ptr<Index> next;
+        std::string error;
+        size_t warmed_terms = 0;
+        auto start = std::chrono::steady_clock::now();
+        std::chrono::duration<double> load_time{0};
+        try {
+            /* the serving generation maps its positions before the new one renames the files over them */
+            serving->get_positional_index().prefetch();
+            serving.reset();
+            next = m_factory();
+            load_time = std::chrono::steady_clock::now() - start;
+            warmed_terms = next->warm_up(queries);
+        } catch (const std::exception &e) {
+            error = e.what();
+            next.reset();
+        }
+        std::chrono::duration<double> warm_up_time = std::chrono::steady_clock::now() - start - load_time;
+
+        boost::asio::post(m_io, [this, next = std::move(next), error, load_time, warm_up_time, warmed_terms, on_done = std::move(on_done)]() mutable {
+            m_reloading = false;
+            m_last_error = error;
+            m_last_load_seconds = load_time.count();
+            m_last_warm_up_seconds = warm_up_time.count();
+            m_last_warmed_terms = warmed_terms;
+            if (!next) {
+                Logger::error() << "Reloading the index failed, generation " << m_generation << " keeps serving: " << error;
+            } else {
+                swap(std::move(next));
+            }
+            if (on_done) {
+                on_done(error);
+            }
+        });
+    });
+    return true;
+}
+
+/* on the thread of the io_context, so no request is between two generations */
+void IndexGenerations::swap(std::shared_ptr<Index> next) {
+    std::shared_ptr<Index> previous = std::move(m_current);
+    m_current = std::move(next);
+    m_generation++;
+    Logger::info() << "Serving index generation " << m_generation << ", loaded in " << m_last_load_seconds
+        << " seconds, warmed up " << m_last_warmed_terms << " terms in " << m_last_warm_up_seconds << " seconds";
+
+    /* requests still running on the previous generation release it when they are done */
+    m_release_thread = std::thread([previous = std::move(previous)]() mutable {
+        previous.reset();
+        malloc_trim(0);
+    });
+}
+
+void IndexGenerations::reload_on_signal(int signal_number) {
+    m_signals = std::make_unique<boost::asio::signal_set>(m_io, signal_number);
+    wait_for_signal();
+}
+
+void IndexGenerations::wait_for_signal() {
+    m_signals->async_wait([this](const boost::system::error_code &ec, int) {
+        if (ec) {
+            return;
+        }
+        if (!reload()) {
+            Logger::info() << "Reload signal ignored, a reload is running";
+        }
+        wait_for_signal();
+    });
+}
+
+void IndexGenerations::remember_query(std::string_view query) {
+    m_recent_queries.emplace_back(query);
+    if (m_recent_queries.size() > max_remembered_queries) {
+        m_recent_queries.pop_front();
+    }
+}
+
+nlohmann::json IndexGenerations::get_status() const {
+    return {
+        {"generation", m_generation},
+        {"reloading", m_reloading},
+        {"last_reload", {
+            {"load_seconds", m_last_load_seconds},
+            {"warm_up_seconds", m_last_warm_up_seconds},
+            {"warmed_terms", m_last_warmed_terms},
+            {"error", m_last_error}
+        }}
+    };
+}
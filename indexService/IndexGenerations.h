@@ -0,0 +1,84 @@
+#ifndef _H_INDEXGENERATIONS
+#define _H_INDEXGENERATIONS
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include <boost/asio.hpp>
+#include <nlohmann/json.hpp>
+
+#include "Index.h"
+
+/*
+*   The index the server queries, replaced by a new generation without downtime.
+*   A reload builds the new generation on a background thread at a lower CPU priority, e.g. a server loads its
+*   updated directory and a worker maps the files its supervisor rebuilt. The new generation is warmed up with the
+*   recent queries, then swapped in on the thread of the io_context. Every request holds the generation it started
+*   with, the old generation is freed on a background thread. If the reload fails the old generation keeps serving.
+*
+*   All methods are called on the thread of the io_context.
+*/
+class IndexGenerations {
+    public:
+        using Factory = std::function<std::unique_ptr<Index>()>;
+        /* the error of a failed reload, empty once the new generation serves */
+        using Done = std::function<void(const std::string &)>;
+
+        /* loads the first generation with the factory, a reload uses it again */
+        IndexGenerations(boost::asio::io_context &io, Factory factory);
+        ~IndexGenerations();
+
+        IndexGenerations(const IndexGenerations &) = delete;
+        IndexGenerations &operator=(const IndexGenerations &) = delete;
+
+        std::shared_ptr<Index> current() const;
+        uint64_t get_generation() const;
+
+        /* starts loading a new generation, false if a reload is running already; on_done is called on the io_context */
+        bool reload(Done on_done = nullptr);
+        bool is_reloading() const;
+        /* reloads on every delivery of the signal, e.g. SIGHUP */
+        void reload_on_signal(int signal_number);
+
+        /* the queries are replayed into the postings of the next generation before it is swapped in */
+        void remember_query(std::string_view query);
+
+        /* generation, whether a reload is running and the outcome of the last one */
+        nlohmann::json get_status() const;
+
+        /* queries kept for the warm up */
+        static constexpr size_t max_remembered_queries = 256;
+        /* nice value of the thread that loads a new generation and of its indexing threads */
+        static constexpr int reload_nice = 10;
+
+    private:
+        boost::asio::io_context &m_io;
+        Factory m_factory;
+        std::shared_ptr<Index> m_current;
+        uint64_t m_generation = 1;
+
+        bool m_reloading = false;
+        std::thread m_reload_thread;
+        /* frees the replaced generation, its destructor can take a while */
+        std::thread m_release_thread;
+        std::unique_ptr<boost::asio::signal_set> m_signals;
+
+        std::deque<std::string> m_recent_queries;
+
+        /* the last reload */
+        std::string m_last_error;
+        double m_last_load_seconds = 0.0;
+        double m_last_warm_up_seconds = 0.0;
+        size_t m_last_warmed_terms = 0;
+
+        void wait_for_signal();
+        void swap(std::shared_ptr<Index> next);
+};
+
+#endif
@@ -0,0 +1,380 @@
+#include <charconv>
+
+#include "JsonReader.h"
+
+namespace {
+
+bool is_number_start(char c) {
+    return c == '-' || (c >= '0' && c <= '9');
+}
+
+int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+void append_utf8(std::string &out, uint32_t code_point) {
+    if (code_point < 0x80) {
+        out += static_cast<char>(code_point);
+    } else if (code_point < 0x800) {
+        out += static_cast<char>(0xC0 | (code_point >> 6));
+        out += static_cast<char>(0x80 | (code_point & 0x3F));
+    } else if (code_point < 0x10000) {
+        out += static_cast<char>(0xE0 | (code_point >> 12));
+        out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code_point & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (code_point >> 18));
+        out += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code_point & 0x3F));
+    }
+}
+
+}
+
+JsonReader::JsonReader(std::string_view text) : m_text(text) {}
+
+JsonReader::Type JsonReader::peek() {
+    skip_whitespace();
+    if (m_pos >= m_text.size()) {
+        fail("Unexpected end of JSON");
+    }
+
+    char c = m_text[m_pos];
+    switch (c) {
+        case '{': return Type::Object;
+        case '[': return Type::Array;
+        case '"': return Type::String;
+        case 't':
+        case 'f': return Type::Bool;
+        case 'n': return Type::Null;
+        default:
+            if (is_number_start(c)) {
+                return Type::Number;
+            }
+            fail(std::string("Unexpected character '") + c + "'");
+    }
+}
+
+void JsonReader::begin_object() {
+    if (peek() != Type::Object) {
+        throw TypeError("Expected an object");
+    }
+    open('{');
+}
+
+bool JsonReader::next_key(std::string_view &key) {
+    if (!next('}')) {
+        return false;
+    }
+    skip_whitespace();
+    if (m_pos >= m_text.size() || m_text[m_pos] != '"') {
+        fail("Expected a key");
+    }
+    key = string_token();
+    skip_whitespace();
+    expect(':');
+    return true;
+}
+
+void JsonReader::begin_array() {
+    if (peek() != Type::Array) {
+        throw TypeError("Expected an array");
+    }
+    open('[');
+}
+
+bool JsonReader::next_element() {
+    return next(']');
+}
+
+std::string_view JsonReader::read_string() {
+    if (peek() != Type::String) {
+        throw TypeError("Expected a string");
+    }
+    return string_token();
+}
+
+int64_t JsonReader::read_integer() {
+    if (peek() != Type::Number) {
+        throw TypeError("Expected a number");
+    }
+    std::string_view token = number_token();
+    int64_t number;
+    auto result = std::from_chars(token.data(), token.data() + token.size(), number);
+    if (result.ec != std::errc() || result.ptr != token.data() + token.size()) {
+        throw TypeError("Expected an integer");
+    }
+    return number;
+}
+
+uint64_t JsonReader::read_unsigned() {
+    if (peek() != Type::Number) {
+        throw TypeError("Expected a number");
+    }
+    std::string_view token = number_token();
+    uint64_t number;
+    auto result = std::from_chars(token.data(), token.data() + token.size(), number);
+    if (result.ec != std::errc() || result.ptr != token.data() + token.size()) {
+        throw TypeError("Expected an unsigned integer");
+    }
+    return number;
+}
+
+double JsonReader::read_double() {
+    if (peek() != Type::Number) {
+        throw TypeError("Expected a number");
+    }
+    std::string_view token = number_token();
+    double number;
+    auto result = std::from_chars(token.data(), token.data() + token.size(), number);
+    if (result.ec != std::errc() || result.ptr != token.data() + token.size()) {
+        fail("Invalid number");
+    }
+    return number;
+}
+
+bool JsonReader::read_bool() {
+    if (peek() != Type::Bool) {
+        throw TypeError("Expected a boolean");
+    }
+    if (m_text[m_pos] == 't') {
+        literal("true");
+        return true;
+    }
+    literal("false");
+    return false;
+}
+
+void JsonReader::skip() {
+    std::string_view key;
+    switch (peek()) {
+        case Type::Object:
+            begin_object();
+            while (next_key(key)) {
+                skip();
+            }
+            break;
+        case Type::Array:
+            begin_array();
+            while (next_element()) {
+                skip();
+            }
+            break;
+        case Type::String:
+            string_token();
+            break;
+        case Type::Number:
+            number_token();
+            break;
+        case Type::Bool:
+            read_bool();
+            break;
+        case Type::Null:
+            literal("null");
+            break;
+    }
+}
+
+std::string_view JsonReader::read_raw() {
+    skip_whitespace();
+    size_t start = m_pos;
+    skip();
+    return m_text.substr(start, m_pos - start);
+}
+
+void JsonReader::finish() {
+    skip_whitespace();
+    if (m_pos != m_text.size() || !m_first.empty()) {
+        fail("Unexpected content after the JSON value");
+    }
+}
+
+void JsonReader::skip_whitespace() {
+    while (m_pos < m_text.size()) {
+        char c = m_text[m_pos];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            return;
+        }
+        m_pos++;
+    }
+}
+
+void JsonReader::expect(char c) {
+    if (m_pos >= m_text.size() || m_text[m_pos] != c) {
+        fail(std::string("Expected '") + c + "'");
+    }
+    m_pos++;
+}
+
+void JsonReader::fail(const std::string &message) const {
+    throw ParseError(message + " at offset " + std::to_string(m_pos));
+}
+
+void JsonReader::open(char c) {
+    if (m_first.size() >= max_depth) {
+        fail("JSON nested too deeply");
+    }
+    expect(c);
+    m_first.push_back(true);
+}
+
+/* moves behind the comma before the next member or element, or behind the closing bracket */
+bool JsonReader::next(char close) {
+    if (m_first.empty()) {
+        fail("No open object or array");
+    }
+    skip_whitespace();
+    if (m_pos < m_text.size() && m_text[m_pos] == close) {
+        m_pos++;
+        m_first.pop_back();
+        return false;
+    }
+    if (!m_first.back()) {
+        expect(',');
+    }
+    m_first.back() = false;
+    return true;
+}
+
+/* the grammar of JSON numbers, converted by the caller */
+std::string_view JsonReader::number_token() {
+    size_t start = m_pos;
+    auto digits = [this]() {
+        size_t first = m_pos;
+        while (m_pos < m_text.size() && m_text[m_pos] >= '0' && m_text[m_pos] <= '9') {
+            m_pos++;
+        }
+        return m_pos - first;
+    };
+
+    if (m_text[m_pos] == '-') {
+        m_pos++;
+    }
+    size_t integer_start = m_pos;
+    size_t integer_digits = digits();
+    if (integer_digits == 0 || (integer_digits > 1 && m_text[integer_start] == '0')) {
+        fail("Invalid number");
+    }
+    if (m_pos < m_text.size() && m_text[m_pos] == '.') {
+        m_pos++;
+        if (digits() == 0) {
+            fail("Invalid number");
+        }
+    }
+    if (m_pos < m_text.size() && (m_text[m_pos] == 'e' || m_text[m_pos] == 'E')) {
+        m_pos++;
+        if (m_pos < m_text.size() && (m_text[m_pos] == '+' || m_text[m_pos] == '-')) {
+            m_pos++;
+        }
+        if (digits() == 0) {
+            fail("Invalid number");
+        }
+    }
+    return m_text.substr(start, m_pos - start);
+}
+
+std::string_view JsonReader::string_token() {
+    expect('"');
+    size_t start = m_pos;
+    while (m_pos < m_text.size()) {
+        unsigned char c = m_text[m_pos];
+        if (c == '"') {
+            return m_text.substr(start, m_pos++ - start);
+        }
+        if (c == '\\') {
+            break;
+        }
+        if (c < 0x20) {
+            fail("Control character in string");
+        }
+        m_pos++;
+    }
+    if (m_pos >= m_text.size()) {
+        fail("Unterminated string");
+    }
+
+    /* escaped, decoded into storage of the reader */
+    std::string &decoded = m_decoded.emplace_back(m_text.substr(start, m_pos - start));
+    auto read_hex4 = [this]() {
+        if (m_pos + 4 > m_text.size()) {
+            fail("Invalid unicode escape");
+        }
+        uint32_t value = 0;
+        for (size_t i = 0; i < 4; ++i) {
+            int digit = hex_value(m_text[m_pos++]);
+            if (digit < 0) {
+                fail("Invalid unicode escape");
+            }
+            value = value << 4 | digit;
+        }
+        return value;
+    };
+
+    while (m_pos < m_text.size()) {
+        unsigned char c = m_text[m_pos++];
+        if (c == '"') {
+            return decoded;
+        }
+        if (c < 0x20) {
+            fail("Control character in string");
+        }
+        if (c != '\\') {
+            decoded += static_cast<char>(c);
+            continue;
+        }
+        if (m_pos >= m_text.size()) {
+            break;
+        }
+
+        char escape = m_text[m_pos++];
+        switch (escape) {
+            case '"': decoded += '"'; break;
+            case '\\': decoded += '\\'; break;
+            case '/': decoded += '/'; break;
+            case 'b': decoded += '\b'; break;
+            case 'f': decoded += '\f'; break;
+            case 'n': decoded += '\n'; break;
+            case 'r': decoded += '\r'; break;
+            case 't': decoded += '\t'; break;
+            case 'u': {
+                uint32_t code_point = read_hex4();
+                /* a high surrogate has to be followed by a low one */
+                if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+                    if (m_pos + 2 > m_text.size() || m_text[m_pos] != '\\' || m_text[m_pos + 1] != 'u') {
+                        fail("Unpaired surrogate in string");
+                    }
+                    m_pos += 2;
+                    uint32_t low = read_hex4();
+                    if (low < 0xDC00 || low > 0xDFFF) {
+                        fail("Unpaired surrogate in string");
+                    }
+                    code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                } else if (code_point >= 0xDC00 && code_point <= 0xDFFF) {
+                    fail("Unpaired surrogate in string");
+                }
+                append_utf8(decoded, code_point);
+                break;
+            }
+            default:
+                fail("Invalid escape in string");
+        }
+    }
+    fail("Unterminated string");
+}
+
+void JsonReader::literal(std::string_view word) {
+    if (m_text.substr(m_pos, word.size()) != word) {
+        fail("Invalid literal");
+    }
+    m_pos += word.size();
+}
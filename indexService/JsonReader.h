@@ -0,0 +1,76 @@
+#ifndef _H_JSONREADER
+#define _H_JSONREADER
+
+#include <cstdint>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+*   Pull parser over a JSON text that stays in memory, e.g. the body of a request, without building a document.
+*   Strings without escapes are returned as views into the text, strings with escapes are decoded into storage
+*   of the reader. The views are valid as long as the text and the reader are.
+*
+*   An object is read with begin_object and next_key until it returns false, an array with begin_array and
+*   next_element. Values that are not needed are skipped.
+*   Throws ParseError on malformed JSON and TypeError if a value is read as another type than it has.
+*/
+class JsonReader {
+    public:
+        enum class Type { Object, Array, String, Number, Bool, Null };
+
+        struct ParseError : std::runtime_error {
+            using std::runtime_error::runtime_error;
+        };
+        struct TypeError : std::runtime_error {
+            using std::runtime_error::runtime_error;
+        };
+
+        explicit JsonReader(std::string_view text);
+
+        /* type of the next value */
+        Type peek();
+
+        void begin_object();
+        /* false at the end of the object, otherwise the next value belongs to the key */
+        bool next_key(std::string_view &key);
+        void begin_array();
+        /* false at the end of the array */
+        bool next_element();
+
+        std::string_view read_string();
+        /* numbers with a fraction or exponent are no integers */
+        int64_t read_integer();
+        uint64_t read_unsigned();
+        double read_double();
+        bool read_bool();
+        void skip();
+        /* skips the next value and returns its text, e.g. for nlohmann::json */
+        std::string_view read_raw();
+
+        /* throws ParseError if anything but whitespace follows the values read */
+        void finish();
+
+        /* nesting of objects and arrays */
+        static constexpr size_t max_depth = 256;
+
+    private:
+        std::string_view m_text;
+        size_t m_pos = 0;
+        /* per open object or array: no member or element read yet */
+        std::vector<bool> m_first;
+        std::deque<std::string> m_decoded;
+
+        void skip_whitespace();
+        void expect(char c);
+        [[noreturn]] void fail(const std::string &message) const;
+        std::string_view number_token();
+        std::string_view string_token();
+        void literal(std::string_view word);
+        void open(char c);
+        bool next(char close);
+};
+
+#endif
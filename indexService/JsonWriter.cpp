@@ -0,0 +1,178 @@
+#include <cmath>
+
+#include "JsonWriter.h"
+
+namespace {
+
+const char *hex_digits = "0123456789abcdef";
+const char *replacement_character = "\xEF\xBF\xBD";
+
+/* length of the valid UTF-8 sequence at the start of text, 0 if it is invalid */
+size_t utf8_sequence_length(std::string_view text) {
+    unsigned char lead = text[0];
+    size_t length;
+    unsigned char min_second = 0x80;
+    unsigned char max_second = 0xBF;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        /* no overlong forms and no surrogates */
+        min_second = lead == 0xE0 ? 0xA0 : 0x80;
+        max_second = lead == 0xED ? 0x9F : 0xBF;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        min_second = lead == 0xF0 ? 0x90 : 0x80;
+        max_second = lead == 0xF4 ? 0x8F : 0xBF;
+    } else {
+        return 0;
+    }
+
+    if (text.size() < length) {
+        return 0;
+    }
+    unsigned char second = text[1];
+    if (second < min_second || second > max_second) {
+        return 0;
+    }
+    for (size_t i = 2; i < length; ++i) {
+        unsigned char c = text[i];
+        if (c < 0x80 || c > 0xBF) {
+            return 0;
+        }
+    }
+    return length;
+}
+
+}
+
+JsonWriter::JsonWriter(std::string &out) : m_out(out) {}
+
+JsonWriter &JsonWriter::begin_object() {
+    separate();
+    m_out += '{';
+    m_first.push_back(true);
+    return *this;
+}
+
+JsonWriter &JsonWriter::end_object() {
+    m_out += '}';
+    m_first.pop_back();
+    return *this;
+}
+
+JsonWriter &JsonWriter::begin_array() {
+    separate();
+    m_out += '[';
+    m_first.push_back(true);
+    return *this;
+}
+
+JsonWriter &JsonWriter::end_array() {
+    m_out += ']';
+    m_first.pop_back();
+    return *this;
+}
+
+JsonWriter &JsonWriter::key(std::string_view name) {
+    separate();
+    write_string(name);
+    m_out += ':';
+    m_after_key = true;
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(std::string_view text) {
+    separate();
+    write_string(text);
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(const char *text) {
+    return value(std::string_view(text));
+}
+
+JsonWriter &JsonWriter::value(bool b) {
+    separate();
+    m_out += b ? "true" : "false";
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(double d) {
+    separate();
+    if (!std::isfinite(d)) {
+        m_out += "null";
+        return *this;
+    }
+
+    char buffer[32];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), d);
+    std::string_view text(buffer, result.ptr - buffer);
+    m_out += text;
+    if (text.find_first_of(".e") == std::string_view::npos) {
+        m_out += ".0";
+    }
+    return *this;
+}
+
+JsonWriter &JsonWriter::raw(std::string_view json) {
+    separate();
+    m_out += json;
+    return *this;
+}
+
+void JsonWriter::separate() {
+    if (m_after_key) {
+        m_after_key = false;
+        return;
+    }
+    if (!m_first.empty()) {
+        if (!m_first.back()) {
+            m_out += ',';
+        }
+        m_first.back() = false;
+    }
+}
+
+void JsonWriter::write_string(std::string_view text) {
+    m_out += '"';
+    /* runs of characters that need no escaping are appended at once */
+    size_t run = 0;
+    size_t i = 0;
+    while (i < text.size()) {
+        unsigned char c = text[i];
+        if (c >= 0x20 && c != '"' && c != '\\' && c < 0x80) {
+            i++;
+            continue;
+        }
+        size_t length = c >= 0x80 ? utf8_sequence_length(text.substr(i)) : 0;
+        if (length > 0) {
+            i += length;
+            continue;
+        }
+
+        m_out.append(text.data() + run, i - run);
+        if (c >= 0x80) {
+            m_out += replacement_character;
+            i++;
+        } else {
+            switch (c) {
+                case '"': m_out += "\\\""; break;
+                case '\\': m_out += "\\\\"; break;
+                case '\b': m_out += "\\b"; break;
+                case '\f': m_out += "\\f"; break;
+                case '\n': m_out += "\\n"; break;
+                case '\r': m_out += "\\r"; break;
+                case '\t': m_out += "\\t"; break;
+                default:
+                    m_out += "\\u00";
+                    m_out += hex_digits[c >> 4];
+                    m_out += hex_digits[c & 0xF];
+            }
+            i++;
+        }
+        run = i;
+    }
+    m_out.append(text.data() + run, text.size() - run);
+    m_out += '"';
+}
@@ -0,0 +1,54 @@
+#ifndef _H_JSONWRITER
+#define _H_JSONWRITER
+
+#include <charconv>
+#include <concepts>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+*   Writes JSON directly into a string, e.g. the body of a response, without building a document first.
+*   The writer places the commas, the caller balances the objects and arrays. The output string can be
+*   taken away between two values, e.g. to send it as a chunk, the writer keeps appending to it.
+*
+*   Doubles are written in their shortest form that reads back to the same value, with ".0" for whole
+*   numbers like nlohmann::json does, NaN and infinity as null. Invalid UTF-8 in strings is replaced by U+FFFD.
+*/
+class JsonWriter {
+    public:
+        explicit JsonWriter(std::string &out);
+
+        JsonWriter &begin_object();
+        JsonWriter &end_object();
+        JsonWriter &begin_array();
+        JsonWriter &end_array();
+        /* the key of the next value in the current object */
+        JsonWriter &key(std::string_view name);
+
+        JsonWriter &value(std::string_view text);
+        JsonWriter &value(const char *text);
+        JsonWriter &value(bool b);
+        JsonWriter &value(double d);
+        template <std::integral T>
+        JsonWriter &value(T number) {
+            separate();
+            char buffer[24];
+            auto result = std::to_chars(buffer, buffer + sizeof(buffer), number);
+            m_out.append(buffer, result.ptr);
+            return *this;
+        }
+        /* a value that is serialized already, e.g. by nlohmann::json */
+        JsonWriter &raw(std::string_view json);
+
+    private:
+        std::string &m_out;
+        /* per open object or array: no value written yet */
+        std::vector<bool> m_first;
+        bool m_after_key = false;
+
+        void separate();
+        void write_string(std::string_view text);
+};
+
+#endif
@@ -0,0 +1,40 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "LevenshteinAutomaton.h"
+
+LevenshteinAutomaton::LevenshteinAutomaton(std::string_view term, int max_edits)
+    : m_term(term)
+{
+    if (max_edits < 0 || max_edits > 254) {
+        throw std::invalid_argument("Invalid edit distance");
+    }
+    m_max_edits = max_edits;
+}
+
+size_t LevenshteinAutomaton::state_size() const { return m_term.size() + 1; }
+
+/* the empty input needs i deletions to match the first i characters of the term */
+void LevenshteinAutomaton::start(uint8_t *state) const {
+    for (size_t i = 0; i <= m_term.size(); ++i) {
+        state[i] = std::min<size_t>(i, m_max_edits + 1);
+    }
+}
+
+bool LevenshteinAutomaton::step(const uint8_t *state, char c, uint8_t *next) const {
+    uint8_t cap = m_max_edits + 1;
+    next[0] = std::min<int>(state[0] + 1, cap);
+    bool alive = next[0] <= m_max_edits;
+
+    for (size_t i = 1; i <= m_term.size(); ++i) {
+        int substitution = state[i - 1] + (m_term[i - 1] == c ? 0 : 1);
+        int insertion = state[i] + 1;
+        int deletion = next[i - 1] + 1;
+        next[i] = std::min({substitution, insertion, deletion, static_cast<int>(cap)});
+        alive = alive || next[i] <= m_max_edits;
+    }
+    return alive;
+}
+
+bool LevenshteinAutomaton::is_match(const uint8_t *state) const { return state[m_term.size()] <= m_max_edits; }
+int LevenshteinAutomaton::distance(const uint8_t *state) const { return state[m_term.size()]; }
@@ -0,0 +1,34 @@
+#ifndef _H_LEVENSHTEINAUTOMATON
+#define _H_LEVENSHTEINAUTOMATON
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/*
+*   Accepts all strings within max_edits insertions, deletions or substitutions of a term.
+*   A state is a row of the edit distance matrix of the term against the input read so far,
+*   the values are capped at max_edits + 1, so the row of the next character only depends on the current row.
+*   Walking the automaton along the sorted term dictionary reuses the rows of a shared prefix,
+*   a dead state rules out every term which starts with the prefix read so far.
+*/
+class LevenshteinAutomaton {
+    public:
+        LevenshteinAutomaton(std::string_view term, int max_edits);
+
+        /* number of values in a state */
+        size_t state_size() const;
+        void start(uint8_t *state) const;
+        /* reads one character, writes the following state to next, false if it is dead */
+        bool step(const uint8_t *state, char c, uint8_t *next) const;
+
+        bool is_match(const uint8_t *state) const;
+        /* edit distance of the input to the term, only valid if is_match */
+        int distance(const uint8_t *state) const;
+
+    private:
+        std::string m_term;
+        uint8_t m_max_edits;
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <iostream>
+
+#include "Logger.h"
+#include "Metrics.h"
+
+Logger::Line::Line(Logger &logger, Level level, bool enabled)
+    : m_logger(logger), m_level(level), m_enabled(enabled)
+{
+}
+
+Logger::Line::~Line() {
+    if (m_enabled) {
+        m_logger.enqueue(m_level, m_stream.str());
+    }
+}
+
+Logger &Logger::instance() {
+    static Logger logger;
+    return logger;
+}
+
+Logger::Line Logger::info() {
+    auto &logger = instance();
+    return Line(logger, Level::Info, logger.admit());
+}
+
+Logger::Line Logger::error() {
+    auto &logger = instance();
+    return Line(logger, Level::Error, logger.admit());
+}
+
+Logger::Logger()
+    : m_thread(&Logger::run, this)
+{
+}
+
+/* the queued lines are written before the thread stops */
+Logger::~Logger() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_line_added.notify_one();
+    m_thread.join();
+}
+
+bool Logger::admit() {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::chrono::duration<double> elapsed = now - m_last_refill;
+    m_tokens = std::min(burst_lines, m_tokens + elapsed.count() * lines_per_second);
+    m_last_refill = now;
+
+    if (m_tokens < 1 || m_queue.size() >= max_queued_lines) {
+        m_dropped++;
+        Metrics::instance().add(Metrics::Counter::LogLinesDropped);
+        return false;
+    }
+    m_tokens -= 1;
+    return true;
+}
+
+void Logger::enqueue(Level level, std::string line) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.emplace_back(level, std::move(line));
+    }
+    m_line_added.notify_one();
+}
+
+void Logger::run() {
+    std::deque<std::pair<Level, std::string>> lines;
+    auto last_report = std::chrono::steady_clock::now();
+    bool stop = false;
+    while (!stop) {
+        uint64_t dropped = 0;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_line_added.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+            stop = m_stop && m_queue.empty();
+            lines.swap(m_queue);
+
+            /* the dropped lines are reported at most once per second */
+            auto now = std::chrono::steady_clock::now();
+            if (stop || now - last_report >= std::chrono::seconds(1)) {
+                std::swap(dropped, m_dropped);
+                last_report = now;
+            }
+        }
+
+        if (dropped > 0) {
+            std::cerr << "Logger: " << dropped << " lines dropped by the rate limit" << std::endl;
+        }
+        for (const auto &[level, line]: lines) {
+            (level == Level::Error ? std::cerr : std::cout) << line << "\n";
+        }
+        std::cout.flush();
+        lines.clear();
+    }
+}
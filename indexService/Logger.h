@@ -0,0 +1,79 @@
+#ifndef _H_LOGGER
+#define _H_LOGGER
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+/*
+*   Logging for the request path, a line is queued and written to stdout or stderr by the logger thread,
+*   so a request does not wait for the terminal or a pipe.
+*   Lines are rate limited by a token bucket, a line over the limit is dropped before it is formatted.
+*   The number of dropped lines is written with the next line and counted in the metrics.
+*
+*       Logger::info() << "Query took: " << ms << " milliseconds";
+*/
+class Logger {
+    public:
+        enum class Level { Info, Error };
+
+        /* collects the parts of a line and queues it when destroyed */
+        class Line {
+            public:
+                Line(Logger &logger, Level level, bool enabled);
+                Line(Line &&other) = delete;
+                ~Line();
+
+                template <typename T>
+                Line &operator<<(const T &value) {
+                    if (m_enabled) {
+                        m_stream << value;
+                    }
+                    return *this;
+                }
+
+            private:
+                Logger &m_logger;
+                Level m_level;
+                bool m_enabled;
+                std::ostringstream m_stream;
+        };
+
+        static Logger &instance();
+        static Line info();
+        static Line error();
+
+        ~Logger();
+
+        /* lines per second and the burst allowed above it */
+        static constexpr double lines_per_second = 200;
+        static constexpr double burst_lines = 1000;
+        /* lines waiting for the logger thread, more are dropped */
+        static constexpr size_t max_queued_lines = 10000;
+
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_line_added;
+        std::deque<std::pair<Level, std::string>> m_queue;
+        bool m_stop = false;
+
+        /* token bucket */
+        double m_tokens = burst_lines;
+        std::chrono::steady_clock::time_point m_last_refill = std::chrono::steady_clock::now();
+        uint64_t m_dropped = 0;
+
+        std::thread m_thread;
+
+        Logger();
+        /* takes a token, false if the line is dropped */
+        bool admit();
+        void enqueue(Level level, std::string line);
+        void run();
+};
+
+#endif
@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "MappedFile.h"
+
+MappedFile::MappedFile(const std::string &filepath, Access access) {
+    int fd = ::open(filepath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open file for mapping: " + filepath + ": " + std::strerror(errno));
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Failed to stat file: " + filepath);
+    }
+
+    m_size = st.st_size;
+    m_open = true;
+
+    /* mmap of an empty file fails, an empty mapping is still valid */
+    if (m_size > 0) {
+        m_data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m_data == MAP_FAILED) {
+            m_data = nullptr;
+            m_open = false;
+            ::close(fd);
+            throw std::runtime_error("Failed to map file: " + filepath + ": " + std::strerror(errno));
+        }
+
+        if (access == Access::Sequential) {
+            madvise(m_data, m_size, MADV_SEQUENTIAL);
+        } else if (access == Access::Random) {
+            madvise(m_data, m_size, MADV_RANDOM);
+        }
+    }
+
+    /* the mapping stays valid after closing the descriptor */
+    ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr)), m_size(std::exchange(other.m_size, 0)), m_open(std::exchange(other.m_open, false))
+{
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+        close();
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+        m_open = std::exchange(other.m_open, false);
+    }
+    return *this;
+}
+
+const uint8_t *MappedFile::data() const { return static_cast<const uint8_t*>(m_data); }
+size_t MappedFile::size() const { return m_size; }
+bool MappedFile::is_open() const { return m_open; }
+
+void MappedFile::prefetch(size_t offset, size_t length) const {
+    if (!m_data || offset >= m_size) {
+        return;
+    }
+    length = std::min(length, m_size - offset);
+
+    /* madvise needs a page aligned start, the read ahead runs while the pages are touched */
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t start = offset / page_size * page_size;
+    madvise(static_cast<uint8_t*>(m_data) + start, offset + length - start, MADV_WILLNEED);
+
+    const volatile uint8_t *bytes = static_cast<const uint8_t*>(m_data);
+    for (size_t pos = start; pos < offset + length; pos += page_size) {
+        (void)bytes[std::max(pos, offset)];
+    }
+}
+
+void MappedFile::prefetch() const {
+    prefetch(0, m_size);
+}
+
+void MappedFile::close() {
+    if (m_data) {
+        munmap(m_data, m_size);
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_open = false;
+}
@@ -0,0 +1,45 @@
+#ifndef _H_MAPPEDFILE
+#define _H_MAPPEDFILE
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+*   Read only memory mapping of a whole file, unmapped in the destructor.
+*   Throws std::runtime_error if the file cannot be opened or mapped.
+*/
+class MappedFile {
+    public:
+        enum class Access { Normal, Sequential, Random };
+
+        MappedFile() = default;
+        explicit MappedFile(const std::string &filepath, Access access = Access::Normal);
+        ~MappedFile();
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+        MappedFile(MappedFile &&other) noexcept;
+        MappedFile &operator=(MappedFile &&other) noexcept;
+
+        const uint8_t *data() const;
+        size_t size() const;
+        bool is_open() const;
+
+        /*
+        *   Reads a range of the file into the page cache and maps its pages, so the first access does not wait for I/O.
+        *   The range is cut at the end of the file.
+        */
+        void prefetch(size_t offset, size_t length) const;
+        void prefetch() const;
+
+        /* unmaps the file early, also done by the destructor */
+        void close();
+
+    private:
+        void *m_data = nullptr;
+        size_t m_size = 0;
+        bool m_open = false;
+};
+
+#endif
@@ -0,0 +1,234 @@
+#include <algorithm>
+#include <bit>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+
+#include "Metrics.h"
+
+namespace {
+
+struct MetricInfo {
+    const char *name;
+    const char *help;
+};
+
+/* in the order of Metrics::Counter */
+const MetricInfo counter_info[] = {
+    {"cearch_http_requests_total", "HTTP requests handled"},
+    {"cearch_http_request_errors_total", "HTTP requests answered with an error status"},
+    {"cearch_queries_total", "Queries evaluated"},
+    {"cearch_queries_partial_total", "Queries which stopped early because of a timeout or budget"},
+    {"cearch_batch_queries_total", "Queries evaluated as part of a batch"},
+    {"cearch_postings_processed_total", "Postings read by queries"},
+    {"cearch_documents_scanned_total", "Matching documents scored by queries"},
+    {"cearch_documents_indexed_total", "Documents indexed"},
+    {"cearch_index_errors_total", "Files which could not be indexed"},
+    {"cearch_log_lines_dropped_total", "Log lines dropped by the rate limit"}
+};
+
+/* label values in the order of Metrics::Stage */
+const char *stage_names[] = {
+    "http_read", "http_write", "queue_interactive", "queue_batch", "queue_admin", "request", "request_parse", "query_parse",
+    "postings", "score", "sort", "snippets", "serialize",
+    "index_read", "index_extract", "index_store", "index_analyze", "index_reorder", "index_postings", "index_impact", "index_save"
+};
+
+/* Prometheus buckets from 1 microsecond to 10 seconds, the histogram itself is finer */
+const double bucket_bounds_seconds[] = {
+    1e-6, 2.5e-6, 5e-6, 1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4, 5e-4, 1e-3, 2.5e-3, 5e-3,
+    1e-2, 2.5e-2, 5e-2, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0
+};
+
+const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+static_assert(std::size(counter_info) == static_cast<size_t>(Metrics::Counter::Count));
+static_assert(std::size(stage_names) == static_cast<size_t>(Metrics::Stage::Count));
+
+/* the owner of a shard is its only writer, so a relaxed load and store is enough */
+void increment(std::atomic<uint64_t> &value, uint64_t amount) {
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+}
+
+void Histogram::record(uint64_t value) {
+    increment(m_buckets[bucket_index(value)], 1);
+    increment(m_count, 1);
+    increment(m_sum, value);
+}
+
+void Histogram::merge(const Histogram &other) {
+    for (size_t i = 0; i < bucket_count; ++i) {
+        m_buckets[i].fetch_add(other.m_buckets[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    m_count.fetch_add(other.m_count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    m_sum.fetch_add(other.m_sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+uint64_t Histogram::get_count() const { return m_count.load(std::memory_order_relaxed); }
+uint64_t Histogram::get_sum() const { return m_sum.load(std::memory_order_relaxed); }
+uint64_t Histogram::get_bucket(size_t index) const { return m_buckets[index].load(std::memory_order_relaxed); }
+
+uint64_t Histogram::value_at_quantile(double quantile) const {
+    /* the buckets are read once, the count may lag behind them during a merge */
+    uint64_t total = 0;
+    std::array<uint64_t, bucket_count> counts;
+    for (size_t i = 0; i < bucket_count; ++i) {
+        counts[i] = get_bucket(i);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(quantile * total + 0.5));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucket_count; ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            /* the middle of the bucket, the last bucket has no end */
+            if (i + 1 == bucket_count) {
+                return bucket_lower_bound(i);
+            }
+            return (bucket_lower_bound(i) + bucket_lower_bound(i + 1) - 1) / 2;
+        }
+    }
+    return bucket_lower_bound(bucket_count - 1);
+}
+
+size_t Histogram::bucket_index(uint64_t value) {
+    if (value < linear_buckets) {
+        return value;
+    }
+    size_t exponent = std::bit_width(value) - 1;
+    if (exponent >= max_exponent) {
+        return bucket_count - 1;
+    }
+    size_t sub_bucket = (value >> (exponent - sub_bucket_bits)) & ((1 << sub_bucket_bits) - 1);
+    return linear_buckets + (exponent - 4) * (1 << sub_bucket_bits) + sub_bucket;
+}
+
+uint64_t Histogram::bucket_lower_bound(size_t index) {
+    if (index < linear_buckets) {
+        return index;
+    }
+    size_t exponent = (index - linear_buckets) / (1 << sub_bucket_bits) + 4;
+    uint64_t sub_bucket = (index - linear_buckets) % (1 << sub_bucket_bits);
+    return ((1 << sub_bucket_bits) + sub_bucket) << (exponent - sub_bucket_bits);
+}
+
+Metrics &Metrics::instance() {
+    static Metrics metrics;
+    return metrics;
+}
+
+void Metrics::add(Counter counter, uint64_t value) {
+    increment(local_shard().counters[static_cast<size_t>(counter)], value);
+}
+
+void Metrics::record(Stage stage, std::chrono::nanoseconds duration) {
+    local_shard().histograms[static_cast<size_t>(stage)].record(std::max<int64_t>(0, duration.count()));
+}
+
+Metrics::Shard &Metrics::local_shard() {
+    thread_local ThreadShard thread_shard;
+    return *thread_shard.shard;
+}
+
+Metrics::ThreadShard::ThreadShard()
+    : shard(std::make_unique<Shard>())
+{
+    auto &metrics = Metrics::instance();
+    std::lock_guard<std::mutex> lock(metrics.m_shards_mutex);
+    metrics.m_shards.push_back(shard.get());
+}
+
+Metrics::ThreadShard::~ThreadShard() {
+    auto &metrics = Metrics::instance();
+    std::lock_guard<std::mutex> lock(metrics.m_shards_mutex);
+    metrics.m_retired.merge(*shard);
+    std::erase(metrics.m_shards, shard.get());
+}
+
+void Metrics::Shard::merge(const Shard &other) {
+    for (size_t i = 0; i < counters.size(); ++i) {
+        counters[i].fetch_add(other.counters[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < histograms.size(); ++i) {
+        histograms[i].merge(other.histograms[i]);
+    }
+}
+
+std::string Metrics::to_prometheus() const {
+    auto total = std::make_unique<Shard>();
+    {
+        std::lock_guard<std::mutex> lock(m_shards_mutex);
+        total->merge(m_retired);
+        for (const Shard *shard: m_shards) {
+            total->merge(*shard);
+        }
+    }
+
+    std::ostringstream out;
+    out << std::setprecision(9);
+
+    for (size_t i = 0; i < std::size(counter_info); ++i) {
+        out << "# HELP " << counter_info[i].name << " " << counter_info[i].help << "\n";
+        out << "# TYPE " << counter_info[i].name << " counter\n";
+        out << counter_info[i].name << " " << total->counters[i].load(std::memory_order_relaxed) << "\n";
+    }
+
+    out << "# HELP cearch_stage_duration_seconds Latency of the request and indexing stages\n";
+    out << "# TYPE cearch_stage_duration_seconds histogram\n";
+    for (size_t stage = 0; stage < total->histograms.size(); ++stage) {
+        const Histogram &histogram = total->histograms[stage];
+        std::string labels = std::string("stage=\"") + stage_names[stage] + "\"";
+
+        /* a bucket is counted for a bound once all of its values are below it */
+        uint64_t cumulative = 0;
+        size_t index = 0;
+        for (double bound: bucket_bounds_seconds) {
+            uint64_t bound_ns = static_cast<uint64_t>(bound * 1e9);
+            while (index + 1 < Histogram::bucket_count && Histogram::bucket_lower_bound(index + 1) - 1 <= bound_ns) {
+                cumulative += histogram.get_bucket(index++);
+            }
+            out << "cearch_stage_duration_seconds_bucket{" << labels << ",le=\"" << bound << "\"} " << cumulative << "\n";
+        }
+        out << "cearch_stage_duration_seconds_bucket{" << labels << ",le=\"+Inf\"} " << histogram.get_count() << "\n";
+        out << "cearch_stage_duration_seconds_sum{" << labels << "} " << histogram.get_sum() / 1e9 << "\n";
+        out << "cearch_stage_duration_seconds_count{" << labels << "} " << histogram.get_count() << "\n";
+    }
+
+    /* the Prometheus buckets are coarse, the quantiles come from the full resolution */
+    out << "# HELP cearch_stage_latency_seconds Quantiles of the stage latencies since the start\n";
+    out << "# TYPE cearch_stage_latency_seconds summary\n";
+    for (size_t stage = 0; stage < total->histograms.size(); ++stage) {
+        const Histogram &histogram = total->histograms[stage];
+        std::string labels = std::string("stage=\"") + stage_names[stage] + "\"";
+        for (double quantile: quantiles) {
+            out << "cearch_stage_latency_seconds{" << labels << ",quantile=\"" << quantile << "\"} "
+                << histogram.value_at_quantile(quantile) / 1e9 << "\n";
+        }
+        out << "cearch_stage_latency_seconds_sum{" << labels << "} " << histogram.get_sum() / 1e9 << "\n";
+        out << "cearch_stage_latency_seconds_count{" << labels << "} " << histogram.get_count() << "\n";
+    }
+
+    return out.str();
+}
+
+Metrics::Timer::Timer(Stage stage)
+    : m_stage(stage), m_start(std::chrono::steady_clock::now())
+{
+}
+
+Metrics::Timer::~Timer() {
+    stop();
+}
+
+void Metrics::Timer::stop() {
+    if (m_running) {
+        m_running = false;
+        Metrics::instance().record(m_stage, std::chrono::steady_clock::now() - m_start);
+    }
+}
@@ -0,0 +1,143 @@
+#ifndef _H_METRICS
+#define _H_METRICS
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+*   Latency histogram with log-linear buckets like HdrHistogram: values below 16 have a bucket each,
+*   above every power of two is split into 8 buckets, so a value is known within 12.5%.
+*   Values are nanoseconds, everything above 2^42 ns (73 minutes) lands in the last bucket.
+*   Only the owning thread records, other threads read the relaxed atomics while merging.
+*/
+class Histogram {
+    public:
+        static constexpr size_t linear_buckets = 16;
+        static constexpr size_t sub_bucket_bits = 3;
+        static constexpr size_t max_exponent = 42;
+        static constexpr size_t bucket_count = linear_buckets + (max_exponent - 4) * (1 << sub_bucket_bits);
+
+        void record(uint64_t value);
+        /* adds the counts of other, which may be recorded at the same time */
+        void merge(const Histogram &other);
+
+        uint64_t get_count() const;
+        uint64_t get_sum() const;
+        uint64_t get_bucket(size_t index) const;
+        /* the smallest value v with at least quantile * count values <= v, within the bucket precision */
+        uint64_t value_at_quantile(double quantile) const;
+
+        static size_t bucket_index(uint64_t value);
+        /* first value of the bucket, the bucket ends before the lower bound of the next one */
+        static uint64_t bucket_lower_bound(size_t index);
+
+    private:
+        std::array<std::atomic<uint64_t>, bucket_count> m_buckets{};
+        std::atomic<uint64_t> m_count{0};
+        std::atomic<uint64_t> m_sum{0};
+};
+
+/*
+*   Counters and stage latencies of the server, exported in the Prometheus text format on /metrics.
+*   Every thread records into its own shard without locks, a scrape merges the shards.
+*   The shard of a thread that exits is merged into the retired totals, so short lived threads
+*   like the ones of std::async do not pile up.
+*/
+class Metrics {
+    public:
+        enum class Stage {
+            HttpRead,
+            HttpWrite,
+            /* waiting for a slot of the priority class, see RequestScheduler */
+            QueueInteractive,
+            QueueBatch,
+            QueueAdmin,
+            /* from the parsed request to the response, without the network */
+            Request,
+            /* reading the fields of a JSON request body */
+            RequestParse,
+            QueryParse,
+            /* iterating the postings, the scoring within is measured on a sample of the matches */
+            Postings,
+            Score,
+            Sort,
+            Snippets,
+            Serialize,
+            IndexRead,
+            IndexExtract,
+            IndexStore,
+            IndexAnalyze,
+            /* renumbering the documents, see DocidReorderer */
+            IndexReorder,
+            IndexPostings,
+            IndexImpact,
+            IndexSave,
+            Count
+        };
+
+        enum class Counter {
+            Requests,
+            RequestErrors,
+            Queries,
+            PartialQueries,
+            BatchQueries,
+            PostingsProcessed,
+            DocumentsScanned,
+            DocumentsIndexed,
+            IndexErrors,
+            LogLinesDropped,
+            Count
+        };
+
+        static Metrics &instance();
+
+        void add(Counter counter, uint64_t value = 1);
+        void record(Stage stage, std::chrono::nanoseconds duration);
+
+        /* all counters and histograms in the Prometheus text exposition format */
+        std::string to_prometheus() const;
+
+        /* records the time from construction to stop or destruction */
+        class Timer {
+            public:
+                explicit Timer(Stage stage);
+                ~Timer();
+                void stop();
+
+            private:
+                Stage m_stage;
+                std::chrono::steady_clock::time_point m_start;
+                bool m_running = true;
+        };
+
+    private:
+        struct Shard {
+            std::array<std::atomic<uint64_t>, static_cast<size_t>(Counter::Count)> counters{};
+            std::array<Histogram, static_cast<size_t>(Stage::Count)> histograms;
+
+            void merge(const Shard &other);
+        };
+
+        /* registers the shard of a thread and retires it when the thread exits */
+        struct ThreadShard {
+            std::unique_ptr<Shard> shard;
+            ThreadShard();
+            ~ThreadShard();
+        };
+
+        mutable std::mutex m_shards_mutex;
+        std::vector<Shard*> m_shards;
+        Shard m_retired;
+
+        Metrics() = default;
+        Shard &local_shard();
+};
+
+#endif
@@ -1,6 +1,63 @@
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <iostream>
+#include <vector>
+
 #include "PDFContentStrategy.h"
+#include "PDFWorkerPool.h"
 
 std::string PDFContentStrategy::read_content(const std::string &filepath) const {
+    auto &pool = PDFWorkerPool::instance();
+    if (!pool.is_available()) {
+        return read_content_in_process(filepath);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + document_timeout;
+
+    PDFWorkerPool::Range first = pool.extract(filepath, 0, pages_per_range, deadline);
+    uint32_t total_pages = first.total_pages;
+
+    /* more threads than workers would only wait for a worker, a document of 10k pages has 625 ranges */
+    size_t range_count = std::max<size_t>(1, (static_cast<size_t>(total_pages) + pages_per_range - 1) / pages_per_range);
+    std::vector<std::string> texts(range_count);
+    texts[0] = std::move(first.text);
+    std::atomic<size_t> next{1};
+    std::atomic<bool> failed{false};
+    auto extract_ranges = [&]() {
+        for (size_t i = next++; i < range_count && !failed; i = next++) {
+            try {
+                texts[i] = pool.extract(filepath, i * pages_per_range, pages_per_range, deadline).text;
+            } catch (...) {
+                /* the document is not indexed, the other threads stop after their current range */
+                failed = true;
+                throw;
+            }
+        }
+    };
+
+    std::vector<std::future<void>> workers;
+    for (size_t i = 0; i < std::min(pool.get_worker_count(), range_count - 1); ++i) {
+        workers.push_back(std::async(std::launch::async, extract_ranges));
+    }
+    for (auto &worker: workers) {
+        worker.get();
+    }
+
+    std::string fulltext;
+    for (auto &text: texts) {
+        fulltext.append(text);
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "PDF " << filepath << ": " << total_pages << " pages in " << elapsed.count() << "s (";
+    std::cout << (elapsed.count() > 0 ? total_pages / elapsed.count() : 0) << " pages/s)" << std::endl;
+
+    return fulltext;
+}
+
+std::string PDFContentStrategy::read_content_in_process(const std::string &filepath) {
     std::string fulltext;
 
     std::unique_ptr<poppler::document> doc{poppler::document::load_from_file(filepath)};
@@ -12,10 +69,11 @@ std::string PDFContentStrategy::read_content(const std::string &filepath) const
     for (int i = 0; i < doc->pages(); ++i) {
         std::unique_ptr<poppler::page> page(doc->create_page(i));
         if (page) {
-            fulltext.append(page->text().to_latin1());
+            auto utf8 = page->text().to_utf8();
+            fulltext.append(utf8.begin(), utf8.end());
             fulltext.append("\n");
         }
     }
 
     return fulltext;
-}
\ No newline at end of file
+}
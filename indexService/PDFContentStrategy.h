@@ -3,6 +3,9 @@
 
 #include "ContentStrategy.h"
 
+#include <chrono>
+#include <cstdint>
+
 #include <poppler/cpp/poppler-document.h>
 #include <poppler/cpp/poppler-page.h>
 
@@ -15,8 +18,20 @@ class PDFContentStrategy: public ContentStrategy {
     *   const &document -> function cant change the document passed in
     *   const -> after a function, const means the function cant change any Data members,
     *   of the class it belongs to (PDFContentStrategy)
+    *
+    *   The pages are extracted in ranges of pages_per_range by the PDFWorkerPool, in parallel and
+    *   isolated from the server. The first range also reports the number of pages, the others are taken
+    *   one by one by at most one thread per worker of the pool and joined in page order. The text is UTF-8.
     */
     std::string read_content(const std::string &filepath) const;
+
+    static constexpr uint32_t pages_per_range = 16;
+    /* a document that is not done after this time, waiting for workers included, is not indexed */
+    static constexpr std::chrono::seconds document_timeout{300};
+
+   private:
+    /* without workers the pages are extracted sequentially in the server process */
+    static std::string read_content_in_process(const std::string &filepath);
 };
 
-#endif
\ No newline at end of file
+#endif
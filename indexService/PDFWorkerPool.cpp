@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <poll.h>
+#include <spawn.h>
+#include <stdexcept>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+#include <poppler/cpp/poppler-document.h>
+#include <poppler/cpp/poppler-page.h>
+
+#include "PDFWorkerPool.h"
+
+extern char **environ;
+
+namespace {
+
+const char *worker_executable = "/proc/self/exe";
+
+/* blocking read of exactly size bytes, false on end of file */
+bool read_exact(int fd, void *data, size_t size) {
+    char *pos = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t n = read(fd, pos, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        pos += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool write_all(int fd, const void *data, size_t size) {
+    const char *pos = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = send(fd, pos, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        pos += n;
+        size -= n;
+    }
+    return true;
+}
+
+/* read of exactly size bytes from a worker, throws on end of file and when the deadline is reached */
+void read_until(int fd, void *data, size_t size, std::chrono::steady_clock::time_point deadline) {
+    char *pos = static_cast<char*>(data);
+    while (size > 0) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0) {
+            throw std::runtime_error("PDF worker timed out");
+        }
+
+        pollfd pfd{fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, std::min<int64_t>(remaining.count(), 1000));
+        if (ready < 0 && errno != EINTR) {
+            throw std::runtime_error(std::string("Polling the PDF worker failed: ") + std::strerror(errno));
+        }
+        if (ready <= 0) {
+            continue;
+        }
+
+        ssize_t n = read(fd, pos, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            throw std::runtime_error("PDF worker crashed");
+        }
+        pos += n;
+        size -= n;
+    }
+}
+
+}
+
+PDFWorkerPool::PDFWorkerPool(size_t workers)
+    : m_workers(std::max<size_t>(workers, 1))
+{
+    m_available = access(worker_executable, X_OK) == 0;
+}
+
+PDFWorkerPool::~PDFWorkerPool() {
+    for (auto &worker: m_workers) {
+        stop(worker);
+    }
+}
+
+PDFWorkerPool &PDFWorkerPool::instance() {
+    static PDFWorkerPool pool(std::thread::hardware_concurrency());
+    return pool;
+}
+
+bool PDFWorkerPool::is_available() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_available;
+}
+
+size_t PDFWorkerPool::get_worker_count() const { return m_workers.size(); }
+
+PDFWorkerPool::Range PDFWorkerPool::extract(const std::string &filepath, uint32_t first, uint32_t count,
+    std::chrono::steady_clock::time_point deadline)
+{
+    size_t index = acquire(deadline);
+    int fd = m_workers[index].fd;
+
+    uint32_t status = 0;
+    Range range;
+    try {
+        uint32_t path_length = filepath.size();
+        bool sent = write_all(fd, &path_length, sizeof(path_length)) && write_all(fd, filepath.data(), filepath.size())
+            && write_all(fd, &first, sizeof(first)) && write_all(fd, &count, sizeof(count));
+        if (!sent) {
+            throw std::runtime_error("PDF worker crashed");
+        }
+
+        uint64_t length = 0;
+        read_until(fd, &status, sizeof(status), deadline);
+        read_until(fd, &range.total_pages, sizeof(range.total_pages), deadline);
+        read_until(fd, &length, sizeof(length), deadline);
+        range.text.resize(length);
+        read_until(fd, range.text.data(), length, deadline);
+    } catch (std::exception &) {
+        /* the state of the worker is unknown, it is replaced */
+        release(index, false);
+        throw;
+    }
+
+    release(index, true);
+    if (status != 0) {
+        throw std::runtime_error("PDF worker: " + range.text);
+    }
+    return range;
+}
+
+size_t PDFWorkerPool::acquire(std::chrono::steady_clock::time_point deadline) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        for (size_t i = 0; i < m_workers.size(); ++i) {
+            Worker &worker = m_workers[i];
+            if (worker.busy) {
+                continue;
+            }
+            if (worker.pid < 0 && !spawn(worker)) {
+                m_available = false;
+                throw std::runtime_error("Failed to start a PDF worker");
+            }
+            worker.busy = true;
+            return i;
+        }
+
+        if (m_worker_released.wait_until(lock, deadline) == std::cv_status::timeout) {
+            throw std::runtime_error("No PDF worker became available in time");
+        }
+    }
+}
+
+void PDFWorkerPool::release(size_t index, bool healthy) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Worker &worker = m_workers[index];
+    if (!healthy) {
+        stop(worker);
+    }
+    worker.busy = false;
+    m_worker_released.notify_one();
+}
+
+/* called with the mutex held */
+bool PDFWorkerPool::spawn(Worker &worker) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+        return false;
+    }
+
+    /* the child end is moved to worker_fd, dup2 onto itself would keep the close on exec flag */
+    if (fds[1] == worker_fd) {
+        int moved = fcntl(fds[1], F_DUPFD_CLOEXEC, worker_fd + 1);
+        close(fds[1]);
+        fds[1] = moved;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], worker_fd);
+    /* stdout of poppler must not end up in the protocol, everything goes to stderr */
+    posix_spawn_file_actions_adddup2(&actions, STDERR_FILENO, STDOUT_FILENO);
+
+    char arg0[] = "cearch";
+    char arg1[] = "--pdf-worker";
+    char *argv[] = {arg0, arg1, nullptr};
+    pid_t pid;
+    int error = posix_spawn(&pid, worker_executable, &actions, nullptr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+
+    if (error != 0) {
+        std::cerr << "Failed to start a PDF worker: " << std::strerror(error) << std::endl;
+        close(fds[0]);
+        return false;
+    }
+
+    worker.pid = pid;
+    worker.fd = fds[0];
+    return true;
+}
+
+void PDFWorkerPool::stop(Worker &worker) {
+    if (worker.fd >= 0) {
+        close(worker.fd);
+        worker.fd = -1;
+    }
+    if (worker.pid > 0) {
+        kill(worker.pid, SIGKILL);
+        waitpid(worker.pid, nullptr, 0);
+        worker.pid = -1;
+    }
+}
+
+int PDFWorkerPool::worker_main() {
+    /* sandbox: limited address space, no core dumps of crashing documents */
+    rlimit memory{worker_memory_limit, worker_memory_limit};
+    setrlimit(RLIMIT_AS, &memory);
+    rlimit core{0, 0};
+    setrlimit(RLIMIT_CORE, &core);
+
+    /* descriptors of the server without close on exec, e.g. client sockets, are not needed here */
+    long max_fd = std::min<long>(sysconf(_SC_OPEN_MAX), 65536);
+    for (int fd = worker_fd + 1; fd < max_fd; ++fd) {
+        close(fd);
+    }
+
+    /* consecutive ranges of the same document reuse it */
+    std::string open_path;
+    std::unique_ptr<poppler::document> doc;
+
+    while (true) {
+        uint32_t path_length;
+        if (!read_exact(worker_fd, &path_length, sizeof(path_length))) {
+            return 0;
+        }
+        std::string path(path_length, '\0');
+        uint32_t first;
+        uint32_t count;
+        if (!read_exact(worker_fd, path.data(), path_length) || !read_exact(worker_fd, &first, sizeof(first))
+            || !read_exact(worker_fd, &count, sizeof(count))) {
+            return 1;
+        }
+
+        uint32_t status = 0;
+        uint32_t total_pages = 0;
+        std::string text;
+        try {
+            if (path != open_path || !doc) {
+                open_path.clear();
+                doc.reset(poppler::document::load_from_file(path));
+                if (!doc) {
+                    throw std::runtime_error("Could not open the PDF file " + path);
+                }
+                open_path = path;
+            }
+
+            total_pages = doc->pages();
+            uint32_t last = std::min<uint64_t>(static_cast<uint64_t>(first) + count, total_pages);
+            for (uint32_t i = first; i < last; ++i) {
+                std::unique_ptr<poppler::page> page(doc->create_page(i));
+                if (page) {
+                    auto utf8 = page->text().to_utf8();
+                    text.append(utf8.begin(), utf8.end());
+                    text.append("\n");
+                }
+            }
+        } catch (std::exception &e) {
+            status = 1;
+            text = e.what();
+        }
+
+        uint64_t length = text.size();
+        bool sent = write_all(worker_fd, &status, sizeof(status)) && write_all(worker_fd, &total_pages, sizeof(total_pages))
+            && write_all(worker_fd, &length, sizeof(length)) && write_all(worker_fd, text.data(), text.size());
+        if (!sent) {
+            return 1;
+        }
+    }
+}
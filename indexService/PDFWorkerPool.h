@@ -0,0 +1,74 @@
+#ifndef _H_PDFWORKERPOOL
+#define _H_PDFWORKERPOOL
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+/*
+*   Pool of worker processes which extract the text of PDF pages with poppler.
+*   A worker is the cearch binary itself, started with --pdf-worker, so a malformed PDF that crashes
+*   poppler or runs out of memory only takes down the worker. Workers run with resource limits
+*   (address space, no core dumps), a worker that crashed or timed out is killed and replaced by
+*   a fresh one on the next request.
+*
+*   Protocol over a unix socket pair, integers in host byte order:
+*       request     u32 path length, path, u32 first page, u32 page count
+*       response    u32 status (0 ok, 1 error), u32 total pages of the document, u64 length, UTF-8 text or error message
+*/
+class PDFWorkerPool {
+    public:
+        struct Range {
+            std::string text;
+            uint32_t total_pages;
+        };
+
+        explicit PDFWorkerPool(size_t workers);
+        ~PDFWorkerPool();
+
+        PDFWorkerPool(const PDFWorkerPool &) = delete;
+        PDFWorkerPool &operator=(const PDFWorkerPool &) = delete;
+
+        /* the pool shared by all PDF documents, one worker per hardware thread */
+        static PDFWorkerPool &instance();
+
+        /*
+        *   Extracts pages [first, first + count) in a worker, count is cut at the end of the document.
+        *   Waits for a free worker until the deadline, throws std::runtime_error on errors, crashes and timeouts.
+        */
+        Range extract(const std::string &filepath, uint32_t first, uint32_t count, std::chrono::steady_clock::time_point deadline);
+
+        /* false if workers cannot be started on this platform, then PDFs are extracted in process */
+        bool is_available();
+        size_t get_worker_count() const;
+
+        /* entry point of a worker process, serves requests on worker_fd until the pool closes it */
+        static int worker_main();
+
+        static constexpr int worker_fd = 3;
+        /* address space limit of a worker */
+        static constexpr uint64_t worker_memory_limit = 2ull * 1024 * 1024 * 1024;
+
+    private:
+        struct Worker {
+            pid_t pid = -1;
+            int fd = -1;
+            bool busy = false;
+        };
+
+        std::vector<Worker> m_workers;
+        std::mutex m_mutex;
+        std::condition_variable m_worker_released;
+        bool m_available = true;
+
+        size_t acquire(std::chrono::steady_clock::time_point deadline);
+        void release(size_t index, bool healthy);
+        bool spawn(Worker &worker);
+        static void stop(Worker &worker);
+};
+
+#endif
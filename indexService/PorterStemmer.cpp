@@ -0,0 +1,322 @@
+#include <cstring>
+
+#include "PorterStemmer.h"
+
+std::string PorterStemmer::stem(const std::string &word) {
+    if (word.size() <= 2) {
+        return word;
+    }
+
+    PorterStemmer stemmer(word);
+    stemmer.step1ab();
+    if (stemmer.k > 0) {
+        stemmer.step1c();
+        stemmer.step2();
+        stemmer.step3();
+        stemmer.step4();
+        stemmer.step5();
+    }
+    return stemmer.b.substr(0, stemmer.k + 1);
+}
+
+PorterStemmer::PorterStemmer(const std::string &word)
+    : b(word), k(word.size() - 1)
+{
+}
+
+/* true if b[i] is a consonant, y is a consonant after a vowel */
+bool PorterStemmer::cons(int i) const {
+    switch (b[i]) {
+        case 'a': case 'e': case 'i': case 'o': case 'u':
+            return false;
+        case 'y':
+            return i == 0 ? true : !cons(i - 1);
+        default:
+            return true;
+    }
+}
+
+/*
+*   Measures the number of consonant sequences in b[0, j], with c a consonant and v a vowel sequence:
+*   [c][v] gives 0, [c]vc[v] gives 1, [c]vcvc[v] gives 2 ...
+*/
+int PorterStemmer::m() const {
+    int n = 0;
+    int i = 0;
+    while (true) {
+        if (i > j) {
+            return n;
+        }
+        if (!cons(i)) {
+            break;
+        }
+        i++;
+    }
+    i++;
+    while (true) {
+        while (true) {
+            if (i > j) {
+                return n;
+            }
+            if (cons(i)) {
+                break;
+            }
+            i++;
+        }
+        i++;
+        n++;
+        while (true) {
+            if (i > j) {
+                return n;
+            }
+            if (!cons(i)) {
+                break;
+            }
+            i++;
+        }
+        i++;
+    }
+}
+
+bool PorterStemmer::vowel_in_stem() const {
+    for (int i = 0; i <= j; ++i) {
+        if (!cons(i)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* b[i - 1, i] is a double consonant */
+bool PorterStemmer::doublec(int i) const {
+    if (i < 1 || b[i] != b[i - 1]) {
+        return false;
+    }
+    return cons(i);
+}
+
+/*
+*   b[i - 2, i] is consonant - vowel - consonant and the last consonant is not w, x or y.
+*   Used to restore an e at the end of a short word: cav(e), lov(e), hop(e), but not snow, box, tray.
+*/
+bool PorterStemmer::cvc(int i) const {
+    if (i < 2 || !cons(i) || cons(i - 1) || !cons(i - 2)) {
+        return false;
+    }
+    char c = b[i];
+    return c != 'w' && c != 'x' && c != 'y';
+}
+
+/* b[0, k] ends with s, sets j to the end of the stem in front of it */
+bool PorterStemmer::ends(const char *s) {
+    int length = std::strlen(s);
+    if (length > k + 1) {
+        return false;
+    }
+    if (b.compare(k - length + 1, length, s) != 0) {
+        return false;
+    }
+    j = k - length;
+    return true;
+}
+
+/* replaces b[j + 1, k] with s */
+void PorterStemmer::setto(const char *s) {
+    int length = std::strlen(s);
+    b.replace(j + 1, k - j, s);
+    k = j + length;
+}
+
+void PorterStemmer::r(const char *s) {
+    if (m() > 0) {
+        setto(s);
+    }
+}
+
+/*
+*   Removes plurals and -ed or -ing:
+*   caresses -> caress, ponies -> poni, cats -> cat, feed -> feed, agreed -> agree,
+*   plastered -> plaster, motoring -> motor, hopping -> hop, filing -> file
+*/
+void PorterStemmer::step1ab() {
+    if (b[k] == 's') {
+        if (ends("sses")) {
+            k -= 2;
+        } else if (ends("ies")) {
+            setto("i");
+        } else if (b[k - 1] != 's') {
+            k--;
+        }
+    }
+
+    if (ends("eed")) {
+        if (m() > 0) {
+            k--;
+        }
+    } else if ((ends("ed") || ends("ing")) && vowel_in_stem()) {
+        k = j;
+        if (ends("at")) {
+            setto("ate");
+        } else if (ends("bl")) {
+            setto("ble");
+        } else if (ends("iz")) {
+            setto("ize");
+        } else if (doublec(k)) {
+            k--;
+            char c = b[k];
+            if (c == 'l' || c == 's' || c == 'z') {
+                k++;
+            }
+        } else if (m() == 1 && cvc(k)) {
+            setto("e");
+        }
+    }
+}
+
+/* turns a terminal y into i if there is another vowel in the stem */
+void PorterStemmer::step1c() {
+    if (ends("y") && vowel_in_stem()) {
+        b[k] = 'i';
+    }
+}
+
+/* maps double suffixes to single ones: -ization -> -ize, -ational -> -ate ... */
+void PorterStemmer::step2() {
+    if (k < 1) {
+        return;
+    }
+
+    switch (b[k - 1]) {
+        case 'a':
+            if (ends("ational")) { r("ate"); break; }
+            if (ends("tional")) { r("tion"); break; }
+            break;
+        case 'c':
+            if (ends("enci")) { r("ence"); break; }
+            if (ends("anci")) { r("ance"); break; }
+            break;
+        case 'e':
+            if (ends("izer")) { r("ize"); break; }
+            break;
+        case 'l':
+            if (ends("bli")) { r("ble"); break; }
+            if (ends("alli")) { r("al"); break; }
+            if (ends("entli")) { r("ent"); break; }
+            if (ends("eli")) { r("e"); break; }
+            if (ends("ousli")) { r("ous"); break; }
+            break;
+        case 'o':
+            if (ends("ization")) { r("ize"); break; }
+            if (ends("ation")) { r("ate"); break; }
+            if (ends("ator")) { r("ate"); break; }
+            break;
+        case 's':
+            if (ends("alism")) { r("al"); break; }
+            if (ends("iveness")) { r("ive"); break; }
+            if (ends("fulness")) { r("ful"); break; }
+            if (ends("ousness")) { r("ous"); break; }
+            break;
+        case 't':
+            if (ends("aliti")) { r("al"); break; }
+            if (ends("iviti")) { r("ive"); break; }
+            if (ends("biliti")) { r("ble"); break; }
+            break;
+        case 'g':
+            if (ends("logi")) { r("log"); break; }
+            break;
+    }
+}
+
+/* -ic-, -full, -ness ... */
+void PorterStemmer::step3() {
+    switch (b[k]) {
+        case 'e':
+            if (ends("icate")) { r("ic"); break; }
+            if (ends("ative")) { r(""); break; }
+            if (ends("alize")) { r("al"); break; }
+            break;
+        case 'i':
+            if (ends("iciti")) { r("ic"); break; }
+            break;
+        case 'l':
+            if (ends("ical")) { r("ic"); break; }
+            if (ends("ful")) { r(""); break; }
+            break;
+        case 's':
+            if (ends("ness")) { r(""); break; }
+            break;
+    }
+}
+
+/* removes -ant, -ence ... in context <c>vcvc<v> */
+void PorterStemmer::step4() {
+    if (k < 1) {
+        return;
+    }
+
+    switch (b[k - 1]) {
+        case 'a':
+            if (ends("al")) break;
+            return;
+        case 'c':
+            if (ends("ance")) break;
+            if (ends("ence")) break;
+            return;
+        case 'e':
+            if (ends("er")) break;
+            return;
+        case 'i':
+            if (ends("ic")) break;
+            return;
+        case 'l':
+            if (ends("able")) break;
+            if (ends("ible")) break;
+            return;
+        case 'n':
+            if (ends("ant")) break;
+            if (ends("ement")) break;
+            if (ends("ment")) break;
+            if (ends("ent")) break;
+            return;
+        case 'o':
+            if (ends("ion") && j >= 0 && (b[j] == 's' || b[j] == 't')) break;
+            if (ends("ou")) break;
+            return;
+        case 's':
+            if (ends("ism")) break;
+            return;
+        case 't':
+            if (ends("ate")) break;
+            if (ends("iti")) break;
+            return;
+        case 'u':
+            if (ends("ous")) break;
+            return;
+        case 'v':
+            if (ends("ive")) break;
+            return;
+        case 'z':
+            if (ends("ize")) break;
+            return;
+        default:
+            return;
+    }
+
+    if (m() > 1) {
+        k = j;
+    }
+}
+
+/* removes a final -e if m() > 1 and changes -ll to -l if m() > 1 */
+void PorterStemmer::step5() {
+    j = k;
+    if (b[k] == 'e') {
+        int a = m();
+        if (a > 1 || (a == 1 && !cvc(k - 1))) {
+            k--;
+        }
+    }
+    if (b[k] == 'l' && doublec(k) && m() > 1) {
+        k--;
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef _H_PORTERSTEMMER
+#define _H_PORTERSTEMMER
+
+#include <string>
+
+/*
+*   The Porter stemming algorithm (M.F. Porter, 1980) for lower case english words,
+*   e.g. "connected", "connecting" and "connections" all become "connect".
+*   Words with up to 2 letters are returned unchanged.
+*/
+class PorterStemmer {
+    public:
+        static std::string stem(const std::string &word);
+
+    private:
+        explicit PorterStemmer(const std::string &word);
+
+        /* b[0, k] is the current word, j marks the end of the stem while a suffix is checked */
+        std::string b;
+        int k;
+        int j = 0;
+
+        bool cons(int i) const;
+        int m() const;
+        bool vowel_in_stem() const;
+        bool doublec(int i) const;
+        bool cvc(int i) const;
+        bool ends(const char *s);
+        void setto(const char *s);
+        void r(const char *s);
+
+        void step1ab();
+        void step1c();
+        void step2();
+        void step3();
+        void step4();
+        void step5();
+};
+
+#endif
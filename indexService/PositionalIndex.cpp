@@ -0,0 +1,307 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "PositionalIndex.h"
+#include "Varint.h"
+
+PositionalIndex::Cursor::Cursor(const uint8_t *begin, const uint8_t *end)
+    : m_pos(begin), m_end(end)
+{
+}
+
+bool PositionalIndex::Cursor::seek(uint64_t docid, std::vector<uint32_t> &positions) {
+    positions.clear();
+
+    while (true) {
+        if (!m_has_entry) {
+            if (m_pos >= m_end) {
+                return false;
+            }
+            m_docid += varint_decode(m_pos, m_end);
+            m_count = varint_decode(m_pos, m_end);
+            uint64_t length = varint_decode(m_pos, m_end);
+            /* every position takes at least one byte, the count is reserved before they are decoded */
+            if (length > static_cast<uint64_t>(m_end - m_pos) || m_count > length) {
+                throw std::runtime_error("Corrupt positional index entry");
+            }
+            m_data = m_pos;
+            m_data_end = m_pos + length;
+            /* skip the positions, they are only decoded for a matching document */
+            m_pos = m_data_end;
+            m_has_entry = true;
+        }
+
+        if (m_docid < docid) {
+            m_has_entry = false;
+            continue;
+        }
+        if (m_docid > docid) {
+            return false;
+        }
+
+        positions.reserve(m_count);
+        const uint8_t *data = m_data;
+        uint32_t position = 0;
+        for (uint64_t i = 0; i < m_count; ++i) {
+            position += varint_decode(data, m_data_end);
+            positions.push_back(position);
+        }
+        return true;
+    }
+}
+
+void PositionalIndex::add_document(uint64_t docid, const std::unordered_map<std::string, std::vector<uint32_t>> &positions) {
+    std::vector<std::pair<std::string, std::string>> encoded;
+    encoded.reserve(positions.size());
+
+    /* encode outside of the lock, the count is needed to decode and comes first */
+    for (const auto &[term, term_positions]: positions) {
+        std::string bytes;
+        varint_encode(term_positions.size(), bytes);
+        uint32_t previous = 0;
+        for (uint32_t position: term_positions) {
+            varint_encode(position - previous, bytes);
+            previous = position;
+        }
+        encoded.emplace_back(term, std::move(bytes));
+    }
+
+    std::lock_guard<std::mutex> lock(m_pending_mutex);
+    for (auto &[term, bytes]: encoded) {
+        m_pending[term].emplace_back(docid, std::move(bytes));
+    }
+    m_available = true;
+}
+
+void PositionalIndex::save(const std::string &directory) {
+    std::lock_guard<std::mutex> lock(m_pending_mutex);
+
+    /* written next to the old files and renamed, a loaded index keeps reading the old ones */
+    std::string stream_path = directory + "/" + stream_filename;
+    std::string directory_path = directory + "/" + directory_filename;
+    std::ofstream stream(stream_path + ".tmp", std::ios::binary | std::ios::trunc);
+    std::ofstream dir(directory_path + ".tmp", std::ios::binary | std::ios::trunc);
+    if (!stream || !dir) {
+        throw std::runtime_error("Failed to open positional index files for writing in: " + directory);
+    }
+
+    /* sorted terms keep the file deterministic */
+    std::vector<std::string> terms;
+    terms.reserve(m_pending.size());
+    for (const auto &[term, entries]: m_pending) {
+        terms.push_back(term);
+    }
+    std::sort(terms.begin(), terms.end());
+
+    uint64_t offset = 0;
+    std::string block;
+    std::string dir_entry;
+    for (const auto &term: terms) {
+        auto &entries = m_pending[term];
+        std::sort(entries.begin(), entries.end(),
+            [](const auto &a, const auto &b) {
+                return a.first < b.first;
+            }
+        );
+
+        block.clear();
+        uint64_t previous_docid = 0;
+        for (const auto &[docid, entry]: entries) {
+            /* entry starts with the count, the length covers only the positions */
+            const uint8_t *pos = reinterpret_cast<const uint8_t*>(entry.data());
+            const uint8_t *end = pos + entry.size();
+            uint64_t count = varint_decode(pos, end);
+
+            varint_encode(docid - previous_docid, block);
+            varint_encode(count, block);
+            varint_encode(end - pos, block);
+            block.append(reinterpret_cast<const char*>(pos), end - pos);
+            previous_docid = docid;
+        }
+        stream.write(block.data(), block.size());
+
+        dir_entry.clear();
+        varint_encode(term.size(), dir_entry);
+        dir_entry.append(term);
+        varint_encode(offset, dir_entry);
+        varint_encode(block.size(), dir_entry);
+        dir.write(dir_entry.data(), dir_entry.size());
+
+        offset += block.size();
+    }
+
+    stream.close();
+    dir.close();
+    if (!stream || !dir) {
+        throw std::runtime_error("Failed to write the positional index in: " + directory);
+    }
+    std::filesystem::rename(stream_path + ".tmp", stream_path);
+    std::filesystem::rename(directory_path + ".tmp", directory_path);
+
+    /* from now on the positions are read from the stream */
+    m_pending.clear();
+    m_directory = directory;
+    m_available = !terms.empty();
+}
+
+void PositionalIndex::open(const std::string &directory) {
+    m_directory = directory;
+    m_available = std::filesystem::exists(directory + "/" + stream_filename)
+        && std::filesystem::exists(directory + "/" + directory_filename);
+}
+
+void PositionalIndex::validate() const {
+    bool has_stream = std::filesystem::exists(m_directory + "/" + stream_filename);
+    bool has_dir = std::filesystem::exists(m_directory + "/" + directory_filename);
+    if (has_stream != has_dir) {
+        throw std::runtime_error("Only one of the positional index files is present in: " + m_directory);
+    }
+    if (!m_available) {
+        return;
+    }
+
+    /* save writes the blocks one after the other in the order of the directory */
+    uint64_t stream_size = std::filesystem::file_size(m_directory + "/" + stream_filename);
+    MappedFile dir(m_directory + "/" + directory_filename, MappedFile::Access::Sequential);
+    const uint8_t *pos = dir.data();
+    const uint8_t *end = pos + dir.size();
+    uint64_t expected_offset = 0;
+    while (pos < end) {
+        uint64_t length = varint_decode(pos, end);
+        if (length > static_cast<uint64_t>(end - pos)) {
+            throw std::runtime_error("Corrupt positional index directory");
+        }
+        pos += length;
+        uint64_t offset = varint_decode(pos, end);
+        uint64_t size = varint_decode(pos, end);
+        if (offset != expected_offset) {
+            break;
+        }
+        expected_offset += size;
+    }
+    if (pos < end || expected_offset != stream_size) {
+        throw std::runtime_error("The positional index files in " + m_directory + " do not match");
+    }
+}
+
+void PositionalIndex::carry_over(const std::string &directory, const std::function<bool(uint64_t)> &keep) {
+    if (!std::filesystem::exists(directory + "/" + stream_filename) || !std::filesystem::exists(directory + "/" + directory_filename)) {
+        return;
+    }
+
+    /* mapped only here, save replaces the files */
+    MappedFile stream(directory + "/" + stream_filename, MappedFile::Access::Sequential);
+    MappedFile dir(directory + "/" + directory_filename, MappedFile::Access::Sequential);
+
+    std::lock_guard<std::mutex> lock(m_pending_mutex);
+    const uint8_t *pos = dir.data();
+    const uint8_t *end = pos + dir.size();
+    while (pos < end) {
+        uint64_t length = varint_decode(pos, end);
+        if (length > static_cast<uint64_t>(end - pos)) {
+            throw std::runtime_error("Corrupt positional index directory");
+        }
+        std::string term(reinterpret_cast<const char*>(pos), length);
+        pos += length;
+        uint64_t offset = varint_decode(pos, end);
+        uint64_t size = varint_decode(pos, end);
+        if (offset + size > stream.size()) {
+            throw std::runtime_error("Positional index directory points behind the stream");
+        }
+
+        /* entries are re-encoded like add_document does: the count followed by the position deltas */
+        const uint8_t *entry = stream.data() + offset;
+        const uint8_t *block_end = entry + size;
+        uint64_t docid = 0;
+        while (entry < block_end) {
+            docid += varint_decode(entry, block_end);
+            uint64_t count = varint_decode(entry, block_end);
+            uint64_t bytes = varint_decode(entry, block_end);
+            if (keep(docid)) {
+                std::string encoded;
+                varint_encode(count, encoded);
+                encoded.append(reinterpret_cast<const char*>(entry), bytes);
+                m_pending[term].emplace_back(docid, std::move(encoded));
+                m_available = true;
+            }
+            entry += bytes;
+        }
+    }
+}
+
+void PositionalIndex::renumber(const std::function<uint64_t(uint64_t)> &new_docid) {
+    std::lock_guard<std::mutex> lock(m_pending_mutex);
+    for (auto &[term, entries]: m_pending) {
+        for (auto &entry: entries) {
+            entry.first = new_docid(entry.first);
+        }
+        std::erase_if(entries, [](const auto &entry) { return entry.first == 0; });
+    }
+    std::erase_if(m_pending, [](const auto &pending) { return pending.second.empty(); });
+}
+
+bool PositionalIndex::is_available() const { return m_available; }
+bool PositionalIndex::is_loaded() const { return m_loaded.load(); }
+
+void PositionalIndex::prefetch() const {
+    if (m_available) {
+        std::call_once(m_load_flag, [this]() { load(); });
+    }
+}
+
+void PositionalIndex::load() const {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    m_stream = MappedFile(m_directory + "/" + stream_filename, MappedFile::Access::Random);
+    MappedFile dir(m_directory + "/" + directory_filename, MappedFile::Access::Sequential);
+
+    const uint8_t *pos = dir.data();
+    const uint8_t *end = pos + dir.size();
+    while (pos < end) {
+        uint64_t length = varint_decode(pos, end);
+        if (length > static_cast<uint64_t>(end - pos)) {
+            throw std::runtime_error("Corrupt positional index directory");
+        }
+        std::string term(reinterpret_cast<const char*>(pos), length);
+        pos += length;
+        uint64_t offset = varint_decode(pos, end);
+        uint64_t size = varint_decode(pos, end);
+        if (offset + size > m_stream.size()) {
+            throw std::runtime_error("Positional index directory points behind the stream");
+        }
+        m_term_blocks.emplace(std::move(term), std::make_pair(offset, size));
+    }
+
+    m_loaded = true;
+    std::chrono::duration<double, std::milli> duration = std::chrono::high_resolution_clock::now() - start;
+    std::cout << "Loaded positional index: " << m_term_blocks.size() << " terms in " << duration.count() << " milliseconds" << std::endl;
+}
+
+PositionalIndex::Cursor PositionalIndex::cursor(const std::string &term) const {
+    if (!m_available) {
+        return Cursor();
+    }
+    std::call_once(m_load_flag, [this]() { load(); });
+
+    auto it = m_term_blocks.find(term);
+    if (it == m_term_blocks.end()) {
+        return Cursor();
+    }
+
+    const uint8_t *begin = m_stream.data() + it->second.first;
+    return Cursor(begin, begin + it->second.second);
+}
+
+uint64_t PositionalIndex::get_size_bytes() const {
+    if (!m_available || m_directory.empty()) {
+        return 0;
+    }
+
+    std::error_code stream_ec, dir_ec;
+    uint64_t stream_size = std::filesystem::file_size(m_directory + "/" + stream_filename, stream_ec);
+    uint64_t dir_size = std::filesystem::file_size(m_directory + "/" + directory_filename, dir_ec);
+    return (stream_ec || dir_ec) ? 0 : stream_size + dir_size;
+}
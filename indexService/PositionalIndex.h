@@ -0,0 +1,96 @@
+#ifndef _H_POSITIONALINDEX
+#define _H_POSITIONALINDEX
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "MappedFile.h"
+
+/*
+*   Optional token positions per (term, document), for phrase matching and proximity ranking.
+*
+*   The positions live in their own stream next to index.json:
+*       positions.bin   per term, in docid order: docid delta, position count, byte length, delta encoded positions
+*       positions.dir   per term: the offset and length of its block in positions.bin
+*   Both are mapped lazily on the first access, queries without phrases never load them.
+*/
+class PositionalIndex {
+    public:
+        /* forward only reader of the positions of one term, docids have to be requested in ascending order */
+        class Cursor {
+            public:
+                Cursor() = default;
+                Cursor(const uint8_t *begin, const uint8_t *end);
+
+                /* fills positions and returns true if the term occurs in the document */
+                bool seek(uint64_t docid, std::vector<uint32_t> &positions);
+
+            private:
+                const uint8_t *m_pos = nullptr;
+                const uint8_t *m_end = nullptr;
+                /* header of the current entry */
+                bool m_has_entry = false;
+                uint64_t m_docid = 0;
+                uint64_t m_count = 0;
+                const uint8_t *m_data = nullptr;
+                const uint8_t *m_data_end = nullptr;
+        };
+
+        PositionalIndex() = default;
+        ~PositionalIndex() = default;
+
+        /* thread safe, called once per document during indexing */
+        void add_document(uint64_t docid, const std::unordered_map<std::string, std::vector<uint32_t>> &positions);
+        /* writes the stream and releases the positions held in memory */
+        void save(const std::string &directory);
+        /* uses the stream in directory if present, nothing is read until the first cursor is requested */
+        void open(const std::string &directory);
+        /*
+        *   Reads only positions.dir and throws std::runtime_error unless its blocks cover positions.bin exactly,
+        *   e.g. if one of the files was replaced by another indexing run, or only one of them is present.
+        */
+        void validate() const;
+        /*
+        *   Incremental indexing: adds the positions of the documents to keep from the stream in directory
+        *   to the positions of this indexing run, so that save writes the complete stream again.
+        *   Must be called before the first cursor is requested.
+        */
+        void carry_over(const std::string &directory, const std::function<bool(uint64_t)> &keep);
+        /* gives the positions of this indexing run new docids before save, the positions of docid 0 are dropped */
+        void renumber(const std::function<uint64_t(uint64_t)> &new_docid);
+
+        bool is_available() const;
+        bool is_loaded() const;
+        /* maps the stream ahead of the first cursor, e.g. before the files are replaced by a new indexing run */
+        void prefetch() const;
+        Cursor cursor(const std::string &term) const;
+
+        /* size of positions.bin and positions.dir */
+        uint64_t get_size_bytes() const;
+
+        static constexpr const char *stream_filename = "positions.bin";
+        static constexpr const char *directory_filename = "positions.dir";
+
+    private:
+        std::string m_directory;
+        bool m_available = false;
+
+        /* positions collected during indexing: term -> (docid, count + encoded position deltas) */
+        std::mutex m_pending_mutex;
+        std::unordered_map<std::string, std::vector<std::pair<uint64_t, std::string>>> m_pending;
+
+        /* lazily loaded stream */
+        mutable std::once_flag m_load_flag;
+        mutable std::atomic<bool> m_loaded{false};
+        mutable MappedFile m_stream;
+        mutable std::unordered_map<std::string, std::pair<uint64_t, uint64_t>> m_term_blocks;
+
+        void load() const;
+};
+
+#endif
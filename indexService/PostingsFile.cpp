@@ -0,0 +1,154 @@
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include "PostingsFile.h"
+
+static_assert(std::endian::native == std::endian::little, "postings.bin is read in place as little endian");
+static_assert(sizeof(int) == 4, "term frequencies are stored as 32 bit integers");
+
+namespace {
+
+template <typename T>
+void write_array(std::ofstream &out, const T *data, size_t count) {
+    out.write(reinterpret_cast<const char*>(data), count * sizeof(T));
+}
+
+}
+
+void PostingsFile::save(const std::string &filepath, const std::vector<PostingsList> &postings, std::span<const uint32_t> doc_lengths) {
+    std::vector<uint64_t> offsets{0};
+    std::vector<uint64_t> skip_offsets{0};
+    offsets.reserve(postings.size() + 1);
+    skip_offsets.reserve(postings.size() + 1);
+    for (const auto &list: postings) {
+        offsets.push_back(offsets.back() + list.size());
+        skip_offsets.push_back(skip_offsets.back() + list.get_skip_docids().size());
+    }
+
+    std::string temporary_path = filepath + ".tmp";
+    {
+        std::ofstream out(temporary_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw std::runtime_error("Failed to open postings file for writing: " + temporary_path);
+        }
+
+        uint32_t skip_interval = PostingsList::skip_interval;
+        uint64_t header[3] = {postings.size(), doc_lengths.size(), offsets.back()};
+        out.write("CPF1", 4);
+        write_array(out, &skip_interval, 1);
+        write_array(out, header, 3);
+        write_array(out, offsets.data(), offsets.size());
+        write_array(out, skip_offsets.data(), skip_offsets.size());
+        for (const auto &list: postings) {
+            write_array(out, list.get_docids().data(), list.size());
+        }
+        for (const auto &list: postings) {
+            write_array(out, list.get_skip_docids().data(), list.get_skip_docids().size());
+        }
+        for (const auto &list: postings) {
+            write_array(out, list.get_term_freqs().data(), list.size());
+        }
+        write_array(out, doc_lengths.data(), doc_lengths.size());
+
+        if (!out.flush()) {
+            throw std::runtime_error("Failed to write postings file: " + temporary_path);
+        }
+    }
+    std::filesystem::rename(temporary_path, filepath);
+}
+
+void PostingsFile::open(const std::string &filepath) {
+    MappedFile file(filepath, MappedFile::Access::Random);
+    const uint8_t *data = file.data();
+    uint64_t size = file.size();
+
+    if (size < header_size || std::memcmp(data, "CPF1", 4) != 0) {
+        throw std::runtime_error("Invalid postings file: " + filepath);
+    }
+    uint32_t skip_interval;
+    uint64_t header[3];
+    std::memcpy(&skip_interval, data + 4, sizeof(skip_interval));
+    std::memcpy(header, data + 8, sizeof(header));
+    if (skip_interval != PostingsList::skip_interval) {
+        throw std::runtime_error("Postings file has an unsupported skip interval: " + filepath);
+    }
+
+    uint64_t term_count = header[0];
+    uint64_t doc_length_count = header[1];
+    uint64_t postings_count = header[2];
+    /* the sizes are checked before anything is read behind the header */
+    uint64_t words = (size - header_size) / 8;
+    if (term_count >= words / 2 || postings_count > words) {
+        throw std::runtime_error("Corrupt postings file header: " + filepath);
+    }
+
+    const uint64_t *offsets = reinterpret_cast<const uint64_t*>(data + header_size);
+    const uint64_t *skip_offsets = offsets + term_count + 1;
+    uint64_t skip_count = skip_offsets[term_count];
+    uint64_t expected = header_size + 8 * (2 * (term_count + 1) + postings_count + skip_count) + 4 * (postings_count + doc_length_count);
+    if (skip_count > words || expected != size || offsets[term_count] != postings_count) {
+        throw std::runtime_error("Postings file has the wrong size: " + filepath);
+    }
+    for (uint64_t term_id = 0; term_id < term_count; ++term_id) {
+        uint64_t count = offsets[term_id + 1] - offsets[term_id];
+        if (offsets[term_id + 1] < offsets[term_id] || skip_offsets[term_id + 1] - skip_offsets[term_id] != PostingsList::skip_count(count)) {
+            throw std::runtime_error("Corrupt postings offsets: " + filepath);
+        }
+    }
+
+    m_term_count = term_count;
+    m_offsets = offsets;
+    m_skip_offsets = skip_offsets;
+    m_docids = skip_offsets + term_count + 1;
+    m_skip_docids = m_docids + postings_count;
+    m_term_freqs = reinterpret_cast<const int*>(m_skip_docids + skip_count);
+    m_doc_lengths = {reinterpret_cast<const uint32_t*>(m_term_freqs + postings_count), doc_length_count};
+    m_file = std::move(file);
+}
+
+PostingsList PostingsFile::get_postings(uint32_t term_id) const {
+    if (term_id >= m_term_count) {
+        return PostingsList::view({}, {}, {});
+    }
+
+    uint64_t first = m_offsets[term_id];
+    uint64_t count = m_offsets[term_id + 1] - first;
+    uint64_t first_skip = m_skip_offsets[term_id];
+    uint64_t skip_count = m_skip_offsets[term_id + 1] - first_skip;
+    return PostingsList::view({m_docids + first, count}, {m_term_freqs + first, count}, {m_skip_docids + first_skip, skip_count});
+}
+
+size_t PostingsFile::get_doc_freq(uint32_t term_id) const {
+    return term_id < m_term_count ? m_offsets[term_id + 1] - m_offsets[term_id] : 0;
+}
+
+size_t PostingsFile::get_term_count() const { return m_term_count; }
+size_t PostingsFile::get_postings_count() const { return m_offsets ? m_offsets[m_term_count] : 0; }
+std::span<const uint32_t> PostingsFile::get_doc_lengths() const { return m_doc_lengths; }
+uint64_t PostingsFile::get_size_bytes() const { return m_file.size(); }
+
+void PostingsFile::prefetch(uint32_t term_id) const {
+    if (term_id >= m_term_count) {
+        return;
+    }
+
+    auto offset_of = [this](const void *pos) {
+        return static_cast<size_t>(static_cast<const uint8_t*>(pos) - m_file.data());
+    };
+    uint64_t first = m_offsets[term_id];
+    uint64_t count = m_offsets[term_id + 1] - first;
+    uint64_t first_skip = m_skip_offsets[term_id];
+    uint64_t skip_count = m_skip_offsets[term_id + 1] - first_skip;
+    m_file.prefetch(offset_of(m_docids + first), count * sizeof(uint64_t));
+    m_file.prefetch(offset_of(m_term_freqs + first), count * sizeof(int));
+    m_file.prefetch(offset_of(m_skip_docids + first_skip), skip_count * sizeof(uint64_t));
+}
+
+void PostingsFile::prefetch_doc_lengths() const {
+    if (m_file.is_open()) {
+        m_file.prefetch(reinterpret_cast<const uint8_t*>(m_doc_lengths.data()) - m_file.data(), m_doc_lengths.size_bytes());
+    }
+}
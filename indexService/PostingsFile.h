@@ -0,0 +1,61 @@
+#ifndef _H_POSTINGSFILE
+#define _H_POSTINGSFILE
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "PostingsList.h"
+
+/*
+*   The docid ordered postings of all terms and the document lengths, memory mapped from postings.bin.
+*   Queries read the postings in place, so every process serving the index shares one copy in the page cache.
+*
+*   File layout, all integers in host byte order (little endian), every array aligned to its element size:
+*       "CPF1", u32 skip_interval, u64 term_count, u64 doc_length_count, u64 postings_count
+*       u64 offsets[term_count + 1]         first posting of every term, the last entry is postings_count
+*       u64 skip_offsets[term_count + 1]    first skip pointer of every term
+*       u64 docids[postings_count]
+*       u64 skip_docids[skip_offsets[term_count]]
+*       i32 term_freqs[postings_count]
+*       u32 doc_lengths[doc_length_count]   indexed by docid
+*/
+class PostingsFile {
+    public:
+        PostingsFile() = default;
+
+        /* writes a new file next to filepath and renames it, processes that mapped the old file keep reading it */
+        static void save(const std::string &filepath, const std::vector<PostingsList> &postings, std::span<const uint32_t> doc_lengths);
+        /* maps a saved file, replaces the mapping of a previous one */
+        void open(const std::string &filepath);
+
+        /* a view of the postings of a term, empty for an unknown term id */
+        PostingsList get_postings(uint32_t term_id) const;
+        size_t get_doc_freq(uint32_t term_id) const;
+        size_t get_term_count() const;
+        size_t get_postings_count() const;
+        std::span<const uint32_t> get_doc_lengths() const;
+        uint64_t get_size_bytes() const;
+
+        /* reads the postings of a term ahead of the first query, see MappedFile::prefetch */
+        void prefetch(uint32_t term_id) const;
+        void prefetch_doc_lengths() const;
+
+        static constexpr const char *filename = "postings.bin";
+
+    private:
+        MappedFile m_file;
+        uint64_t m_term_count = 0;
+        const uint64_t *m_offsets = nullptr;
+        const uint64_t *m_skip_offsets = nullptr;
+        const uint64_t *m_docids = nullptr;
+        const uint64_t *m_skip_docids = nullptr;
+        const int *m_term_freqs = nullptr;
+        std::span<const uint32_t> m_doc_lengths;
+
+        static constexpr size_t header_size = 32;
+};
+
+#endif
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "PostingsList.h"
+
+PostingsList::PostingsList(const PostingsList &other)
+    : m_docids(other.m_docids), m_term_freqs(other.m_term_freqs), m_skip_docids(other.m_skip_docids), m_owned(other.m_owned),
+      m_docids_view(other.m_docids_view), m_term_freqs_view(other.m_term_freqs_view), m_skip_docids_view(other.m_skip_docids_view)
+{
+    if (m_owned) {
+        attach_owned();
+    }
+}
+
+PostingsList &PostingsList::operator=(const PostingsList &other) {
+    if (this != &other) {
+        PostingsList copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+PostingsList PostingsList::view(std::span<const uint64_t> docids, std::span<const int> term_freqs,
+    std::span<const uint64_t> skip_docids)
+{
+    if (term_freqs.size() != docids.size() || skip_docids.size() != skip_count(docids.size())) {
+        throw std::invalid_argument("Postings view with inconsistent sizes");
+    }
+
+    PostingsList list;
+    list.m_owned = false;
+    list.m_docids_view = docids;
+    list.m_term_freqs_view = term_freqs;
+    list.m_skip_docids_view = skip_docids;
+    return list;
+}
+
+void PostingsList::add(uint64_t docid, int term_freq) {
+    if (!m_owned) {
+        throw std::logic_error("Postings can only be added to a list that owns them");
+    }
+    if (!m_docids.empty() && docid <= m_docids.back()) {
+        throw std::invalid_argument("Postings must be added in ascending docid order");
+    }
+
+    m_docids.push_back(docid);
+    m_term_freqs.push_back(term_freq);
+    attach_owned();
+}
+
+void PostingsList::finalize() {
+    if (!m_owned) {
+        return;
+    }
+    m_docids.shrink_to_fit();
+    m_term_freqs.shrink_to_fit();
+
+    m_skip_docids.clear();
+    for (size_t i = skip_interval - 1; i < m_docids.size(); i += skip_interval) {
+        m_skip_docids.push_back(m_docids[i]);
+    }
+    /* the last block can be shorter */
+    if (m_docids.size() % skip_interval != 0) {
+        m_skip_docids.push_back(m_docids.back());
+    }
+    attach_owned();
+}
+
+void PostingsList::attach_owned() {
+    m_docids_view = m_docids;
+    m_term_freqs_view = m_term_freqs;
+    m_skip_docids_view = m_skip_docids;
+}
+
+PostingsList::Cursor PostingsList::cursor() const { return Cursor(*this); }
+size_t PostingsList::size() const { return m_docids_view.size(); }
+std::span<const uint64_t> PostingsList::get_docids() const { return m_docids_view; }
+std::span<const int> PostingsList::get_term_freqs() const { return m_term_freqs_view; }
+std::span<const uint64_t> PostingsList::get_skip_docids() const { return m_skip_docids_view; }
+
+PostingsList::Cursor::Cursor(const PostingsList &list)
+    : m_docids(list.m_docids_view), m_term_freqs(list.m_term_freqs_view), m_skip_docids(list.m_skip_docids_view), m_pos(0)
+{
+}
+
+bool PostingsList::Cursor::at_end() const { return m_pos >= m_docids.size(); }
+uint64_t PostingsList::Cursor::docid() const { return m_docids[m_pos]; }
+int PostingsList::Cursor::term_freq() const { return m_term_freqs[m_pos]; }
+
+void PostingsList::Cursor::next() {
+    m_pos++;
+}
+
+size_t PostingsList::Cursor::advance(uint64_t target) {
+    if (at_end() || docid() >= target) {
+        return 0;
+    }
+
+    const auto &docids = m_docids;
+    const auto &skips = m_skip_docids;
+    size_t start = m_pos;
+    size_t block = m_pos / skip_interval;
+
+    /* target is behind the current block, gallop over the skip pointers */
+    if (skips[block] < target) {
+        size_t low = block;
+        size_t step = 1;
+        while (low + step < skips.size() && skips[low + step] < target) {
+            low += step;
+            step *= 2;
+        }
+        size_t high = std::min(low + step, skips.size() - 1);
+
+        /* first block whose last docid is >= target */
+        auto it = std::lower_bound(skips.begin() + low + 1, skips.begin() + high + 1, target);
+        block = it - skips.begin();
+        if (block >= skips.size() || *it < target) {
+            m_pos = docids.size();
+            return m_pos - start;
+        }
+        m_pos = block * skip_interval;
+    }
+
+    /* the target is inside this block */
+    size_t block_end = std::min((block + 1) * skip_interval, docids.size());
+    m_pos = std::lower_bound(docids.begin() + m_pos, docids.begin() + block_end, target) - docids.begin();
+
+    return m_pos - start;
+}
@@ -0,0 +1,82 @@
+#ifndef _H_POSTINGSLIST
+#define _H_POSTINGSLIST
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/*
+*   Postings of a single term ordered by docid, with one skip pointer per block of postings.
+*   The skip pointers hold the last docid of every block, so a cursor can jump over whole blocks
+*   when intersecting with a more selective term.
+*
+*   A list either owns its postings while the index is built, or is a view of postings stored elsewhere,
+*   e.g. in a mapped PostingsFile. Both are read through the same spans.
+*/
+class PostingsList {
+    public:
+        /* iterates the postings, positioned on the first posting after creation, valid as long as the postings are */
+        class Cursor {
+            public:
+                explicit Cursor(const PostingsList &list);
+
+                bool at_end() const;
+                uint64_t docid() const;
+                int term_freq() const;
+
+                void next();
+                /*
+                *   moves to the first posting with docid >= target, gallops over the skip pointers
+                *   and searches inside the block. Returns the number of postings skipped.
+                */
+                size_t advance(uint64_t target);
+
+            private:
+                std::span<const uint64_t> m_docids;
+                std::span<const int> m_term_freqs;
+                std::span<const uint64_t> m_skip_docids;
+                size_t m_pos;
+        };
+
+        PostingsList() = default;
+        PostingsList(const PostingsList &other);
+        PostingsList &operator=(const PostingsList &other);
+        PostingsList(PostingsList &&other) noexcept = default;
+        PostingsList &operator=(PostingsList &&other) noexcept = default;
+
+        /* a view of finalized postings, the memory has to outlive the list and its cursors */
+        static PostingsList view(std::span<const uint64_t> docids, std::span<const int> term_freqs,
+            std::span<const uint64_t> skip_docids);
+
+        /* postings have to be added in ascending docid order */
+        void add(uint64_t docid, int term_freq);
+        /* builds the skip pointers, call after the last add */
+        void finalize();
+
+        Cursor cursor() const;
+        size_t size() const;
+        std::span<const uint64_t> get_docids() const;
+        std::span<const int> get_term_freqs() const;
+        std::span<const uint64_t> get_skip_docids() const;
+
+        /* number of postings per skip pointer */
+        static constexpr size_t skip_interval = 64;
+        static size_t skip_count(size_t postings) { return (postings + skip_interval - 1) / skip_interval; }
+
+    private:
+        /* only used by a list that owns its postings */
+        std::vector<uint64_t> m_docids;
+        std::vector<int> m_term_freqs;
+        /* last docid of every block */
+        std::vector<uint64_t> m_skip_docids;
+        bool m_owned = true;
+
+        std::span<const uint64_t> m_docids_view;
+        std::span<const int> m_term_freqs_view;
+        std::span<const uint64_t> m_skip_docids_view;
+
+        /* points the views at the owned vectors, moving a vector keeps its buffer */
+        void attach_owned();
+};
+
+#endif
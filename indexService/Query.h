@@ -0,0 +1,89 @@
+#ifndef _H_QUERY
+#define _H_QUERY
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+/*
+*   Statistics of the whole collection when the index is one shard of it, BM25 scores with them are
+*   comparable across the shards. A term without a document frequency here, like a fuzzy match,
+*   gets its local document frequency scaled to the size of the collection.
+*/
+struct CollectionStats {
+    uint64_t documents = 0;
+    uint64_t total_term_count = 0;
+    std::unordered_map<std::string, uint64_t> doc_freqs;
+
+    /* sums the statistics of another shard */
+    void add(const CollectionStats &other) {
+        documents += other.documents;
+        total_term_count += other.total_term_count;
+        for (const auto &[term, doc_freq]: other.doc_freqs) {
+            doc_freqs[term] += doc_freq;
+        }
+    }
+
+    nlohmann::json to_json() const {
+        return {{"documents", documents}, {"total_term_count", total_term_count}, {"doc_freqs", doc_freqs}};
+    }
+
+    /* throws nlohmann::json::type_error on fields of the wrong type */
+    static CollectionStats from_json(const nlohmann::json &j) {
+        CollectionStats stats;
+        stats.documents = j.value("documents", uint64_t{0});
+        stats.total_term_count = j.value("total_term_count", uint64_t{0});
+        if (j.contains("doc_freqs")) {
+            stats.doc_freqs = j["doc_freqs"].get<std::unordered_map<std::string, uint64_t>>();
+        }
+        return stats;
+    }
+};
+
+/* options for a single query, the defaults run the exhaustive BM25 search */
+struct QueryOptions {
+    /* score-at-a-time search over the impact ordered postings */
+    bool impact_ordered = false;
+    /* only for impact ordered search: stop after this many postings, 0 means no limit */
+    size_t postings_budget = 0;
+    /* only for impact ordered search: stop after this duration, 0 means no limit */
+    std::chrono::microseconds time_budget{0};
+    /* return only the best k results, 0 means all results */
+    size_t top_k = 0;
+    /* boost documents in which the query terms occur close together, needs the positional index */
+    bool proximity = false;
+    /* match terms within this edit distance (1 or 2) of the query terms, 0 means exact matching */
+    int fuzzy = 0;
+    /* stop the search after this duration and return what was found so far, 0 means no timeout */
+    std::chrono::milliseconds timeout{0};
+    /* score with the statistics of the whole collection instead of the local ones, not for impact ordered search */
+    std::shared_ptr<const CollectionStats> collection_stats;
+};
+
+/* counters for the work done by a query */
+struct QueryStats {
+    size_t terms_processed = 0;
+    size_t documents_scanned = 0;
+    size_t postings_processed = 0;
+    /* postings jumped over with skip pointers during intersections */
+    size_t postings_skipped = 0;
+    /* dictionary terms matched by wildcards and fuzzy terms */
+    size_t terms_expanded = 0;
+    double elapsed_ms = 0.0;
+};
+
+struct QueryResult {
+    /* pairs of <docid, score>, sorted by descending score */
+    std::vector<std::pair<uint64_t, double>> results;
+    /* true if the search stopped early because of a timeout or budget */
+    bool partial = false;
+    QueryStats stats;
+};
+
+#endif
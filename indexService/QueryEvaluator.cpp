@@ -0,0 +1,690 @@
+#include <algorithm>
+#include <cmath>
+
+#include "QueryEvaluator.h"
+#include "Metrics.h"
+
+namespace {
+
+using DocIterator = QueryEvaluator::DocIterator;
+constexpr uint64_t end_docid = QueryEvaluator::end_docid;
+
+class EmptyIterator : public DocIterator {
+    public:
+        uint64_t docid() const override { return end_docid; }
+        void next() override {}
+        void advance(uint64_t) override {}
+        double score() override { return 0.0; }
+        size_t cost() const override { return 0; }
+};
+
+/* leaf iterator over the postings of a single term, ends early when the deadline passed */
+class TermIterator : public DocIterator {
+    public:
+        TermIterator(PostingsList postings, int doc_freq, std::span<const uint32_t> doc_lengths,
+            const QueryEvaluator::ScoreFunction &score, QueryStats &stats, QueryEvaluator::DeadlineCheck &deadline)
+            : m_postings(std::move(postings)), m_cursor(m_postings.cursor()), m_doc_freq(doc_freq), m_doc_lengths(doc_lengths),
+              m_score(score), m_stats(stats), m_deadline(deadline)
+        {
+            m_stats.postings_processed++;
+        }
+
+        uint64_t docid() const override {
+            return m_cursor.at_end() || m_deadline.expired() ? end_docid : m_cursor.docid();
+        }
+
+        void next() override {
+            m_cursor.next();
+            m_stats.postings_processed++;
+            m_deadline.advance(1);
+        }
+
+        void advance(uint64_t target) override {
+            size_t moved = m_cursor.advance(target);
+            if (moved > 0) {
+                m_stats.postings_processed++;
+                m_stats.postings_skipped += moved - 1;
+                m_deadline.advance(moved);
+            }
+        }
+
+        double score() override {
+            uint64_t id = m_cursor.docid();
+            int doc_length = id < m_doc_lengths.size() ? m_doc_lengths[id] : 0;
+            return m_score(m_cursor.term_freq(), doc_length, m_doc_freq);
+        }
+
+        size_t cost() const override { return m_postings.size(); }
+
+    private:
+        PostingsList m_postings;
+        PostingsList::Cursor m_cursor;
+        int m_doc_freq;
+        std::span<const uint32_t> m_doc_lengths;
+        const QueryEvaluator::ScoreFunction &m_score;
+        QueryStats &m_stats;
+        QueryEvaluator::DeadlineCheck &m_deadline;
+};
+
+/* all children have to match, driven by the child with the lowest cost */
+class ConjunctionIterator : public DocIterator {
+    public:
+        explicit ConjunctionIterator(std::vector<std::unique_ptr<DocIterator>> children)
+            : m_children(std::move(children))
+        {
+            std::sort(m_children.begin(), m_children.end(),
+                [](const auto &a, const auto &b) {
+                    return a->cost() < b->cost();
+                }
+            );
+            align();
+        }
+
+        uint64_t docid() const override { return m_children.front()->docid(); }
+
+        void next() override {
+            m_children.front()->next();
+            align();
+        }
+
+        void advance(uint64_t target) override {
+            m_children.front()->advance(target);
+            align();
+        }
+
+        double score() override {
+            double sum = 0.0;
+            for (auto &child: m_children) {
+                sum += child->score();
+            }
+            return sum;
+        }
+
+        size_t cost() const override { return m_children.front()->cost(); }
+
+    private:
+        std::vector<std::unique_ptr<DocIterator>> m_children;
+
+        /* leapfrog until all children are on the same docid */
+        void align() {
+            auto &lead = m_children.front();
+            while (lead->docid() != end_docid) {
+                uint64_t target = lead->docid();
+                bool matched = true;
+
+                for (size_t i = 1; i < m_children.size(); ++i) {
+                    m_children[i]->advance(target);
+                    if (m_children[i]->docid() != target) {
+                        lead->advance(m_children[i]->docid());
+                        matched = false;
+                        break;
+                    }
+                }
+
+                if (matched) {
+                    return;
+                }
+            }
+        }
+};
+
+/* any child has to match, the scores of all matching children are summed */
+class DisjunctionIterator : public DocIterator {
+    public:
+        explicit DisjunctionIterator(std::vector<std::unique_ptr<DocIterator>> children)
+            : m_children(std::move(children))
+        {
+            update_current();
+        }
+
+        uint64_t docid() const override { return m_current; }
+
+        void next() override {
+            for (auto &child: m_children) {
+                if (child->docid() == m_current) {
+                    child->next();
+                }
+            }
+            update_current();
+        }
+
+        void advance(uint64_t target) override {
+            for (auto &child: m_children) {
+                child->advance(target);
+            }
+            update_current();
+        }
+
+        double score() override {
+            double sum = 0.0;
+            for (auto &child: m_children) {
+                if (child->docid() == m_current) {
+                    sum += child->score();
+                }
+            }
+            return sum;
+        }
+
+        size_t cost() const override {
+            size_t sum = 0;
+            for (const auto &child: m_children) {
+                sum += child->cost();
+            }
+            return sum;
+        }
+
+    private:
+        std::vector<std::unique_ptr<DocIterator>> m_children;
+        uint64_t m_current = end_docid;
+
+        void update_current() {
+            m_current = end_docid;
+            for (const auto &child: m_children) {
+                m_current = std::min(m_current, child->docid());
+            }
+        }
+};
+
+/* conjunction of the phrase terms, verified against the positions */
+class PhraseIterator : public DocIterator {
+    public:
+        PhraseIterator(std::unique_ptr<DocIterator> conjunction, std::vector<PositionalIndex::Cursor> cursors)
+            : m_conjunction(std::move(conjunction)), m_cursors(std::move(cursors)), m_positions(m_cursors.size())
+        {
+            skip_non_phrases();
+        }
+
+        uint64_t docid() const override { return m_conjunction->docid(); }
+
+        void next() override {
+            m_conjunction->next();
+            skip_non_phrases();
+        }
+
+        void advance(uint64_t target) override {
+            m_conjunction->advance(target);
+            skip_non_phrases();
+        }
+
+        double score() override { return m_conjunction->score(); }
+        size_t cost() const override { return m_conjunction->cost(); }
+
+    private:
+        std::unique_ptr<DocIterator> m_conjunction;
+        std::vector<PositionalIndex::Cursor> m_cursors;
+        std::vector<std::vector<uint32_t>> m_positions;
+
+        void skip_non_phrases() {
+            while (m_conjunction->docid() != end_docid && !is_phrase(m_conjunction->docid())) {
+                m_conjunction->next();
+            }
+        }
+
+        /* term i of the phrase has to occur at position p + i */
+        bool is_phrase(uint64_t docid) {
+            for (size_t i = 0; i < m_cursors.size(); ++i) {
+                if (!m_cursors[i].seek(docid, m_positions[i])) {
+                    return false;
+                }
+            }
+
+            for (uint32_t start: m_positions.front()) {
+                bool matched = true;
+                for (size_t i = 1; i < m_positions.size() && matched; ++i) {
+                    matched = std::binary_search(m_positions[i].begin(), m_positions[i].end(), start + i);
+                }
+                if (matched) {
+                    return true;
+                }
+            }
+            return false;
+        }
+};
+
+/*
+*   Merged postings of all terms a wildcard or fuzzy term expands to. A document scores with its best matching term,
+*   so a document is not ranked higher just because it contains many different expansions.
+*   The score of every expansion is multiplied with its weight, fuzzy matches are weighted by their edit distance.
+*/
+struct Expansion {
+    PostingsList postings;
+    double weight;
+    int doc_freq;
+};
+
+class ExpansionIterator : public DocIterator {
+    public:
+        ExpansionIterator(const std::vector<Expansion> &expansions, std::span<const uint32_t> doc_lengths,
+            const QueryEvaluator::ScoreFunction &score, QueryStats &stats, QueryEvaluator::DeadlineCheck &deadline)
+        {
+            for (const auto &[postings, weight, doc_freq]: expansions) {
+                /* the terms merged so far are used, the result is partial */
+                if (deadline.advance(postings.size())) {
+                    break;
+                }
+                for (auto cursor = postings.cursor(); !cursor.at_end(); cursor.next()) {
+                    uint64_t docid = cursor.docid();
+                    int doc_length = docid < doc_lengths.size() ? doc_lengths[docid] : 0;
+                    m_matches.emplace_back(docid, weight * score(cursor.term_freq(), doc_length, doc_freq));
+                }
+                stats.postings_processed += postings.size();
+            }
+
+            /* sorted by docid and score, the last entry of a docid has its best score */
+            std::sort(m_matches.begin(), m_matches.end());
+            size_t out = 0;
+            for (size_t i = 0; i < m_matches.size(); ++i) {
+                if (out > 0 && m_matches[out - 1].first == m_matches[i].first) {
+                    m_matches[out - 1].second = m_matches[i].second;
+                } else {
+                    m_matches[out++] = m_matches[i];
+                }
+            }
+            m_matches.resize(out);
+        }
+
+        uint64_t docid() const override {
+            return m_pos < m_matches.size() ? m_matches[m_pos].first : end_docid;
+        }
+
+        void next() override { m_pos++; }
+
+        void advance(uint64_t target) override {
+            if (docid() >= target) {
+                return;
+            }
+            auto it = std::lower_bound(m_matches.begin() + m_pos, m_matches.end(), target,
+                [](const auto &match, uint64_t value) {
+                    return match.first < value;
+                }
+            );
+            m_pos = it - m_matches.begin();
+        }
+
+        double score() override { return m_matches[m_pos].second; }
+        size_t cost() const override { return m_matches.size(); }
+
+    private:
+        /* pairs of <docid, score> in docid order */
+        std::vector<std::pair<uint64_t, double>> m_matches;
+        size_t m_pos = 0;
+};
+
+/* matches of the driver without the excluded docids, optional clauses only add to the score */
+class BooleanIterator : public DocIterator {
+    public:
+        BooleanIterator(std::unique_ptr<DocIterator> driver, std::vector<std::unique_ptr<DocIterator>> optional,
+            std::vector<std::unique_ptr<DocIterator>> excluded)
+            : m_driver(std::move(driver)), m_optional(std::move(optional)), m_excluded(std::move(excluded))
+        {
+            skip_excluded();
+        }
+
+        uint64_t docid() const override { return m_driver->docid(); }
+
+        void next() override {
+            m_driver->next();
+            skip_excluded();
+        }
+
+        void advance(uint64_t target) override {
+            m_driver->advance(target);
+            skip_excluded();
+        }
+
+        double score() override {
+            uint64_t current = m_driver->docid();
+            double sum = m_driver->score();
+            for (auto &child: m_optional) {
+                child->advance(current);
+                if (child->docid() == current) {
+                    sum += child->score();
+                }
+            }
+            return sum;
+        }
+
+        size_t cost() const override { return m_driver->cost(); }
+
+    private:
+        std::unique_ptr<DocIterator> m_driver;
+        std::vector<std::unique_ptr<DocIterator>> m_optional;
+        std::vector<std::unique_ptr<DocIterator>> m_excluded;
+
+        void skip_excluded() {
+            while (m_driver->docid() != end_docid) {
+                uint64_t current = m_driver->docid();
+                bool excluded = false;
+                for (auto &child: m_excluded) {
+                    child->advance(current);
+                    if (child->docid() == current) {
+                        excluded = true;
+                        break;
+                    }
+                }
+
+                if (!excluded) {
+                    return;
+                }
+                m_driver->next();
+            }
+        }
+};
+
+}
+
+QueryEvaluator::QueryEvaluator(const TermDictionary &dictionary, const PostingsFile &postings,
+    const PositionalIndex &positions, ScoreFunction score, std::chrono::steady_clock::time_point deadline)
+    : m_dictionary(dictionary), m_postings(postings), m_doc_lengths(postings.get_doc_lengths()), m_positions(positions), m_score(std::move(score)),
+      m_deadline(deadline), m_deadline_check(deadline)
+{
+}
+
+QueryEvaluator::DeadlineCheck::DeadlineCheck(std::chrono::steady_clock::time_point deadline)
+    : m_deadline(deadline), m_enabled(deadline != std::chrono::steady_clock::time_point::max())
+{
+}
+
+bool QueryEvaluator::DeadlineCheck::advance(size_t postings) {
+    if (!m_enabled || m_expired) {
+        return m_expired;
+    }
+    m_postings += postings;
+    if (m_postings >= deadline_check_interval) {
+        m_postings = 0;
+        m_expired = std::chrono::steady_clock::now() >= m_deadline;
+    }
+    return m_expired;
+}
+
+bool QueryEvaluator::DeadlineCheck::expired() const { return m_expired; }
+
+/*
+*   Collects all matches of the query, sorted by descending score.
+*   The leaf iterators check the deadline while they move over the postings, see DeadlineCheck, when it is reached
+*   the matches so far are returned as partial result.
+*/
+QueryResult QueryEvaluator::evaluate(const QueryNode &query, const QueryOptions &options) {
+    size_t top_k = options.top_k;
+    QueryResult query_result;
+    m_stats = QueryStats();
+    m_deadline_check = DeadlineCheck(m_deadline);
+
+    m_fuzzy = options.fuzzy;
+    m_expansion_deadline = std::min(m_deadline, std::chrono::steady_clock::now() + expansion_time_budget);
+    m_expansions_complete = true;
+
+    auto traversal_start = std::chrono::steady_clock::now();
+    auto root = make_iterator(query);
+    /* terms a fuzzy or wildcard expansion did not find in time are missing */
+    query_result.partial = !m_expansions_complete;
+    auto &results = query_result.results;
+
+    /* scoring is interleaved with the traversal, timing every call would cost more than the scoring */
+    std::chrono::nanoseconds sampled_score_time{0};
+    size_t score_samples = 0;
+    while (root->docid() != end_docid) {
+        /* an excluding iterator that ended early would let excluded documents through */
+        if (m_deadline_check.expired()) {
+            break;
+        }
+
+        if (results.size() % score_sample_interval == 0) {
+            auto score_start = std::chrono::steady_clock::now();
+            double score = root->score();
+            sampled_score_time += std::chrono::steady_clock::now() - score_start;
+            score_samples++;
+            results.emplace_back(root->docid(), score);
+        } else {
+            results.emplace_back(root->docid(), root->score());
+        }
+        root->next();
+    }
+
+    if (m_deadline_check.expired()) {
+        query_result.partial = true;
+    }
+    auto traversal_time = std::chrono::steady_clock::now() - traversal_start;
+    std::chrono::nanoseconds score_time{0};
+    if (score_samples > 0) {
+        score_time = std::min<std::chrono::nanoseconds>(sampled_score_time * static_cast<int64_t>(results.size()) / static_cast<int64_t>(score_samples), traversal_time);
+    }
+    Metrics::instance().record(Metrics::Stage::Postings, traversal_time - score_time);
+    Metrics::instance().record(Metrics::Stage::Score, score_time);
+
+    m_stats.documents_scanned = results.size();
+    query_result.stats = m_stats;
+    /* sorting and the proximity rerank */
+    Metrics::Timer sort_timer(Metrics::Stage::Sort);
+
+    auto by_score = [](const auto &a, const auto &b) {
+        return a.second > b.second || (a.second == b.second && a.first < b.first);
+    };
+
+    bool proximity = options.proximity && m_positions.is_available();
+    /* the proximity boost reranks the best results, so it needs them sorted */
+    if (top_k > 0 && top_k < results.size() && !proximity) {
+        std::partial_sort(results.begin(), results.begin() + top_k, results.end(), by_score);
+        results.resize(top_k);
+    } else {
+        std::sort(results.begin(), results.end(), by_score);
+    }
+
+    if (proximity) {
+        apply_proximity_boost(results, query, top_k);
+        if (top_k > 0 && top_k < results.size()) {
+            results.resize(top_k);
+        }
+    }
+
+    return query_result;
+}
+
+void QueryEvaluator::set_doc_freqs(DocFreqFunction doc_freq) {
+    m_doc_freq = std::move(doc_freq);
+}
+
+int QueryEvaluator::doc_freq(uint32_t term_id) const {
+    int local = m_postings.get_doc_freq(term_id);
+    return m_doc_freq ? m_doc_freq(term_id, local) : local;
+}
+
+std::unique_ptr<QueryEvaluator::DocIterator> QueryEvaluator::make_term_iterator(const std::string &term) {
+    auto term_id = m_dictionary.lookup(term);
+    if (!term_id || m_postings.get_doc_freq(*term_id) == 0) {
+        return std::make_unique<EmptyIterator>();
+    }
+
+    m_stats.terms_processed++;
+    return std::make_unique<TermIterator>(m_postings.get_postings(*term_id), doc_freq(*term_id), m_doc_lengths, m_score, m_stats, m_deadline_check);
+}
+
+std::unique_ptr<QueryEvaluator::DocIterator> QueryEvaluator::make_wildcard_iterator(const std::string &pattern) {
+    auto expansion = m_dictionary.expand_wildcard(pattern, max_wildcard_terms, m_expansion_deadline);
+    m_expansions_complete = m_expansions_complete && expansion.complete;
+
+    std::vector<Expansion> expansions;
+    for (uint32_t term_id: expansion.ids) {
+        if (m_postings.get_doc_freq(term_id) > 0) {
+            expansions.push_back({m_postings.get_postings(term_id), 1.0, doc_freq(term_id)});
+        }
+    }
+    if (expansions.empty()) {
+        return std::make_unique<EmptyIterator>();
+    }
+
+    m_stats.terms_processed++;
+    m_stats.terms_expanded += expansions.size();
+    return std::make_unique<ExpansionIterator>(expansions, m_doc_lengths, m_score, m_stats, m_deadline_check);
+}
+
+std::unique_ptr<QueryEvaluator::DocIterator> QueryEvaluator::make_fuzzy_iterator(const std::string &term) {
+    int max_edits = fuzzy_edits(term, m_fuzzy);
+    if (max_edits == 0) {
+        return make_term_iterator(term);
+    }
+
+    auto expansion = m_dictionary.expand_fuzzy(term, max_edits, max_fuzzy_terms, m_expansion_deadline);
+    m_expansions_complete = m_expansions_complete && expansion.complete;
+
+    std::vector<Expansion> expansions;
+    for (const auto &match: expansion.matches) {
+        if (m_postings.get_doc_freq(match.id) > 0) {
+            expansions.push_back({m_postings.get_postings(match.id), std::pow(fuzzy_edit_weight, match.distance), doc_freq(match.id)});
+        }
+    }
+    if (expansions.empty()) {
+        return std::make_unique<EmptyIterator>();
+    }
+
+    m_stats.terms_processed++;
+    m_stats.terms_expanded += expansions.size();
+    return std::make_unique<ExpansionIterator>(expansions, m_doc_lengths, m_score, m_stats, m_deadline_check);
+}
+
+int QueryEvaluator::fuzzy_edits(const std::string &term, int fuzzy) {
+    if (term.size() <= 2) {
+        return 0;
+    }
+    return std::min(fuzzy, term.size() <= 5 ? 1 : 2);
+}
+
+std::unique_ptr<QueryEvaluator::DocIterator> QueryEvaluator::make_iterator(const QueryNode &node) {
+    switch (node.type) {
+        case QueryNode::Type::Term:
+            return m_fuzzy > 0 ? make_fuzzy_iterator(node.terms.front()) : make_term_iterator(node.terms.front());
+
+        case QueryNode::Type::Wildcard:
+            return make_wildcard_iterator(node.terms.front());
+
+        /* without positions a phrase is approximated by the conjunction of its terms */
+        case QueryNode::Type::Phrase: {
+            std::vector<std::unique_ptr<DocIterator>> children;
+            for (const auto &term: node.terms) {
+                children.push_back(make_term_iterator(term));
+            }
+            auto conjunction = std::make_unique<ConjunctionIterator>(std::move(children));
+            if (!m_positions.is_available()) {
+                return conjunction;
+            }
+
+            std::vector<PositionalIndex::Cursor> cursors;
+            for (const auto &term: node.terms) {
+                cursors.push_back(m_positions.cursor(term));
+            }
+            return std::make_unique<PhraseIterator>(std::move(conjunction), std::move(cursors));
+        }
+
+        case QueryNode::Type::Boolean:
+            break;
+    }
+
+    auto make_all = [this](const std::vector<std::unique_ptr<QueryNode>> &clauses) {
+        std::vector<std::unique_ptr<DocIterator>> iterators;
+        for (const auto &clause: clauses) {
+            iterators.push_back(make_iterator(*clause));
+        }
+        return iterators;
+    };
+
+    std::unique_ptr<DocIterator> driver;
+    std::vector<std::unique_ptr<DocIterator>> optional;
+
+    if (!node.must.empty()) {
+        auto required = make_all(node.must);
+        driver = required.size() == 1 ? std::move(required.front()) : std::make_unique<ConjunctionIterator>(std::move(required));
+        optional = make_all(node.should);
+    } else if (!node.should.empty()) {
+        auto any = make_all(node.should);
+        driver = any.size() == 1 ? std::move(any.front()) : std::make_unique<DisjunctionIterator>(std::move(any));
+    } else {
+        /* a query of only excluded terms matches nothing */
+        return std::make_unique<EmptyIterator>();
+    }
+
+    if (optional.empty() && node.must_not.empty()) {
+        return driver;
+    }
+    return std::make_unique<BooleanIterator>(std::move(driver), std::move(optional), make_all(node.must_not));
+}
+
+/*
+*   Reranks the best results by the smallest window of the document which contains all query terms
+*   that occur in it. Adjacent terms get the full proximity_weight as boost, the boost decays with the window size.
+*/
+void QueryEvaluator::apply_proximity_boost(std::vector<std::pair<uint64_t, double>> &results, const QueryNode &query, size_t top_k) {
+    std::vector<std::string> terms;
+    query.collect_terms(terms);
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+
+    if (terms.size() < 2 || results.empty()) {
+        return;
+    }
+
+    /* results are sorted by score, the window is read in docid order for the forward only cursors */
+    size_t window = std::min(results.size(), std::max(top_k, proximity_window));
+    std::vector<std::pair<uint64_t, double>*> candidates;
+    for (size_t i = 0; i < window; ++i) {
+        candidates.push_back(&results[i]);
+    }
+    std::sort(candidates.begin(), candidates.end(),
+        [](const auto *a, const auto *b) {
+            return a->first < b->first;
+        }
+    );
+
+    std::vector<PositionalIndex::Cursor> cursors;
+    for (const auto &term: terms) {
+        cursors.push_back(m_positions.cursor(term));
+    }
+
+    std::vector<uint32_t> term_positions;
+    for (auto *candidate: candidates) {
+        std::vector<std::vector<uint32_t>> present;
+        for (auto &cursor: cursors) {
+            if (cursor.seek(candidate->first, term_positions)) {
+                present.push_back(term_positions);
+            }
+        }
+
+        if (present.size() < 2) {
+            continue;
+        }
+
+        uint32_t span = min_span(present);
+        double boost = proximity_weight * (present.size() - 1) / std::max<double>(span - 1, present.size() - 1);
+        candidate->second *= 1.0 + boost;
+    }
+
+    std::sort(results.begin(), results.begin() + window,
+        [](const auto &a, const auto &b) {
+            return a.second > b.second || (a.second == b.second && a.first < b.first);
+        }
+    );
+}
+
+/* length of the smallest window which contains a position of every list */
+uint32_t QueryEvaluator::min_span(const std::vector<std::vector<uint32_t>> &positions) {
+    std::vector<size_t> index(positions.size(), 0);
+    uint32_t best = UINT32_MAX;
+
+    while (true) {
+        size_t min_list = 0;
+        uint32_t low = UINT32_MAX;
+        uint32_t high = 0;
+        for (size_t i = 0; i < positions.size(); ++i) {
+            uint32_t p = positions[i][index[i]];
+            if (p < low) {
+                low = p;
+                min_list = i;
+            }
+            high = std::max(high, p);
+        }
+
+        best = std::min(best, high - low + 1);
+        if (++index[min_list] >= positions[min_list].size()) {
+            return best;
+        }
+    }
+}
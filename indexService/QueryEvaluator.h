@@ -0,0 +1,133 @@
+#ifndef _H_QUERYEVALUATOR
+#define _H_QUERYEVALUATOR
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "PositionalIndex.h"
+#include "PostingsFile.h"
+#include "Query.h"
+#include "QueryParser.h"
+#include "TermDictionary.h"
+
+/*
+*   Evaluates a query AST document-at-a-time over the docid ordered postings.
+*   Every node becomes an iterator over matching docids. Conjunctions are driven by the
+*   clause with the fewest postings and advance the other clauses with the skip pointers,
+*   so a selective AND query only touches a fraction of the postings of its common terms.
+*   If positions are indexed, phrase candidates are verified against them and results can get a proximity boost.
+*   Wildcards and fuzzy terms are expanded with the term dictionary, the postings of the matching terms are merged.
+*/
+class QueryEvaluator {
+    public:
+        /* computes the BM25 score of a term for a document: term_freq, doc_length, doc_freq */
+        using ScoreFunction = std::function<double(int, int, int)>;
+        /* the document frequency a term is scored with: term id, local doc_freq */
+        using DocFreqFunction = std::function<int(uint32_t, int)>;
+
+        /*
+        *   @param dictionary maps the terms to the term ids
+        *   @param postings docid ordered postings and the term count per docid
+        *   @param positions token positions, only read for phrases and proximity ranking
+        *   @param deadline stop when this point in time is reached, time_point::max() means no limit
+        */
+        QueryEvaluator(const TermDictionary &dictionary, const PostingsFile &postings, const PositionalIndex &positions,
+            ScoreFunction score, std::chrono::steady_clock::time_point deadline);
+
+        /* uses top_k, proximity and fuzzy from the options */
+        QueryResult evaluate(const QueryNode &query, const QueryOptions &options);
+
+        /* replaces the local document frequencies, e.g. with the ones of all shards */
+        void set_doc_freqs(DocFreqFunction doc_freq);
+
+        /*
+        *   Told by the leaf iterators about every posting they move over, the clock is read every deadline_check_interval
+        *   postings. Once the deadline passed the leaf iterators end, so a query stops in time even when it walks long
+        *   postings without finding matches, e.g. a sparse conjunction or a term with most documents excluded.
+        */
+        class DeadlineCheck {
+            public:
+                explicit DeadlineCheck(std::chrono::steady_clock::time_point deadline);
+
+                /* adds the postings moved over, true once the deadline passed */
+                bool advance(size_t postings);
+                bool expired() const;
+
+            private:
+                std::chrono::steady_clock::time_point m_deadline;
+                bool m_enabled;
+                bool m_expired = false;
+                size_t m_postings = 0;
+        };
+
+        /* iterator over the matching docids of a query node, positioned on the first match after creation */
+        class DocIterator {
+            public:
+                virtual ~DocIterator() = default;
+                /* end_docid when exhausted */
+                virtual uint64_t docid() const = 0;
+                virtual void next() = 0;
+                /* move to the first match with docid >= target */
+                virtual void advance(uint64_t target) = 0;
+                /* score of the current docid */
+                virtual double score() = 0;
+                /* upper bound of matches, conjunctions are driven by the cheapest iterator */
+                virtual size_t cost() const = 0;
+        };
+
+        static constexpr uint64_t end_docid = UINT64_MAX;
+        /* a wildcard matching more terms is cut off, the first terms in sorted order are used */
+        static constexpr size_t max_wildcard_terms = 1024;
+
+        /* a fuzzy term is expanded to at most this many terms, the closest ones are kept */
+        static constexpr size_t max_fuzzy_terms = 64;
+        /* time for the fuzzy and wildcard expansions of all terms of a query, terms not found in time are missing from the result */
+        static constexpr std::chrono::milliseconds expansion_time_budget{5};
+        /* every edit multiplies the score of an expanded term with this weight */
+        static constexpr double fuzzy_edit_weight = 0.5;
+
+        /* edit distance for a term: exact for up to 2 letters, at most 1 edit for up to 5 letters */
+        static int fuzzy_edits(const std::string &term, int fuzzy);
+
+    private:
+        const TermDictionary &m_dictionary;
+        const PostingsFile &m_postings;
+        std::span<const uint32_t> m_doc_lengths;
+        const PositionalIndex &m_positions;
+        ScoreFunction m_score;
+        DocFreqFunction m_doc_freq;
+        std::chrono::steady_clock::time_point m_deadline;
+        DeadlineCheck m_deadline_check;
+
+        int m_fuzzy = 0;
+        std::chrono::steady_clock::time_point m_expansion_deadline;
+        /* false if a fuzzy or wildcard expansion ran out of time */
+        bool m_expansions_complete = true;
+
+        QueryStats m_stats;
+
+        /* postings moved over between two reads of the clock */
+        static constexpr size_t deadline_check_interval = 1024;
+        /* the scoring time is measured for every n-th match and extrapolated */
+        static constexpr size_t score_sample_interval = 64;
+
+        /* the best n results are reranked by proximity */
+        static constexpr size_t proximity_window = 100;
+        /* boost of a document with all query terms next to each other */
+        static constexpr double proximity_weight = 0.5;
+
+        int doc_freq(uint32_t term_id) const;
+        std::unique_ptr<DocIterator> make_iterator(const QueryNode &node);
+        std::unique_ptr<DocIterator> make_term_iterator(const std::string &term);
+        std::unique_ptr<DocIterator> make_wildcard_iterator(const std::string &pattern);
+        std::unique_ptr<DocIterator> make_fuzzy_iterator(const std::string &term);
+        void apply_proximity_boost(std::vector<std::pair<uint64_t, double>> &results, const QueryNode &query, size_t top_k);
+        static uint32_t min_span(const std::vector<std::vector<uint32_t>> &positions);
+};
+
+#endif
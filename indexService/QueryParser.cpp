@@ -0,0 +1,383 @@
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+#include <stdexcept>
+
+#include "QueryParser.h"
+
+std::unique_ptr<QueryNode> QueryNode::make_term(const std::string &term) {
+    auto node = std::make_unique<QueryNode>();
+    node->type = Type::Term;
+    node->terms.push_back(term);
+    return node;
+}
+
+std::unique_ptr<QueryNode> QueryNode::make_phrase(std::vector<std::string> terms) {
+    auto node = std::make_unique<QueryNode>();
+    node->type = Type::Phrase;
+    node->terms = std::move(terms);
+    return node;
+}
+
+std::unique_ptr<QueryNode> QueryNode::make_boolean() {
+    auto node = std::make_unique<QueryNode>();
+    node->type = Type::Boolean;
+    return node;
+}
+
+std::unique_ptr<QueryNode> QueryNode::make_wildcard(const std::string &pattern) {
+    auto node = std::make_unique<QueryNode>();
+    node->type = Type::Wildcard;
+    node->terms.push_back(pattern);
+    return node;
+}
+
+bool QueryNode::is_bag_of_words() const {
+    if (type == Type::Term) {
+        return true;
+    }
+    if (type == Type::Phrase || type == Type::Wildcard || !must.empty() || !must_not.empty()) {
+        return false;
+    }
+
+    for (const auto &clause: should) {
+        if (clause->type != Type::Term) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void QueryNode::collect_terms(std::vector<std::string> &result) const {
+    if (type != Type::Wildcard) {
+        result.insert(result.end(), terms.begin(), terms.end());
+    }
+    for (const auto &clause: must) {
+        clause->collect_terms(result);
+    }
+    for (const auto &clause: should) {
+        clause->collect_terms(result);
+    }
+}
+
+void QueryNode::collect_patterns(std::vector<std::string> &result) const {
+    if (type == Type::Wildcard) {
+        result.push_back(terms.front());
+    }
+    for (const auto &clause: must) {
+        clause->collect_patterns(result);
+    }
+    for (const auto &clause: should) {
+        clause->collect_patterns(result);
+    }
+}
+
+std::string QueryNode::to_string() const {
+    std::ostringstream oss;
+
+    switch (type) {
+        case Type::Term:
+        case Type::Wildcard:
+            oss << terms.front();
+            break;
+        case Type::Phrase:
+            oss << '"';
+            for (size_t i = 0; i < terms.size(); ++i) {
+                oss << (i > 0 ? " " : "") << terms[i];
+            }
+            oss << '"';
+            break;
+        case Type::Boolean: {
+            std::string separator;
+            oss << '(';
+            for (const auto &clause: must) {
+                oss << separator << '+' << clause->to_string();
+                separator = " ";
+            }
+            for (const auto &clause: should) {
+                oss << separator << clause->to_string();
+                separator = " ";
+            }
+            for (const auto &clause: must_not) {
+                oss << separator << '-' << clause->to_string();
+                separator = " ";
+            }
+            oss << ')';
+            break;
+        }
+    }
+
+    return oss.str();
+}
+
+nlohmann::json QueryNode::to_json() const {
+    switch (type) {
+        case Type::Term:
+            return {{"type", "term"}, {"term", terms.front()}};
+        case Type::Phrase:
+            return {{"type", "phrase"}, {"terms", terms}};
+        case Type::Wildcard:
+            return {{"type", "wildcard"}, {"pattern", terms.front()}};
+        case Type::Boolean:
+            break;
+    }
+
+    nlohmann::json j = {{"type", "boolean"}};
+    for (const auto &[name, clauses]: {std::pair{"must", &must}, std::pair{"should", &should}, std::pair{"must_not", &must_not}}) {
+        if (!clauses->empty()) {
+            j[name] = nlohmann::json::array();
+            for (const auto &clause: *clauses) {
+                j[name].push_back(clause->to_json());
+            }
+        }
+    }
+    return j;
+}
+
+std::unique_ptr<QueryNode> QueryParser::parse(std::string_view query, const Analyzer &analyzer) {
+    QueryParser parser(query, analyzer);
+    auto node = parser.parse_or();
+
+    if (parser.peek().type != TokenType::End) {
+        throw std::invalid_argument("Unexpected ')' in query");
+    }
+    return node;
+}
+
+QueryParser::QueryParser(std::string_view query, const Analyzer &analyzer)
+    : m_tokens(tokenize(query)), m_analyzer(analyzer)
+{
+}
+
+std::vector<QueryParser::Token> QueryParser::tokenize(std::string_view query) {
+    std::vector<Token> tokens;
+    size_t i = 0;
+    size_t n = query.size();
+
+    while (i < n) {
+        unsigned char c = query[i];
+        if (std::isspace(c)) {
+            i++;
+            continue;
+        }
+
+        /* a modifier belongs to the following token, a lone + or - is ignored */
+        char modifier = 0;
+        if ((c == '+' || c == '-') && i + 1 < n && !std::isspace(static_cast<unsigned char>(query[i + 1]))) {
+            modifier = c;
+            c = query[++i];
+        }
+
+        if (c == '(') {
+            tokens.push_back({TokenType::LeftParen, "(", modifier});
+            i++;
+        } else if (c == ')') {
+            tokens.push_back({TokenType::RightParen, ")", modifier});
+            i++;
+        } else if (c == '"') {
+            /* an unterminated phrase runs until the end of the query */
+            size_t end = query.find('"', i + 1);
+            if (end == std::string_view::npos) {
+                end = n;
+            }
+            tokens.push_back({TokenType::Phrase, std::string(query.substr(i + 1, end - i - 1)), modifier});
+            i = end + 1;
+        } else {
+            size_t end = i;
+            while (end < n && !std::isspace(static_cast<unsigned char>(query[end]))
+                && query[end] != '(' && query[end] != ')' && query[end] != '"') {
+                end++;
+            }
+            std::string word(query.substr(i, end - i));
+            i = end;
+
+            if (modifier == 0 && word == "AND") {
+                tokens.push_back({TokenType::And, word});
+            } else if (modifier == 0 && word == "OR") {
+                tokens.push_back({TokenType::Or, word});
+            } else if (modifier == 0 && word == "NOT") {
+                tokens.push_back({TokenType::Not, word});
+            } else {
+                tokens.push_back({TokenType::Word, word, modifier});
+            }
+        }
+    }
+
+    tokens.push_back({TokenType::End, ""});
+    return tokens;
+}
+
+/* same analysis as during indexing */
+std::vector<std::string> QueryParser::analyze(const std::string &text) const {
+    std::vector<std::string> terms;
+    std::istringstream iss(text);
+    std::string word;
+
+    while (iss >> word) {
+        for (auto &term: m_analyzer.analyze(word)) {
+            terms.push_back(std::move(term));
+        }
+    }
+    return terms;
+}
+
+/*
+*   Cleans a word with wildcards like a term, but keeps * and ?.
+*   A pattern without a letter would expand to the whole dictionary, so it is rejected.
+*/
+std::string QueryParser::analyze_pattern(const std::string &text) {
+    std::string pattern;
+    for (unsigned char c: text) {
+        if (std::isalpha(c)) {
+            pattern.push_back(std::tolower(c));
+        } else if (c == '*' || c == '?') {
+            /* ** matches the same as * */
+            if (c == '*' && !pattern.empty() && pattern.back() == '*') {
+                continue;
+            }
+            pattern.push_back(c);
+        }
+    }
+
+    if (std::none_of(pattern.begin(), pattern.end(), [](unsigned char c) { return std::isalpha(c); })) {
+        throw std::invalid_argument("Wildcard '" + text + "' needs at least one letter");
+    }
+    return pattern;
+}
+
+const QueryParser::Token &QueryParser::peek() const {
+    return m_tokens[m_pos];
+}
+
+void QueryParser::enter() {
+    if (++m_depth > max_depth) {
+        throw std::invalid_argument("Query is nested more than " + std::to_string(max_depth) + " levels deep");
+    }
+}
+
+/* clauses separated by OR or by whitespace */
+std::unique_ptr<QueryNode> QueryParser::parse_or() {
+    auto node = QueryNode::make_boolean();
+
+    while (peek().type != TokenType::End && peek().type != TokenType::RightParen) {
+        if (peek().type == TokenType::Or) {
+            m_pos++;
+            continue;
+        }
+        auto [clause, occur] = parse_and();
+        add_clause(*node, std::move(clause), occur);
+    }
+
+    return simplify(std::move(node));
+}
+
+/* clauses joined by AND, a NOT clause is an exclusion of the group */
+std::pair<std::unique_ptr<QueryNode>, QueryParser::Occur> QueryParser::parse_and() {
+    auto [first, occur] = parse_unary();
+    if (peek().type != TokenType::And) {
+        return {std::move(first), occur};
+    }
+
+    auto group = QueryNode::make_boolean();
+    add_clause(*group, std::move(first), occur == Occur::MustNot ? Occur::MustNot : Occur::Must);
+
+    while (peek().type == TokenType::And) {
+        m_pos++;
+        auto [clause, clause_occur] = parse_unary();
+        add_clause(*group, std::move(clause), clause_occur == Occur::MustNot ? Occur::MustNot : Occur::Must);
+    }
+
+    return {simplify(std::move(group)), Occur::Should};
+}
+
+std::pair<std::unique_ptr<QueryNode>, QueryParser::Occur> QueryParser::parse_unary() {
+    if (peek().type == TokenType::Not) {
+        m_pos++;
+        enter();
+        auto [node, occur] = parse_unary();
+        m_depth--;
+        return {std::move(node), Occur::MustNot};
+    }
+
+    Token token = peek();
+    if (token.type == TokenType::End) {
+        throw std::invalid_argument("Missing operand at the end of the query");
+    }
+    m_pos++;
+
+    auto node = parse_primary(token);
+    Occur occur = Occur::Should;
+    if (token.modifier == '+') {
+        occur = Occur::Must;
+    } else if (token.modifier == '-') {
+        occur = Occur::MustNot;
+    }
+
+    return {std::move(node), occur};
+}
+
+/* returns nullptr if nothing is left after cleaning the text */
+std::unique_ptr<QueryNode> QueryParser::parse_primary(const Token &token) {
+    switch (token.type) {
+        case TokenType::Word:
+        case TokenType::Phrase: {
+            /* wildcards inside a phrase are treated as separators, like any other punctuation */
+            if (token.type == TokenType::Word && token.text.find_first_of("*?") != std::string::npos) {
+                return QueryNode::make_wildcard(analyze_pattern(token.text));
+            }
+
+            std::vector<std::string> terms = analyze(token.text);
+            if (terms.empty()) {
+                return nullptr;
+            }
+            if (terms.size() == 1) {
+                return QueryNode::make_term(terms.front());
+            }
+            return QueryNode::make_phrase(std::move(terms));
+        }
+        case TokenType::LeftParen: {
+            enter();
+            auto node = parse_or();
+            if (peek().type != TokenType::RightParen) {
+                throw std::invalid_argument("Missing ')' in query");
+            }
+            m_pos++;
+            m_depth--;
+            return node;
+        }
+        default:
+            throw std::invalid_argument("Unexpected '" + token.text + "' in query");
+    }
+}
+
+void QueryParser::add_clause(QueryNode &node, std::unique_ptr<QueryNode> clause, Occur occur) {
+    if (!clause) {
+        return;
+    }
+
+    switch (occur) {
+        case Occur::Must:
+            node.must.push_back(std::move(clause));
+            break;
+        case Occur::Should:
+            node.should.push_back(std::move(clause));
+            break;
+        case Occur::MustNot:
+            node.must_not.push_back(std::move(clause));
+            break;
+    }
+}
+
+/* a boolean node with a single positive clause is replaced by that clause */
+std::unique_ptr<QueryNode> QueryParser::simplify(std::unique_ptr<QueryNode> node) {
+    if (!node->must_not.empty()) {
+        return node;
+    }
+    if (node->must.size() == 1 && node->should.empty()) {
+        return std::move(node->must.front());
+    }
+    if (node->should.size() == 1 && node->must.empty()) {
+        return std::move(node->should.front());
+    }
+    return node;
+}
@@ -0,0 +1,103 @@
+#ifndef _H_QUERYPARSER
+#define _H_QUERYPARSER
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "Analyzer.h"
+
+/*
+*   AST of a parsed query.
+*   A Boolean node holds its clauses in three groups, like a boolean query in lucene:
+*   must clauses are required, must_not clauses exclude documents,
+*   should clauses are optional and only add to the score, unless there are no must clauses.
+*/
+struct QueryNode {
+    enum class Type { Term, Phrase, Boolean, Wildcard };
+
+    Type type;
+    /* the term for Term, the terms in order for Phrase, the pattern for Wildcard */
+    std::vector<std::string> terms;
+
+    std::vector<std::unique_ptr<QueryNode>> must;
+    std::vector<std::unique_ptr<QueryNode>> should;
+    std::vector<std::unique_ptr<QueryNode>> must_not;
+
+    static std::unique_ptr<QueryNode> make_term(const std::string &term);
+    static std::unique_ptr<QueryNode> make_phrase(std::vector<std::string> terms);
+    static std::unique_ptr<QueryNode> make_boolean();
+    static std::unique_ptr<QueryNode> make_wildcard(const std::string &pattern);
+
+    /* true for a plain disjunction of terms, which is how queries were interpreted before the query language */
+    bool is_bag_of_words() const;
+    /* all terms which can contribute to the score, excluded terms and wildcards are skipped */
+    void collect_terms(std::vector<std::string> &terms) const;
+    /* the wildcard patterns which can contribute to the score */
+    void collect_patterns(std::vector<std::string> &patterns) const;
+
+    /* for the explain mode */
+    std::string to_string() const;
+    nlohmann::json to_json() const;
+};
+
+/*
+*   Parses the query language:
+*       whale moby          either term, ranked by BM25 (default, same as the old bag of words query)
+*       whale AND moby      both terms are required
+*       whale OR moby       either term
+*       whale NOT ship      documents with ship are excluded, also: whale AND NOT ship
+*       +whale -ship moby   whale is required, ship is excluded, moby is optional
+*       "white whale"       phrase
+*       (a OR b) AND c      grouping
+*       whal* or ?hale      wildcard, * matches any sequence and ? a single letter, expanded with the term dictionary
+*   AND binds tighter than OR. Operators must be written in upper case, otherwise they are terms.
+*   Terms are analyzed like the documents of the index, a word that splits into several terms becomes a phrase.
+*   Wildcard patterns are only cleaned, they are matched against the analyzed terms of the dictionary.
+*   Throws std::invalid_argument on syntax errors and on groups or NOTs nested deeper than max_depth.
+*/
+class QueryParser {
+    public:
+        static std::unique_ptr<QueryNode> parse(std::string_view query, const Analyzer &analyzer = Analyzer());
+
+        /* the parser, the evaluation and the destructor of the AST recurse once per level */
+        static constexpr size_t max_depth = 256;
+
+    private:
+        enum class TokenType { Word, Phrase, And, Or, Not, LeftParen, RightParen, End };
+        enum class Occur { Must, Should, MustNot };
+
+        struct Token {
+            TokenType type;
+            std::string text;
+            /* '+' or '-' directly in front of the token, 0 if none */
+            char modifier = 0;
+        };
+
+        QueryParser(std::string_view query, const Analyzer &analyzer);
+
+        std::vector<Token> m_tokens;
+        size_t m_pos = 0;
+        /* open groups and NOTs at the current token */
+        size_t m_depth = 0;
+        const Analyzer &m_analyzer;
+
+        static std::vector<Token> tokenize(std::string_view query);
+        std::vector<std::string> analyze(const std::string &text) const;
+        static std::string analyze_pattern(const std::string &text);
+
+        const Token &peek() const;
+        void enter();
+        std::unique_ptr<QueryNode> parse_or();
+        std::pair<std::unique_ptr<QueryNode>, Occur> parse_and();
+        std::pair<std::unique_ptr<QueryNode>, Occur> parse_unary();
+        std::unique_ptr<QueryNode> parse_primary(const Token &token);
+
+        static void add_clause(QueryNode &node, std::unique_ptr<QueryNode> clause, Occur occur);
+        static std::unique_ptr<QueryNode> simplify(std::unique_ptr<QueryNode> node);
+};
+
+#endif
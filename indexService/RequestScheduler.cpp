@@ -0,0 +1,183 @@
+#include <sstream>
+
+#include "Metrics.h"
+#include "RequestScheduler.h"
+
+namespace {
+
+struct ClassLimits {
+    const char *name;
+    size_t max_queued;
+    /* 0 is unlimited */
+    size_t max_running;
+    std::chrono::milliseconds queue_budget;
+    std::chrono::seconds retry_after;
+    Metrics::Stage queue_stage;
+};
+
+/* in the order of RequestScheduler::Priority */
+const ClassLimits class_limits[] = {
+    /* started one by one anyway, a running one is only writing its response */
+    {"interactive", 1024, 0, std::chrono::milliseconds(100), std::chrono::seconds(1), Metrics::Stage::QueueInteractive},
+    /* a batch keeps all cores busy */
+    {"batch", 8, 1, std::chrono::seconds(30), std::chrono::seconds(10), Metrics::Stage::QueueBatch},
+    /* an update loads a new generation of the index, a check reads every blob of its step */
+    {"admin", 4, 1, std::chrono::seconds(60), std::chrono::seconds(30), Metrics::Stage::QueueAdmin}
+};
+
+static_assert(std::size(class_limits) == static_cast<size_t>(RequestScheduler::Priority::Count));
+
+/* weight of the latest start in the moving average of the service time */
+constexpr double service_time_weight = 0.125;
+
+}
+
+RequestScheduler::RequestScheduler(boost::asio::io_context &io) : m_io(io) {}
+
+void RequestScheduler::submit(Priority priority, Start start, Reject reject) {
+    size_t p = static_cast<size_t>(priority);
+    const auto &limits = class_limits[p];
+    auto &queue = m_classes[p].waiting;
+    if (queue.size() >= limits.max_queued || estimated_wait(p) > limits.queue_budget) {
+        shed(p, reject);
+        return;
+    }
+
+    queue.push_back({std::chrono::steady_clock::now(), std::move(start), std::move(reject)});
+    schedule();
+}
+
+void RequestScheduler::finish(Priority priority) {
+    m_classes[static_cast<size_t>(priority)].running--;
+    /* the end of a batch or an admin request can also let the other class start */
+    for (const auto &request_class: m_classes) {
+        if (!request_class.waiting.empty()) {
+            schedule();
+            break;
+        }
+    }
+}
+
+/* the reads and writes completed meanwhile run first, their requests are queued before the next one is picked */
+void RequestScheduler::schedule() {
+    if (m_scheduled) {
+        return;
+    }
+    m_scheduled = true;
+    boost::asio::post(m_io, [this]() {
+        m_scheduled = false;
+        run_next();
+    });
+}
+
+void RequestScheduler::run_next() {
+    auto &metrics = Metrics::instance();
+    for (size_t p = 0; p < m_classes.size(); ++p) {
+        auto &request_class = m_classes[p];
+        while (!request_class.waiting.empty() && can_start(p)) {
+            Waiting request = std::move(request_class.waiting.front());
+            request_class.waiting.pop_front();
+
+            auto now = std::chrono::steady_clock::now();
+            metrics.record(class_limits[p].queue_stage, now - request.queued);
+            if (now - request.queued > class_limits[p].queue_budget) {
+                shed(p, request.reject);
+                continue;
+            }
+
+            request_class.running++;
+            request.start();
+            std::chrono::duration<double, std::nano> service_time = std::chrono::steady_clock::now() - now;
+            request_class.service_ns += service_time_weight * (service_time.count() - request_class.service_ns);
+
+            /* one request per turn, the others wait for the next one */
+            for (size_t next = 0; next < m_classes.size(); ++next) {
+                if (!m_classes[next].waiting.empty() && can_start(next)) {
+                    schedule();
+                    break;
+                }
+            }
+            return;
+        }
+    }
+}
+
+bool RequestScheduler::can_start(size_t priority) const {
+    size_t max_running = class_limits[priority].max_running;
+    if (max_running != 0 && m_classes[priority].running >= max_running) {
+        return false;
+    }
+    /* a batch and an update or check never run at the same time, both keep the cores and the disk busy */
+    constexpr size_t batch = static_cast<size_t>(Priority::Batch);
+    constexpr size_t admin = static_cast<size_t>(Priority::Admin);
+    if (priority == batch) {
+        return m_classes[admin].running == 0;
+    }
+    if (priority == admin) {
+        return m_classes[batch].running == 0;
+    }
+    return true;
+}
+
+void RequestScheduler::shed(size_t priority, const Reject &reject) {
+    m_classes[priority].shed++;
+    reject(class_limits[priority].retry_after);
+}
+
+/* the requests queued in this class and the more important ones start first, a lower bound of the wait */
+std::chrono::nanoseconds RequestScheduler::estimated_wait(size_t priority) const {
+    double wait_ns = 0.0;
+    for (size_t p = 0; p <= priority; ++p) {
+        wait_ns += m_classes[p].waiting.size() * m_classes[p].service_ns;
+    }
+    return std::chrono::nanoseconds(static_cast<int64_t>(wait_ns));
+}
+
+bool RequestScheduler::open_connection(std::function<void()> resume) {
+    if (m_connections < max_connections) {
+        m_connections++;
+        return true;
+    }
+
+    m_resume_accept = std::move(resume);
+    m_accept_paused = true;
+    /* a connection closed on another thread before the pause was set did not resume */
+    if (m_connections < max_connections && m_accept_paused.exchange(false)) {
+        m_connections++;
+        return true;
+    }
+    return false;
+}
+
+void RequestScheduler::close_connection() {
+    m_connections--;
+    if (m_accept_paused.exchange(false)) {
+        boost::asio::post(m_io, [this]() {
+            auto resume = std::move(m_resume_accept);
+            resume();
+        });
+    }
+}
+
+std::string RequestScheduler::to_prometheus() const {
+    std::ostringstream out;
+    out << "# HELP cearch_queued_requests Requests waiting for their turn, per priority class\n";
+    out << "# TYPE cearch_queued_requests gauge\n";
+    for (size_t p = 0; p < m_classes.size(); ++p) {
+        out << "cearch_queued_requests{class=\"" << class_limits[p].name << "\"} " << m_classes[p].waiting.size() << "\n";
+    }
+    out << "# HELP cearch_running_requests Requests started and not yet answered, per priority class\n";
+    out << "# TYPE cearch_running_requests gauge\n";
+    for (size_t p = 0; p < m_classes.size(); ++p) {
+        out << "cearch_running_requests{class=\"" << class_limits[p].name << "\"} " << m_classes[p].running << "\n";
+    }
+    out << "# HELP cearch_requests_shed_total Requests answered with 503 because their queue was over budget\n";
+    out << "# TYPE cearch_requests_shed_total counter\n";
+    for (size_t p = 0; p < m_classes.size(); ++p) {
+        out << "cearch_requests_shed_total{class=\"" << class_limits[p].name << "\"} " << m_classes[p].shed << "\n";
+    }
+    out << "# HELP cearch_open_connections Open connections and the one being accepted, at most " << max_connections << "\n";
+    out << "# TYPE cearch_open_connections gauge\n";
+    out << "cearch_open_connections " << m_connections.load() << "\n";
+    return out.str();
+}
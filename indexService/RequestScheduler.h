@@ -0,0 +1,87 @@
+#ifndef _H_REQUESTSCHEDULER
+#define _H_REQUESTSCHEDULER
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+
+#include <boost/asio.hpp>
+
+/*
+*   Admission control of the server: the requests wait in a bounded queue per priority class and are started
+*   one at a time on the thread of the io_context, between the reads and writes of the other connections.
+*   The next request is the oldest one of the most important class below its concurrency limit:
+*   interactive queries before batches before indexing and admin. A batch and an admin request never run at
+*   the same time, an admin request waits until the running batch is done and the other way round.
+*   A request keeps its slot until its response is written.
+*
+*   A request that would wait longer than the queue budget of its class is answered with 503 and Retry-After
+*   instead of running late: when it arrives and the queue is full or the queued requests ahead of it already
+*   take longer than the budget, or when its turn comes after the budget ran out.
+*   Open connections are limited too, further ones wait in the backlog of the listening socket.
+*
+*   All methods but close_connection are called on the thread of the io_context.
+*/
+class RequestScheduler {
+    public:
+        enum class Priority { Interactive, Batch, Admin, Count };
+
+        /* starts the request, finish is called once its response is written */
+        using Start = std::function<void()>;
+        /* answers the request with 503 */
+        using Reject = std::function<void(std::chrono::seconds retry_after)>;
+
+        explicit RequestScheduler(boost::asio::io_context &io);
+
+        RequestScheduler(const RequestScheduler &) = delete;
+        RequestScheduler &operator=(const RequestScheduler &) = delete;
+
+        void submit(Priority priority, Start start, Reject reject);
+        void finish(Priority priority);
+
+        /* false at the limit, resume is posted when the next connection is closed */
+        bool open_connection(std::function<void()> resume);
+        /* from any thread, e.g. a session released by the thread of a batch */
+        void close_connection();
+
+        /* queued, running and shed requests per class and the open connections */
+        std::string to_prometheus() const;
+
+        static constexpr size_t max_connections = 4096;
+
+    private:
+        struct Waiting {
+            std::chrono::steady_clock::time_point queued;
+            Start start;
+            Reject reject;
+        };
+
+        struct Class {
+            std::deque<Waiting> waiting;
+            size_t running = 0;
+            uint64_t shed = 0;
+            /* moving average of the time a start takes on the thread of the io_context */
+            double service_ns = 0.0;
+        };
+
+        boost::asio::io_context &m_io;
+        std::array<Class, static_cast<size_t>(Priority::Count)> m_classes;
+        /* a run_next is posted */
+        bool m_scheduled = false;
+
+        std::atomic<size_t> m_connections{0};
+        std::atomic<bool> m_accept_paused{false};
+        std::function<void()> m_resume_accept;
+
+        void schedule();
+        void run_next();
+        bool can_start(size_t priority) const;
+        void shed(size_t priority, const Reject &reject);
+        std::chrono::nanoseconds estimated_wait(size_t priority) const;
+};
+
+#endif
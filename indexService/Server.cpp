@@ -2,8 +2,8 @@
 
 using boost::asio::ip::tcp;
 
-Server::Server(boost::asio::io_context &io_context, short port, Index &idx)
-    :endpoint(tcp::v4(), port), acceptor(io_context), idx(idx) {
+Server::Server(boost::asio::io_context &io_context, short port, IndexGenerations &generations, bool reuse_port)
+    :endpoint(tcp::v4(), port), acceptor(io_context), generations(generations), reuse_port(reuse_port), scheduler(io_context) {
     open_acceptor();
 }
 
@@ -12,6 +12,9 @@ void Server::open_acceptor() {
     if (!acceptor.is_open()) {
         acceptor.open(endpoint.protocol());
         acceptor.set_option(boost::asio::socket_base::reuse_address(true));
+        if (reuse_port) {
+            acceptor.set_option(boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+        }
         acceptor.bind(endpoint);
         acceptor.listen(boost::asio::socket_base::max_listen_connections, error_code);
         if (!error_code) {
@@ -23,12 +26,18 @@ void Server::open_acceptor() {
 }
 
 void Server::do_accept() {
+    /* at the limit further connections wait in the backlog, the next closed one resumes accepting */
+    if (!scheduler.open_connection([this]() { do_accept(); })) {
+        return;
+    }
+
     acceptor.async_accept(
         [this](boost::system::error_code error_code, tcp::socket socket) {
             if (!error_code) {
-                std::make_shared<Session>(std::move(socket), idx)->start();
+                std::make_shared<Session>(std::move(socket), generations, scheduler)->start();
                 do_accept();
             } else {
+                scheduler.close_connection();
                 std::cerr << "ERROR: " << error_code << std::endl;
             }
         });
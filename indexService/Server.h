@@ -6,12 +6,14 @@
 #include <memory>
 #include <utility>
 
-#include "Index.h"
+#include "IndexGenerations.h"
+#include "RequestScheduler.h"
 #include "Session.h"
 
 class Server {
    public:
-    Server(boost::asio::io_context &io_context, short port, Index &idx);
+    /* with reuse_port several processes listen on the port and the kernel spreads the connections over them */
+    Server(boost::asio::io_context &io_context, short port, IndexGenerations &generations, bool reuse_port = false);
     void open_acceptor();
 
    private:
@@ -19,7 +21,10 @@ class Server {
 
     boost::asio::ip::tcp::endpoint endpoint;
     boost::asio::ip::tcp::acceptor acceptor;
-    Index &idx;
+    IndexGenerations &generations;
+    bool reuse_port;
+    /* shared by the sessions, see RequestScheduler */
+    RequestScheduler scheduler;
 };
 
 #endif
\ No newline at end of file
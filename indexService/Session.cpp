@@ -1,33 +1,273 @@
+#include <atomic>
 #include <functional>
+#include <optional>
 #include <unordered_map>
 #include <fstream>
 #include <regex>
+#include <string_view>
+#include <thread>
+#include <utility>
 
 #include "nlohmann/json.hpp"
 #include "Session.h"
 #include "Document.h"
+#include "JsonReader.h"
+#include "JsonWriter.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "QueryParser.h"
 
 using json = nlohmann::json;
 
-Session::Session(tcp::socket socket, Index &idx)
-    : m_stream(std::move(socket)), m_idx(idx) {
+namespace {
+
+/* the fields of /query and /query/batch, the strings are views into the body or into its reader */
+struct QueryRequest {
+    std::optional<std::string_view> query;
+    std::optional<std::vector<std::string_view>> queries;
+    QueryOptions options;
+    bool explain = false;
+    size_t snippets = 0;
+    std::chrono::milliseconds snippet_budget{50};
+};
+
+/* returns the error message of an invalid field, throws on malformed JSON and fields of the wrong type */
+std::string read_query_fields(JsonReader &reader, QueryRequest &request) {
+    auto &options = request.options;
+    std::string_view key;
+    reader.begin_object();
+    while (reader.next_key(key)) {
+        if (key == "query") {
+            if (reader.peek() != JsonReader::Type::String) {
+                return "Missing or invalid 'query' field in JSON body";
+            }
+            request.query = reader.read_string();
+        } else if (key == "queries") {
+            if (reader.peek() != JsonReader::Type::Array) {
+                return "Missing or invalid 'queries' field in JSON body";
+            }
+            request.queries.emplace();
+            reader.begin_array();
+            while (reader.next_element()) {
+                request.queries->push_back(reader.read_string());
+            }
+        } else if (key == "mode") {
+            std::string_view mode = reader.peek() == JsonReader::Type::String ? reader.read_string() : "";
+            if (mode == "impact") {
+                options.impact_ordered = true;
+            } else if (mode != "exhaustive") {
+                return "Invalid 'mode' field, expected 'exhaustive' or 'impact'";
+            }
+        } else if (key == "postings_budget") {
+            int64_t postings_budget = reader.read_integer();
+            if (postings_budget < 0) {
+                return "Invalid 'postings_budget' field, expected a number of postings, 0 for no limit";
+            }
+            options.postings_budget = postings_budget;
+        } else if (key == "time_budget_us") {
+            int64_t time_budget = reader.read_integer();
+            if (time_budget < 0) {
+                return "Invalid 'time_budget_us' field, expected a number of microseconds, 0 for no limit";
+            }
+            options.time_budget = std::chrono::microseconds(time_budget);
+        } else if (key == "top_k") {
+            options.top_k = reader.read_unsigned();
+        } else if (key == "proximity") {
+            options.proximity = reader.read_bool();
+        } else if (key == "fuzzy") {
+            /* true picks the largest edit distance, short terms are limited further */
+            int64_t fuzzy = reader.peek() == JsonReader::Type::Bool ? (reader.read_bool() ? 2 : 0) : reader.read_integer();
+            if (fuzzy < 0 || fuzzy > 2) {
+                return "Invalid 'fuzzy' field, expected an edit distance of 0, 1 or 2";
+            }
+            options.fuzzy = fuzzy;
+        } else if (key == "timeout_ms") {
+            options.timeout = std::chrono::milliseconds(reader.read_integer());
+        } else if (key == "collection_stats") {
+            /* sent by a coordinator, small compared to the queries */
+            options.collection_stats = std::make_shared<CollectionStats>(CollectionStats::from_json(json::parse(reader.read_raw())));
+        } else if (key == "snippets") {
+            request.snippets = reader.read_unsigned();
+        } else if (key == "snippet_budget_ms") {
+            request.snippet_budget = std::chrono::milliseconds(reader.read_integer());
+        } else if (key == "explain") {
+            request.explain = reader.read_bool();
+        } else {
+            reader.skip();
+        }
+    }
+    reader.finish();
+    return "";
+}
+
+/* the fields /query and /query/batch share, returns the error message of an invalid request */
+std::string read_query_request(JsonReader &reader, QueryRequest &request) {
+    Metrics::Timer parse_timer(Metrics::Stage::RequestParse);
+    try {
+        return read_query_fields(reader, request);
+    } catch (const JsonReader::TypeError &e) {
+        Logger::error() << "JSON type error: " << e.what();
+        return "Invalid type of a query option";
+    } catch (const JsonReader::ParseError &e) {
+        Logger::error() << "JSON parse error: " << e.what();
+        return "Malformed JSON in request body";
+    } catch (const json::exception &e) {
+        Logger::error() << "JSON error in collection_stats: " << e.what();
+        return "Invalid 'collection_stats' field";
+    }
+}
+
+/* a /query/batch request, the threads of the batch keep it for the views into the body */
+struct BatchRequest {
+    std::string body;
+    JsonReader reader;
+    QueryRequest request;
+
+    explicit BatchRequest(std::string request_body) : body(std::move(request_body)), reader(body) {}
+};
+
+/*
+*   The body of a /query response, written hit by hit so that a large page can be sent in chunks
+*   without holding all of its JSON.
+*/
+struct QueryResponseBody {
+    QueryResult query_result;
+    /* of the best hits */
+    std::vector<std::vector<std::string>> snippets;
+    /* serialized already, empty without explain */
+    std::string explain;
+
+    std::string buffer;
+    JsonWriter writer{buffer};
+    size_t next_hit = 0;
+    bool started = false;
+    bool complete = false;
+    std::chrono::steady_clock::duration serialize_time{};
+
+    /* appends up to hits results to the buffer, after the last one the rest of the body; true once it is complete */
+    bool write(size_t hits) {
+        if (complete) {
+            return true;
+        }
+        auto start = std::chrono::steady_clock::now();
+        if (!started) {
+            writer.begin_object().key("results").begin_array();
+            started = true;
+        }
+
+        const auto &results = query_result.results;
+        size_t end = std::min(results.size(), next_hit + hits);
+        for (; next_hit < end; ++next_hit) {
+            writer.begin_object().key("docid").value(results[next_hit].first).key("score").value(results[next_hit].second);
+            if (next_hit < snippets.size()) {
+                writer.key("snippets").begin_array();
+                for (const auto &snippet: snippets[next_hit]) {
+                    writer.value(snippet);
+                }
+                writer.end_array();
+            }
+            writer.end_object();
+        }
+
+        if (next_hit == results.size()) {
+            const auto &stats = query_result.stats;
+            writer.end_array();
+            /* how much work was done, relevant when the query timed out */
+            writer.key("partial").value(query_result.partial);
+            writer.key("stats").begin_object()
+                .key("terms_processed").value(stats.terms_processed)
+                .key("documents_scanned").value(stats.documents_scanned)
+                .key("postings_processed").value(stats.postings_processed)
+                .key("postings_skipped").value(stats.postings_skipped)
+                .key("terms_expanded").value(stats.terms_expanded)
+                .key("elapsed_ms").value(stats.elapsed_ms)
+                .end_object();
+            if (!explain.empty()) {
+                writer.key("explain").raw(explain);
+            }
+            writer.end_object();
+            complete = true;
+        }
+        serialize_time += std::chrono::steady_clock::now() - start;
+        return complete;
+    }
+};
+
+/* the class a request waits in, none for the cheap ones that show how the server is doing */
+std::optional<RequestScheduler::Priority> request_priority(std::string_view target) {
+    using Priority = RequestScheduler::Priority;
+    if (target == "/query" || target == "/shard/stats" || target.rfind("/document/", 0) == 0) {
+        return Priority::Interactive;
+    }
+    if (target == "/query/batch") {
+        return Priority::Batch;
+    }
+    if (target == "/index" || target.rfind("/admin/", 0) == 0) {
+        return Priority::Admin;
+    }
+    return std::nullopt;
+}
+
+/* one line of a /query/batch response */
+std::string batch_line(size_t index, const QueryResult &query_result, const std::string &error) {
+    std::string line;
+    JsonWriter writer(line);
+    writer.begin_object().key("index").value(index);
+    if (!error.empty()) {
+        writer.key("error").value(error);
+    } else {
+        const auto &stats = query_result.stats;
+        writer.key("results").begin_array();
+        for (const auto &[docid, score]: query_result.results) {
+            writer.begin_object().key("docid").value(docid).key("score").value(score).end_object();
+        }
+        writer.end_array();
+        writer.key("partial").value(query_result.partial);
+        writer.key("stats").begin_object()
+            .key("terms_processed").value(stats.terms_processed)
+            .key("documents_scanned").value(stats.documents_scanned)
+            .key("postings_processed").value(stats.postings_processed)
+            .key("elapsed_ms").value(stats.elapsed_ms)
+            .end_object();
+    }
+    writer.end_object();
+    line += '\n';
+    return line;
+}
+
+}
+
+Session::Session(tcp::socket socket, IndexGenerations &generations, RequestScheduler &scheduler)
+    : m_generations(generations), m_scheduler(scheduler), m_stream(std::move(socket)) {
 
     /* init the possible routes for this session */
     m_routes = {
         /* POST, returns query results ranked bm25 */
         {"/query", [this]() { return handle_index_query(); }},
-        /* POST, TODO: index a document */
+        /* POST, streams the results of many queries as NDJSON */
+        {"/query/batch", [this]() { return handle_query_batch(); }},
+        /* POST, indexes the files added to or changed in the directory */
         {"/index", [this]() { return handle_index(); }},
         /* GET, return json representation for a specific document, example /document/123 */
         {"/document", [this]() { return handle_document(); }},
         /* GET, return simple statistics from index as json */
-        {"/statistics", [this]() { return handle_statistics(); }}
+        {"/statistics", [this]() { return handle_statistics(); }},
+        /* POST, checks the next documents against the content storage */
+        {"/admin/verify", [this]() { return handle_verify(); }},
+        /* POST, loads a new generation of the index in the background and swaps it in */
+        {"/admin/reload", [this]() { return handle_reload(); }},
+        /* GET, counters and stage latencies in the Prometheus text format */
+        {"/metrics", [this]() { return handle_metrics(); }},
+        /* POST, document frequencies of the query terms for a coordinator, see Coordinator */
+        {"/shard/stats", [this]() { return handle_shard_stats(); }}
 
         /* POST, TODO: /filter filter a specific document and return filtered content */
     };
 }
 
-Session::~Session() {}
+Session::~Session() {
+    m_scheduler.close_connection();
+}
 
 void Session::start() {
     read_request();
@@ -46,13 +286,18 @@ void Session::print_http_request_info(const Request &req) {
 
 void Session::read_request() {
     auto self = shared_from_this();
+    m_request = {};
+    m_stream.expires_after(keep_alive_timeout);
+    m_io_start = std::chrono::steady_clock::now();
     http::async_read(m_stream, m_buffer, m_request,
         [self](beast::error_code ec, std::size_t bytes_transferred) {
             boost::ignore_unused(bytes_transferred);
             if (!ec) {
+                Metrics::instance().record(Metrics::Stage::HttpRead, std::chrono::steady_clock::now() - self->m_io_start);
                 self->handle_request();
-            } else {
-                std::cerr << "ERROR: reading http request: " << ec.message() << std::endl; 
+            } else if (ec != http::error::end_of_stream && ec != beast::error::timeout) {
+                /* a client closing its persistent connection or leaving it idle is no error */
+                Logger::error() << "ERROR: reading http request: " << ec.message();
             }
         }
     );
@@ -62,28 +307,96 @@ void Session::handle_request() {
     /* print info about the request */
     //print_http_request_info(m_request);
 
+    /* /metrics and /statistics answer right away, also under overload */
+    auto priority = request_priority(std::string_view(m_request.target().data(), m_request.target().size()));
+    if (!priority) {
+        run_request();
+        return;
+    }
+
+    auto self = shared_from_this();
+    m_scheduler.submit(*priority,
+        [self, priority]() {
+            self->m_slot = priority;
+            self->run_request();
+        },
+        [self](std::chrono::seconds retry_after) {
+            self->send_response(self->make_unavailable(retry_after));
+        }
+    );
+}
+
+void Session::run_request() {
+    m_idx = m_generations.current();
+
     /* get the response from a handle */
-    m_response = route_request(m_request.target());
+    Metrics::Timer request_timer(Metrics::Stage::Request);
+    Response response = route_request(m_request.target());
+    request_timer.stop();
+    if (m_deferred) {
+        m_deferred = false;
+        m_idx.reset();
+        return;
+    }
+    /* a handle which set m_next_chunk returns only the header, the body is streamed */
+    if (m_next_chunk) {
+        start_stream(std::move(response));
+    } else {
+        send_response(std::move(response));
+    }
+}
+
+void Session::send_response(Response response) {
+    m_idx.reset();
+    m_response = std::move(response);
 
-    /* send the response */
+    auto &metrics = Metrics::instance();
+    metrics.add(Metrics::Counter::Requests);
+    if (m_response.result_int() >= 400) {
+        metrics.add(Metrics::Counter::RequestErrors);
+    }
+
+    /* send the response, a persistent connection waits for the next request */
+    m_response.keep_alive(m_request.keep_alive());
+    m_response.prepare_payload();
     auto self = shared_from_this();
-    std::cout << "INFO writing response" << std::endl;
+    m_stream.expires_after(keep_alive_timeout);
+    m_io_start = std::chrono::steady_clock::now();
     http::async_write(m_stream, m_response, 
         [self](boost::beast::error_code ec, std::size_t) {
+            self->finish_request();
             if (ec) {
-                std::cerr << "ERROR: writing http response: " << ec.message() << std::endl; 
+                Logger::error() << "ERROR: writing http response: " << ec.message();
+            } else if (self->m_response.keep_alive()) {
+                Metrics::instance().record(Metrics::Stage::HttpWrite, std::chrono::steady_clock::now() - self->m_io_start);
+                self->read_request();
             } else {
-                std::cout << "INFO: writing request done, socket shutdown" << std::endl;
+                Metrics::instance().record(Metrics::Stage::HttpWrite, std::chrono::steady_clock::now() - self->m_io_start);
                 beast::error_code shutdown_ec;
                 self->m_stream.socket().shutdown(tcp::socket::shutdown_send, shutdown_ec);
                 if (shutdown_ec) {
-                    std::cerr << "ERROR: shutdown of socket failed: " << shutdown_ec.message() << std::endl;
+                    Logger::error() << "ERROR: shutdown of socket failed: " << shutdown_ec.message();
                 }
             }
         }
     );
 }
 
+void Session::post_response(Response response) {
+    auto self = shared_from_this();
+    asio::post(m_stream.get_executor(), [self, response = std::move(response)]() mutable {
+        self->send_response(std::move(response));
+    });
+}
+
+/* the next request of the class can start */
+void Session::finish_request() {
+    if (m_slot) {
+        m_scheduler.finish(*m_slot);
+        m_slot.reset();
+    }
+}
+
 Response Session::route_request(const std::string &target) {
     /* dynamic rest style route */
     if (target.rfind("/document/", 0) == 0) {
@@ -106,6 +419,15 @@ Response Session::not_found() {
     return res;
 }
 
+Response Session::make_unavailable(std::chrono::seconds retry_after) {
+    Response res{http::status::service_unavailable, 11};
+    res.set(http::field::server, "Cearch");
+    res.set(http::field::content_type, "application/json");
+    res.set(http::field::retry_after, std::to_string(retry_after.count()));
+    res.body() = json{{"error", "Too many requests waiting, retry later"}}.dump();
+    return res;
+}
+
 Response Session::make_bad_request(const std::string &message) {
     Response res{http::status::bad_request, 11};
     res.set(http::field::server, "Cearch");
@@ -118,13 +440,48 @@ Response Session::make_bad_request(const std::string &message) {
     return res;
 }
 
+/*
+*   Updates the index with the files added to, changed in or removed from the indexed directory:
+*        curl -X POST http://localhost:8080/index
+*   The update is a reload, the next generation indexes the changes while queries run on the current one.
+*   The response is sent once the new generation serves, a running reload is answered with 409.
+*/
 Response Session::handle_index() {
-    Response res{http::status::not_found, 11};
-    res.set(http::field::server, "Cearch");
-    res.set(http::field::content_type, "text/plain");
-    res.body() = "Not implemented yet";
-    res.prepare_payload();
-    return res;
+    if (m_request.method() != http::verb::post) {
+        return not_found();
+    }
+
+    auto self = shared_from_this();
+    auto start = std::chrono::steady_clock::now();
+    bool started = m_generations.reload([self, start](const std::string &error) {
+        Response res{http::status::ok, 11};
+        res.set(http::field::server, "Cearch");
+        res.set(http::field::content_type, "application/json");
+        if (!error.empty()) {
+            Logger::error() << "Exception updating the index: " << error;
+            res.result(http::status::internal_server_error);
+            res.body() = json{{"error", error}}.dump();
+        } else {
+            auto idx = self->m_generations.current();
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            Logger::info() << "Updated the index, " << idx->get_changed_documents() << " documents changed in " << elapsed.count() << " ms";
+            res.body() = json{
+                {"changed_documents", idx->get_changed_documents()},
+                {"documents", idx->get_document_counter()},
+                {"elapsed_ms", elapsed.count()}
+            }.dump();
+        }
+        self->send_response(std::move(res));
+    });
+    if (!started) {
+        Response res{http::status::conflict, 11};
+        res.set(http::field::server, "Cearch");
+        res.set(http::field::content_type, "application/json");
+        res.body() = json{{"error", "The index is being reloaded"}}.dump();
+        return res;
+    }
+    m_deferred = true;
+    return Response{};
 }
 
 /* 
@@ -132,52 +489,309 @@ Response Session::handle_index() {
 *        curl -X POST http://localhost:8080/search \
 *        -H "Content-Type: application/json" \
 *        -d '{"query": "example search term"}'
-*      
-*   TODO: Stream the response on bigger queries? 
+*
+*   the query supports AND, OR, NOT, +required, -excluded terms, "phrases" and (grouping), see QueryParser.h
+*
+*   optional fields:
+*        "mode": "impact"         score-at-a-time search over impact ordered postings
+*        "postings_budget": 10000 impact mode, stop after this many postings
+*        "time_budget_us": 500    impact mode, stop after this many microseconds
+*        "top_k": 10              return only the best k results
+*        "explain": true          add the parsed query to the response
+*        "snippets": 3            up to 3 snippets with highlighted terms per hit, for the best "top_k" hits (default 10)
+*        "snippet_budget_ms": 50  time budget for the snippets, hits that did not make it get no snippets
+*        "proximity": true        boost documents with the query terms close together, needs --positions
+*        "timeout_ms": 50         return the results found so far after this many milliseconds,
+*                                 the response is then marked with "partial": true
+*
+*   A response with more than stream_chunk_hits results is sent in chunks of that many hits.
 */
 Response Session::handle_index_query() {
     Response res{http::status::ok, 11};
     res.set(http::field::server, "Cearch");
     res.set(http::field::content_type, "application/json");
 
-    std::string query = "";
-    std::vector<std::string> clean_query;
+    QueryRequest request;
+    JsonReader reader(m_request.body());
+    std::string error = read_query_request(reader, request);
+    if (!error.empty()) {
+        return make_bad_request(error);
+    }
+    if (!request.query) {
+        Logger::info() << "Invalid or missing query field";
+        return make_bad_request("Missing or invalid 'query' field in JSON body");
+    }
+    Logger::info() << "Searching for: " << *request.query;
+    m_generations.remember_query(*request.query);
 
+    /* parse the query language and search the index */
+    auto body = std::make_shared<QueryResponseBody>();
+    std::unique_ptr<QueryNode> parsed_query;
+    const QueryOptions &options = request.options;
     try {
-        /* try parsing the json */
-        json j = json::parse(m_request.body());
+        Metrics::Timer parse_timer(Metrics::Stage::QueryParse);
+        parsed_query = QueryParser::parse(*request.query, m_idx->get_analyzer());
+        parse_timer.stop();
+        body->query_result = m_idx->query_index(*parsed_query, options);
+    } catch (const std::invalid_argument &e) {
+        return make_bad_request(e.what());
+    } catch (const std::exception &e) {
+        /* e.g. the positions of a phrase query could not be loaded */
+        Logger::error() << "Exception querying the index: " << e.what();
+        res.result(http::status::internal_server_error);
+        res.body() = json{{"error", e.what()}}.dump();
+        return res;
+    }
 
-        /* try accessing the query field */
-        if (j.contains("query") && j["query"].is_string()) {
-            query = j["query"];
-            std::cout << "Searching for: " << query << std::endl;
-        } else {
-            std::cout << "Invalid or missing query field" << std::endl;
-            return make_bad_request("Missing or invalid 'query' field in JSON body");
+    /* snippets only for the best hits, their content has to be decompressed */
+    const auto &results = body->query_result.results;
+    if (request.snippets > 0 && !results.empty()) {
+        size_t hits = std::min(results.size(), options.top_k > 0 ? options.top_k : default_snippet_hits);
+        std::vector<uint64_t> docids;
+        for (size_t i = 0; i < hits; ++i) {
+            docids.push_back(results[i].first);
         }
-    } catch (const json::parse_error &e) {
-        std::cerr << "JSON parse error: " << e.what() << std::endl;
-        return make_bad_request("Malformed JSON in request body");
+        body->snippets = m_idx->get_snippets(docids, *parsed_query, options.fuzzy, request.snippets, request.snippet_budget);
     }
 
-    /* get search terms */
-    clean_query = Document::clean_word(query);
+    if (request.explain) {
+        body->explain = json{
+            {"query", parsed_query->to_string()},
+            {"ast", parsed_query->to_json()},
+            /* without positions phrases are matched as conjunction of their terms */
+            {"phrases", m_idx->get_positional_index().is_available() ? "exact" : "conjunction"}
+        }.dump();
+    }
 
-    /* search the index */
-    std::vector<std::pair<uint64_t, double>> query_result = m_idx.query_index(clean_query);
+    if (results.size() <= stream_chunk_hits) {
+        body->write(stream_chunk_hits);
+        res.body() = std::move(body->buffer);
+        Metrics::instance().record(Metrics::Stage::Serialize, body->serialize_time);
+        return res;
+    }
 
-    json response;
-    for(const auto &[docid, score]: query_result) {
-        response["results"].push_back({
-            {"docid", docid},
-            {"score", score}
-        });
+    /* the next hits are written when the previous chunk is sent */
+    m_next_chunk = [body](std::string &chunk) {
+        bool was_complete = body->complete;
+        bool complete = body->write(stream_chunk_hits);
+        std::swap(chunk, body->buffer);
+        if (complete && !was_complete) {
+            Metrics::instance().record(Metrics::Stage::Serialize, body->serialize_time);
+        }
+        return complete;
+    };
+    return res;
+}
+
+/*
+*   Evaluates many queries with the same options, answered with one line of JSON per query (NDJSON):
+*        curl -X POST http://localhost:8080/query/batch \
+*        -d '{"queries": ["whale", "moby AND dick"], "top_k": 10}'
+*   The options are the ones of /query without snippets and explain, top_k defaults to 10.
+*   The lines are streamed in chunks as the queries are done, in no particular order:
+*        {"index": 1, "results": [{"docid": 3, "score": 1.2}], "partial": false, "stats": {...}}
+*        {"index": 0, "error": "..."}
+*   The last line sums up the batch, a stream without it was cut off:
+*        {"summary": {"queries": 2, "errors": 1, "elapsed_ms": 1.5}}
+*/
+Response Session::handle_query_batch() {
+    if (m_request.method() != http::verb::post) {
+        return not_found();
+    }
+
+    /* the queries stay views into the body, the threads of the batch keep it */
+    auto batch_request = std::make_shared<BatchRequest>(std::move(m_request.body()));
+    QueryRequest &request = batch_request->request;
+    request.options.top_k = default_batch_top_k;
+    std::string error = read_query_request(batch_request->reader, request);
+    if (!error.empty()) {
+        return make_bad_request(error);
+    }
+    if (!request.queries) {
+        return make_bad_request("Missing or invalid 'queries' field in JSON body");
     }
+    Logger::info() << "Searching a batch of " << request.queries->size() << " queries";
+
+    m_batch = std::make_shared<BatchStream>();
+    m_next_chunk = [batch = m_batch](std::string &chunk) {
+        bool done;
+        {
+            std::lock_guard<std::mutex> lock(batch->mutex);
+            std::swap(chunk, batch->pending);
+            done = batch->done;
+        }
+        batch->drained.notify_all();
+        return done;
+    };
+
+    /* the batch keeps its generation of the index, the threads of the io_context only write */
+    auto self = shared_from_this();
+    std::thread([self, idx = m_idx, batch = m_batch, batch_request]() {
+        auto start = std::chrono::steady_clock::now();
+        auto append = [&self, &batch](const std::string &line, bool last) {
+            std::unique_lock<std::mutex> lock(batch->mutex);
+            batch->drained.wait(lock, [&batch]() {
+                return batch->closed || batch->pending.size() < max_batch_pending_bytes;
+            });
+            if (batch->closed) {
+                return;
+            }
+            bool was_empty = batch->pending.empty();
+            batch->pending += line;
+            batch->done = last;
+            if (was_empty || last) {
+                asio::post(self->m_stream.get_executor(), [self]() { self->write_chunk(); });
+            }
+        };
+
+        const auto &queries = *batch_request->request.queries;
+        std::atomic<size_t> errors{0};
+        std::string last_line;
+        try {
+            idx->query_batch(queries, batch_request->request.options,
+                [&](size_t index, const QueryResult &query_result, const std::string &error) {
+                    if (!error.empty()) {
+                        errors++;
+                    }
+                    append(batch_line(index, query_result, error), false);
+                },
+                &batch->closed
+            );
+
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            JsonWriter(last_line).begin_object().key("summary").begin_object()
+                .key("queries").value(queries.size())
+                .key("errors").value(errors.load())
+                .key("elapsed_ms").value(elapsed.count())
+                .end_object().end_object();
+        } catch (const std::exception &e) {
+            Logger::error() << "Exception in a batch of queries: " << e.what();
+            last_line.clear();
+            JsonWriter(last_line).begin_object().key("error").value(e.what()).end_object();
+        }
+        append(last_line + "\n", true);
+
+        /* the workers are joined, the slot of a batch whose client is gone is free now */
+        asio::post(self->m_stream.get_executor(), [self, batch]() {
+            batch->joined = true;
+            if (batch->slot) {
+                self->m_scheduler.finish(*batch->slot);
+            }
+        });
+    }).detach();
 
-    res.body() = response.dump();
+    Response res{http::status::ok, 11};
+    res.set(http::field::server, "Cearch");
+    res.set(http::field::content_type, "application/x-ndjson");
     return res;
 }
 
+/* sends the header of the response, then the chunks of m_next_chunk; the next request is read after the last one */
+void Session::start_stream(Response response) {
+    m_idx.reset();
+    m_stream_header = {};
+    m_stream_header.base() = response.base();
+    m_stream_header.keep_alive(m_request.keep_alive());
+    m_stream_header.chunked(true);
+    m_stream_serializer = std::make_unique<http::response_serializer<http::empty_body>>(m_stream_header);
+
+    /* the header and the chunks are separate writes, Nagle would hold each back until the previous one is acked */
+    beast::error_code no_delay_ec;
+    m_stream.socket().set_option(tcp::no_delay(true), no_delay_ec);
+
+    auto self = shared_from_this();
+    m_chunk_writing = true;
+    m_stream.expires_after(keep_alive_timeout);
+    http::async_write_header(m_stream, *m_stream_serializer,
+        [self](beast::error_code ec, std::size_t) {
+            self->m_chunk_writing = false;
+            if (ec) {
+                Logger::error() << "ERROR: writing http response: " << ec.message();
+                self->close_stream();
+                return;
+            }
+            self->write_chunk();
+        }
+    );
+}
+
+/* on the io_context, writes the next chunk; if none is ready, the one who fills it calls write_chunk again */
+void Session::write_chunk() {
+    if (m_chunk_writing || !m_next_chunk) {
+        return;
+    }
+
+    m_chunk.clear();
+    bool complete = m_next_chunk(m_chunk);
+
+    auto self = shared_from_this();
+    m_stream.expires_after(keep_alive_timeout);
+    if (!m_chunk.empty()) {
+        m_chunk_writing = true;
+        asio::async_write(m_stream, http::make_chunk(asio::buffer(m_chunk)),
+            [self](beast::error_code ec, std::size_t) {
+                self->m_chunk_writing = false;
+                if (ec) {
+                    Logger::error() << "ERROR: writing http response: " << ec.message();
+                    self->close_stream();
+                    return;
+                }
+                self->write_chunk();
+            }
+        );
+    } else if (complete) {
+        m_chunk_writing = true;
+        asio::async_write(m_stream, http::make_chunk_last(),
+            [self](beast::error_code ec, std::size_t) {
+                self->m_chunk_writing = false;
+                self->finish_stream(ec);
+            }
+        );
+    }
+}
+
+/* the client is gone, a batch stops and keeps the slot until its workers are joined */
+void Session::close_stream() {
+    m_next_chunk = nullptr;
+    if (m_batch) {
+        {
+            std::lock_guard<std::mutex> lock(m_batch->mutex);
+            m_batch->closed = true;
+        }
+        m_batch->drained.notify_all();
+        if (!m_batch->joined) {
+            m_batch->slot = std::exchange(m_slot, std::nullopt);
+        }
+        m_batch.reset();
+    }
+    finish_request();
+    Metrics::instance().add(Metrics::Counter::Requests);
+    Metrics::instance().add(Metrics::Counter::RequestErrors);
+}
+
+void Session::finish_stream(beast::error_code ec) {
+    if (ec) {
+        Logger::error() << "ERROR: writing http response: " << ec.message();
+        close_stream();
+        return;
+    }
+    finish_request();
+    m_next_chunk = nullptr;
+    m_batch.reset();
+    m_stream_serializer.reset();
+    Metrics::instance().add(Metrics::Counter::Requests);
+
+    if (m_stream_header.keep_alive()) {
+        read_request();
+    } else {
+        beast::error_code shutdown_ec;
+        m_stream.socket().shutdown(tcp::socket::shutdown_send, shutdown_ec);
+        if (shutdown_ec) {
+            Logger::error() << "ERROR: shutdown of socket failed: " << shutdown_ec.message();
+        }
+    }
+}
+
 Response Session::handle_document() {
     std::string target = std::string(m_request.target());
 
@@ -188,7 +802,7 @@ Response Session::handle_document() {
         if (std::regex_match(target, match, re)) {
             try {
                 uint64_t docid = std::stoull(match[1]);
-                auto &doc = m_idx.get_document_by_id(docid);
+                auto &doc = m_idx->get_document_by_id(docid);
 
                 /* return the json representation of the doc if found */
                 Response res{http::status::ok, 11};
@@ -197,7 +811,7 @@ Response Session::handle_document() {
                 res.body() = doc.to_json().dump();
                 return res;
             } catch (std::exception &e) {
-                std::cerr << "Exception in hanling documents: " << e.what() << std::endl;
+                Logger::error() << "Exception in hanling documents: " << e.what();
                 return not_found();
             }
         }
@@ -216,10 +830,156 @@ Response Session::handle_statistics() {
     res.set(http::field::content_type, "application/json");
 
     json j;
-    j["Document_count"] = m_idx.get_document_counter();
-    j["Total_term_count"] = m_idx.get_total_term_count();
-    j["Average_document_length"] = m_idx.get_avg_doc_length();
+    j["Document_count"] = m_idx->get_document_counter();
+    j["Total_term_count"] = m_idx->get_total_term_count();
+    j["Average_document_length"] = m_idx->get_avg_doc_length();
+    j["Index_generation"] = m_generations.get_status();
+
+    /* size overhead of the optional positional index compared to index.json */
+    const auto &positions = m_idx->get_positional_index();
+    uint64_t index_bytes = m_idx->get_index_size_bytes();
+    uint64_t positions_bytes = positions.get_size_bytes();
+    j["Index_size_bytes"] = index_bytes;
+    j["Positional_index"] = {
+        {"available", positions.is_available()},
+        {"loaded", positions.is_loaded()},
+        {"size_bytes", positions_bytes},
+        {"overhead", index_bytes > 0 ? (double)positions_bytes / index_bytes : 0.0}
+    };
+
+    const auto &dictionary = m_idx->get_term_dictionary();
+    j["Term_dictionary"] = {
+        {"terms", dictionary.size()},
+        {"size_bytes", dictionary.get_size_bytes()}
+    };
     res.body() = j.dump();
 
+    return res;
+}
+
+/*
+*   Loads a new generation of the index in the background, warms it up and swaps it in:
+*        curl -X POST http://localhost:8080/admin/reload
+*   answers 202 with the status, the generation in /statistics is increased once the new one serves.
+*   Queries keep running on the current generation meanwhile. A second reload is refused with 409.
+*/
+Response Session::handle_reload() {
+    if (m_request.method() != http::verb::post) {
+        return not_found();
+    }
+
+    Response res{http::status::accepted, 11};
+    res.set(http::field::server, "Cearch");
+    res.set(http::field::content_type, "application/json");
+    if (!m_generations.reload()) {
+        res.result(http::status::conflict);
+    }
+    res.body() = m_generations.get_status().dump();
+    return res;
+}
+
+/*
+*   One step of the consistency check, the next request continues after the last checked document.
+*   The body is optional:
+*        "limit": 1000        documents checked in this step, 0 checks all the remaining
+*        "concurrency": 1     blobs read at the same time
+*        "repair": true       quarantine bad blobs and orphans, restore the content from the files
+*   Orphan blobs are reported by the step which reaches the last document, it is marked "complete".
+*   The step runs on its own thread, the io_context keeps serving meanwhile.
+*/
+Response Session::handle_verify() {
+    if (m_request.method() != http::verb::post) {
+        return not_found();
+    }
+
+    VerifyOptions options;
+    options.limit = default_verify_limit;
+    try {
+        if (!m_request.body().empty()) {
+            json j = json::parse(m_request.body());
+            if (j.contains("limit")) {
+                options.limit = j["limit"].get<size_t>();
+            }
+            if (j.contains("concurrency")) {
+                options.concurrency = std::max<size_t>(1, j["concurrency"].get<size_t>());
+            }
+            if (j.contains("repair")) {
+                options.repair = j["repair"].get<bool>();
+            }
+        }
+    } catch (const json::type_error &e) {
+        return make_bad_request("Invalid type of a verify option");
+    } catch (const json::parse_error &e) {
+        return make_bad_request("Malformed JSON in request body");
+    }
+
+    m_deferred = true;
+    auto self = shared_from_this();
+    std::thread([self, idx = m_idx, options]() {
+        Response res{http::status::ok, 11};
+        res.set(http::field::server, "Cearch");
+        res.set(http::field::content_type, "application/json");
+        try {
+            res.body() = idx->verify_content(options).to_json().dump();
+        } catch (std::exception &e) {
+            Logger::error() << "Exception verifying the content storage: " << e.what();
+            res.result(http::status::internal_server_error);
+            res.body() = json{{"error", e.what()}}.dump();
+        }
+        self->post_response(std::move(res));
+    }).detach();
+    return Response{};
+}
+
+/*
+*   The statistics a coordinator needs to score the query like a single index would:
+*        curl -X POST http://localhost:8080/shard/stats -d '{"query": "whale AND moby"}'
+*   answers {"documents": n, "total_term_count": n, "doc_freqs": {"whale": n, "moby": n}}
+*/
+Response Session::handle_shard_stats() {
+    if (m_request.method() != http::verb::post) {
+        return not_found();
+    }
+
+    std::unique_ptr<QueryNode> parsed_query;
+    try {
+        json j = json::parse(m_request.body());
+        if (!j.contains("query") || !j["query"].is_string()) {
+            return make_bad_request("Missing or invalid 'query' field in JSON body");
+        }
+        parsed_query = QueryParser::parse(j["query"].get<std::string>(), m_idx->get_analyzer());
+    } catch (const json::parse_error &e) {
+        return make_bad_request("Malformed JSON in request body");
+    } catch (const std::invalid_argument &e) {
+        return make_bad_request(e.what());
+    }
+
+    Response res{http::status::ok, 11};
+    res.set(http::field::server, "Cearch");
+    res.set(http::field::content_type, "application/json");
+    res.body() = m_idx->get_collection_stats(*parsed_query).to_json().dump();
+    return res;
+}
+
+Response Session::handle_metrics() {
+    Response res{http::status::ok, 11};
+    res.set(http::field::server, "Cearch");
+    res.set(http::field::content_type, "text/plain; version=0.0.4");
+
+    std::string body = Metrics::instance().to_prometheus();
+    body += "# HELP cearch_documents Documents in the index\n";
+    body += "# TYPE cearch_documents gauge\n";
+    body += "cearch_documents " + std::to_string(m_idx->get_document_counter()) + "\n";
+    body += "# HELP cearch_terms Terms in the term dictionary\n";
+    body += "# TYPE cearch_terms gauge\n";
+    body += "cearch_terms " + std::to_string(m_idx->get_term_dictionary().size()) + "\n";
+    body += "# HELP cearch_index_size_bytes Size of index.json\n";
+    body += "# TYPE cearch_index_size_bytes gauge\n";
+    body += "cearch_index_size_bytes " + std::to_string(m_idx->get_index_size_bytes()) + "\n";
+    body += "# HELP cearch_index_generation Generation of the index served, increased by every reload\n";
+    body += "# TYPE cearch_index_generation gauge\n";
+    body += "cearch_index_generation " + std::to_string(m_generations.get_generation()) + "\n";
+    body += m_scheduler.to_prometheus();
+    res.body() = std::move(body);
     return res;
 }
\ No newline at end of file
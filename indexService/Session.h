@@ -1,6 +1,13 @@
 #ifndef _H_SESSION
 #define _H_SESSION
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 
 /* Boost HTTP Stuff*/
@@ -10,6 +17,8 @@
 #include <boost/beast/version.hpp>
 
 #include "Index.h"
+#include "IndexGenerations.h"
+#include "RequestScheduler.h"
 #include "Server.h"
 
 namespace beast = boost::beast;  // from <boost/beast.hpp>
@@ -23,13 +32,19 @@ using Response = http::response<http::string_body>;
 
 class Session : public std::enable_shared_from_this<Session> {
     public:
-        explicit Session(tcp::socket socket, Index &idx);
+        Session(tcp::socket socket, IndexGenerations &generations, RequestScheduler &scheduler);
         ~Session();
         void start();
 
     private:
         /* when searching we need to access the index */
-        Index &m_idx;
+        IndexGenerations &m_generations;
+        /* the generation the current request started with, a reload does not change it under the request */
+        std::shared_ptr<Index> m_idx;
+
+        RequestScheduler &m_scheduler;
+        /* the class whose slot the current request holds until its response is written */
+        std::optional<RequestScheduler::Priority> m_slot;
 
         beast::tcp_stream m_stream;
 
@@ -41,18 +56,75 @@ class Session : public std::enable_shared_from_this<Session> {
         Request m_request;
         Response m_response;
 
+        /* start of the current read or write, for the metrics */
+        std::chrono::steady_clock::time_point m_io_start;
+
+        /* a response whose body is sent in chunks, see start_stream */
+        http::response<http::empty_body> m_stream_header;
+        std::unique_ptr<http::response_serializer<http::empty_body>> m_stream_serializer;
+        /* fills the next chunk, true once the body is complete; an empty chunk of an incomplete body is not ready yet */
+        std::function<bool(std::string &)> m_next_chunk;
+        std::string m_chunk;
+        bool m_chunk_writing = false;
+
+        /* a handle which set this answers later, it posts send_response to the io_context when it is done */
+        bool m_deferred = false;
+
+        /* the lines of a running /query/batch, appended by its threads and written by the io_context */
+        struct BatchStream {
+            std::mutex mutex;
+            std::condition_variable drained;
+            std::string pending;
+            /* the last line is pending */
+            bool done = false;
+            /* the client is gone, further lines are dropped and no further query is started */
+            std::atomic<bool> closed{false};
+            /* on the io_context: the workers are done, or the slot they release when they are */
+            bool joined = false;
+            std::optional<RequestScheduler::Priority> slot;
+        };
+        std::shared_ptr<BatchStream> m_batch;
+
+        /* number of hits which get snippets if the query has no top_k */
+        static constexpr size_t default_snippet_hits = 10;
+        /* a step of the consistency check holds the admin slot, its steps are kept short */
+        static constexpr size_t default_verify_limit = 1000;
+        /* a persistent connection is closed after this long without a request */
+        static constexpr std::chrono::seconds keep_alive_timeout{30};
+        /* results per query of a batch without top_k */
+        static constexpr size_t default_batch_top_k = 10;
+        /* the threads of a batch wait while this much of the response is not written */
+        static constexpr size_t max_batch_pending_bytes = 1024 * 1024;
+        /* a /query response with more hits is sent in chunks of this many hits */
+        static constexpr size_t stream_chunk_hits = 1000;
+
         void print_http_request_info(const Request &req);
 
         /* Request handles */
         void read_request();
         void handle_request();
+        void run_request();
+        void finish_request();
+        void send_response(Response response);
+        /* from any thread, the response is sent on the io_context */
+        void post_response(Response response);
         Response route_request(const std::string &target);
         Response handle_index_query();
         Response handle_index();
         Response handle_document();
         Response handle_statistics();
+        Response handle_verify();
+        Response handle_metrics();
+        Response handle_shard_stats();
+        Response handle_reload();
+        Response handle_query_batch();
+        void start_stream(Response response);
+        void write_chunk();
+        void close_stream();
+        void finish_stream(beast::error_code ec);
         Response not_found();
         Response make_bad_request(const std::string &message);
+        Response make_unavailable(std::chrono::seconds retry_after);
 };
 
 #endif
\ No newline at end of file
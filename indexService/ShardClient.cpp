@@ -0,0 +1,128 @@
+#include <stdexcept>
+
+#include "ShardClient.h"
+
+namespace asio = boost::asio;
+namespace beast = boost::beast;
+namespace http = beast::http;
+using tcp = asio::ip::tcp;
+
+struct ShardClient::Connection {
+    explicit Connection(asio::io_context &io) : stream(io) {}
+
+    beast::tcp_stream stream;
+    beast::flat_buffer buffer;
+    http::request<http::string_body> request;
+    http::response<http::string_body> response;
+    bool connected = false;
+};
+
+ShardClient::ShardClient(asio::io_context &io, const std::vector<std::string> &replicas)
+    : m_io(io)
+{
+    if (replicas.empty()) {
+        throw std::invalid_argument("A shard needs at least one replica");
+    }
+
+    tcp::resolver resolver(io);
+    for (const auto &address: replicas) {
+        size_t colon = address.rfind(':');
+        if (colon == std::string::npos || colon == 0 || colon + 1 == address.size()) {
+            throw std::invalid_argument("Expected host:port for a shard, got: " + address);
+        }
+        Replica replica;
+        replica.address = address;
+        replica.host = address.substr(0, colon);
+        replica.endpoints = resolver.resolve(replica.host, address.substr(colon + 1));
+        m_replicas.push_back(std::move(replica));
+    }
+}
+
+size_t ShardClient::get_replica_count() const { return m_replicas.size(); }
+const std::string &ShardClient::get_address(size_t replica) const { return m_replicas.at(replica).address; }
+
+void ShardClient::post(size_t replica, const std::string &target, std::string body,
+    std::chrono::steady_clock::time_point deadline, Callback callback)
+{
+    auto &idle = m_replicas.at(replica).idle;
+    std::shared_ptr<Connection> connection;
+    bool reused = !idle.empty();
+    if (reused) {
+        connection = std::move(idle.back());
+        idle.pop_back();
+    } else {
+        connection = std::make_shared<Connection>(m_io);
+    }
+
+    connection->request = {http::verb::post, target, 11};
+    connection->request.set(http::field::host, m_replicas[replica].host);
+    connection->request.set(http::field::content_type, "application/json");
+    connection->request.keep_alive(true);
+    connection->request.body() = std::move(body);
+    connection->request.prepare_payload();
+    send(replica, std::move(connection), reused, deadline, std::move(callback));
+}
+
+void ShardClient::send(size_t replica, std::shared_ptr<Connection> connection, bool reused,
+    std::chrono::steady_clock::time_point deadline, Callback callback)
+{
+    auto timeout = deadline - std::chrono::steady_clock::now();
+    if (timeout <= std::chrono::steady_clock::duration::zero()) {
+        asio::post(m_io, [callback = std::move(callback)]() { callback({0, "", "timed out"}); });
+        return;
+    }
+    connection->stream.expires_after(timeout);
+
+    auto write = [this, replica, connection, reused, deadline, callback]() {
+        http::async_write(connection->stream, connection->request,
+            [this, replica, connection, reused, deadline, callback](beast::error_code ec, std::size_t) {
+                if (ec) {
+                    fail(replica, connection, reused, ec, deadline, callback);
+                    return;
+                }
+                connection->response = {};
+                http::async_read(connection->stream, connection->buffer, connection->response,
+                    [this, replica, connection, reused, deadline, callback](beast::error_code ec, std::size_t) {
+                        if (ec) {
+                            fail(replica, connection, reused, ec, deadline, callback);
+                            return;
+                        }
+
+                        ShardReply reply{static_cast<int>(connection->response.result_int()), std::move(connection->response.body()), ""};
+                        auto &idle = m_replicas[replica].idle;
+                        if (connection->response.keep_alive() && idle.size() < max_idle_connections) {
+                            connection->stream.expires_never();
+                            idle.push_back(connection);
+                        }
+                        callback(std::move(reply));
+                    });
+            });
+    };
+
+    if (connection->connected) {
+        write();
+        return;
+    }
+    connection->stream.async_connect(m_replicas[replica].endpoints,
+        [this, replica, connection, reused, deadline, callback, write](beast::error_code ec, const tcp::endpoint &) {
+            if (ec) {
+                fail(replica, connection, reused, ec, deadline, callback);
+                return;
+            }
+            connection->connected = true;
+            connection->stream.socket().set_option(tcp::no_delay(true), ec);
+            write();
+        });
+}
+
+void ShardClient::fail(size_t replica, std::shared_ptr<Connection> connection, bool reused, const beast::error_code &ec,
+    std::chrono::steady_clock::time_point deadline, Callback callback)
+{
+    if (reused && ec != beast::error::timeout) {
+        auto fresh = std::make_shared<Connection>(m_io);
+        fresh->request = std::move(connection->request);
+        send(replica, std::move(fresh), false, deadline, std::move(callback));
+        return;
+    }
+    callback({0, "", ec == beast::error::timeout ? "timed out" : ec.message()});
+}
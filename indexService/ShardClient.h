@@ -0,0 +1,64 @@
+#ifndef _H_SHARDCLIENT
+#define _H_SHARDCLIENT
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+
+/* the answer of a shard, status 0 if there was none */
+struct ShardReply {
+    int status = 0;
+    std::string body;
+    std::string error;
+};
+
+/*
+*   HTTP client of one shard of the index for the Coordinator. A shard is served by one or more replicas,
+*   cearch processes with the same index. Every replica has a pool of persistent connections, a connection
+*   goes back to the pool when its response is read.
+*   Requests and callbacks run on the thread of the io_context.
+*/
+class ShardClient {
+    public:
+        using Callback = std::function<void(ShardReply)>;
+
+        /* replicas as host:port, resolved once */
+        ShardClient(boost::asio::io_context &io, const std::vector<std::string> &replicas);
+
+        /* POSTs the body to the replica, fails with a timeout at the deadline */
+        void post(size_t replica, const std::string &target, std::string body,
+            std::chrono::steady_clock::time_point deadline, Callback callback);
+
+        size_t get_replica_count() const;
+        const std::string &get_address(size_t replica) const;
+
+        /* idle connections kept per replica */
+        static constexpr size_t max_idle_connections = 16;
+
+    private:
+        struct Connection;
+
+        struct Replica {
+            std::string address;
+            std::string host;
+            boost::asio::ip::tcp::resolver::results_type endpoints;
+            std::vector<std::shared_ptr<Connection>> idle;
+        };
+
+        boost::asio::io_context &m_io;
+        std::vector<Replica> m_replicas;
+
+        /* a reused connection may have been closed by the server meanwhile, then the request is sent once more */
+        void send(size_t replica, std::shared_ptr<Connection> connection, bool reused,
+            std::chrono::steady_clock::time_point deadline, Callback callback);
+        void fail(size_t replica, std::shared_ptr<Connection> connection, bool reused, const boost::beast::error_code &ec,
+            std::chrono::steady_clock::time_point deadline, Callback callback);
+};
+
+#endif
@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <future>
+#include <thread>
+
+#include "Logger.h"
+#include "SnippetGenerator.h"
+
+SnippetGenerator::SnippetGenerator(std::shared_ptr<ContentAddressedStorage> content_store, size_t cache_bytes)
+    : m_content_store(std::move(content_store)), m_cache_capacity(cache_bytes)
+{
+}
+
+std::vector<std::vector<std::string>> SnippetGenerator::generate(const std::vector<std::string> &content_hashes,
+    const std::vector<std::string> &terms, const Analyzer &analyzer, size_t snippets_per_hit, std::chrono::steady_clock::time_point deadline)
+{
+    std::unordered_set<std::string> term_set(terms.begin(), terms.end());
+    std::vector<std::vector<std::string>> result(content_hashes.size());
+
+    /* the hits are taken one by one by at most one thread per core, however many hits were asked for */
+    std::atomic<size_t> next{0};
+    auto generate_hits = [&]() {
+        for (size_t i = next++; i < content_hashes.size(); i = next++) {
+            const auto &hash = content_hashes[i];
+            try {
+                if (std::chrono::steady_clock::now() >= deadline) {
+                    continue;
+                }
+                auto content = load_content(hash);
+
+                if (std::chrono::steady_clock::now() >= deadline) {
+                    continue;
+                }
+                result[i] = make_snippets(*content, term_set, analyzer, snippets_per_hit);
+            } catch (std::exception &e) {
+                Logger::error() << "Failed to generate snippets for " << hash << ": " << e.what();
+            }
+        }
+    };
+
+    size_t threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), content_hashes.size());
+    std::vector<std::future<void>> workers;
+    for (size_t i = 1; i < threads; ++i) {
+        workers.push_back(std::async(std::launch::async, generate_hits));
+    }
+    generate_hits();
+    /* the workers skip the remaining hits once the deadline passed, at most one decompression per worker is waited for */
+    for (auto &worker: workers) {
+        worker.get();
+    }
+    return result;
+}
+
+std::shared_ptr<const std::string> SnippetGenerator::load_content(const std::string &content_hash) {
+    {
+        std::lock_guard<std::mutex> lock(m_cache_mutex);
+        auto it = m_cache_index.find(content_hash);
+        if (it != m_cache_index.end()) {
+            m_cache.splice(m_cache.begin(), m_cache, it->second);
+            return it->second->second;
+        }
+    }
+
+    /* decompress outside of the lock, other hits can be loaded in parallel */
+    auto content = std::make_shared<const std::string>(m_content_store->load(content_hash));
+
+    std::lock_guard<std::mutex> lock(m_cache_mutex);
+    if (content->size() > m_cache_capacity || m_cache_index.count(content_hash)) {
+        return content;
+    }
+
+    m_cache.emplace_front(content_hash, content);
+    m_cache_index[content_hash] = m_cache.begin();
+    m_cache_size += content->size();
+
+    while (m_cache_size > m_cache_capacity) {
+        auto &[hash, evicted] = m_cache.back();
+        m_cache_size -= evicted->size();
+        m_cache_index.erase(hash);
+        m_cache.pop_back();
+    }
+
+    return content;
+}
+
+namespace {
+
+struct Token {
+    size_t begin;
+    size_t end;
+    /* index of the matched query term, -1 if no match */
+    int term;
+};
+
+void append_escaped(std::string &out, const std::string &content, size_t begin, size_t end) {
+    bool in_space = false;
+    for (size_t i = begin; i < end; ++i) {
+        char c = content[i];
+        /* line breaks of the document make no sense in a snippet */
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            if (!in_space) {
+                out.push_back(' ');
+            }
+            in_space = true;
+            continue;
+        }
+        in_space = false;
+
+        switch (c) {
+            case '<': out.append("&lt;"); break;
+            case '>': out.append("&gt;"); break;
+            case '&': out.append("&amp;"); break;
+            case '"': out.append("&quot;"); break;
+            default: out.push_back(c);
+        }
+    }
+}
+
+}
+
+std::vector<std::string> SnippetGenerator::make_snippets(const std::string &content, const std::unordered_set<std::string> &terms,
+    const Analyzer &analyzer, size_t count)
+{
+    std::vector<std::string> snippets;
+    if (count == 0 || terms.empty()) {
+        return snippets;
+    }
+
+    /* a term is a run of alphabetic characters, the same split as iss >> word and clean_word during indexing */
+    std::vector<std::string> term_list(terms.begin(), terms.end());
+    std::vector<Token> tokens;
+    std::vector<size_t> matches;
+    std::string current;
+
+    for (size_t i = 0; i <= content.size(); ++i) {
+        unsigned char c = i < content.size() ? content[i] : ' ';
+        if (std::isalpha(c)) {
+            current.push_back(std::tolower(c));
+            continue;
+        }
+        if (current.empty()) {
+            continue;
+        }
+
+        int term = -1;
+        std::string normalized = analyzer.is_plain() ? current : analyzer.normalize(current);
+        if (terms.count(normalized)) {
+            term = std::find(term_list.begin(), term_list.end(), normalized) - term_list.begin();
+            matches.push_back(tokens.size());
+        }
+        tokens.push_back({i - current.size(), i, term});
+        current.clear();
+    }
+
+    if (matches.empty()) {
+        return snippets;
+    }
+
+    /* score the window starting before every match: distinct terms count most, then the number of matches */
+    struct Window {
+        size_t first;
+        size_t last;
+        size_t score;
+    };
+    std::vector<Window> windows;
+    size_t end_match = 0;
+    for (size_t i = 0; i < matches.size(); ++i) {
+        size_t first = matches[i] >= leading_tokens ? matches[i] - leading_tokens : 0;
+        size_t last = std::min(first + window_tokens, tokens.size());
+
+        end_match = std::max(end_match, i);
+        while (end_match < matches.size() && matches[end_match] < last) {
+            end_match++;
+        }
+
+        std::unordered_set<int> distinct;
+        for (size_t m = i; m < end_match; ++m) {
+            distinct.insert(tokens[matches[m]].term);
+        }
+        windows.push_back({first, last, distinct.size() * window_tokens + (end_match - i)});
+    }
+
+    /* best windows first, earlier windows win ties */
+    std::stable_sort(windows.begin(), windows.end(),
+        [](const Window &a, const Window &b) {
+            return a.score > b.score;
+        }
+    );
+
+    std::vector<Window> selected;
+    for (const auto &window: windows) {
+        bool overlaps = std::any_of(selected.begin(), selected.end(),
+            [&window](const Window &other) {
+                return window.first < other.last && other.first < window.last;
+            }
+        );
+        if (!overlaps) {
+            selected.push_back(window);
+        }
+        if (selected.size() == count) {
+            break;
+        }
+    }
+
+    /* snippets in document order */
+    std::sort(selected.begin(), selected.end(),
+        [](const Window &a, const Window &b) {
+            return a.first < b.first;
+        }
+    );
+
+    for (const auto &window: selected) {
+        std::string snippet = window.first > 0 ? "..." : "";
+        for (size_t t = window.first; t < window.last; ++t) {
+            const Token &token = tokens[t];
+            if (token.term >= 0) {
+                snippet.append("<b>");
+                append_escaped(snippet, content, token.begin, token.end);
+                snippet.append("</b>");
+            } else {
+                append_escaped(snippet, content, token.begin, token.end);
+            }
+
+            /* keep the punctuation and spaces between two tokens */
+            if (t + 1 < window.last) {
+                append_escaped(snippet, content, token.end, tokens[t + 1].begin);
+            }
+        }
+        if (window.last < tokens.size()) {
+            snippet.append("...");
+        }
+        snippets.push_back(std::move(snippet));
+    }
+
+    return snippets;
+}
@@ -0,0 +1,60 @@
+#ifndef _H_SNIPPETGENERATOR
+#define _H_SNIPPETGENERATOR
+
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "Analyzer.h"
+#include "ContentAddressedStorage.h"
+
+/*
+*   Builds text snippets with highlighted query terms for search hits.
+*   The content of a hit is loaded from the content storage, decompressed documents are kept
+*   in a LRU cache limited by size, so repeated queries for the same hits skip the decompression.
+*/
+class SnippetGenerator {
+    public:
+        explicit SnippetGenerator(std::shared_ptr<ContentAddressedStorage> content_store, size_t cache_bytes = default_cache_bytes);
+        ~SnippetGenerator() = default;
+
+        /*
+        *   Generates the snippets of all hits on up to one thread per core, one list per content hash.
+        *   The deadline is checked before each hit is loaded and before its snippets are built,
+        *   hits which did not make it in time get an empty list.
+        */
+        std::vector<std::vector<std::string>> generate(const std::vector<std::string> &content_hashes, const std::vector<std::string> &terms,
+            const Analyzer &analyzer, size_t snippets_per_hit, std::chrono::steady_clock::time_point deadline);
+
+        /*
+        *   Finds the windows with the most distinct query terms, tokens are split like during indexing
+        *   and normalized by the analyzer, so "whaling" is highlighted for the stemmed term "whale".
+        *   Matched terms are wrapped in <b></b>, the rest of the text is html escaped.
+        */
+        static std::vector<std::string> make_snippets(const std::string &content, const std::unordered_set<std::string> &terms,
+            const Analyzer &analyzer, size_t count);
+
+        static constexpr size_t default_cache_bytes = 64 * 1024 * 1024;
+        /* tokens per snippet, the first match is placed after the leading context */
+        static constexpr size_t window_tokens = 24;
+        static constexpr size_t leading_tokens = 8;
+
+    private:
+        std::shared_ptr<ContentAddressedStorage> m_content_store;
+
+        /* LRU cache, most recently used content at the front */
+        std::mutex m_cache_mutex;
+        std::list<std::pair<std::string, std::shared_ptr<const std::string>>> m_cache;
+        std::unordered_map<std::string, decltype(m_cache)::iterator> m_cache_index;
+        size_t m_cache_size = 0;
+        size_t m_cache_capacity;
+
+        std::shared_ptr<const std::string> load_content(const std::string &content_hash);
+};
+
+#endif
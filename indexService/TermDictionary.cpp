@@ -0,0 +1,437 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include "LevenshteinAutomaton.h"
+#include "TermDictionary.h"
+#include "Varint.h"
+
+namespace {
+
+void append_u32(std::string &out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<char>(value >> (8 * i)));
+    }
+}
+
+void append_u64(std::string &out, uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        out.push_back(static_cast<char>(value >> (8 * i)));
+    }
+}
+
+uint64_t read_u64(const uint8_t *pos) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value |= static_cast<uint64_t>(pos[i]) << (8 * i);
+    }
+    return value;
+}
+
+uint32_t read_u32(const uint8_t *pos) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= static_cast<uint32_t>(pos[i]) << (8 * i);
+    }
+    return value;
+}
+
+}
+
+void TermDictionary::build(const std::vector<std::string_view> &sorted_terms) {
+    std::string blocks;
+    std::vector<uint64_t> keys;
+    std::vector<uint64_t> offsets;
+
+    for (size_t i = 0; i < sorted_terms.size(); ++i) {
+        std::string_view term = sorted_terms[i];
+
+        if (i % block_size == 0) {
+            keys.push_back(make_key(term));
+            offsets.push_back(blocks.size());
+            varint_encode(term.size(), blocks);
+            blocks.append(term);
+            continue;
+        }
+
+        std::string_view previous = sorted_terms[i - 1];
+        if (term <= previous) {
+            throw std::invalid_argument("Terms of the dictionary have to be sorted and unique");
+        }
+
+        size_t shared = std::mismatch(previous.begin(), previous.end(), term.begin(), term.end()).first - previous.begin();
+        varint_encode(shared, blocks);
+        varint_encode(term.size() - shared, blocks);
+        blocks.append(term.substr(shared));
+    }
+
+    std::string buffer;
+    buffer.reserve(header_size + 16 * keys.size() + blocks.size());
+    buffer.append("CTD1");
+    append_u32(buffer, block_size);
+    append_u64(buffer, sorted_terms.size());
+    append_u64(buffer, keys.size());
+    for (uint64_t key: keys) {
+        append_u64(buffer, key);
+    }
+    for (uint64_t offset: offsets) {
+        append_u64(buffer, offset);
+    }
+    buffer.append(blocks);
+
+    m_file.close();
+    m_buffer = std::move(buffer);
+    attach(reinterpret_cast<const uint8_t*>(m_buffer.data()), m_buffer.size());
+}
+
+void TermDictionary::save(const std::string &filepath) const {
+    /* written next to the old file and renamed, processes that mapped the old file keep reading it */
+    std::string temporary_path = filepath + ".tmp";
+    {
+        std::ofstream out(temporary_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw std::runtime_error("Failed to open term dictionary for writing: " + temporary_path);
+        }
+        out.write(reinterpret_cast<const char*>(m_data), m_data_size);
+        if (!out.flush()) {
+            throw std::runtime_error("Failed to write term dictionary: " + temporary_path);
+        }
+    }
+    std::filesystem::rename(temporary_path, filepath);
+}
+
+void TermDictionary::prefetch() const {
+    m_file.prefetch();
+}
+
+void TermDictionary::open(const std::string &filepath) {
+    MappedFile file(filepath, MappedFile::Access::Random);
+    attach(file.data(), file.size());
+
+    m_file = std::move(file);
+    m_buffer.clear();
+    m_buffer.shrink_to_fit();
+}
+
+void TermDictionary::attach(const uint8_t *data, uint64_t size) {
+    if (size < header_size || std::memcmp(data, "CTD1", 4) != 0) {
+        throw std::runtime_error("Invalid term dictionary");
+    }
+    if (read_u32(data + 4) != block_size) {
+        throw std::runtime_error("Term dictionary has an unsupported block size");
+    }
+
+    uint64_t term_count = read_u64(data + 8);
+    uint64_t block_count = read_u64(data + 16);
+    if (block_count > (size - header_size) / 16 || block_count != (term_count + block_size - 1) / block_size) {
+        throw std::runtime_error("Corrupt term dictionary header");
+    }
+
+    m_data = data;
+    m_data_size = size;
+    m_term_count = term_count;
+    m_block_count = block_count;
+    m_keys = data + header_size;
+    m_offsets = m_keys + 8 * block_count;
+    m_blocks = m_offsets + 8 * block_count;
+}
+
+uint64_t TermDictionary::key_at(uint64_t block) const { return read_u64(m_keys + 8 * block); }
+uint64_t TermDictionary::offset_at(uint64_t block) const { return read_u64(m_offsets + 8 * block); }
+
+std::string_view TermDictionary::first_term(uint64_t block) const {
+    const uint8_t *pos = m_blocks + offset_at(block);
+    uint64_t length = varint_decode(pos, m_data + m_data_size);
+    return std::string_view(reinterpret_cast<const char*>(pos), length);
+}
+
+/* the first 8 bytes big endian, comparing keys compares the 8 byte prefixes of the terms */
+uint64_t TermDictionary::make_key(std::string_view term) {
+    uint64_t key = 0;
+    for (size_t i = 0; i < 8; ++i) {
+        key = (key << 8) | (i < term.size() ? static_cast<uint8_t>(term[i]) : 0);
+    }
+    return key;
+}
+
+uint64_t TermDictionary::find_block(std::string_view term) const {
+    uint64_t key = make_key(term);
+
+    /* blocks before low have a smaller key, blocks from high on a bigger one */
+    uint64_t low = 0;
+    uint64_t high = m_block_count;
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        if (key_at(mid) < key) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    high = m_block_count;
+    uint64_t upper_low = low;
+    while (upper_low < high) {
+        uint64_t mid = upper_low + (high - upper_low) / 2;
+        if (key_at(mid) <= key) {
+            upper_low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    /* only blocks with the same key need a full comparison */
+    high = upper_low;
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        if (first_term(mid) <= term) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low == 0 ? m_block_count : low - 1;
+}
+
+std::optional<uint32_t> TermDictionary::lookup(std::string_view term) const {
+    uint64_t block = find_block(term);
+    if (block >= m_block_count) {
+        return std::nullopt;
+    }
+
+    for (Iterator it(*this, block); it.valid() && it.id() < (block + 1) * block_size; it.next()) {
+        int cmp = it.term().compare(term);
+        if (cmp == 0) {
+            return it.id();
+        }
+        if (cmp > 0) {
+            break;
+        }
+    }
+    return std::nullopt;
+}
+
+std::string TermDictionary::term(uint32_t id) const {
+    if (id >= m_term_count) {
+        throw std::out_of_range("Invalid term id");
+    }
+
+    Iterator it(*this, id / block_size);
+    while (it.id() < id) {
+        it.next();
+    }
+    return it.term();
+}
+
+TermDictionary::Iterator TermDictionary::seek(std::string_view term) const {
+    uint64_t block = find_block(term);
+    Iterator it(*this, block >= m_block_count ? 0 : block);
+    while (it.valid() && it.term() < term) {
+        it.next();
+    }
+    return it;
+}
+
+TermDictionary::Iterator TermDictionary::begin() const {
+    return Iterator(*this, 0);
+}
+
+std::vector<uint32_t> TermDictionary::expand_prefix(std::string_view prefix, size_t limit) const {
+    std::vector<uint32_t> ids;
+    for (Iterator it = seek(prefix); it.valid() && ids.size() < limit; it.next()) {
+        if (it.term().compare(0, prefix.size(), prefix) != 0) {
+            break;
+        }
+        ids.push_back(it.id());
+    }
+    return ids;
+}
+
+/* only the terms sharing the literal prefix of the pattern are enumerated */
+TermDictionary::WildcardExpansion TermDictionary::expand_wildcard(std::string_view pattern, size_t limit,
+    std::chrono::steady_clock::time_point deadline) const
+{
+    WildcardExpansion expansion;
+    std::string_view literal = pattern.substr(0, pattern.find_first_of("*?"));
+    if (literal.size() == pattern.size()) {
+        if (auto id = lookup(pattern)) {
+            expansion.ids.push_back(*id);
+        }
+        return expansion;
+    }
+    /* every term of the prefix matches, the limit bounds the walk */
+    if (pattern.size() == literal.size() + 1 && pattern.back() == '*') {
+        expansion.ids = expand_prefix(literal, limit);
+        return expansion;
+    }
+
+    size_t visited = 0;
+    for (Iterator it = seek(literal); it.valid() && expansion.ids.size() < limit; it.next()) {
+        if (++visited % expansion_check_interval == 0 && std::chrono::steady_clock::now() >= deadline) {
+            expansion.complete = false;
+            break;
+        }
+        if (it.term().compare(0, literal.size(), literal) != 0) {
+            break;
+        }
+        if (wildcard_match(pattern, it.term())) {
+            expansion.ids.push_back(it.id());
+        }
+    }
+    return expansion;
+}
+
+TermDictionary::FuzzyExpansion TermDictionary::expand_fuzzy(std::string_view term, int max_edits, size_t limit,
+    std::chrono::steady_clock::time_point deadline) const
+{
+    FuzzyExpansion expansion;
+    LevenshteinAutomaton automaton(term, max_edits);
+    size_t state_size = automaton.state_size();
+
+    /* the states after each character of prefix, the state for prefix[0, i) starts at i * state_size */
+    std::string prefix;
+    std::vector<uint8_t> states(state_size);
+    automaton.start(states.data());
+
+    size_t visited = 0;
+    Iterator it = begin();
+    while (it.valid()) {
+        if (++visited % expansion_check_interval == 0 && std::chrono::steady_clock::now() >= deadline) {
+            expansion.complete = false;
+            break;
+        }
+
+        const std::string &current = it.term();
+        size_t depth = std::mismatch(prefix.begin(), prefix.end(), current.begin(), current.end()).first - prefix.begin();
+        prefix.resize(depth);
+        states.resize((depth + 1) * state_size);
+
+        bool alive = true;
+        while (depth < current.size() && alive) {
+            states.resize((depth + 2) * state_size);
+            alive = automaton.step(&states[depth * state_size], current[depth], &states[(depth + 1) * state_size]);
+            prefix.push_back(current[depth]);
+            depth++;
+        }
+
+        if (alive) {
+            const uint8_t *state = &states[depth * state_size];
+            if (automaton.is_match(state)) {
+                expansion.matches.push_back({it.id(), automaton.distance(state)});
+            }
+            it.next();
+            continue;
+        }
+
+        /* no term starting with prefix can match, most of these subtrees are small, so first step over them */
+        auto in_subtree = [&it, &prefix]() {
+            return it.valid() && it.term().compare(0, prefix.size(), prefix) == 0;
+        };
+        for (size_t steps = 0; steps < block_size && in_subtree(); ++steps) {
+            it.next();
+        }
+        if (!in_subtree()) {
+            continue;
+        }
+
+        /* continue at the first term after the subtree */
+        std::string successor = prefix;
+        while (!successor.empty() && static_cast<unsigned char>(successor.back()) == 0xff) {
+            successor.pop_back();
+        }
+        if (successor.empty()) {
+            break;
+        }
+        successor.back()++;
+        it = seek(successor);
+    }
+
+    std::stable_sort(expansion.matches.begin(), expansion.matches.end(),
+        [](const FuzzyMatch &a, const FuzzyMatch &b) {
+            return a.distance < b.distance;
+        }
+    );
+    if (expansion.matches.size() > limit) {
+        expansion.matches.resize(limit);
+    }
+    return expansion;
+}
+
+/* glob matching, backtracks to the last * on a mismatch */
+bool TermDictionary::wildcard_match(std::string_view pattern, std::string_view text) {
+    size_t p = 0;
+    size_t t = 0;
+    size_t star = std::string_view::npos;
+    size_t star_text = 0;
+
+    while (t < text.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == text[t])) {
+            p++;
+            t++;
+        } else if (p < pattern.size() && pattern[p] == '*') {
+            star = p++;
+            star_text = t;
+        } else if (star != std::string_view::npos) {
+            p = star + 1;
+            t = ++star_text;
+        } else {
+            return false;
+        }
+    }
+
+    while (p < pattern.size() && pattern[p] == '*') {
+        p++;
+    }
+    return p == pattern.size();
+}
+
+uint64_t TermDictionary::size() const { return m_term_count; }
+uint64_t TermDictionary::get_size_bytes() const { return m_data_size; }
+
+TermDictionary::Iterator::Iterator(const TermDictionary &dictionary, uint64_t block)
+    : m_dictionary(&dictionary)
+{
+    load_block(block);
+}
+
+bool TermDictionary::Iterator::valid() const { return m_id < m_dictionary->m_term_count; }
+uint32_t TermDictionary::Iterator::id() const { return m_id; }
+const std::string &TermDictionary::Iterator::term() const { return m_term; }
+
+void TermDictionary::Iterator::load_block(uint64_t block) {
+    const TermDictionary &dict = *m_dictionary;
+    m_id = block * block_size;
+    if (block >= dict.m_block_count) {
+        m_id = dict.m_term_count;
+        return;
+    }
+
+    m_pos = dict.m_blocks + dict.offset_at(block);
+    m_block_end = block + 1 < dict.m_block_count ? dict.m_blocks + dict.offset_at(block + 1) : dict.m_data + dict.m_data_size;
+
+    uint64_t length = varint_decode(m_pos, m_block_end);
+    m_term.assign(reinterpret_cast<const char*>(m_pos), length);
+    m_pos += length;
+}
+
+void TermDictionary::Iterator::next() {
+    m_id++;
+    if (!valid()) {
+        return;
+    }
+    if (m_id % block_size == 0) {
+        load_block(m_id / block_size);
+        return;
+    }
+
+    uint64_t shared = varint_decode(m_pos, m_block_end);
+    uint64_t suffix = varint_decode(m_pos, m_block_end);
+    if (shared > m_term.size() || suffix > static_cast<uint64_t>(m_block_end - m_pos)) {
+        throw std::runtime_error("Corrupt term dictionary block");
+    }
+    m_term.resize(shared);
+    m_term.append(reinterpret_cast<const char*>(m_pos), suffix);
+    m_pos += suffix;
+}
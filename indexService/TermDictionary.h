@@ -0,0 +1,132 @@
+#ifndef _H_TERMDICTIONARY
+#define _H_TERMDICTIONARY
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "MappedFile.h"
+
+/*
+*   Sorted, front coded term dictionary, a term id is the rank of the term in sorted order.
+*
+*   File layout (terms.dict), all integers little endian:
+*       "CTD1", u32 block_size, u64 term_count, u64 block_count
+*       u64 keys[block_count]      first 8 bytes of the first term of every block, big endian, zero padded
+*       u64 offsets[block_count]   offset of every block in the data section
+*       data                       per block: the first term as varint length + bytes, the following terms
+*                                  as varint shared prefix length, varint suffix length, suffix bytes
+*
+*   A lookup binary searches the dense keys array and decodes a single block, so it costs a few cache misses.
+*   The file is memory mapped, the dictionary itself does not live on the heap.
+*/
+class TermDictionary {
+    public:
+        /* sequential reader, starts at a block boundary and decodes the front coding */
+        class Iterator {
+            public:
+                Iterator(const TermDictionary &dictionary, uint64_t block);
+
+                bool valid() const;
+                uint32_t id() const;
+                const std::string &term() const;
+                void next();
+
+            private:
+                const TermDictionary *m_dictionary;
+                uint64_t m_id;
+                const uint8_t *m_pos = nullptr;
+                const uint8_t *m_block_end = nullptr;
+                std::string m_term;
+
+                void load_block(uint64_t block);
+        };
+
+        struct FuzzyMatch {
+            uint32_t id;
+            int distance;
+        };
+
+        struct WildcardExpansion {
+            /* in sorted order */
+            std::vector<uint32_t> ids;
+            /* false if the deadline stopped the walk, then terms may be missing */
+            bool complete = true;
+        };
+
+        struct FuzzyExpansion {
+            /* closest terms first */
+            std::vector<FuzzyMatch> matches;
+            /* false if the deadline stopped the walk, then terms may be missing */
+            bool complete = true;
+        };
+
+        TermDictionary() = default;
+
+        /* builds the dictionary in memory, terms have to be sorted and unique */
+        void build(const std::vector<std::string_view> &sorted_terms);
+        void save(const std::string &filepath) const;
+        /* maps a saved dictionary, replaces the in memory one */
+        void open(const std::string &filepath);
+
+        std::optional<uint32_t> lookup(std::string_view term) const;
+        std::string term(uint32_t id) const;
+
+        /* iterator at the first term >= term */
+        Iterator seek(std::string_view term) const;
+        Iterator begin() const;
+
+        /* ids of the terms starting with prefix, at most limit terms */
+        std::vector<uint32_t> expand_prefix(std::string_view prefix, size_t limit) const;
+        /*
+        *   Ids of the terms matching a pattern with * (any sequence) and ? (any character), at most limit terms.
+        *   Only the terms sharing the literal prefix are walked, a pattern starting with a wildcard walks all of them,
+        *   so the deadline is checked every expansion_check_interval terms.
+        */
+        WildcardExpansion expand_wildcard(std::string_view pattern, size_t limit, std::chrono::steady_clock::time_point deadline) const;
+        static bool wildcard_match(std::string_view pattern, std::string_view text);
+        /*
+        *   Terms within max_edits of term, at most limit terms, found by walking a Levenshtein automaton along the
+        *   sorted terms. Subtrees of prefixes the automaton rejects are skipped with a seek, so only a fraction
+        *   of the dictionary is decoded. The deadline is checked every expansion_check_interval terms.
+        */
+        FuzzyExpansion expand_fuzzy(std::string_view term, int max_edits, size_t limit,
+            std::chrono::steady_clock::time_point deadline) const;
+
+        uint64_t size() const;
+        uint64_t get_size_bytes() const;
+        /* reads a mapped dictionary ahead of the first lookup */
+        void prefetch() const;
+
+        static constexpr uint32_t block_size = 16;
+
+    private:
+        /* either the mapped file or the buffer of a freshly built dictionary */
+        MappedFile m_file;
+        std::string m_buffer;
+        const uint8_t *m_data = nullptr;
+        uint64_t m_data_size = 0;
+
+        uint64_t m_term_count = 0;
+        uint64_t m_block_count = 0;
+        const uint8_t *m_keys = nullptr;
+        const uint8_t *m_offsets = nullptr;
+        const uint8_t *m_blocks = nullptr;
+
+        static constexpr size_t header_size = 24;
+        static constexpr size_t expansion_check_interval = 256;
+
+        void attach(const uint8_t *data, uint64_t size);
+        uint64_t key_at(uint64_t block) const;
+        uint64_t offset_at(uint64_t block) const;
+        std::string_view first_term(uint64_t block) const;
+        /* last block whose first term is <= term, block_count if there is none */
+        uint64_t find_block(std::string_view term) const;
+
+        static uint64_t make_key(std::string_view term);
+};
+
+#endif
@@ -1,15 +1,17 @@
-#include <fstream>
-
 #include "TextContentStrategy.h"
 
 TextContentStrategy::TextContentStrategy() {}
 
 std::string TextContentStrategy::read_content(const std::string &filepath) const {
-    std::ifstream file(filepath);
-    if (!file.is_open()) {
-        throw std::runtime_error("Failed to open file: " + filepath);
-    }
+    return std::string(read_view(filepath).view());
+}
+
+/* MappedFile throws if the file cannot be opened or mapped */
+Content TextContentStrategy::read_view(const std::string &filepath) const {
+    return Content(MappedFile(filepath, MappedFile::Access::Sequential));
+}
 
-    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-    return content;
+/* plain text is its own content */
+Content TextContentStrategy::parse_raw(const std::string &, std::string raw) const {
+    return Content(std::move(raw));
 }
\ No newline at end of file
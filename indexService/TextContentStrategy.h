@@ -7,6 +7,10 @@ class TextContentStrategy: public ContentStrategy{
    public:
     TextContentStrategy();
     std::string read_content(const std::string &filepath) const override;
+    /* maps the file for a single sequential pass, the text is not copied */
+    Content read_view(const std::string &filepath) const override;
+    bool parses_raw() const override { return true; }
+    Content parse_raw(const std::string &filepath, std::string raw) const override;
 
    private:
 };
@@ -0,0 +1,236 @@
+#ifdef CEARCH_HAVE_LIBURING
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "UringIOBackend.h"
+
+UringIOBackend::UringIOBackend(size_t queue_depth)
+    : IOBackend(queue_depth)
+{
+    /* one more entry for the read of the eventfd */
+    int error = io_uring_queue_init(queue_depth + 1, &m_ring, 0);
+    if (error < 0) {
+        throw std::runtime_error(std::string("io_uring_queue_init failed: ") + std::strerror(-error));
+    }
+
+    m_event_fd = eventfd(0, EFD_CLOEXEC);
+    if (m_event_fd < 0) {
+        error = errno;
+        io_uring_queue_exit(&m_ring);
+        throw std::runtime_error(std::string("eventfd failed: ") + std::strerror(error));
+    }
+
+    prepare_wakeup();
+    io_uring_submit(&m_ring);
+    m_thread = std::thread(&UringIOBackend::run, this);
+}
+
+/* the queued operations are finished before the ring thread stops */
+UringIOBackend::~UringIOBackend() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    uint64_t one = 1;
+    [[maybe_unused]] ssize_t written = write(m_event_fd, &one, sizeof(one));
+    m_thread.join();
+
+    io_uring_queue_exit(&m_ring);
+    close(m_event_fd);
+    for (auto request: m_active) {
+        delete request;
+    }
+}
+
+std::future<std::string> UringIOBackend::read_file(const std::string &filepath) {
+    auto request = new Request();
+    request->filepath = filepath;
+    auto future = request->read_promise.get_future();
+
+    try {
+        size_t size = 0;
+        request->fd = open_for_read(filepath, size);
+        request->read_buffer.resize(size);
+    } catch (std::exception &) {
+        request->read_promise.set_exception(std::current_exception());
+        delete request;
+        return future;
+    }
+
+    if (request->read_buffer.empty()) {
+        close(request->fd);
+        request->read_promise.set_value(std::string());
+        delete request;
+        return future;
+    }
+
+    enqueue(request);
+    return future;
+}
+
+std::future<void> UringIOBackend::write_file(const std::string &filepath, std::vector<uint8_t> data) {
+    auto request = new Request();
+    request->write = true;
+    request->filepath = filepath;
+    request->write_buffer = std::move(data);
+    auto future = request->write_promise.get_future();
+
+    try {
+        request->fd = open_for_write(filepath);
+    } catch (std::exception &) {
+        request->write_promise.set_exception(std::current_exception());
+        delete request;
+        return future;
+    }
+
+    if (request->write_buffer.empty()) {
+        close(request->fd);
+        request->write_promise.set_value();
+        delete request;
+        return future;
+    }
+
+    enqueue(request);
+    return future;
+}
+
+void UringIOBackend::enqueue(Request *request) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_error.empty()) {
+            fail(request, m_error);
+            delete request;
+            return;
+        }
+        m_queued.push_back(request);
+    }
+    uint64_t one = 1;
+    [[maybe_unused]] ssize_t written = write(m_event_fd, &one, sizeof(one));
+}
+
+void UringIOBackend::run() {
+    while (true) {
+        /* fill the ring up to the queue depth */
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            while (!m_queued.empty() && m_in_flight < m_queue_depth) {
+                prepare(m_queued.front());
+                m_active.insert(m_queued.front());
+                m_queued.pop_front();
+                m_in_flight++;
+            }
+            if (m_stop && m_queued.empty() && m_in_flight == 0) {
+                return;
+            }
+        }
+
+        io_uring_cqe *cqe;
+        int error = io_uring_submit_and_wait(&m_ring, 1);
+        if (error < 0 && error != -EINTR) {
+            abandon(std::string("io_uring_submit_and_wait failed: ") + std::strerror(-error));
+            return;
+        }
+
+        /* all completions that are ready, requests with a short transfer are prepared again */
+        while (io_uring_peek_cqe(&m_ring, &cqe) == 0) {
+            auto request = static_cast<Request*>(io_uring_cqe_get_data(cqe));
+            int result = cqe->res;
+            io_uring_cqe_seen(&m_ring, cqe);
+
+            if (!request) {
+                prepare_wakeup();
+            } else if (complete(request, result)) {
+                m_active.erase(request);
+                delete request;
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_in_flight--;
+            }
+        }
+    }
+}
+
+void UringIOBackend::abandon(const std::string &message) {
+    std::deque<Request*> queued;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_error = message;
+        queued.swap(m_queued);
+        m_in_flight = 0;
+    }
+    for (auto request: queued) {
+        fail(request, message);
+        delete request;
+    }
+    /* the kernel may still use their buffers until the ring is torn down */
+    for (auto request: m_active) {
+        fail(request, message);
+    }
+}
+
+void UringIOBackend::prepare(Request *request) {
+    io_uring_sqe *sqe = io_uring_get_sqe(&m_ring);
+    if (request->write) {
+        size_t length = std::min(request->write_buffer.size() - request->done, max_transfer_size);
+        io_uring_prep_write(sqe, request->fd, request->write_buffer.data() + request->done, length, request->done);
+    } else {
+        size_t length = std::min(request->read_buffer.size() - request->done, max_transfer_size);
+        io_uring_prep_read(sqe, request->fd, request->read_buffer.data() + request->done, length, request->done);
+    }
+    io_uring_sqe_set_data(sqe, request);
+}
+
+void UringIOBackend::prepare_wakeup() {
+    io_uring_sqe *sqe = io_uring_get_sqe(&m_ring);
+    io_uring_prep_read(sqe, m_event_fd, &m_event_value, sizeof(m_event_value), 0);
+    io_uring_sqe_set_data(sqe, nullptr);
+}
+
+bool UringIOBackend::complete(Request *request, int result) {
+    if (result == -EINTR || result == -EAGAIN) {
+        prepare(request);
+        return false;
+    }
+    if (result < 0) {
+        fail(request, std::string("Failed to ") + (request->write ? "write " : "read ") + request->filepath + ": " + std::strerror(-result));
+        return true;
+    }
+
+    request->done += result;
+    size_t size = request->write ? request->write_buffer.size() : request->read_buffer.size();
+    if (result > 0 && request->done < size) {
+        prepare(request);
+        return false;
+    }
+
+    close(request->fd);
+    if (request->write) {
+        if (request->done < size) {
+            request->write_promise.set_exception(std::make_exception_ptr(std::runtime_error("Failed to write " + request->filepath)));
+        } else {
+            request->write_promise.set_value();
+        }
+    } else {
+        /* a file truncated since it was opened ends early */
+        request->read_buffer.resize(request->done);
+        request->read_promise.set_value(std::move(request->read_buffer));
+    }
+    return true;
+}
+
+void UringIOBackend::fail(Request *request, const std::string &message) {
+    close(request->fd);
+    auto error = std::make_exception_ptr(std::runtime_error(message));
+    if (request->write) {
+        request->write_promise.set_exception(error);
+    } else {
+        request->read_promise.set_exception(error);
+    }
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef _H_URINGIOBACKEND
+#define _H_URINGIOBACKEND
+
+#ifdef CEARCH_HAVE_LIBURING
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+#include <liburing.h>
+
+#include "IOBackend.h"
+
+/*
+*   IOBackend on an io_uring. Requests are queued by the calling threads, a single ring thread
+*   submits up to queue_depth reads and writes at once and completes them as the kernel reports them,
+*   short reads and writes are resubmitted for the rest. The ring thread is woken up through an eventfd
+*   whose read is part of the ring, so it waits for new requests and completions at the same time.
+*   Files are opened and closed synchronously by the caller, only the data transfer is asynchronous.
+*   If the ring itself fails, every pending and later request fails through its future.
+*/
+class UringIOBackend : public IOBackend {
+    public:
+        /* throws std::runtime_error if the kernel does not support io_uring */
+        explicit UringIOBackend(size_t queue_depth);
+        ~UringIOBackend() override;
+
+        std::future<std::string> read_file(const std::string &filepath) override;
+        std::future<void> write_file(const std::string &filepath, std::vector<uint8_t> data) override;
+        const char *name() const override { return "io_uring"; }
+
+    private:
+        struct Request {
+            bool write = false;
+            std::string filepath;
+            int fd = -1;
+            /* bytes transferred so far */
+            size_t done = 0;
+            std::string read_buffer;
+            std::vector<uint8_t> write_buffer;
+            std::promise<std::string> read_promise;
+            std::promise<void> write_promise;
+        };
+
+        /* a single operation is at most this large, bigger files take several */
+        static constexpr size_t max_transfer_size = 1 << 30;
+
+        io_uring m_ring;
+        std::thread m_thread;
+        int m_event_fd = -1;
+        uint64_t m_event_value = 0;
+
+        std::mutex m_mutex;
+        std::deque<Request*> m_queued;
+        bool m_stop = false;
+        size_t m_in_flight = 0;
+        /* set when the ring failed, requests are failed with it instead of queued */
+        std::string m_error;
+
+        /* requests prepared on the ring, only used by the ring thread and after it stopped */
+        std::unordered_set<Request*> m_active;
+
+        void enqueue(Request *request);
+        void run();
+        /* fails all queued and in flight requests, the in flight ones are deleted with the ring */
+        void abandon(const std::string &message);
+        void prepare(Request *request);
+        void prepare_wakeup();
+        /* true if the request is finished, its promise is set */
+        bool complete(Request *request, int result);
+        static void fail(Request *request, const std::string &message);
+};
+
+#endif
+
+#endif
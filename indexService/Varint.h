@@ -0,0 +1,36 @@
+#ifndef _H_VARINT
+#define _H_VARINT
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+/*
+*   LEB128 style variable length integers, 7 bit per byte, the high bit marks a following byte.
+*   Used for delta encoded docids and positions, small deltas take a single byte.
+*/
+inline void varint_encode(uint64_t value, std::string &out) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+/* decodes one value and moves pos behind it, throws if the value runs past end */
+inline uint64_t varint_decode(const uint8_t *&pos, const uint8_t *end) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos >= end) {
+            throw std::runtime_error("Truncated varint");
+        }
+        uint8_t byte = *pos++;
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+    throw std::runtime_error("Varint too long");
+}
+
+#endif
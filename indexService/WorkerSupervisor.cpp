@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <spawn.h>
+#include <stdexcept>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+#include "IndexGenerations.h"
+#include "WorkerSupervisor.h"
+
+extern char **environ;
+
+namespace {
+
+const char *worker_executable = "/proc/self/exe";
+
+/* set by SIGTERM and SIGINT, whichever thread of the supervisor gets them */
+volatile std::sig_atomic_t stop_requested = 0;
+
+void request_stop(int) {
+    stop_requested = 1;
+}
+
+volatile std::sig_atomic_t reload_requested = 0;
+
+void request_reload(int) {
+    reload_requested = 1;
+}
+
+std::string describe_exit(int status) {
+    if (WIFSIGNALED(status)) {
+        return std::string("killed by signal ") + strsignal(WTERMSIG(status));
+    }
+    return "exited with status " + std::to_string(WEXITSTATUS(status));
+}
+
+}
+
+WorkerSupervisor::WorkerSupervisor(size_t workers, std::vector<std::string> worker_args, std::function<void()> rebuild)
+    : m_workers(std::max<size_t>(workers, 1)), m_worker_args(std::move(worker_args)), m_rebuild(std::move(rebuild))
+{
+    if (access(worker_executable, X_OK) != 0) {
+        throw std::runtime_error("Workers cannot be started on this platform");
+    }
+}
+
+WorkerSupervisor::~WorkerSupervisor() {
+    if (m_rebuild_thread.joinable()) {
+        m_rebuild_thread.join();
+    }
+}
+
+int WorkerSupervisor::run() {
+    struct sigaction action {};
+    action.sa_handler = request_stop;
+    sigemptyset(&action.sa_mask);
+    struct sigaction previous_term;
+    struct sigaction previous_int;
+    sigaction(SIGTERM, &action, &previous_term);
+    sigaction(SIGINT, &action, &previous_int);
+    struct sigaction reload_action {};
+    reload_action.sa_handler = request_reload;
+    sigemptyset(&reload_action.sa_mask);
+    struct sigaction previous_hup;
+    sigaction(SIGHUP, &reload_action, &previous_hup);
+
+    for (auto &worker: m_workers) {
+        spawn(worker);
+    }
+
+    /* exited workers are noticed within a poll interval */
+    while (!stop_requested) {
+        std::this_thread::sleep_for(poll_interval);
+
+        reap();
+        if (reload_requested && !m_rebuilding) {
+            reload_requested = 0;
+            start_rebuild();
+        }
+        if (m_rebuilding && m_rebuild_done) {
+            finish_rebuild();
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        for (auto &worker: m_workers) {
+            if (worker.pid < 0 && worker.restart_at <= now && !stop_requested) {
+                worker.restarts++;
+                spawn(worker);
+            }
+        }
+    }
+
+    std::cout << "Stopping " << m_workers.size() << " workers" << std::endl;
+    stop_all();
+    sigaction(SIGTERM, &previous_term, nullptr);
+    sigaction(SIGINT, &previous_int, nullptr);
+    sigaction(SIGHUP, &previous_hup, nullptr);
+    return 0;
+}
+
+void WorkerSupervisor::prepare_worker() {
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    /* a worker that is still loading its index must not be terminated by a forwarded reload */
+    signal(SIGHUP, SIG_IGN);
+}
+
+void WorkerSupervisor::start_rebuild() {
+    if (!m_rebuild) {
+        finish_rebuild();
+        return;
+    }
+
+    std::cout << "Rebuilding the index for the workers" << std::endl;
+    m_rebuilding = true;
+    m_rebuild_done = false;
+    m_rebuild_failed = false;
+    m_rebuild_thread = std::thread([this]() {
+        /* the workers keep serving on the same CPUs */
+        setpriority(PRIO_PROCESS, syscall(SYS_gettid), IndexGenerations::reload_nice);
+        try {
+            m_rebuild();
+        } catch (const std::exception &e) {
+            std::cerr << "Rebuilding the index failed, the workers keep their index: " << e.what() << std::endl;
+            m_rebuild_failed = true;
+        }
+        m_rebuild_done = true;
+    });
+}
+
+void WorkerSupervisor::finish_rebuild() {
+    if (m_rebuild_thread.joinable()) {
+        m_rebuild_thread.join();
+    }
+    m_rebuilding = false;
+    if (m_rebuild_failed) {
+        return;
+    }
+
+    std::cout << "Reloading " << m_workers.size() << " workers" << std::endl;
+    for (const auto &worker: m_workers) {
+        if (worker.pid > 0) {
+            kill(worker.pid, SIGHUP);
+        }
+    }
+}
+
+bool WorkerSupervisor::spawn(Worker &worker) {
+    std::vector<std::string> args{"cearch", "--serve-worker"};
+    args.insert(args.end(), m_worker_args.begin(), m_worker_args.end());
+    std::vector<char*> argv;
+    for (auto &arg: args) {
+        argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid;
+    int error = posix_spawn(&pid, worker_executable, nullptr, nullptr, argv.data(), environ);
+
+    auto now = std::chrono::steady_clock::now();
+    worker.started = now;
+    if (error != 0) {
+        std::cerr << "Failed to start a worker: " << std::strerror(error) << std::endl;
+        worker.pid = -1;
+        worker.restart_at = now + restart_delay;
+        return false;
+    }
+
+    worker.pid = pid;
+    std::cout << "Started worker " << pid << std::endl;
+    return true;
+}
+
+void WorkerSupervisor::reap() {
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        auto worker = std::find_if(m_workers.begin(), m_workers.end(), [pid](const Worker &w) { return w.pid == pid; });
+        if (worker == m_workers.end()) {
+            continue;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        bool early = now - worker->started < min_uptime;
+        worker->pid = -1;
+        worker->restart_at = early ? now + restart_delay : now;
+        std::cerr << "Worker " << pid << " " << describe_exit(status) << ", restarting it";
+        std::cerr << (early ? " after a delay" : "") << " (" << worker->restarts << " restarts so far)" << std::endl;
+    }
+}
+
+void WorkerSupervisor::stop_all() {
+    for (const auto &worker: m_workers) {
+        if (worker.pid > 0) {
+            kill(worker.pid, SIGTERM);
+        }
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + stop_timeout;
+    while (true) {
+        for (auto &worker: m_workers) {
+            if (worker.pid > 0 && waitpid(worker.pid, nullptr, WNOHANG) == worker.pid) {
+                worker.pid = -1;
+            }
+        }
+        bool running = std::any_of(m_workers.begin(), m_workers.end(), [](const Worker &w) { return w.pid > 0; });
+        if (!running) {
+            return;
+        }
+        if (std::chrono::steady_clock::now() >= deadline) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    for (auto &worker: m_workers) {
+        if (worker.pid > 0) {
+            kill(worker.pid, SIGKILL);
+            waitpid(worker.pid, nullptr, 0);
+            worker.pid = -1;
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef _H_WORKERSUPERVISOR
+#define _H_WORKERSUPERVISOR
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
+
+/*
+*   Pre-forked serving: the supervisor starts a number of worker processes, the cearch binary itself started with
+*   --serve-worker, and restarts every worker that exits while the others keep serving.
+*   The workers listen on the same port with SO_REUSEPORT and map the same read only index files, so the page
+*   cache holds one copy of the postings and the term dictionary for all of them.
+*
+*   SIGTERM or SIGINT stop the workers and the supervisor. A worker stops when its supervisor dies.
+*   SIGHUP runs the rebuild in the background, then forwards SIGHUP to the workers which reload the new files.
+*/
+class WorkerSupervisor {
+    public:
+        /*
+        *   @param worker_args the arguments of a worker after --serve-worker
+        *   @param rebuild updates the index files on SIGHUP, may throw, the workers then keep their index
+        */
+        WorkerSupervisor(size_t workers, std::vector<std::string> worker_args, std::function<void()> rebuild = {});
+        ~WorkerSupervisor();
+
+        WorkerSupervisor(const WorkerSupervisor &) = delete;
+        WorkerSupervisor &operator=(const WorkerSupervisor &) = delete;
+
+        /* runs until SIGTERM or SIGINT, returns the exit code of the supervisor */
+        int run();
+
+        /* to be called first by a worker process, it gets SIGTERM when the supervisor exits and ignores SIGHUP */
+        static void prepare_worker();
+
+        /* a worker that exits sooner after its start is restarted after restart_delay, so a broken index does not spin */
+        static constexpr std::chrono::seconds min_uptime{5};
+        static constexpr std::chrono::seconds restart_delay{1};
+        /* workers still running this long after SIGTERM are killed */
+        static constexpr std::chrono::seconds stop_timeout{5};
+        static constexpr std::chrono::milliseconds poll_interval{100};
+
+    private:
+        struct Worker {
+            pid_t pid = -1;
+            std::chrono::steady_clock::time_point started;
+            std::chrono::steady_clock::time_point restart_at;
+            uint64_t restarts = 0;
+        };
+
+        std::vector<Worker> m_workers;
+        std::vector<std::string> m_worker_args;
+
+        std::function<void()> m_rebuild;
+        std::thread m_rebuild_thread;
+        bool m_rebuilding = false;
+        std::atomic<bool> m_rebuild_done{false};
+        bool m_rebuild_failed = false;
+
+        bool spawn(Worker &worker);
+        void start_rebuild();
+        /* joins a finished rebuild and tells the workers to reload */
+        void finish_rebuild();
+        /* collects the exited workers and schedules their restart */
+        void reap();
+        void stop_all();
+};
+
+#endif
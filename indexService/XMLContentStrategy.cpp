@@ -1,12 +1,32 @@
+#include <cstring>
 #include <iostream>
-#include <queue>
+#include <stack>
 
 #include "XMLContentStrategy.h"
+#include "XMLTextExtractor.h"
 
 /* XML Specific Documents */
 XMLContentStrategy::XMLContentStrategy() {}
 
 std::string XMLContentStrategy::read_content(const std::string &filepath) const {
+    try {
+        return XMLTextExtractor::extract_file(filepath);
+    } catch (std::exception &e) {
+        std::cerr << "Streaming extraction of " << filepath << " failed: " << e.what() << ", loading the DOM" << std::endl;
+    }
+    return read_content_dom(filepath);
+}
+
+Content XMLContentStrategy::parse_raw(const std::string &filepath, std::string raw) const {
+    try {
+        return Content(XMLTextExtractor::extract(raw));
+    } catch (std::exception &e) {
+        std::cerr << "Streaming extraction of " << filepath << " failed: " << e.what() << ", loading the DOM" << std::endl;
+    }
+    return Content(read_content_dom(filepath));
+}
+
+std::string XMLContentStrategy::read_content_dom(const std::string &filepath) const {
     pugi::xml_document doc;
     std::string file_content;
 
@@ -19,20 +39,33 @@ std::string XMLContentStrategy::read_content(const std::string &filepath) const
 }
 
 void XMLContentStrategy::traverse_nodes(const pugi::xml_node &root_node, std::string &content) const {
-    std::queue<pugi::xml_node> node_queue;
-    node_queue.push(root_node);
+    std::stack<pugi::xml_node> node_stack;
+    node_stack.push(root_node);
 
-    while (!node_queue.empty()) {
-        pugi::xml_node current_node = node_queue.front();
-        node_queue.pop();
+    while (!node_stack.empty()) {
+        pugi::xml_node current_node = node_stack.top();
+        node_stack.pop();
 
-        /* process the current node */
-        content.append(current_node.value());
-        content.append(" ");
+        /* process the current node, only text, the content of script and style is skipped */
+        if (current_node.type() == pugi::node_pcdata || current_node.type() == pugi::node_cdata) {
+            content.append(current_node.value());
+            content.append(" ");
+            continue;
+        }
+        if (current_node.type() != pugi::node_element
+            || std::strcmp(current_node.name(), "script") == 0 || std::strcmp(current_node.name(), "style") == 0) {
+            continue;
+        }
 
+        /* children are pushed in reverse, so the first child is processed next */
+        std::stack<pugi::xml_node> children;
         for (pugi::xml_node child_node = current_node.first_child(); child_node;
              child_node = child_node.next_sibling()) {
-            node_queue.push(child_node);
+            children.push(child_node);
+        }
+        while (!children.empty()) {
+            node_stack.push(children.top());
+            children.pop();
         }
     }
-}
\ No newline at end of file
+}
@@ -6,14 +6,23 @@
 /* XML Parsing */
 #include <pugixml.hpp>
 
+/*
+*   Text of XML and XHTML files in document order, extracted with the streaming XMLTextExtractor.
+*   Documents the extractor cannot handle are loaded into a pugixml DOM instead.
+*/
 class XMLContentStrategy : public ContentStrategy {
    public:
     XMLContentStrategy();
-    std::string read_content(const std::string &filepath) const;
+    std::string read_content(const std::string &filepath) const override;
+    bool parses_raw() const override { return true; }
+    Content parse_raw(const std::string &filepath, std::string raw) const override;
+
+    /* the text from a pugixml DOM, the fallback for documents the extractor cannot handle and the baseline of its benchmark */
+    std::string read_content_dom(const std::string &filepath) const;
 
    private:
-    /* helper function to traverse every node in a xml file */
+    /* helper function to traverse every node in a xml file, depth first to keep the reading order */
     void traverse_nodes(const pugi::xml_node &root_node, std::string &content) const;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,372 @@
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include "XMLTextExtractor.h"
+
+namespace {
+
+bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+void append_utf8(std::string &out, uint32_t code_point) {
+    if (code_point < 0x80) {
+        out.push_back(static_cast<char>(code_point));
+    } else if (code_point < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+        out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else if (code_point < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else if (code_point < 0x110000) {
+        out.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+}
+
+}
+
+XMLTextExtractor::XMLTextExtractor(Sink sink)
+    : m_sink(std::move(sink))
+{
+}
+
+std::string XMLTextExtractor::extract_file(const std::string &filepath, size_t chunk_size) {
+    std::ifstream file(filepath, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open file: " + filepath);
+    }
+
+    /* the text is at most as long as the file, reserving it avoids copies while the text grows */
+    file.seekg(0, std::ios::end);
+    std::string content;
+    content.reserve(file.tellg());
+    file.seekg(0, std::ios::beg);
+
+    XMLTextExtractor extractor([&content](std::string_view text) {
+        content.append(text);
+    });
+
+    std::vector<char> buffer(chunk_size);
+    while (file) {
+        file.read(buffer.data(), buffer.size());
+        extractor.feed(buffer.data(), file.gcount());
+    }
+    extractor.finish();
+    return content;
+}
+
+std::string XMLTextExtractor::extract(std::string_view xml) {
+    std::string content;
+    content.reserve(xml.size());
+
+    XMLTextExtractor extractor([&content](std::string_view text) {
+        content.append(text);
+    });
+    extractor.feed(xml.data(), xml.size());
+    extractor.finish();
+    return content;
+}
+
+void XMLTextExtractor::feed(const char *data, size_t size) {
+    size_t i = 0;
+    while (i < size) {
+        char c = data[i];
+
+        switch (m_state) {
+            case State::Text:
+                if (c == '<') {
+                    m_state = State::TagOpen;
+                    m_token.clear();
+                } else if (c == '&') {
+                    m_state = State::Entity;
+                    m_token.clear();
+                } else {
+                    /* copy the whole run of text up to the next markup at once */
+                    size_t end = i + 1;
+                    while (end < size && data[end] != '<' && data[end] != '&') {
+                        end++;
+                    }
+                    if (m_skip_element.empty()) {
+                        m_out.append(data + i, end - i);
+                    }
+                    i = end;
+                    continue;
+                }
+                break;
+
+            case State::Entity:
+                if (c == ';') {
+                    emit_entity(m_token);
+                    m_state = State::Text;
+                } else if (c == '<' || c == '&' || is_space(c) || m_token.size() >= max_token_length) {
+                    /* a stray &, keep it as text and read the character again */
+                    emit('&');
+                    for (char t: m_token) {
+                        emit(t);
+                    }
+                    m_state = State::Text;
+                    continue;
+                } else {
+                    m_token.push_back(c);
+                }
+                break;
+
+            case State::TagOpen:
+                if (c == '!') {
+                    m_state = State::MarkupDeclaration;
+                } else if (c == '?') {
+                    m_state = State::ProcessingInstruction;
+                    m_end_match = 0;
+                } else if (c == '/') {
+                    m_state = State::EndTagName;
+                } else if (std::isalpha(static_cast<unsigned char>(c)) || c == '_' || c == ':') {
+                    m_state = State::StartTagName;
+                    m_self_closing = false;
+                    m_token.push_back(c);
+                } else {
+                    /* not a tag, e.g. "a < b" */
+                    emit('<');
+                    m_state = State::Text;
+                    continue;
+                }
+                break;
+
+            case State::MarkupDeclaration: {
+                static const std::string comment = "--";
+                static const std::string cdata = "[CDATA[";
+                std::string candidate = m_token + c;
+
+                if (candidate == comment) {
+                    m_state = State::Comment;
+                    m_end_match = 0;
+                } else if (candidate == cdata) {
+                    m_state = State::CData;
+                    m_end_match = 0;
+                } else if (comment.compare(0, candidate.size(), candidate) == 0 || cdata.compare(0, candidate.size(), candidate) == 0) {
+                    m_token = std::move(candidate);
+                } else {
+                    /* <!DOCTYPE or another declaration */
+                    m_state = State::Doctype;
+                    m_bracket_depth = 0;
+                    m_quote = 0;
+                    continue;
+                }
+                break;
+            }
+
+            case State::Comment:
+                if (c == '-') {
+                    m_end_match = std::min<size_t>(m_end_match + 1, 2);
+                } else if (c == '>' && m_end_match == 2) {
+                    m_state = State::Text;
+                    emit_separator();
+                } else {
+                    m_end_match = 0;
+                }
+                break;
+
+            case State::CData:
+                if (c == ']') {
+                    if (m_end_match < 2) {
+                        m_end_match++;
+                    } else {
+                        emit(']');
+                    }
+                } else if (c == '>' && m_end_match == 2) {
+                    m_state = State::Text;
+                } else {
+                    for (; m_end_match > 0; --m_end_match) {
+                        emit(']');
+                    }
+                    emit(c);
+                }
+                break;
+
+            case State::Doctype:
+                if (m_quote) {
+                    if (c == m_quote) {
+                        m_quote = 0;
+                    }
+                } else if (c == '"' || c == '\'') {
+                    m_quote = c;
+                } else if (c == '[') {
+                    m_bracket_depth++;
+                } else if (c == ']') {
+                    m_bracket_depth--;
+                } else if (c == '>' && m_bracket_depth <= 0) {
+                    m_state = State::Text;
+                    emit_separator();
+                }
+                break;
+
+            case State::ProcessingInstruction:
+                if (c == '>' && m_end_match == 1) {
+                    m_state = State::Text;
+                    emit_separator();
+                } else {
+                    m_end_match = c == '?' ? 1 : 0;
+                }
+                break;
+
+            case State::StartTagName:
+                if (c == '>') {
+                    end_start_tag();
+                } else if (c == '/') {
+                    m_self_closing = true;
+                    m_state = State::Attributes;
+                } else if (is_space(c)) {
+                    m_state = State::Attributes;
+                } else if (m_token.size() < max_token_length) {
+                    m_token.push_back(c);
+                }
+                break;
+
+            case State::Attributes:
+                if (c == '>') {
+                    end_start_tag();
+                } else if (c == '"' || c == '\'') {
+                    m_quote = c;
+                    m_state = State::AttributeValue;
+                } else if (!is_space(c)) {
+                    m_self_closing = c == '/';
+                }
+                break;
+
+            case State::AttributeValue:
+                if (c == m_quote) {
+                    m_quote = 0;
+                    m_state = State::Attributes;
+                }
+                break;
+
+            case State::EndTagName:
+                if (c == '>') {
+                    end_end_tag();
+                } else if (!is_space(c) && m_token.size() < max_token_length) {
+                    m_token.push_back(c);
+                }
+                break;
+        }
+
+        i++;
+    }
+
+    if (!m_out.empty()) {
+        m_sink(m_out);
+        m_last = m_out.back();
+        m_out.clear();
+    }
+}
+
+void XMLTextExtractor::finish() {
+    if (m_state == State::Entity) {
+        emit('&');
+        for (char t: m_token) {
+            emit(t);
+        }
+        m_state = State::Text;
+    }
+
+    if (!m_out.empty()) {
+        m_sink(m_out);
+        m_last = m_out.back();
+        m_out.clear();
+    }
+
+    if (m_state != State::Text) {
+        throw std::runtime_error("XML document ends inside of markup");
+    }
+}
+
+void XMLTextExtractor::emit(char c) {
+    if (m_skip_element.empty()) {
+        m_out.push_back(c);
+    }
+}
+
+void XMLTextExtractor::emit_separator() {
+    if (!m_skip_element.empty()) {
+        return;
+    }
+    char last = m_out.empty() ? m_last : m_out.back();
+    if (!is_space(last)) {
+        m_out.push_back(' ');
+    }
+}
+
+/* the predefined entities of XML, nbsp is common in XHTML, unknown entities are kept as written */
+void XMLTextExtractor::emit_entity(const std::string &entity) {
+    if (!m_skip_element.empty()) {
+        return;
+    }
+
+    if (entity == "amp") {
+        m_out.push_back('&');
+    } else if (entity == "lt") {
+        m_out.push_back('<');
+    } else if (entity == "gt") {
+        m_out.push_back('>');
+    } else if (entity == "quot") {
+        m_out.push_back('"');
+    } else if (entity == "apos") {
+        m_out.push_back('\'');
+    } else if (entity == "nbsp") {
+        m_out.push_back(' ');
+    } else if (entity.size() > 1 && entity[0] == '#') {
+        bool hex = entity[1] == 'x' || entity[1] == 'X';
+        try {
+            size_t parsed = 0;
+            std::string digits = entity.substr(hex ? 2 : 1);
+            unsigned long code_point = std::stoul(digits, &parsed, hex ? 16 : 10);
+            if (parsed != digits.size()) {
+                throw std::invalid_argument("Invalid character reference");
+            }
+            append_utf8(m_out, code_point);
+        } catch (std::exception &) {
+            m_out.append("&" + entity + ";");
+        }
+    } else {
+        m_out.append("&" + entity + ";");
+    }
+}
+
+/* script and style elements are skipped up to their end tag, a self closing one has no content */
+void XMLTextExtractor::end_start_tag() {
+    if (m_skip_element.empty() && !m_self_closing) {
+        std::string name = local_name(m_token);
+        if (name == "script" || name == "style") {
+            emit_separator();
+            m_skip_element = name;
+        }
+    }
+
+    emit_separator();
+    m_token.clear();
+    m_state = State::Text;
+}
+
+void XMLTextExtractor::end_end_tag() {
+    if (!m_skip_element.empty() && local_name(m_token) == m_skip_element) {
+        m_skip_element.clear();
+    }
+
+    emit_separator();
+    m_token.clear();
+    m_state = State::Text;
+}
+
+/* lower case name without the namespace prefix, xhtml:script is a script element */
+std::string XMLTextExtractor::local_name(const std::string &name) {
+    size_t colon = name.rfind(':');
+    std::string local = colon == std::string::npos ? name : name.substr(colon + 1);
+    std::transform(local.begin(), local.end(), local.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return local;
+}
@@ -0,0 +1,72 @@
+#ifndef _H_XMLTEXTEXTRACTOR
+#define _H_XMLTEXTEXTRACTOR
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+/*
+*   Streaming text extraction for XML and XHTML, the input is fed in chunks of any size.
+*   A state machine over the characters replaces the DOM: text and CDATA are emitted in document order,
+*   markup, comments, processing instructions and the content of script and style elements are skipped.
+*   Every tag boundary emits a single space, so the text of neighbouring elements is not glued together.
+*   The state of the extractor is bounded by the chunk size, none of it grows with the size or the depth of the document.
+*   The text itself is collected by the sink; extract and extract_file return it as one string, because the index
+*   hashes, stores and tokenizes the whole text of a document. So a document still takes memory proportional to its
+*   text, but not to its markup and not for a DOM.
+*/
+class XMLTextExtractor {
+    public:
+        /* receives the extracted text, called at most once per feed */
+        using Sink = std::function<void(std::string_view)>;
+
+        explicit XMLTextExtractor(Sink sink);
+
+        void feed(const char *data, size_t size);
+        /* flushes the remaining text, throws std::runtime_error if the document ends inside of markup */
+        void finish();
+
+        /* extracts a whole file in chunks of chunk_size bytes */
+        static std::string extract_file(const std::string &filepath, size_t chunk_size = default_chunk_size);
+        /* extracts a document that is already in memory */
+        static std::string extract(std::string_view xml);
+
+        static constexpr size_t default_chunk_size = 64 * 1024;
+
+    private:
+        enum class State {
+            Text, Entity, TagOpen, MarkupDeclaration, Comment, CData, Doctype,
+            ProcessingInstruction, StartTagName, EndTagName, Attributes, AttributeValue
+        };
+
+        Sink m_sink;
+        /* text of the current feed and the last character passed to the sink before */
+        std::string m_out;
+        char m_last = ' ';
+        State m_state = State::Text;
+
+        /* names, entities and markup declarations are cut at this length, longer ones are garbage anyway */
+        static constexpr size_t max_token_length = 64;
+        std::string m_token;
+
+        /* for comments, CDATA and processing instructions: number of matched characters of the end marker */
+        size_t m_end_match = 0;
+        /* for the internal subset of a doctype */
+        int m_bracket_depth = 0;
+        char m_quote = 0;
+        bool m_self_closing = false;
+
+        /* name of the script or style element whose content is skipped, empty if text is emitted */
+        std::string m_skip_element;
+
+        void emit(char c);
+        void emit_separator();
+        void emit_entity(const std::string &entity);
+        void end_start_tag();
+        void end_end_tag();
+        static std::string local_name(const std::string &name);
+};
+
+#endif
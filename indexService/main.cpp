@@ -1,22 +1,174 @@
+#include <algorithm>
 #include <exception>
 #include <iostream>
+#include <csignal>
+#include <malloc.h>
+#include <memory>
+#include <thread>
 
 /* boost headers */
 #include <boost/asio.hpp>
 
 /* cearch headers */
 #include "Index.h"
+#include "IndexGenerations.h"
 #include "Server.h"
+#include "ConsistencyChecker.h"
 #include "ContentAddressedStorage.h"
+#include "Coordinator.h"
+#include "PDFWorkerPool.h"
+#include "WorkerSupervisor.h"
+
+/*
+*   ./cearch fsck <directory the index is saved in> [--repair] [--concurrency <n>]
+*   Checks every document of the index against the content storage and prints a report as json.
+*   Returns 0 if the storage is consistent or was repaired, 1 if problems are left.
+*/
+static int fsck_main(int argc, const char *argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: ./cearch fsck <directory the index is saved in> [--repair] [--concurrency <n>]" << std::endl;
+        return 2;
+    }
+
+    std::string index_path = argv[2];
+    VerifyOptions options;
+    options.concurrency = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 3; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag == "--repair") {
+            options.repair = true;
+        } else if (flag == "--concurrency" && i + 1 < argc) {
+            options.concurrency = std::max(1, atoi(argv[++i]));
+        } else {
+            std::cerr << "Unknown option: " << flag << std::endl;
+            return 2;
+        }
+    }
+
+    try {
+        auto entries = ConsistencyChecker::read_entries(index_path + "/index.json");
+        /* restored blobs get the codec and dictionary of the storage, no dictionary is trained on them */
+        ConsistencyChecker checker(std::make_shared<ContentAddressedStorage>(index_path, ContentAddressedStorage::saved_codec(index_path), false));
+        VerifyReport report = checker.verify(std::move(entries), options);
+
+        std::cout << report.to_json().dump(4) << std::endl;
+        std::cerr << "Checked " << report.documents << " documents and " << report.blobs << " blobs in "
+            << report.seconds << " seconds: " << report.missing << " missing, " << report.corrupt << " corrupt, "
+            << report.orphans << " orphans, " << report.unresolved << " unresolved" << std::endl;
+        return report.unresolved == 0 ? 0 : 1;
+    } catch (const std::exception &e) {
+        std::cerr << "Error in fsck: " << e.what() << std::endl;
+        return 2;
+    }
+}
+
+/*
+*   ./cearch coordinator <query_port> <shard> [<shard> ...] [--timeout-ms <n>]
+*   A shard is host:port of a cearch, or the replicas of a shard separated by commas: host:port,host:port
+*   Answers /query by scatter-gather over the shards, see Coordinator.
+*/
+static int coordinator_main(int argc, const char *argv[]) {
+    if (argc < 4) {
+        std::cerr << "Usage: ./cearch coordinator <query_port> <host:port[,host:port...]> [...] [--timeout-ms <n>]" << std::endl;
+        return 1;
+    }
+
+    int query_port = atoi(argv[2]);
+    CoordinatorOptions options;
+    std::vector<std::vector<std::string>> shards;
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--timeout-ms" && i + 1 < argc) {
+            options.timeout = std::chrono::milliseconds(std::max(1, atoi(argv[++i])));
+            continue;
+        }
+        std::vector<std::string> replicas;
+        size_t start = 0;
+        while (start <= arg.size()) {
+            size_t comma = arg.find(',', start);
+            if (comma == std::string::npos) {
+                comma = arg.size();
+            }
+            if (comma > start) {
+                replicas.push_back(arg.substr(start, comma - start));
+            }
+            start = comma + 1;
+        }
+        shards.push_back(std::move(replicas));
+    }
+
+    try {
+        boost::asio::io_context io_context;
+        Coordinator coordinator(io_context, query_port, shards, options);
+        std::cout << "Starting the coordinator of " << shards.size() << " shards on " << query_port << std::endl;
+        io_context.run();
+    } catch (const std::exception &e) {
+        std::cerr << "Error in the coordinator: " << e.what() << std::endl;
+        return 2;
+    }
+    return 0;
+}
+
+/*
+*   ./cearch --serve-worker <query_port> <directory the index is saved in>
+*   A worker of WorkerSupervisor, serves the saved index read only on a port shared with the other workers.
+*   SIGHUP maps the files again, after the supervisor rebuilt them.
+*/
+static int serve_worker_main(int argc, const char *argv[]) {
+    WorkerSupervisor::prepare_worker();
+    if (argc != 4) {
+        std::cerr << "Usage: ./cearch --serve-worker <query_port> <directory the index is saved in>" << std::endl;
+        return 1;
+    }
+
+    int query_port = atoi(argv[2]);
+    std::string index_path = argv[3];
+    try {
+        boost::asio::io_context io_context;
+        IndexGenerations generations(io_context, [&index_path]() {
+            auto cas_storage = std::make_unique<ContentAddressedStorage>(index_path, ContentAddressedStorage::saved_codec(index_path), false);
+            IndexOptions index_options;
+            index_options.read_only = true;
+            auto idx = std::make_unique<Index>("", index_path, cas_storage, index_options);
+            /* what parsing index.json left behind, every worker would keep its own copy of it */
+            malloc_trim(0);
+            return idx;
+        });
+        generations.reload_on_signal(SIGHUP);
+
+        Server query_service(io_context, query_port, generations, true);
+        io_context.run();
+    } catch (const std::exception &e) {
+        std::cerr << "Error in worker: " << e.what() << std::endl;
+        return 2;
+    }
+    return 0;
+}
 
 int main(int argc, const char *argv[]) {
     /*
     *   TODO: Use propper commandline parsing
     */
-    if (argc != 4) {
+    /* the server starts itself in this mode for the PDFWorkerPool */
+    if (argc == 2 && std::string(argv[1]) == "--pdf-worker") {
+        return PDFWorkerPool::worker_main();
+    }
+    if (argc >= 2 && std::string(argv[1]) == "fsck") {
+        return fsck_main(argc, argv);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "coordinator") {
+        return coordinator_main(argc, argv);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--serve-worker") {
+        return serve_worker_main(argc, argv);
+    }
+
+    if (argc < 4) {
         std::cerr << "Usage: ./cearch <query_port> <Directory to index> <directory ";
-        std::cerr << "to save index in> ";
+        std::cerr << "to save index in> [--positions] [--stopwords <file>] [--stem] [--strip-possessives] [--io-depth <n>] [--codec <zlib|zstd|lz4>] [--reorder] [--workers <n>]";
         std::cerr << std::endl;
+        std::cerr << "       ./cearch fsck <directory the index is saved in> [--repair] [--concurrency <n>]" << std::endl;
+        std::cerr << "       ./cearch coordinator <query_port> <host:port[,host:port...]> [...] [--timeout-ms <n>]" << std::endl;
         return 1;
     }
 
@@ -24,20 +176,72 @@ int main(int argc, const char *argv[]) {
     std::string directory = argv[2];
     std::string index_path = argv[3];
 
+    /* optional flags, only relevant when a new index is built */
+    IndexOptions index_options;
+    std::string codec = ContentAddressedStorage::default_codec;
+    size_t workers = 0;
+    for (int i = 4; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (flag == "--positions") {
+            index_options.positional = true;
+        } else if (flag == "--stopwords" && i + 1 < argc) {
+            index_options.stopwords_path = argv[++i];
+        } else if (flag == "--stem") {
+            index_options.stem = true;
+        } else if (flag == "--strip-possessives") {
+            index_options.strip_possessives = true;
+        } else if (flag == "--reorder") {
+            index_options.reorder_docids = true;
+        } else if (flag == "--codec" && i + 1 < argc) {
+            codec = argv[++i];
+        } else if (flag == "--io-depth" && i + 1 < argc) {
+            index_options.io_queue_depth = std::max(0, atoi(argv[++i]));
+        } else if (flag == "--workers" && i + 1 < argc) {
+            workers = std::max(1, atoi(argv[++i]));
+        } else {
+            std::cerr << "Unknown option: " << flag << std::endl;
+            return 1;
+        }
+    }
+
+    /* the index is built or updated here, then served by worker processes that map it */
+    if (workers > 0) {
+        try {
+            auto build_index = [&]() {
+                {
+                    auto cas_storage = std::make_unique<ContentAddressedStorage>(index_path, codec);
+                    Index idx(directory, index_path, cas_storage, index_options);
+                }
+                /* the supervisor keeps running, the memory of the index goes back to the system */
+                malloc_trim(0);
+            };
+            build_index();
+            std::cout << "Starting " << workers << " workers on " << query_port << std::endl;
+            WorkerSupervisor supervisor(workers, {std::to_string(query_port), index_path}, build_index);
+            return supervisor.run();
+        } catch (const std::exception &e) {
+            std::cerr << "Error in main: " << e.what() << std::endl;
+            return 2;
+        }
+    }
+
     try {
         boost::asio::io_context io_context;
 
-        /* TODO: Make CAS Optional for the index */
-        auto cas_storage = std::make_unique<ContentAddressedStorage>(index_path);
-
         /* 
         *   TODO: Make indexing multithreaded?
         *   TODO: Indexing should be triggered from external sources? Right now it blocks here until the indexing is done
+        *   A reload indexes the directory again into a new generation, see IndexGenerations
         */
-        Index idx(directory, index_path, cas_storage);
+        IndexGenerations generations(io_context, [&]() {
+            /* TODO: Make CAS Optional for the index */
+            auto cas_storage = std::make_unique<ContentAddressedStorage>(index_path, codec);
+            return std::make_unique<Index>(directory, index_path, cas_storage, index_options);
+        });
+        generations.reload_on_signal(SIGHUP);
 
         std::cout << "Starting Index and Query Services " << query_port << std::endl;
-        Server query_service(io_context, query_port, idx);
+        Server query_service(io_context, query_port, generations);
         io_context.run();
     } catch (const std::exception &e) {
         std::cerr << "Error in main: " << e.what() << std::endl;